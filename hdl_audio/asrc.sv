@@ -0,0 +1,417 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ * The asynchronous sample rate converter between the volume stage and the oversampling filter. The host streams stereo
+ * PCM at any rate from 8000Hz up to the sample rate (input_rate_i in Hz, 0 bypasses the module) and the transmitters
+ * run at the sample rate (output_rate_i in Hz). The transmitters pace the host through the FIFOs so the ratio of the
+ * rates is exact: the rate is tracked by a phase accumulator which adds input_rate_i for each output frame and takes
+ * an input frame each time it wraps at output_rate_i. The phase left (a 16-bit fraction of an input period, by a
+ * 16 clock division) selects the branch of a 64 phase polyphase interpolator of 32 taps per phase:
+ *  y = A + (B - A) x f, with A and B the sums of the last 32 samples of the channel weighted by the branches
+ *  p = phase[15:10] and p + 1, and f = phase[9:0] / 1024.
+ * The prototype is a Kaiser windowed sinc (2048 taps at 64 times the input rate, cutoff 0.48 of the input rate,
+ * beta 9) in asrc_coefficients.mem: its second half (Q1.17, symmetric). It is flat to 0.38 of the input rate within
+ * 0.0002dB and the images are down by 92dB above 0.58 of the input rate (89dB with the interpolation of the branches).
+ * The products are computed one per clock in two 18x18 multipliers (MULT18X18D) as in oversampler.sv: an output frame
+ * takes about 175 clocks, 307 are available at 384KHz. The input frames queue in two slots: full_o holds off the writer
+ * while one waits so that the one frame which may still be in flight is kept.
+ **********************************************************************************************************************/
+`timescale 1ps/1ps
+`default_nettype none
+
+`include "definitions.svh"
+
+module asrc (
+    input logic reset_i,
+    input logic clk_i,
+    // Stream configuration
+    input logic [1:0] bit_depth_i,
+    input logic [18:0] input_rate_i,
+    input logic [18:0] output_rate_i,
+    // Audio bytes in and out
+    input logic en_i,
+    input logic [7:0] data_i,
+    input logic ready_i,
+    output logic en_o,
+    output logic [7:0] data_o,
+    output logic full_o);
+
+    logic bypass;
+    assign bypass = input_rate_i == 19'd0;
+
+    // The index of the last byte of a sample.
+    logic [1:0] last_byte;
+    assign last_byte = bit_depth_i == `BIT_DEPTH_16 ? 2'd1 : bit_depth_i == `BIT_DEPTH_32 ? 2'd3 : 2'd2;
+
+    // The left justified sample of the last bytes received (the newest byte in bits[31:24]).
+    function [31:0] sample_of (input logic [31:0] bytes, input logic [1:0] bit_depth);
+        logic [31:0] word;
+`ifdef BIG_ENDIAN_SAMPLES
+        word = {bytes[7:0], bytes[15:8], bytes[23:16], bytes[31:24]};
+        (* parallel_case, full_case *)
+        case (bit_depth)
+            `BIT_DEPTH_16: sample_of = {word[15:0], 16'h0};
+            `BIT_DEPTH_24, `BIT_DEPTH_DOP: sample_of = {word[23:0], 8'h0};
+            `BIT_DEPTH_32: sample_of = word;
+        endcase
+`else
+        word = bytes;
+        (* parallel_case, full_case *)
+        case (bit_depth)
+            `BIT_DEPTH_16: sample_of = {word[31:16], 16'h0};
+            `BIT_DEPTH_24, `BIT_DEPTH_DOP: sample_of = {word[31:8], 8'h0};
+            `BIT_DEPTH_32: sample_of = word;
+        endcase
+`endif
+    endfunction
+
+    // A sum (17 fraction bits) rounded and saturated to a 32-bit sample.
+    function [31:0] sample_of_sum (input logic signed [55:0] sum);
+        logic signed [38:0] rounded;
+        rounded = (sum + 56'sd65536) >>> 17;
+        sample_of_sum = rounded > 39'sh7fffffff ? 32'h7fffffff : rounded < -39'sh80000000 ? 32'h80000000 :
+                            rounded[31:0];
+    endfunction
+
+    //==================================================================================================================
+    // The input frames: two slots, the next frame to take in pending_0.
+    //==================================================================================================================
+    logic [31:0] pack, pack_next;
+    assign pack_next = {data_i, pack[31:8]};
+    logic [1:0] in_index;
+    logic in_channel;
+    logic [31:0] in_left;
+    logic [63:0] pending_0, pending_1, in_frame;
+    logic pending_valid_0, pending_valid_1, push, take;
+    assign in_frame = {in_left, sample_of (pack_next, bit_depth_i)};
+    assign push = en_i && ~bypass && in_index == last_byte && in_channel;
+
+    always @(posedge clk_i, posedge reset_i) begin
+        if (reset_i) begin
+            in_index <= 2'd0;
+            in_channel <= 1'b0;
+            pending_valid_0 <= 1'b0;
+            pending_valid_1 <= 1'b0;
+        end else begin
+            if (en_i && ~bypass) begin
+                pack <= pack_next;
+                if (in_index == last_byte) begin
+                    in_index <= 2'd0;
+                    in_channel <= ~in_channel;
+                    if (~in_channel) begin
+                        in_left <= sample_of (pack_next, bit_depth_i);
+                    end
+                end else begin
+                    in_index <= in_index + 2'd1;
+                end
+            end
+
+            if (take) begin
+                pending_0 <= pending_valid_1 ? pending_1 : in_frame;
+                pending_valid_0 <= pending_valid_1 || push;
+                pending_1 <= in_frame;
+                pending_valid_1 <= pending_valid_1 && push;
+            end else if (push) begin
+                if (pending_valid_0) begin
+                    pending_1 <= in_frame;
+                    pending_valid_1 <= 1'b1;
+                end else begin
+                    pending_0 <= in_frame;
+                    pending_valid_0 <= 1'b1;
+                end
+            end
+        end
+    end
+
+    //==================================================================================================================
+    // The memories: the second half of the prototype (ROM) and the last 32 samples of each channel.
+    //==================================================================================================================
+    logic signed [17:0] coefficients [0:1023];
+    initial begin
+        $readmemh ("asrc_coefficients.mem", coefficients);
+    end
+
+    // {channel, index}
+    logic [31:0] history [0:63];
+
+    //==================================================================================================================
+    // The converter state machine
+    //==================================================================================================================
+    localparam [3:0] STATE_CLEAR = 4'd0,
+                     STATE_STEP = 4'd1,
+                     STATE_INPUT = 4'd2,
+                     STATE_INPUT_RIGHT = 4'd3,
+                     STATE_DIVIDE = 4'd4,
+                     STATE_MAC = 4'd5,
+                     STATE_BRANCHES = 4'd6,
+                     STATE_DIFFERENCE = 4'd7,
+                     STATE_INTERPOLATE = 4'd8,
+                     STATE_SAMPLE = 4'd9,
+                     STATE_SEND = 4'd10;
+    logic [3:0] state;
+    logic [5:0] clear_index;
+    logic [63:0] current;
+    logic [4:0] newest;
+    logic channel;
+
+    // The phase: the time since the newest input frame in 1/output_rate_i of an input period.
+    logic [18:0] phase;
+    logic [19:0] phase_next;
+    assign phase_next = {1'b0, phase} + {1'b0, input_rate_i};
+
+    // The division of the phase by output_rate_i: the fraction of an input period.
+    logic [19:0] remainder, remainder_shifted;
+    assign remainder_shifted = {remainder[18:0], 1'b0};
+    logic [15:0] fraction;
+    logic [3:0] divide_count;
+
+    // The taps: tap[5:1] the sample (0 for the newest), tap[0] the branch (p or p + 1).
+    logic [5:0] tap;
+    logic [11:0] prototype_index;
+    assign prototype_index = {1'b0, tap[5:1], fraction[15:10]} + {11'd0, tap[0]};
+    // The ROM holds the taps 1 to 1024, the second half mirrors the first one and the ends are 0.
+    logic [11:0] coefficient_index;
+    assign coefficient_index = prototype_index <= 12'd1024 ? prototype_index - 12'd1 : 12'd2047 - prototype_index;
+    logic coefficient_zero;
+    assign coefficient_zero = prototype_index == 12'd0 || prototype_index == 12'd2048;
+
+    logic history_write;
+    logic [5:0] history_write_address;
+    logic [31:0] history_write_data;
+    assign history_write = state == STATE_CLEAR || state == STATE_INPUT_RIGHT ||
+                            (state == STATE_INPUT && pending_valid_0);
+    assign history_write_address = state == STATE_CLEAR ? clear_index : {state == STATE_INPUT_RIGHT, newest + 5'd1};
+    assign history_write_data = state == STATE_CLEAR ? 32'h0 : state == STATE_INPUT ? pending_0[63:32] : current[31:0];
+    assign take = state == STATE_INPUT && pending_valid_0;
+
+    //==================================================================================================================
+    // The MAC pipeline: the memories are read, the products computed then summed, a clock each. The interpolation of
+    // the branches goes through the same multipliers.
+    //==================================================================================================================
+    logic [31:0] history_q, branch_a, branch_b, difference;
+    logic signed [17:0] coefficient_q, interpolation;
+    assign interpolation = {1'b0, fraction[9:0], 7'd0};
+    logic read_valid, read_zero, read_branch, read_first, read_last, read_interpolate;
+    logic [31:0] operand;
+    logic signed [17:0] operand_coefficient;
+    assign operand = read_interpolate ? difference : history_q;
+    assign operand_coefficient = read_interpolate ? interpolation : read_zero ? 18'sd0 : coefficient_q;
+    logic signed [35:0] product_hi, product_lo;
+    logic product_valid, product_branch, product_first, product_last, product_interpolate;
+    logic signed [55:0] accumulator_a, accumulator_b;
+    logic accumulator_done;
+
+    always @(posedge clk_i) begin
+        if (history_write) begin
+            history[history_write_address] <= history_write_data;
+        end
+        history_q <= history[{channel, newest - tap[5:1]}];
+        coefficient_q <= coefficients[coefficient_index[9:0]];
+
+        product_hi <= $signed(operand[31:14]) * operand_coefficient;
+        product_lo <= $signed({4'b0000, operand[13:0]}) * operand_coefficient;
+
+        if (product_valid) begin
+            if (product_interpolate) begin
+                // A + (B - A) x f
+                accumulator_a <= ($signed(branch_a) <<< 17) + (product_hi <<< 14) + product_lo;
+            end else if (product_branch) begin
+                accumulator_b <= (product_first ? 56'sd0 : accumulator_b) + (product_hi <<< 14) + product_lo;
+            end else begin
+                accumulator_a <= (product_first ? 56'sd0 : accumulator_a) + (product_hi <<< 14) + product_lo;
+            end
+        end
+    end
+
+    // B - A, saturated.
+    logic signed [32:0] branch_difference;
+    assign branch_difference = $signed({branch_b[31], branch_b}) - $signed({branch_a[31], branch_a});
+
+    //==================================================================================================================
+    // The sent sample: rounded to the bit depth with saturation, right justified.
+    //==================================================================================================================
+    logic [63:0] out_frame;
+    logic send_channel;
+    logic [1:0] send_byte;
+    logic [31:0] send_sample;
+    assign send_sample = send_channel ? out_frame[31:0] : out_frame[63:32];
+    logic [32:0] send_rounded;
+    assign send_rounded = {send_sample[31], send_sample} +
+                            (bit_depth_i == `BIT_DEPTH_16 ? 33'h8000 : bit_depth_i == `BIT_DEPTH_32 ? 33'h0 : 33'h80);
+    logic [31:0] send_clipped, send_word;
+    assign send_clipped = send_rounded[32:31] == 2'b01 ? 32'h7fffffff : send_rounded[31:0];
+    assign send_word = bit_depth_i == `BIT_DEPTH_16 ? {16'h0, send_clipped[31:16]} :
+                        bit_depth_i == `BIT_DEPTH_32 ? send_clipped : {8'h0, send_clipped[31:8]};
+    logic [1:0] send_index;
+`ifdef BIG_ENDIAN_SAMPLES
+    // The most significant byte first.
+    assign send_index = last_byte - send_byte;
+`else
+    assign send_index = send_byte;
+`endif
+
+    logic send_en;
+    logic [7:0] send_data;
+    assign full_o = ~bypass && (pending_valid_0 || state == STATE_CLEAR);
+    assign en_o = bypass ? en_i : send_en;
+    assign data_o = bypass ? data_i : send_data;
+
+    always @(posedge clk_i, posedge reset_i) begin
+        if (reset_i) begin
+            state <= STATE_CLEAR;
+            clear_index <= 6'd0;
+            newest <= 5'd0;
+            phase <= 19'd0;
+            read_valid <= 1'b0;
+            product_valid <= 1'b0;
+            accumulator_done <= 1'b0;
+            send_en <= 1'b0;
+        end else begin
+            read_valid <= state == STATE_MAC || state == STATE_INTERPOLATE;
+            read_zero <= coefficient_zero;
+            read_branch <= tap[0];
+            read_first <= tap[5:1] == 5'd0;
+            read_last <= state == STATE_INTERPOLATE || tap == 6'd63;
+            read_interpolate <= state == STATE_INTERPOLATE;
+            product_valid <= read_valid;
+            product_branch <= read_branch;
+            product_first <= read_first;
+            product_last <= read_last;
+            product_interpolate <= read_interpolate;
+            accumulator_done <= product_valid && product_last;
+            send_en <= 1'b0;
+
+            (* parallel_case, full_case *)
+            case (state)
+                STATE_CLEAR: begin
+                    // The histories start silent.
+                    clear_index <= clear_index + 6'd1;
+                    if (clear_index == 6'd63) begin
+                        state <= STATE_STEP;
+                    end
+                end
+
+                STATE_STEP: begin
+                    // The phase of the next output frame, after the next input frame when it wraps.
+                    channel <= 1'b0;
+                    if (bypass) begin
+                        phase <= 19'd0;
+                    end else if (phase_next >= {1'b0, output_rate_i}) begin
+                        state <= STATE_INPUT;
+                    end else begin
+                        phase <= phase_next[18:0];
+                        remainder <= phase_next;
+                        divide_count <= 4'd0;
+                        state <= STATE_DIVIDE;
+                    end
+                end
+
+                STATE_INPUT: begin
+                    if (pending_valid_0) begin
+                        current <= pending_0;
+                        state <= STATE_INPUT_RIGHT;
+                    end
+                end
+
+                STATE_INPUT_RIGHT: begin
+                    newest <= newest + 5'd1;
+                    phase <= phase_next[18:0] - output_rate_i;
+                    remainder <= phase_next - {1'b0, output_rate_i};
+                    divide_count <= 4'd0;
+                    state <= STATE_DIVIDE;
+                end
+
+                STATE_DIVIDE: begin
+                    // One bit of the quotient per clock.
+                    if (remainder_shifted >= {1'b0, output_rate_i}) begin
+                        remainder <= remainder_shifted - {1'b0, output_rate_i};
+                        fraction <= {fraction[14:0], 1'b1};
+                    end else begin
+                        remainder <= remainder_shifted;
+                        fraction <= {fraction[14:0], 1'b0};
+                    end
+                    divide_count <= divide_count + 4'd1;
+                    if (divide_count == 4'd15) begin
+                        tap <= 6'd0;
+                        state <= STATE_MAC;
+                    end
+                end
+
+                STATE_MAC: begin
+                    tap <= tap + 6'd1;
+                    if (tap == 6'd63) begin
+                        state <= STATE_BRANCHES;
+                    end
+                end
+
+                STATE_BRANCHES: begin
+                    if (accumulator_done) begin
+                        branch_a <= sample_of_sum (accumulator_a);
+                        branch_b <= sample_of_sum (accumulator_b);
+                        state <= STATE_DIFFERENCE;
+                    end
+                end
+
+                STATE_DIFFERENCE: begin
+                    difference <= branch_difference[32:31] == 2'b01 ? 32'h7fffffff :
+                                    branch_difference[32:31] == 2'b10 ? 32'h80000000 : branch_difference[31:0];
+                    state <= STATE_INTERPOLATE;
+                end
+
+                STATE_INTERPOLATE: begin
+                    state <= STATE_SAMPLE;
+                end
+
+                STATE_SAMPLE: begin
+                    if (accumulator_done) begin
+                        if (channel) begin
+                            out_frame[31:0] <= sample_of_sum (accumulator_a);
+                            send_channel <= 1'b0;
+                            send_byte <= 2'd0;
+                            state <= STATE_SEND;
+                        end else begin
+                            out_frame[63:32] <= sample_of_sum (accumulator_a);
+                            channel <= 1'b1;
+                            tap <= 6'd0;
+                            state <= STATE_MAC;
+                        end
+                    end
+                end
+
+                STATE_SEND: begin
+                    if (ready_i) begin
+                        send_en <= 1'b1;
+                        send_data <= send_word[{send_index, 3'b000} +: 8];
+                        send_byte <= send_byte + 2'd1;
+                        if (send_byte == last_byte) begin
+                            send_byte <= 2'd0;
+                            send_channel <= ~send_channel;
+                            if (send_channel) begin
+                                state <= STATE_STEP;
+                            end
+                        end
+                    end
+                end
+
+                default: begin
+                    state <= STATE_STEP;
+                end
+            endcase
+        end
+    end
+endmodule
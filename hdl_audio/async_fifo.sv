@@ -18,6 +18,14 @@
 
 /***********************************************************************************************************************
  * This module implements the dual port FIFO.
+ * The occupancy is available in both clock domains (wr_count_o, rd_count_o). It is derived from the local pointer and
+ * the synchronized gray pointer of the other domain so it lags the other side by two clocks: the write side may see
+ * more words than there are and the read side fewer, which is always safe. wr_awfull_o is asserted when at most
+ * AWFULL_LEVEL slots are free and rd_arempty_o when at most AREMPTY_LEVEL words are stored (both include full/empty).
+ * With EBR = "TRUE" the memory is inferred as block RAM (DP16KD) with a registered output. A prefetch stage reads
+ * ahead into a small register FIFO so that the head word is available as with the LUT RAM FIFO, FALLTHROUGH included.
+ * With SYNC = "TRUE" both sides must use the same clock: the pointers are compared without synchronizers so a write is
+ * visible to the reader on the next clock.
  **********************************************************************************************************************/
 `timescale 1ps/1ps
 `default_nettype none
@@ -25,7 +33,9 @@
 //==================================================================================================================
 // Dual port FIFO.
 //==================================================================================================================
-module async_fifo #(parameter DSIZE = 8, parameter ASIZE = 8, parameter FALLTHROUGH = "TRUE")(
+module async_fifo #(parameter DSIZE = 8, parameter ASIZE = 8, parameter FALLTHROUGH = "TRUE",
+                    parameter AWFULL_LEVEL = 1, parameter AREMPTY_LEVEL = 1, parameter EBR = "FALSE",
+                    parameter SYNC = "FALSE")(
         // Write
         input  wire             wr_clk_i,
         input  wire             wr_reset_i,
@@ -33,31 +43,47 @@ module async_fifo #(parameter DSIZE = 8, parameter ASIZE = 8, parameter FALLTHRO
         input  wire [DSIZE-1:0] wr_data_i,
         output wire             wr_full_o,
         output wire             wr_awfull_o,
+        output wire [ASIZE:0]   wr_count_o,
         // Read
         input  wire             rd_clk_i,
         input  wire             rd_reset_i,
         input  wire             rd_en_i,
         output wire [DSIZE-1:0] rd_data_o,
         output wire             rd_empty_o,
-        output wire             rd_arempty_o);
+        output wire             rd_arempty_o,
+        output wire [ASIZE:0]   rd_count_o);
 
     wire [ASIZE-1:0] waddr, raddr;
     wire [ASIZE  :0] wptr, rptr, wq2_rptr, rq2_wptr;
+    // The read side of the memory: driven by the reader or by the prefetch stage.
+    wire             rd_mem_en, rd_mem_empty, rd_mem_arempty;
+    wire [ASIZE  :0] rd_mem_count;
 
-    sync_r2w #(ASIZE) sync_r2w (
-        .wq2_rptr (wq2_rptr),
-        .rptr     (rptr),
-        .wclk     (wr_clk_i),
-        .wrst_n   (~wr_reset_i));
-
-    sync_w2r #(ASIZE) sync_w2r (
-        .rq2_wptr (rq2_wptr),
-        .wptr     (wptr),
-        .rclk     (rd_clk_i),
-        .rrst_n   (~rd_reset_i));
+    generate
+        if (SYNC == "TRUE")
+        begin : same_clock
+            assign wq2_rptr = rptr;
+            assign rq2_wptr = wptr;
+        end
+        else
+        begin : cdc
+            sync_r2w #(ASIZE) sync_r2w (
+                .wq2_rptr (wq2_rptr),
+                .rptr     (rptr),
+                .wclk     (wr_clk_i),
+                .wrst_n   (~wr_reset_i));
+
+            sync_w2r #(ASIZE) sync_w2r (
+                .rq2_wptr (rq2_wptr),
+                .wptr     (wptr),
+                .rclk     (rd_clk_i),
+                .rrst_n   (~rd_reset_i));
+        end
+    endgenerate
 
-    wptr_full #(ASIZE) wptr_full (
+    wptr_full #(ASIZE, AWFULL_LEVEL) wptr_full (
         .awfull   (wr_awfull_o),
+        .wcount   (wr_count_o),
         .wfull    (wr_full_o),
         .waddr    (waddr),
         .wptr     (wptr),
@@ -66,25 +92,64 @@ module async_fifo #(parameter DSIZE = 8, parameter ASIZE = 8, parameter FALLTHRO
         .wclk     (wr_clk_i),
         .wrst_n   (~wr_reset_i));
 
-    fifomem #(DSIZE, ASIZE, FALLTHROUGH) fifomem (
-        .rclken   (rd_en_i),
-        .rclk     (rd_clk_i),
-        .rdata    (rd_data_o),
-        .rempty   (rd_empty_o),
-        .wdata    (wr_data_i),
-        .waddr    (waddr),
-        .raddr    (raddr),
-        .wclken   (wr_en_i),
-        .wfull    (wr_full_o),
-        .wclk     (wr_clk_i));
+    generate
+        if (EBR == "TRUE")
+        begin : ebr
+            wire [DSIZE-1:0] ram_data;
+
+            fifomem_ebr #(DSIZE, ASIZE) fifomem (
+                .rclken   (rd_mem_en),
+                .rclk     (rd_clk_i),
+                .rdata    (ram_data),
+                .wdata    (wr_data_i),
+                .waddr    (waddr),
+                .raddr    (raddr),
+                .wclken   (wr_en_i),
+                .wfull    (wr_full_o),
+                .wclk     (wr_clk_i));
+
+            fifo_prefetch #(DSIZE, ASIZE, FALLTHROUGH, AREMPTY_LEVEL) prefetch (
+                .mem_rd     (rd_mem_en),
+                .mem_empty  (rd_mem_empty),
+                .mem_count  (rd_mem_count),
+                .mem_data   (ram_data),
+                .rinc       (rd_en_i),
+                .rdata      (rd_data_o),
+                .rempty     (rd_empty_o),
+                .arempty    (rd_arempty_o),
+                .rcount     (rd_count_o),
+                .rclk       (rd_clk_i),
+                .rrst_n     (~rd_reset_i));
+        end
+        else
+        begin : lut
+            assign rd_mem_en = rd_en_i;
+            assign rd_empty_o = rd_mem_empty;
+            assign rd_arempty_o = rd_mem_arempty;
+            assign rd_count_o = rd_mem_count;
+
+            fifomem #(DSIZE, ASIZE, FALLTHROUGH) fifomem (
+                .rclken   (rd_en_i),
+                .rclk     (rd_clk_i),
+                .rdata    (rd_data_o),
+                .rempty   (rd_mem_empty),
+                .wdata    (wr_data_i),
+                .waddr    (waddr),
+                .raddr    (raddr),
+                .wclken   (wr_en_i),
+                .wfull    (wr_full_o),
+                .wclk     (wr_clk_i));
+        end
+    endgenerate
 
-    rptr_empty #(ASIZE) rptr_empty (
-        .arempty  (rd_arempty_o),
-        .rempty   (rd_empty_o),
+    rptr_empty #(ASIZE, AREMPTY_LEVEL) rptr_empty (
+        .arempty  (rd_mem_arempty),
+        .rcount   (rd_mem_count),
+        .rempty   (rd_mem_empty),
         .raddr    (raddr),
         .rptr     (rptr),
         .rq2_wptr (rq2_wptr),
-        .rinc     (rd_en_i),
+        .rinc     (rd_mem_en),
         .rclk     (rd_clk_i),
         .rrst_n   (~rd_reset_i));
 
@@ -136,21 +201,38 @@ module sync_w2r #(parameter ASIZE = 4)(
     end
 endmodule
 
+//==================================================================================================================
+// The gray to binary conversion of a synchronized pointer
+//==================================================================================================================
+module gray_to_bin #(parameter WIDTH = 5)(
+    input  wire [WIDTH-1:0] gray,
+    output reg  [WIDTH-1:0] bin);
+
+    integer i;
+    always @(*) begin
+        bin[WIDTH-1] = gray[WIDTH-1];
+        for (i = WIDTH-2; i >= 0; i = i - 1) begin
+            bin[i] = bin[i+1] ^ gray[i];
+        end
+    end
+endmodule
+
 //==================================================================================================================
 // The module handling read requests
 //==================================================================================================================
-module rptr_empty #(parameter ADDRSIZE = 4)(
+module rptr_empty #(parameter ADDRSIZE = 4, parameter AREMPTY_LEVEL = 1)(
     input  wire                rclk,
     input  wire                rrst_n,
     input  wire                rinc,
     input  wire [ADDRSIZE  :0] rq2_wptr,
     output reg                 rempty,
     output reg                 arempty,
+    output reg  [ADDRSIZE  :0] rcount,
     output wire [ADDRSIZE-1:0] raddr,
     output reg  [ADDRSIZE  :0] rptr);
 
     reg  [ADDRSIZE:0] rbin;
-    wire [ADDRSIZE:0] rgraynext, rbinnext, rgraynextm1;
+    wire [ADDRSIZE:0] rgraynext, rbinnext, rq2_wbin, rcount_next;
     wire              arempty_val, rempty_val;
 
     //-------------------
@@ -165,21 +247,26 @@ module rptr_empty #(parameter ADDRSIZE = 4)(
     assign raddr     = rbin[ADDRSIZE-1:0];
     assign rbinnext  = rbin + (rinc & ~rempty);
     assign rgraynext = (rbinnext >> 1) ^ rbinnext;
-    assign rgraynextm1 = ((rbinnext + 1'b1) >> 1) ^ (rbinnext + 1'b1);
+
+    // Words stored after this clock, as seen with the synchronized wptr.
+    gray_to_bin #(ADDRSIZE + 1) rq2_wptr_bin (.gray(rq2_wptr), .bin(rq2_wbin));
+    assign rcount_next = rq2_wbin - rbinnext;
 
     //---------------------------------------------------------------
     // FIFO empty when the next rptr == synchronized wptr or on reset
     //---------------------------------------------------------------
     assign rempty_val = (rgraynext == rq2_wptr);
-    assign arempty_val = (rgraynextm1 == rq2_wptr);
+    assign arempty_val = (rcount_next <= AREMPTY_LEVEL);
 
     always @ (posedge rclk or negedge rrst_n) begin
         if (!rrst_n) begin
-            arempty <= 1'b0;
+            arempty <= 1'b1;
             rempty <= 1'b1;
+            rcount <= 0;
         end else begin
             arempty <= arempty_val;
             rempty <= rempty_val;
+            rcount <= rcount_next;
 
 `ifdef D_FIFO
             if (rempty_val && ~rempty) begin
@@ -193,18 +280,19 @@ endmodule
 //==================================================================================================================
 // The module handling the write requests
 //==================================================================================================================
-module wptr_full #(parameter ADDRSIZE = 4)(
+module wptr_full #(parameter ADDRSIZE = 4, parameter AWFULL_LEVEL = 1)(
         input  wire                wclk,
         input  wire                wrst_n,
         input  wire                winc,
         input  wire [ADDRSIZE  :0] wq2_rptr,
         output reg                 wfull,
         output reg                 awfull,
+        output reg  [ADDRSIZE  :0] wcount,
         output wire [ADDRSIZE-1:0] waddr,
         output reg  [ADDRSIZE  :0] wptr);
 
     reg  [ADDRSIZE:0] wbin;
-    wire [ADDRSIZE:0] wgraynext, wbinnext, wgraynextp1;
+    wire [ADDRSIZE:0] wgraynext, wbinnext, wq2_rbin, wcount_next;
     wire              awfull_val, wfull_val;
 
     // GRAYSTYLE2 pointer
@@ -217,19 +305,24 @@ module wptr_full #(parameter ADDRSIZE = 4)(
     assign waddr = wbin[ADDRSIZE-1:0];
     assign wbinnext  = wbin + (winc & ~wfull);
     assign wgraynext = (wbinnext >> 1) ^ wbinnext;
-    assign wgraynextp1 = ((wbinnext + 1'b1) >> 1) ^ (wbinnext + 1'b1);
+
+    // Words stored after this clock, as seen with the synchronized rptr.
+    gray_to_bin #(ADDRSIZE + 1) wq2_rptr_bin (.gray(wq2_rptr), .bin(wq2_rbin));
+    assign wcount_next = wbinnext - wq2_rbin;
 
     assign wfull_val = (wgraynext == {~wq2_rptr[ADDRSIZE:ADDRSIZE-1], wq2_rptr[ADDRSIZE-2:0]});
-    assign awfull_val = (wgraynextp1 == {~wq2_rptr[ADDRSIZE:ADDRSIZE-1], wq2_rptr[ADDRSIZE-2:0]});
+    assign awfull_val = (wcount_next >= (1 << ADDRSIZE) - AWFULL_LEVEL);
 
     always @(posedge wclk or negedge wrst_n) begin
 
         if (!wrst_n) begin
             awfull <= 1'b0;
             wfull  <= 1'b0;
+            wcount <= 0;
         end else begin
             awfull <= awfull_val;
             wfull  <= wfull_val;
+            wcount <= wcount_next;
 
 `ifdef D_FIFO
             if (awfull_val && ~awfull) begin
@@ -308,3 +401,134 @@ module fifomem #(
     endgenerate
 endmodule
 
+
+//==================================================================================================================
+// The block RAM (DP16KD) with a registered output: the data of a read is available two clocks later.
+//==================================================================================================================
+module fifomem_ebr #(
+        parameter  DATASIZE = 8,            // Memory data word width
+        parameter  ADDRSIZE = 10)(          // Number of mem address bits
+        input  wire                wclk,
+        input  wire                wclken,
+        input  wire [ADDRSIZE-1:0] waddr,
+        input  wire [DATASIZE-1:0] wdata,
+        input  wire                wfull,
+        input  wire                rclk,
+        input  wire                rclken,
+        input  wire [ADDRSIZE-1:0] raddr,
+        output reg  [DATASIZE-1:0] rdata);
+
+    localparam DEPTH = 1<<ADDRSIZE;
+
+    reg [DATASIZE-1:0] mem [0:DEPTH-1];
+    reg [DATASIZE-1:0] ram_q;
+
+    always @(posedge wclk) begin
+        if (wclken && !wfull) begin
+            mem[waddr] <= wdata;
+`ifdef D_FIFO
+            $display ($time, " FIFO:\tWr: %d @%h.", wdata, waddr);
+`endif
+        end
+
+`ifdef D_FIFO
+        if (wclken && wfull) begin
+            $display ($time, " FIFO:\t==== Cannot write: %d.", wdata);
+        end
+`endif
+    end
+
+    always @(posedge rclk) begin
+        if (rclken) begin
+            ram_q <= mem[raddr];
+        end
+
+        // Output register
+        rdata <= ram_q;
+    end
+endmodule
+
+//==================================================================================================================
+// The prefetch stage of the block RAM FIFO. Words are read ahead from the memory into a 4 word register FIFO whose
+// head is presented to the reader. The 2 clocks memory latency is covered so a word can be read on every clock.
+//==================================================================================================================
+module fifo_prefetch #(
+        parameter  DATASIZE = 8,
+        parameter  ADDRSIZE = 10,
+        parameter  FALLTHROUGH = "TRUE",
+        parameter  AREMPTY_LEVEL = 1)(
+        input  wire                rclk,
+        input  wire                rrst_n,
+        // Memory side
+        output wire                mem_rd,
+        input  wire                mem_empty,
+        input  wire [ADDRSIZE  :0] mem_count,
+        input  wire [DATASIZE-1:0] mem_data,
+        // Reader side
+        input  wire                rinc,
+        output wire [DATASIZE-1:0] rdata,
+        output wire                rempty,
+        output wire                arempty,
+        output wire [ADDRSIZE  :0] rcount);
+
+    reg [DATASIZE-1:0] skid [0:3];
+    reg [DATASIZE-1:0] rdata_r;
+    reg [1:0] head, tail;
+    reg [2:0] count;
+    // Reads in flight in the memory pipeline.
+    reg rd_q1, rd_q2;
+
+    wire pop  = rinc && count != 3'd0;
+    wire push = rd_q2;
+
+    // Read ahead while the words in flight fit in the register FIFO.
+    assign mem_rd = ~mem_empty && (count + rd_q1 + rd_q2 < 3'd4);
+
+    assign rempty = count == 3'd0;
+    assign rcount = mem_count + count + rd_q1 + rd_q2;
+    assign arempty = rcount <= AREMPTY_LEVEL;
+
+    always @(posedge rclk or negedge rrst_n) begin
+        if (!rrst_n) begin
+            {rd_q2, rd_q1} <= 2'b00;
+            head <= 2'd0;
+            tail <= 2'd0;
+            count <= 3'd0;
+        end else begin
+            {rd_q2, rd_q1} <= {rd_q1, mem_rd};
+            if (push) tail <= tail + 1'b1;
+            if (pop) head <= head + 1'b1;
+            count <= count + push - pop;
+        end
+    end
+
+    always @(posedge rclk) begin
+        if (push) begin
+            skid[tail] <= mem_data;
+        end
+    end
+
+    generate
+        if (FALLTHROUGH == "TRUE")
+        begin : fallthrough
+            assign rdata = skid[head];
+        end
+        else
+        begin : registered_read
+            always @(posedge rclk) begin
+                if (pop) begin
+                    rdata_r <= skid[head];
+                end
+            end
+            assign rdata = rdata_r;
+        end
+    endgenerate
+
+`ifdef D_FIFO
+    always @(posedge rclk) begin
+        if (pop) begin
+            $display ($time, " FIFO:\tRd: %d.", skid[head]);
+        end
+    end
+`endif
+endmodule
@@ -21,6 +21,8 @@
 `timescale 1ps/1ps
 `default_nettype none
 
+`include "definitions.svh"
+
 module audio (
     // Reset button
     input logic btn_reset,
@@ -46,7 +48,8 @@ module audio (
     output logic led_user);
 
     logic ext_led_ctrl_err_o;
-    logic spdif_o, i2s_sdata_o, i2s_bclk_o, i2s_lrck_o, i2s_mclk_o, dsd_o, mute_o;
+    logic spdif_o, spdif_i, i2s_sdata_i, i2s_bclk_o, i2s_lrck_o, i2s_mclk_o, dsd_o, mute_o;
+    logic [`I2S_DATA_LINES-1:0] i2s_sdata_o;
     logic ext_led_sr_48000Hz_o, ext_led_sr_96000Hz_o, ext_led_sr_192000Hz_o, ext_led_sr_384000Hz_o;
     logic ext_led_sr_44100Hz_o, ext_led_sr_88200Hz_o, ext_led_sr_176400Hz_o, ext_led_sr_352800Hz_o;
     logic ext_led_br_dop_o, ext_led_br_16_bit_o, ext_led_br_24_bit_o, ext_led_br_32_bit_o;
@@ -109,7 +112,11 @@ module audio (
     // Audio outputs
     TRELLIS_IO #(.DIR("OUTPUT")) extension_4(.B(extension[4]), .T(1'b0), .I(spdif_o));
 
-    TRELLIS_IO #(.DIR("OUTPUT")) extension_12(.B(extension[12]), .T(1'b0), .I(i2s_sdata_o));
+    TRELLIS_IO #(.DIR("OUTPUT")) extension_12(.B(extension[12]), .T(1'b0), .I(i2s_sdata_o[0]));
+    // The other sdata lines (SETUP_OPTION_LINES_SHIFT)
+    TRELLIS_IO #(.DIR("OUTPUT")) extension_13(.B(extension[13]), .T(1'b0), .I(i2s_sdata_o[1]));
+    TRELLIS_IO #(.DIR("OUTPUT")) extension_15(.B(extension[15]), .T(1'b0), .I(i2s_sdata_o[2]));
+    TRELLIS_IO #(.DIR("OUTPUT")) extension_17(.B(extension[17]), .T(1'b0), .I(i2s_sdata_o[3]));
     TRELLIS_IO #(.DIR("OUTPUT")) extension_10(.B(extension[10]), .T(1'b0), .I(i2s_bclk_o));
     TRELLIS_IO #(.DIR("OUTPUT")) extension_8(.B(extension[8]), .T(1'b0), .I(i2s_lrck_o));
     TRELLIS_IO #(.DIR("OUTPUT")) extension_6(.B(extension[6]), .T(1'b0), .I(i2s_mclk_o));
@@ -119,6 +126,14 @@ module audio (
 
     TRELLIS_IO #(.DIR("OUTPUT")) extension_11(.B(extension[11]), .T(1'b0), .I(dsd_o));
 
+    // Audio input
+`ifndef SPDIF_LOOPBACK
+    TRELLIS_IO #(.DIR("INPUT")) extension_3(.B(extension[3]), .T(1'b1), .O(spdif_i));
+`endif
+`ifndef I2S_LOOPBACK
+    TRELLIS_IO #(.DIR("INPUT")) extension_5(.B(extension[5]), .T(1'b1), .O(i2s_sdata_i));
+`endif
+
     // Sample rate LEDs
     TRELLIS_IO #(.DIR("OUTPUT")) extension_32(.B(extension[32]), .T(1'b0), .I(ext_led_sr_48000Hz_o));
     TRELLIS_IO #(.DIR("OUTPUT")) extension_30(.B(extension[30]), .T(1'b0), .I(ext_led_sr_96000Hz_o));
@@ -156,6 +171,21 @@ module audio (
     assign led_0 = fifo_rxf_n;
     assign led_1 = fifo_txe_n;
     assign led_user = ext_led_ctrl_err_o;
+`ifndef SPDIF_LOOPBACK
+    assign spdif_i = 1'b0;
+`endif
+`ifndef I2S_LOOPBACK
+    assign i2s_sdata_i = 1'b0;
+`endif
+`endif
+
+`ifdef SPDIF_LOOPBACK
+    // The SPDIF receiver is fed by the SPDIF transmitter.
+    assign spdif_i = spdif_o;
+`endif
+`ifdef I2S_LOOPBACK
+    // The I2S receiver is fed by the I2S transmitter.
+    assign i2s_sdata_i = i2s_sdata_o[0];
 `endif
 
     //==================================================================================================================
@@ -179,16 +209,28 @@ module audio (
     // FIFO address sizes.
 `ifdef FIFO_ADDR_BITS
     localparam IN_FIFO_ASIZE = `FIFO_ADDR_BITS;
-    localparam OUT_FIFO_ASIZE = `FIFO_ADDR_BITS;
+    // The FPGA to host traffic is small: 4KB is enough and leaves the block RAM to a 64KB IN FIFO on the 25k. Above 12
+    // address bits only the IN FIFO grows.
+    localparam OUT_FIFO_ASIZE = `FIFO_ADDR_BITS > 12 ? 12 : `FIFO_ADDR_BITS;
 `else
     // Default FIFO address bits
     localparam IN_FIFO_ASIZE = 5;
     localparam OUT_FIFO_ASIZE = 5;
 `endif
+    // Deep FIFOs use block RAM: LUT RAM beyond 64 words costs too many slices and fails timing.
+    localparam IN_FIFO_EBR = IN_FIFO_ASIZE > 6 ? "TRUE" : "FALSE";
+    localparam OUT_FIFO_EBR = OUT_FIFO_ASIZE > 6 ? "TRUE" : "FALSE";
+    // Both sides of the FT2232 FIFOs use the FT2232 clock when the control module runs on it.
+`ifdef CONTROL_ON_FIFO_CLK
+    localparam FT2232_FIFO_SYNC = "TRUE";
+`else
+    localparam FT2232_FIFO_SYNC = "FALSE";
+`endif
 
-    logic wr_in_fifo_en, wr_in_fifo_clk, wr_in_fifo_afull, wr_in_fifo_full;
+    logic wr_in_fifo_en, wr_in_fifo_clk, wr_in_fifo_full;
     logic rd_in_fifo_en, rd_in_fifo_clk, rd_in_fifo_empty;
     logic [7:0] wr_in_fifo_data, rd_in_fifo_data;
+    logic [1:0] in_fifo_flushes_gray;
 
     logic wr_out_fifo_en, wr_out_fifo_clk, wr_out_fifo_afull, wr_out_fifo_full;
     logic rd_out_fifo_en, rd_out_fifo_clk, rd_out_fifo_empty;
@@ -197,14 +239,14 @@ module audio (
     //==================================================================================================================
     // The FIFO used by the FPGA to read from the FT2232 FIFO.
     //==================================================================================================================
-    async_fifo #(.ASIZE(IN_FIFO_ASIZE)) in_async_fifo_m (
+    async_fifo #(.ASIZE(IN_FIFO_ASIZE), .EBR(IN_FIFO_EBR), .SYNC(FT2232_FIFO_SYNC)) in_async_fifo_m (
         // Write to FIFO
         .wr_reset_i         (reset),
         .wr_en_i            (wr_in_fifo_en),
         .wr_clk_i           (wr_in_fifo_clk),
         .wr_data_i          (wr_in_fifo_data),
         .wr_full_o          (wr_in_fifo_full),
-        .wr_awfull_o        (wr_in_fifo_afull),
+        .wr_awfull_o        (),
         // Read from FIFO
         .rd_reset_i         (reset),
         .rd_en_i            (rd_in_fifo_en),
@@ -215,7 +257,7 @@ module audio (
     //==================================================================================================================
     // The FIFO used by the FPGA to write to the FT2232 FIFO.
     //==================================================================================================================
-    async_fifo #(.ASIZE(OUT_FIFO_ASIZE)) out_async_fifo_m (
+    async_fifo #(.ASIZE(OUT_FIFO_ASIZE), .EBR(OUT_FIFO_EBR), .SYNC(FT2232_FIFO_SYNC)) out_async_fifo_m (
         // Write to FIFO
         .wr_reset_i         (reset),
         .wr_en_i            (wr_out_fifo_en),
@@ -250,13 +292,27 @@ module audio (
         .wr_in_fifo_en_o    (wr_in_fifo_en),
         .wr_in_fifo_data_o  (wr_in_fifo_data),
         .wr_in_fifo_full_i  (wr_in_fifo_full),
-        .wr_in_fifo_afull_i (wr_in_fifo_afull),
+        .in_fifo_flushes_gray_o (in_fifo_flushes_gray),
         // Output FIFO ports
         .rd_out_fifo_clk_o   (rd_out_fifo_clk),
         .rd_out_fifo_en_o    (rd_out_fifo_en),
         .rd_out_fifo_data_i  (rd_out_fifo_data),
         .rd_out_fifo_empty_i (rd_out_fifo_empty));
 
+`ifdef SLOW_CONSUMER
+    //==================================================================================================================
+    // Simulation workload: the control module stops reading the IN FIFO for 256 of every 1024 clocks so that the FT2232
+    // reads keep hitting a full IN FIFO. A read in progress is never interrupted.
+    //==================================================================================================================
+    logic [9:0] slow_consumer_clocks = 10'd0;
+    always @(posedge rd_in_fifo_clk) slow_consumer_clocks <= slow_consumer_clocks + 10'd1;
+    logic rd_in_fifo_empty_ctrl;
+    assign rd_in_fifo_empty_ctrl = rd_in_fifo_empty || (&slow_consumer_clocks[9:8] && ~rd_in_fifo_en);
+`else
+    logic rd_in_fifo_empty_ctrl;
+    assign rd_in_fifo_empty_ctrl = rd_in_fifo_empty;
+`endif
+
     //==================================================================================================================
     // The control module sends and receives data from FT2232 using two asynchronous FIFOs.
     //==================================================================================================================
@@ -265,11 +321,13 @@ module audio (
         .reset_i                (reset),
         .clk_24576000_i         (clk_24576000_i),
         .clk_22579200_i         (clk_22579200_i),
+        .fifo_clk_i             (fifo_clk_i),
         // Input FIFO ports
         .rd_in_fifo_clk_o       (rd_in_fifo_clk),
         .rd_in_fifo_en_o        (rd_in_fifo_en),
         .rd_in_fifo_data_i      (rd_in_fifo_data),
-        .rd_in_fifo_empty_i     (rd_in_fifo_empty),
+        .rd_in_fifo_empty_i     (rd_in_fifo_empty_ctrl),
+        .in_fifo_flushes_gray_i (in_fifo_flushes_gray),
         // Output FIFO ports
         .wr_out_fifo_clk_o      (wr_out_fifo_clk),
         .wr_out_fifo_en_o       (wr_out_fifo_en),
@@ -283,6 +341,9 @@ module audio (
         .i2s_lrck_o             (i2s_lrck_o),
         .i2s_mclk_o             (i2s_mclk_o),
         .dsd_o                  (dsd_o),
+        // Audio input
+        .spdif_i                (spdif_i),
+        .i2s_sdata_i            (i2s_sdata_i),
         // LEDs
         // Sample rate
         .led_sr_48000Hz_o       (ext_led_sr_48000Hz_o),
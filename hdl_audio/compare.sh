@@ -0,0 +1,55 @@
+########################################################################################################################
+# Run a sim.sh or fpga.sh command on a commit and on its parent (before / after comparison of a change).
+########################################################################################################################
+#!/usr/bin/bash
+
+helpFunction()
+{
+    echo ""
+    echo "Usage: $0 -c <commit> [-p <patch>] <command> -h"
+    echo "    -c: the commit of the change. The command is run on the parent of the commit, then on the commit."
+    echo "    -p: a patch applied to the parent tree first (e.g. a bench workload added by the change)."
+    echo "    -h: Help."
+    echo "    e.g. $0 -c a2e0d0c ./fpga.sh -r 5"
+    echo "         $0 -c 2ea4c59 -p slow_consumer.patch ./sim.sh -f sound.bin -D SLOW_CONSUMER"
+    exit 1
+}
+
+while getopts 'c:p:h' opt; do
+    case "$opt" in
+        c ) COMMIT=${OPTARG} ;;
+        p ) PATCH=$(realpath "${OPTARG}") ;;
+        h ) helpFunction ;;
+        ? ) helpFunction ;; # Print helpFunction in case parameter is non-existent
+    esac
+done
+shift $((OPTIND - 1))
+
+if [ -z "$COMMIT" ] || [ $# -eq 0 ]; then
+    helpFunction
+fi
+
+# The command runs from this directory of a worktree of each revision; relative file arguments (e.g. the bin file)
+# are taken from here.
+SUBDIR=$(git rev-parse --show-prefix)
+WORKTREE=$(mktemp -d)
+
+for REVISION in "$COMMIT^" "$COMMIT"; do
+    echo "==================== $(git log -1 --format='%h %s' "$REVISION") ===================="
+    git worktree add --detach "$WORKTREE/tree" "$REVISION" > /dev/null 2>&1
+    if [ $? -eq 0 ] && [ -n "$PATCH" ] && [ "$REVISION" != "$COMMIT" ]; then
+        git -C "$WORKTREE/tree" apply "$PATCH"
+    fi
+    if [ -d "$WORKTREE/tree" ]; then
+        # Files given to the command that are not in the repository (bin files) are linked into the worktree.
+        for ARG in "$@"; do
+            if [ -f "$ARG" ] && [ ! -e "$WORKTREE/tree/$SUBDIR$ARG" ]; then
+                ln -s "$PWD/$ARG" "$WORKTREE/tree/$SUBDIR$ARG"
+            fi
+        done
+        (cd "$WORKTREE/tree/$SUBDIR" && "$@")
+        git worktree remove --force "$WORKTREE/tree"
+    fi
+done
+
+rmdir "$WORKTREE"
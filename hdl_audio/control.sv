@@ -17,7 +17,8 @@
 
  /***********************************************************************************************************************
  * This module implements the reading out of the async FIFO at the appropriate audio frequency and sends the audio
- * samples to the digital audio module. It only supports playback at this time.
+ * samples to the digital audio module. The stereo frames captured by the SPDIF or I2S receiver are forwarded to the
+ * host.
  **********************************************************************************************************************/
 `timescale 1ps/1ps
 `default_nettype none
@@ -28,11 +29,15 @@ module control (
     input logic reset_i,
     input logic clk_24576000_i,
     input logic clk_22579200_i,
+    // The FT2232 FIFO clock (system clock with CONTROL_ON_FIFO_CLK)
+    input logic fifo_clk_i,
     // Input FIFO access
     output logic rd_in_fifo_clk_o,
     output logic rd_in_fifo_en_o,
     input logic rd_in_fifo_empty_i,
     input logic [7:0] rd_in_fifo_data_i,
+    // The CMD_HOST_FLUSH commands written to the IN FIFO (gray code, FT2232 clock)
+    input logic [1:0] in_fifo_flushes_gray_i,
     // Output FIFO ports
     output logic wr_out_fifo_clk_o,
     output logic wr_out_fifo_en_o,
@@ -41,11 +46,14 @@ module control (
     input logic wr_out_fifo_afull_i,
     // Audio output
     output logic spdif_o,
-    output logic i2s_sdata_o,
+    output logic [`I2S_DATA_LINES-1:0] i2s_sdata_o,
     output logic i2s_bclk_o,
     output logic i2s_lrck_o,
     output logic i2s_mclk_o,
     output logic dsd_o,
+    // Audio input
+    input logic spdif_i,
+    input logic i2s_sdata_i,
     // Sample rate LEDs
     output logic led_ctrl_err_o,
     output logic led_sr_48000Hz_o,
@@ -76,30 +84,36 @@ module control (
     assign wr_out_fifo_clk_o = clk;
 
 `ifdef SIMULATION
-    logic [2:0] pll_clocks_24576000;
+    logic [3:0] pll_clocks_24576000;
+    initial pll_clocks_24576000[3:1] = 3'b000;
     assign pll_clocks_24576000[0] = clk_24576000_i;
-    // Max bit clock for 24 bit @24.576000 MHz
-    localparam CLK_18432000_PS = 54253;
-    always #(CLK_18432000_PS/2) pll_clocks_24576000[1] = ~pll_clocks_24576000[1];
+    // Master clock of the transmitters @24.576000 MHz
+    localparam CLK_147456000_PS = 6781;
+    always #(CLK_147456000_PS/2) pll_clocks_24576000[1] = ~pll_clocks_24576000[1];
     // Max frequency which is a multiple of 2 @24.576000 MHz
     localparam CLK_98304000_PS = 10172;
     always #(CLK_98304000_PS/2) pll_clocks_24576000[2] = ~pll_clocks_24576000[2];
+    // System clock (control and the control side of the FIFOs)
+    localparam CLK_117964800_PS = 8477;
+    always #(CLK_117964800_PS/2) pll_clocks_24576000[3] = ~pll_clocks_24576000[3];
 
     logic [2:0] pll_clocks_22579200;
+    initial pll_clocks_22579200[2:1] = 2'b00;
     assign pll_clocks_22579200[0] = clk_22579200_i;
-    // Max bit clock for 24 bit @22.579200 MHz
-    localparam CLK_16934400_PS = 59051;
-    always #(CLK_16934400_PS/2) pll_clocks_22579200[1] = ~pll_clocks_22579200[1];
+    // Master clock of the transmitters @22.579200 MHz
+    localparam CLK_135475200_PS = 7381;
+    always #(CLK_135475200_PS/2) pll_clocks_22579200[1] = ~pll_clocks_22579200[1];
     // Max frequency which is a multiple of 2 of @22.579200 MHz
     localparam CLK_90316800_PS = 11072;
     always #(CLK_90316800_PS/2) pll_clocks_22579200[2] = ~pll_clocks_22579200[2];
 `else
-    logic [2:0] pll_clocks_24576000;
+    logic [3:0] pll_clocks_24576000;
     pll_24576000 pll_24576000_m(
         .CLKI (clk_24576000_i),
         .CLKOP(pll_clocks_24576000[0]),
         .CLKOS(pll_clocks_24576000[1]),
-        .CLKOS2(pll_clocks_24576000[2]));
+        .CLKOS2(pll_clocks_24576000[2]),
+        .CLKOS3(pll_clocks_24576000[3]));
 
     logic [2:0] pll_clocks_22579200;
     pll_22579200 pll_22579200_m(
@@ -125,113 +139,60 @@ module control (
     352800  11289600    16934400    22579200    90316800
     ==================================================================================================================*/
 
-    // 32 bit @24.576000 MHz
-    logic [3:0] clk_24576000_32;
-    // 384 KHz 32 bit: 24576000 Hz
-    assign clk_24576000_32[3] = clk_24576000_i;
-    // 192 KHz 32 bit: 12288000 Hz
-    divide_by_2 divide_by_2_1_m (reset_i, clk_24576000_32[3], clk_24576000_32[2]);
-    // 96 KHz 32 bit: 6144000 Hz
-    divide_by_2 divide_by_2_2_m (reset_i, clk_24576000_32[2], clk_24576000_32[1]);
-    // 48 KHz 32 bit: 3072000 Hz
-    divide_by_2 divide_by_2_3_m (reset_i, clk_24576000_32[1], clk_24576000_32[0]);
-
-    // 24 bit @24.576000 MHz
-    logic [3:0] clk_24576000_24;
-    // 384 KHz 24 bit: 18432000 Hz
-    assign clk_24576000_24[3] = pll_clocks_24576000[1];
-    // 192 KHz 24 bit: 9216000 Hz
-    divide_by_2 divide_by_2_4_m (reset_i, clk_24576000_24[3], clk_24576000_24[2]);
-    // 96 KHz 24 bit: 4608000 Hz
-    divide_by_2 divide_by_2_5_m (reset_i, clk_24576000_24[2], clk_24576000_24[1]);
-    // 48 KHz 24 bit: 2304000 Hz
-    divide_by_2 divide_by_2_6_m (reset_i, clk_24576000_24[1], clk_24576000_24[0]);
-
-    // 16 bit @24.576000 MHz
-    logic [3:0] clk_24576000_16;
-    // 384 KHz 16 bit: 12288000 Hz
-    assign clk_24576000_16[3] = clk_24576000_32[2];
-    // 192 KHz 16 bit: 6144000 Hz
-    assign clk_24576000_16[2] = clk_24576000_32[1];
-    // 96 KHz 16 bit: 3072000 Hz
-    assign clk_24576000_16[1] = clk_24576000_32[0];
-    // 48 KHz 16 bit: 1536000 Hz
-    divide_by_2 divide_by_2_7_m (reset_i, clk_24576000_16[1], clk_24576000_16[0]);
-
-    // MCLK @24.576000 MHz
-    logic [3:0] clk_24576000_mclk;
-    // 384 KHz MCLK: 98304000 Hz
-    assign clk_24576000_mclk[3] = pll_clocks_24576000[2];
-    // 192 KHz MCLK: 49152000 Hz
-    divide_by_2 divide_by_2_8_m (reset_i, clk_24576000_mclk[3], clk_24576000_mclk[2]);
-    // 96 KHz MCLK: 24576000 Hz
-    assign clk_24576000_mclk[1] = clk_24576000_i;
-    // 48 KHZ MCLK: 12288000 Hz
-    assign clk_24576000_mclk[0] = clk_24576000_32[2];
-
-    // 32 bit @22.579200 MHz
-    logic [3:0] clk_22579200_32;
-    // 352.8 KHz 32 bit: 22579200 Hz
-    assign clk_22579200_32[3] = clk_22579200_i;
-    // 176.4 KHz 32 bit: 11289600 Hz
-    divide_by_2 divide_by_2_20_m (reset_i, clk_22579200_32[3], clk_22579200_32[2]);
-    // 88.2 KHz 32 bit: 5644800 Hz
-    divide_by_2 divide_by_2_21_m (reset_i, clk_22579200_32[2], clk_22579200_32[1]);
-    // 44.1 KHz 32 bit: 2822400 Hz
-    divide_by_2 divide_by_2_22_m (reset_i, clk_22579200_32[1], clk_22579200_32[0]);
-
-    // 24 bit @22.579200 MHz
-    logic [3:0] clk_22579200_24;
-    // 352.8 KHz 24 bit: 16934400 Hz
-    assign clk_22579200_24[3] = pll_clocks_22579200[1];
-    // 176.4 KHz 24 bit: 8467200 Hz
-    divide_by_2 divide_by_2_23_m (reset_i, clk_22579200_24[3], clk_22579200_24[2]);
-    // 88.2 KHz 24 bit: 4233600 Hz
-    divide_by_2 divide_by_2_24_m (reset_i, clk_22579200_24[2], clk_22579200_24[1]);
-    // 44.1 KHz 24 bit: 2116800 Hz
-    divide_by_2 divide_by_2_25_m (reset_i, clk_22579200_24[1], clk_22579200_24[0]);
-
-    // 16 bit @22.579200 MHz
-    logic [3:0] clk_22579200_16;
-    // 352.8 KHz 16 bit: 11289600 Hz
-    assign clk_22579200_16[3] = clk_22579200_32[2];
-    // 176.4 KHz 16 bit: 5644800 Hz
-    assign clk_22579200_16[2] = clk_22579200_32[1];
-    // 88.2 KHz 16 bit: 2822400 Hz
-    assign clk_22579200_16[1] = clk_22579200_32[0];
-    // 44.1 KHz 16 bit: 1411200 Hz
-    divide_by_2 divide_by_2_26_m (reset_i, clk_22579200_16[1], clk_22579200_16[0]);
-
-    // MCLK @22.579200 MHz
-    logic [3:0] clk_22579200_mclk;
-    // 352.8 KHz MCLK: 90316800 Hz
-    assign clk_22579200_mclk[3] = pll_clocks_22579200[2];
-    // 176.4 KHz MCLK: 45158400 Hz
-    divide_by_2 divide_by_2_27_m (reset_i, clk_22579200_mclk[3], clk_22579200_mclk[2]);
-    // 88.2 KHz MCLK: 22579200 Hz
-    assign clk_22579200_mclk[1] = clk_22579200_i;
-    // 44.1 KHz MCLK: 11289600 Hz
-    assign clk_22579200_mclk[0] = clk_22579200_32[2];
-
-    // The I2S bit clock
-    logic [15:0] i_clk_24576000;
-    assign i_clk_24576000 = {clk_24576000_32, clk_24576000_24, clk_24576000_16, 4'b0000};
-    logic [15:0] i_clk_22579200;
-    assign i_clk_22579200 = {clk_22579200_32, clk_22579200_24, clk_22579200_16, 4'b0000};
-    logic [3:0] bc_index;
-    assign bc_index = {bit_depth, sample_rate[1:0]};
-    logic i2s_bit_clk;
-    assign i2s_bit_clk = io_en[IO_TYPE_I2S_BIT] ? sample_rate[2] ? i_clk_24576000[bc_index] :
-                                                                    i_clk_22579200[bc_index] : 1'b0;
-
-    // The I2S MCLK
-    logic i2s_mclk;
-    assign i2s_mclk = io_en[IO_TYPE_I2S_BIT] ? sample_rate[2] ? clk_24576000_mclk[sample_rate[1:0]] :
-                                                                clk_22579200_mclk[sample_rate[1:0]] : 1'b0;
-
-    logic i2s_rd_output_FIFO_clk;
-    // From the FIFO we read 8 bits at the bit clock divided by 8.
-    divide_by_8 divide_by_8_m (.reset_i(reset_i), .clk_i(i2s_bit_clk), .clk_o(i2s_rd_output_FIFO_clk));
+    // The master clock of the transmitters: 3072 x the base sample rate of the family (147.456MHz or 135.4752MHz). All
+    // the bit clocks above and the SPDIF symbol rates below are a whole number of master clocks per half period.
+    logic tx_clk;
+    clock_select tx_clock_select_m (
+        .reset_i                (reset_i),
+        .sel_i                  (sample_rate[2]),
+        .clk_0_i                (pll_clocks_22579200[1]),
+        .clk_1_i                (pll_clocks_24576000[1]),
+        .clk_o                  (tx_clk));
+
+    // The I2S bit clock period: 3072 / (bits per frame x 2^sample_rate[1:0]) master clocks, with 2 slots of the bit
+    // depth per frame or the TDM slots. Native DSD runs the bit clock at the DSD rate: 64 x 2^sample_rate[1:0] x the
+    // base sample rate (DSD64 to DSD512).
+    function [6:0] i2s_bit_period (input logic [1:0] tdm_mode, input logic [1:0] slot, input logic [1:0] depth,
+                                    input logic dsd, input logic [2:0] rate);
+        (* parallel_case, full_case *)
+        case (tdm_mode)
+            `TDM_4: i2s_bit_period = slot == `BIT_DEPTH_16 ? 7'd48 : slot == `BIT_DEPTH_24 ? 7'd32 : 7'd24;
+            `TDM_8: i2s_bit_period = slot == `BIT_DEPTH_16 ? 7'd24 : slot == `BIT_DEPTH_24 ? 7'd16 : 7'd12;
+            default: begin
+                (* parallel_case, full_case *)
+                case (depth)
+                    `BIT_DEPTH_16: i2s_bit_period = 7'd96;
+                    `BIT_DEPTH_24: i2s_bit_period = 7'd64;
+                    `BIT_DEPTH_DOP: i2s_bit_period = dsd ? 7'd48 : 7'd64;
+                    `BIT_DEPTH_32: i2s_bit_period = 7'd48;
+                endcase
+            end
+        endcase
+        i2s_bit_period = i2s_bit_period >> rate[1:0];
+    endfunction
+
+    // The sample rate in Hz.
+    function [18:0] sample_rate_hz (input logic [2:0] rate);
+        sample_rate_hz = (rate[2] ? 19'd48000 : 19'd44100) << rate[1:0];
+    endfunction
+
+    logic i2s_bit_en;
+    bit_clock_enable i2s_bit_en_m (
+        .reset_i                (reset_i || ~io_en[IO_TYPE_I2S_BIT]),
+        .clk_i                  (tx_clk),
+        .period_i               (i2s_bit_period (tdm, slot_width, bit_depth, dsd_native, sample_rate)),
+        .en_o                   (i2s_bit_en));
+
+    // The I2S MCLK is the MCLK PLL output of the family at 384KHz / 352.8KHz and that clock divided by 2, 4 or 8. It is
+    // sent by i2s_mclk_m (after tx_i2s) while the I2S output streams.
+    logic mclk_base, i2s_mclk;
+    clock_select mclk_select_m (
+        .reset_i                (reset_i),
+        .sel_i                  (sample_rate[2]),
+        .clk_0_i                (pll_clocks_22579200[2]),
+        .clk_1_i                (pll_clocks_24576000[2]),
+        .clk_o                  (mclk_base));
+
 
     /*==================================================================================================================
     SPDIF bit clock rates
@@ -246,47 +207,37 @@ module control (
     88200   11289600
     176400  22579200
     ==================================================================================================================*/
-    // @22.579200 MHz
-    logic [3:0] clk_22579200_spdif;
-    // 352.8 KHz is not supported for SPDIF
-    assign clk_22579200_spdif[3] = 1'b0;
-    // 176.4 KHz: 22579200 Hz
-    assign clk_22579200_spdif[2] = clk_22579200_32[3];
-    // 88.2 KHz: 11289600 Hz
-    assign clk_22579200_spdif[1] = clk_22579200_32[2];
-    // 44.1 KHz: 5644800 Hz
-    assign clk_22579200_spdif[0] = clk_22579200_32[1];
-
-    // @24.576000 MHz
-    logic [3:0] clk_24576000_spdif;
-    // 384 KHz is not supported for SPDIF
-    assign clk_24576000_spdif[3] = 1'b0;
-    // 192 KHz: 24576000 Hz
-    assign clk_24576000_spdif[2] = clk_24576000_32[3];
-    // 96 KHz: 12288000 Hz
-    assign clk_24576000_spdif[1] = clk_24576000_32[2];
-    // 48 KHz: 6144000 Hz
-    assign clk_24576000_spdif[0] = clk_24576000_32[1];
-
-    logic spdif_bit_clk;
-    assign spdif_bit_clk = io_en[IO_TYPE_SPDIF_BIT] ? (sample_rate[2] ? clk_24576000_spdif[sample_rate[1:0]] :
-                                                            clk_22579200_spdif[sample_rate[1:0]]) : 1'b0;
-
-    logic spdif_rd_output_FIFO_clk;
-    // From the FIFO we read 8 bits at the symbol clock divided by 16 (/8 bits and /2 for bi-phase encoding).
-    divide_by_16 divide_by_16_m (.reset_i(reset_i), .clk_i(spdif_bit_clk), .clk_o(spdif_rd_output_FIFO_clk));
+    // The SPDIF symbols: one every 24 / 2^sample_rate[1:0] master clocks.
+    logic spdif_bit_en;
+    clock_enable spdif_bit_en_m (
+        .reset_i                (reset_i || ~io_en[IO_TYPE_SPDIF_BIT]),
+        .clk_i                  (tx_clk),
+        .period_i               (6'd24 >> sample_rate[1:0]),
+        .en_o                   (spdif_bit_en));
     /*================================================================================================================*/
     logic clk;
-    // For this module use a frequency that is higher than any byte_clk. For I2S the maximum byte_clk is 24576000/8.
-    // For SPDIF the maximum byte_clk is 24576000/8. 24.576MHz clk fits the bill.
+    // The system clock of this module and of the control side of the FIFOs: 117.9648MHz (24.576MHz x 24 / 5), so that
+    // command processing is faster than the FT2232 (60MHz, one byte per clock) and never the bottleneck. Every signal
+    // to or from the audio clock domains crosses through an async FIFO, a gray coded counter or a DFF_META.
+    // CONTROL_CLK_24576000 selects the former 24.576MHz clock for comparison. CONTROL_ON_FIFO_CLK runs this module on
+    // the FT2232 clock (60MHz): the commands are parsed in that domain and the IN/OUT FIFOs need no synchronizers
+    // (audio.sv), the audio bytes cross to the audio clocks only in the transmitter FIFOs.
+`ifdef CONTROL_ON_FIFO_CLK
+    assign clk = fifo_clk_i;
+`elsif CONTROL_CLK_24576000
     assign clk = clk_24576000_i;
+`else
+    assign clk = pll_clocks_24576000[3];
+`endif
 
     // State machines
-    localparam STATE_IDLE                   = 2'b00;
-    localparam STATE_RD                     = 2'b01;
-    localparam STATE_WR_BUFFER              = 2'b10;
-    localparam STATE_WAIT_OUTPUT_TO_STOP    = 2'b11;
-    logic [1:0] state_m, next_state_m;
+    localparam STATE_IDLE                   = 3'd0;
+    localparam STATE_RD                     = 3'd1;
+    localparam STATE_WR_BUFFER              = 3'd2;
+    localparam STATE_WAIT_OUTPUT_TO_STOP    = 3'd3;
+    localparam STATE_FLUSH_OUTPUT           = 3'd4;
+    localparam STATE_RD_INPUT               = 3'd5;
+    logic [2:0] state_m, next_state_m;
 
     // Protocol state machine
     localparam STATE_FIFO_CMD               = 2'b00;
@@ -297,8 +248,10 @@ module control (
 
     logic [2:0] last_fifo_cmd;
     logic [15:0] rd_payload_bytes;
+    // The index of the payload byte for commands with a short payload.
+    logic [3:0] rd_payload_index;
     logic [4:0] wr_data_index;
-    logic [7:0] wr_data[0:1];
+    logic [7:0] wr_data[0:8];
 
     // Audio configuration
     // The io_en index of the bit indicating what type of input/output is enabled.
@@ -311,61 +264,312 @@ module control (
 
     assign wr_output_FIFO_full = {wr_output_FIFO_afull_i2s || wr_output_FIFO_full_i2s,      // IO_TYPE_I2S_BIT index
                                     wr_output_FIFO_afull_spdif || wr_output_FIFO_full_spdif}; // IO_TYPE_SPDIF_BIT index
-    logic is_wr_output_FIFO_full;
-    assign is_wr_output_FIFO_full = |(wr_output_FIFO_full & io_en);
+    logic is_wr_output_FIFO_full, dop_encoder_full, asrc_full, oversampler_full;
+    assign is_wr_output_FIFO_full = |(wr_output_FIFO_full & io_en) || dop_encoder_full || asrc_full ||
+                                        oversampler_full;
+    // Only audio payload bytes wait for room in the output FIFO, and not when they are dropped ahead of a flush.
+    // Commands are processed even if the output FIFO is full (e.g. a resume while paused).
+    logic can_process_rd_data;
+    assign can_process_rd_data = ~is_wr_output_FIFO_full || fifo_state_m != STATE_FIFO_PAYLOAD ||
+                                    last_fifo_cmd != `CMD_HOST_STREAM_OUTPUT || flush_pending;
 
     logic [2:0] sample_rate;
     logic [1:0] bit_depth;
+    // Native DSD on the I2S port (bit_depth is BIT_DEPTH_DOP).
+    logic dsd_native;
+    // Raw DSD bytes encoded to DoP before the transmitters (bit_depth is BIT_DEPTH_DOP).
+    logic dop_encode;
+    // TDM on the I2S port (TDM_OFF for I2S) and the TDM slot width (coded as the bit depth).
+    logic [1:0] tdm, slot_width;
+    // The sdata lines of the I2S port (LINES_1 for I2S).
+    logic [1:0] lines;
+    // The oversampling ratio (log2, 0 when off).
+    logic [1:0] oversampling;
+    // The rate of the stream in Hz when it is converted to the sample rate (0 when off) and its first bytes.
+    logic [18:0] asrc_rate;
+    logic [15:0] asrc_rate_msb;
     logic [7:0] saved_rd_data;
     logic have_saved_rd_data;
 
+    // The transmitters are held in reset while flushing so that their FIFOs are emptied at once.
+    logic flush_output;
+    logic [2:0] flush_output_clocks;
+    // While a CMD_HOST_FLUSH is in the IN FIFO (written by ft2232_fifo, not parsed yet) the audio ahead of it is
+    // dropped without waiting for room in the output FIFOs. The parsed count may be one ahead of the written count
+    // for the few clocks it takes to cross the clock domains (a difference of 3), which is not a pending flush.
+    logic [1:0] in_fifo_flushes_gray_meta, in_fifo_flushes_written, in_fifo_flushes_parsed, in_fifo_flushes_pending;
+    DFF_META in_fifo_flushes_meta_0_m (reset_i, in_fifo_flushes_gray_i[0], clk, in_fifo_flushes_gray_meta[0]);
+    DFF_META in_fifo_flushes_meta_1_m (reset_i, in_fifo_flushes_gray_i[1], clk, in_fifo_flushes_gray_meta[1]);
+    assign in_fifo_flushes_written = {in_fifo_flushes_gray_meta[1], ^in_fifo_flushes_gray_meta};
+    assign in_fifo_flushes_pending = in_fifo_flushes_written - in_fifo_flushes_parsed;
+    logic flush_pending;
+    assign flush_pending = in_fifo_flushes_pending == 2'd1 || in_fifo_flushes_pending == 2'd2;
+    // The transmitters keep their FIFO contents and send silence while paused.
+    logic pause_output;
+    // The volume stage: the gain (Q1.15) and the requantization options. The gain is set at once with its LSB.
+    logic [15:0] gain;
+    logic [7:0] gain_msb;
+    logic dither, noise_shaping;
+
+    //==================================================================================================================
+    // The sample counters (one per clock family) and the scheduled start.
+    //==================================================================================================================
+    // The stream does not start before the sample counter reaches start_at (when armed).
+    logic start_at_option, start_armed;
+    logic [31:0] start_at;
+
+    logic start_reached_24576000, start_reached_22579200;
+    logic [31:0] count_gray_24576000, count_gray_22579200;
+    sample_counter sample_counter_24576000_m (
+        .reset_i                (reset_i),
+        .clk_i                  (clk_24576000_i),
+        .rate_index_i           (sample_rate[1:0]),
+        .start_armed_i          (start_armed && sample_rate[2]),
+        .start_at_i             (start_at),
+        .start_reached_o        (start_reached_24576000),
+        .count_gray_o           (count_gray_24576000));
+
+    sample_counter sample_counter_22579200_m (
+        .reset_i                (reset_i),
+        .clk_i                  (clk_22579200_i),
+        .rate_index_i           (sample_rate[1:0]),
+        .start_armed_i          (start_armed && ~sample_rate[2]),
+        .start_at_i             (start_at),
+        .start_reached_o        (start_reached_22579200),
+        .count_gray_o           (count_gray_22579200));
+
+    // start_armed is used directly (not through the sample counter synchronizer) so that the transmitters are held
+    // before the first audio byte reaches them.
+    logic start_output;
+    assign start_output = ~start_armed || (sample_rate[2] ? start_reached_24576000 : start_reached_22579200);
+
+    // Synchronize the gray coded sample count of the selected clock family to clk.
+    logic [31:0] count_gray_meta_1, count_gray_meta_2;
+    always @(posedge clk) begin
+        count_gray_meta_1 <= sample_rate[2] ? count_gray_24576000 : count_gray_22579200;
+        count_gray_meta_2 <= count_gray_meta_1;
+    end
+
+    logic [31:0] sample_count;
+    assign sample_count = gray_to_binary (count_gray_meta_2);
+
+    //==================================================================================================================
+    // Playback position: the frames emitted by each transmitter are reported to the host periodically.
+    //==================================================================================================================
+    logic [31:0] frames_gray_i2s, frames_gray_spdif;
+    logic [31:0] frames_gray_meta_1_i2s, frames_gray_meta_2_i2s, frames_gray_meta_1_spdif, frames_gray_meta_2_spdif;
+    always @(posedge clk) begin
+        frames_gray_meta_1_i2s <= frames_gray_i2s;
+        frames_gray_meta_2_i2s <= frames_gray_meta_1_i2s;
+        frames_gray_meta_1_spdif <= frames_gray_spdif;
+        frames_gray_meta_2_spdif <= frames_gray_meta_1_spdif;
+    end
+
+    logic [31:0] frames_i2s, frames_spdif;
+    assign frames_i2s = gray_to_binary (frames_gray_meta_2_i2s);
+    assign frames_spdif = gray_to_binary (frames_gray_meta_2_spdif);
+
+    // A report is sent every 2^25 clocks (~284ms at 117.9648MHz) while streaming.
+    logic [24:0] report_position_clocks;
+    logic report_position;
+
+    function [31:0] gray_to_binary (input logic [31:0] gray);
+        integer i;
+        for (i = 0; i < 32; i = i + 1) begin
+            gray_to_binary[i] = ^(gray >> i);
+        end
+    endfunction
+
+    //==================================================================================================================
+    // The DoP encoder: the audio bytes go through unchanged unless the host streams raw DSD bytes.
+    //==================================================================================================================
+    logic [7:0] wr_output_FIFO_data, wr_tx_FIFO_data;
+    logic wr_tx_en;
+    dop_encoder dop_encoder_m (
+        .reset_i                (reset_i || flush_output),
+        .clk_i                  (clk),
+        .enable_i               (dop_encode),
+        .en_i                   (wr_output_en),
+        .data_i                 (wr_output_FIFO_data),
+        .ready_i                (~|(wr_output_FIFO_full & io_en)),
+        .en_o                   (wr_tx_en),
+        .data_o                 (wr_tx_FIFO_data),
+        .full_o                 (dop_encoder_full));
+
+    //==================================================================================================================
+    // The volume stage. The noise shaping state is kept for each channel of the frames sent by the host.
+    //==================================================================================================================
+    logic [5:0] last_channel;
+    assign last_channel = {(tdm == `TDM_8 ? 5'd4 : tdm == `TDM_4 ? 5'd2 : 5'd1) << lines, 1'b0} - 6'd1;
+    logic [7:0] wr_volume_data;
+    logic wr_volume_en;
+    volume volume_m (
+        .reset_i                (reset_i || flush_output),
+        .clk_i                  (clk),
+        .bit_depth_i            (bit_depth),
+        .last_channel_i         (last_channel[4:0]),
+        .gain_i                 (gain),
+        .dither_i               (dither),
+        .noise_shaping_i        (noise_shaping),
+        .en_i                   (wr_tx_en),
+        .data_i                 (wr_tx_FIFO_data),
+        .en_o                   (wr_volume_en),
+        .data_o                 (wr_volume_data));
+
+    //==================================================================================================================
+    // The sample rate converter: the host streams at any rate up to the sample rate.
+    //==================================================================================================================
+    logic [7:0] wr_asrc_data;
+    logic wr_asrc_en;
+    asrc asrc_m (
+        .reset_i                (reset_i || flush_output),
+        .clk_i                  (clk),
+        .bit_depth_i            (bit_depth),
+        .input_rate_i           (asrc_rate),
+        .output_rate_i          (sample_rate_hz (sample_rate)),
+        .en_i                   (wr_volume_en),
+        .data_i                 (wr_volume_data),
+        .ready_i                (~|(wr_output_FIFO_full & io_en)),
+        .en_o                   (wr_asrc_en),
+        .data_o                 (wr_asrc_data),
+        .full_o                 (asrc_full));
+
+    //==================================================================================================================
+    // The oversampling filter: the host streams at the base rate and the transmitters run at the sample rate.
+    //==================================================================================================================
+    logic [7:0] wr_oversampler_data;
+    logic wr_oversampler_en;
+    oversampler oversampler_m (
+        .reset_i                (reset_i || flush_output),
+        .clk_i                  (clk),
+        .bit_depth_i            (bit_depth),
+        .ratio_i                (oversampling),
+        .en_i                   (wr_asrc_en),
+        .data_i                 (wr_asrc_data),
+        .ready_i                (~|(wr_output_FIFO_full & io_en)),
+        .en_o                   (wr_oversampler_en),
+        .data_o                 (wr_oversampler_data),
+        .full_o                 (oversampler_full));
+
     //==================================================================================================================
     // The SPDIF module
     //==================================================================================================================
-    logic [7:0] wr_output_FIFO_data;
     logic wr_output_FIFO_full_spdif, wr_output_FIFO_afull_spdif, output_streaming_spdif;
     tx_spdif tx_spdif_m (
-        .reset_i                (reset_i),
-        .byte_clk_i             (spdif_rd_output_FIFO_clk),
-        .bit_clk_i              (spdif_bit_clk),
+        .reset_i                (reset_i || flush_output),
+        .clk_i                  (tx_clk),
+        .bit_en_i               (spdif_bit_en),
         // Streaming configuration
         .sample_rate_i          (sample_rate),
         .bit_depth_i            (bit_depth),
+        .pause_i                (pause_output),
+        .start_i                (start_output),
         // Clock to write to the output FIFO
         .wr_output_FIFO_clk_i   (clk),
-        .wr_output_FIFO_en_i    (io_en[IO_TYPE_SPDIF_BIT] && wr_output_en),
-        .wr_output_FIFO_data_i  (wr_output_FIFO_data),
+        .wr_output_FIFO_en_i    (io_en[IO_TYPE_SPDIF_BIT] && wr_oversampler_en),
+        .wr_output_FIFO_data_i  (wr_oversampler_data),
         .wr_output_FIFO_afull_o (wr_output_FIFO_afull_spdif),
         .wr_output_FIFO_full_o  (wr_output_FIFO_full_spdif),
         .output_streaming_o     (output_streaming_spdif),
+        .frames_emitted_gray_o  (frames_gray_spdif),
         // SPDIF output
         .spdif_o                (spdif_o));
 
     //==================================================================================================================
     // The I2S module
     //==================================================================================================================
-    logic wr_output_FIFO_full_i2s, wr_output_FIFO_afull_i2s, output_streaming_i2s;
-    tx_i2s tx_i2s_m (
-        .reset_i                (reset_i),
-        .byte_clk_i             (i2s_rd_output_FIFO_clk),
-        .bit_clk_i              (i2s_bit_clk),
+    logic wr_output_FIFO_full_i2s, wr_output_FIFO_afull_i2s, output_streaming_i2s, i2s_bclk_rise;
+    tx_i2s #(.LINES(`I2S_DATA_LINES)) tx_i2s_m (
+        .reset_i                (reset_i || flush_output),
+        .clk_i                  (tx_clk),
+        .bit_en_i               (i2s_bit_en),
         .mclk_i                 (i2s_mclk),
         // Streaming configuration
         .sample_rate_i          (sample_rate),
         .bit_depth_i            (bit_depth),
+        .dsd_i                  (dsd_native),
+        .tdm_i                  (tdm),
+        .slot_width_i           (slot_width),
+        .lines_i                (lines),
+        .pause_i                (pause_output),
+        .start_i                (start_output),
         // Clock to write to the output FIFO
         .wr_output_FIFO_clk_i   (clk),
-        .wr_output_FIFO_en_i    (io_en[IO_TYPE_I2S_BIT] && wr_output_en),
-        .wr_output_FIFO_data_i  (wr_output_FIFO_data),
+        .wr_output_FIFO_en_i    (io_en[IO_TYPE_I2S_BIT] && wr_oversampler_en),
+        .wr_output_FIFO_data_i  (wr_oversampler_data),
         .wr_output_FIFO_afull_o (wr_output_FIFO_afull_i2s),
         .wr_output_FIFO_full_o  (wr_output_FIFO_full_i2s),
         .output_streaming_o     (output_streaming_i2s),
+        .frames_emitted_gray_o  (frames_gray_i2s),
         // I2S outputs
         .sdata_o                (i2s_sdata_o),
         .bclk_o                 (i2s_bclk_o),
         .lrck_o                 (i2s_lrck_o),
         .mclk_o                 (i2s_mclk_o),
-        .dsd_o                  (dsd_o));
+        .dsd_o                  (dsd_o),
+        .bclk_rise_o            (i2s_bclk_rise));
+
+    // The I2S MCLK, from an output register on mclk_base, while the I2S output is enabled and streaming.
+    clock_output i2s_mclk_m (
+        .reset_i                (reset_i),
+        .clk_i                  (mclk_base),
+        .en_i                   (io_en[IO_TYPE_I2S_BIT] && output_streaming_i2s),
+        .div_i                  (2'd3 - sample_rate[1:0]),
+        .clk_o                  (i2s_mclk));
+
+    //==================================================================================================================
+    // The receivers. Only the selected receiver is out of reset while the input is enabled.
+    //==================================================================================================================
+    logic input_en, input_i2s;
+    logic [1:0] input_bit_depth;
+    logic [2:0] input_sample_rate;
+
+    logic rd_input_FIFO_en;
+    logic rd_input_FIFO_empty_spdif, input_overrun_spdif;
+    logic [47:0] rd_input_FIFO_data_spdif;
+    rx_spdif rx_spdif_m (
+        .reset_i                (reset_i || ~input_en || input_i2s),
+        .clk_i                  (pll_clocks_24576000[2]),
+        // Streaming configuration
+        .sample_rate_i          (input_sample_rate),
+        // Clock to read from the input FIFO
+        .rd_input_FIFO_clk_i    (clk),
+        .rd_input_FIFO_en_i     (rd_input_FIFO_en && ~input_i2s),
+        .rd_input_FIFO_data_o   (rd_input_FIFO_data_spdif),
+        .rd_input_FIFO_empty_o  (rd_input_FIFO_empty_spdif),
+        .locked_o               (),
+        .overrun_o              (input_overrun_spdif),
+        // SPDIF input
+        .spdif_i                (spdif_i));
+
+    // The I2S receiver uses the master clock, the bit clock strobe and LRCK of the I2S transmitter.
+    logic rd_input_FIFO_empty_i2s, input_overrun_i2s;
+    logic [63:0] rd_input_FIFO_data_i2s;
+    rx_i2s rx_i2s_m (
+        .reset_i                (reset_i || ~input_en || ~input_i2s),
+        // Streaming configuration
+        .bit_depth_i            (input_bit_depth),
+        // Clock to read from the input FIFO
+        .rd_input_FIFO_clk_i    (clk),
+        .rd_input_FIFO_en_i     (rd_input_FIFO_en && input_i2s),
+        .rd_input_FIFO_data_o   (rd_input_FIFO_data_i2s),
+        .rd_input_FIFO_empty_o  (rd_input_FIFO_empty_i2s),
+        .overrun_o              (input_overrun_i2s),
+        // I2S inputs
+        .clk_i                  (tx_clk),
+        .bit_en_i               (i2s_bclk_rise),
+        .lrck_i                 (i2s_lrck_o),
+        .sdata_i                (i2s_sdata_i));
+
+    // The frame of the selected receiver: {left[31:0], right[31:0]}, left justified samples.
+    logic rd_input_FIFO_empty;
+    assign rd_input_FIFO_empty = input_i2s ? rd_input_FIFO_empty_i2s : rd_input_FIFO_empty_spdif;
+    logic [63:0] rd_input_FIFO_data;
+    assign rd_input_FIFO_data = input_i2s ? rd_input_FIFO_data_i2s :
+                                    {rd_input_FIFO_data_spdif[47:24], 8'h00, rd_input_FIFO_data_spdif[23:0], 8'h00};
+
+    logic input_overrun_meta;
+    DFF_META input_overrun_m (1'b0, input_i2s ? input_overrun_i2s : input_overrun_spdif, clk, input_overrun_meta);
 
     logic output_streaming_meta_spdif, output_streaming_meta_i2s;
     DFF_META streaming_spdif_m (1'b0, output_streaming_spdif, clk, output_streaming_meta_spdif);
@@ -400,20 +604,58 @@ module control (
         case (fifo_cmd)
             `CMD_HOST_SETUP_OUTPUT: begin
                 led_ctrl_err_o <= 1'b0;
-                if (payload_length == 5'd1) begin
+                // byte[0]: format; byte[1] (optional): setup options; bytes[2-5]: start sample count (big endian);
+                // bytes[6-8]: the rate of the stream in Hz (big endian).
+                if (payload_length == 5'd1 || payload_length == 5'd2 || payload_length == 5'd6 ||
+                        payload_length == 5'd9) begin
 `ifdef D_CTRL
                     $display ($time, "\033[0;36m CTRL:\t---> [STATE_FIFO_CMD] Rd IN: CMD_HOST_SETUP_OUTPUT. \033[0;0m");
 `endif
                     // Reset the output
+                    start_at_option <= 1'b0;
+                    start_armed <= 1'b0;
+                    tdm <= `TDM_OFF;
+                    lines <= `LINES_1;
+                    oversampling <= 2'd0;
+                    asrc_rate <= 19'd0;
                 end else begin
 `ifdef D_CTRL
-                    $display ($time, "\033[0;36m CTRL:\t[ERROR] ---> [STATE_FIFO_CMD] Rd IN: CMD_HOST_SETUP_OUTPUT payload bytes: %d (expected 1). \033[0;0m",
+                    $display ($time, "\033[0;36m CTRL:\t[ERROR] ---> [STATE_FIFO_CMD] Rd IN: CMD_HOST_SETUP_OUTPUT payload bytes: %d (expected 1, 2, 6 or 9). \033[0;0m",
                                         payload_length);
 `endif
                     error_task (`ERROR_INVALID_SETUP_OUTPUT_PAYLOAD);
                 end
             end
 
+            `CMD_HOST_SETUP_INPUT: begin
+                if (payload_length == 5'd1) begin
+`ifdef D_CTRL
+                    $display ($time, "\033[0;36m CTRL:\t---> [STATE_FIFO_CMD] Rd IN: CMD_HOST_SETUP_INPUT. \033[0;0m");
+`endif
+                    // Restart the receiver with the new format.
+                    input_en <= 1'b0;
+                end else if (payload_length == 5'd0) begin
+`ifdef D_CTRL
+                    $display ($time, "\033[0;36m CTRL:\t---> [STATE_FIFO_CMD] Rd IN: CMD_HOST_SETUP_INPUT (stop input). \033[0;0m");
+`endif
+                    rd_in_fifo_en_o <= 1'b0;
+                    input_en <= 1'b0;
+
+                    wr_data_index <= 5'd0;
+                    wr_data[0] <= {`CMD_FPGA_STOPPED, 5'd1};
+                    wr_data[1] <= input_overrun_meta ? `ERROR_INPUT_OVERRUN : `ERROR_NONE;
+
+                    state_m <= STATE_WR_BUFFER;
+                    next_state_m <= STATE_RD;
+                end else begin
+`ifdef D_CTRL
+                    $display ($time, "\033[0;36m CTRL:\t[ERROR] ---> [STATE_FIFO_CMD] Rd IN: CMD_HOST_SETUP_INPUT payload bytes: %d (expected 0 or 1). \033[0;0m",
+                                        payload_length);
+`endif
+                    error_task (`ERROR_INVALID_SETUP_INPUT_PAYLOAD);
+                end
+            end
+
             `CMD_HOST_STREAM_OUTPUT: begin
                 if (payload_length[4]) begin
 `ifdef D_CTRL
@@ -436,6 +678,8 @@ module control (
 `endif
 
                     rd_in_fifo_en_o <= 1'b0;
+                    // A paused output never stops streaming; play out what is buffered.
+                    pause_output <= 1'b0;
                     state_m <= STATE_WAIT_OUTPUT_TO_STOP;
                 end else begin
 `ifdef D_CTRL
@@ -445,6 +689,80 @@ module control (
                     error_task (`ERROR_INVALID_STOP_PAYLOAD);
                 end
             end
+
+            `CMD_HOST_FLUSH: begin
+                if (payload_length == 5'd0) begin
+`ifdef D_CTRL
+                    $display ($time, "\033[0;36m CTRL:\t---> [STATE_FIFO_CMD] Rd IN: CMD_HOST_FLUSH. \033[0;0m");
+`endif
+                    // Discard the audio buffered in the transmitters; the stream continues with the next packet.
+                    in_fifo_flushes_parsed <= in_fifo_flushes_parsed + 2'd1;
+                    rd_in_fifo_en_o <= 1'b0;
+                    flush_output <= 1'b1;
+                    flush_output_clocks <= 3'd4;
+                    state_m <= STATE_FLUSH_OUTPUT;
+                end else begin
+`ifdef D_CTRL
+                    $display ($time, "\033[0;36m CTRL:\t[ERROR] ---> [STATE_FIFO_CMD] Rd IN: CMD_HOST_FLUSH payload bytes: %d (expected 0). \033[0;0m",
+                                        payload_length);
+`endif
+                    error_task (`ERROR_INVALID_FLUSH_PAYLOAD);
+                end
+            end
+
+            `CMD_HOST_PAUSE: begin
+                if (payload_length == 5'd1) begin
+`ifdef D_CTRL
+                    $display ($time, "\033[0;36m CTRL:\t---> [STATE_FIFO_CMD] Rd IN: CMD_HOST_PAUSE. \033[0;0m");
+`endif
+                end else begin
+`ifdef D_CTRL
+                    $display ($time, "\033[0;36m CTRL:\t[ERROR] ---> [STATE_FIFO_CMD] Rd IN: CMD_HOST_PAUSE payload bytes: %d (expected 1). \033[0;0m",
+                                        payload_length);
+`endif
+                    error_task (`ERROR_INVALID_PAUSE_PAYLOAD);
+                end
+            end
+
+            `CMD_HOST_SET_VOLUME: begin
+                if (payload_length == 5'd2 || payload_length == 5'd3) begin
+`ifdef D_CTRL
+                    $display ($time, "\033[0;36m CTRL:\t---> [STATE_FIFO_CMD] Rd IN: CMD_HOST_SET_VOLUME. \033[0;0m");
+`endif
+                end else begin
+`ifdef D_CTRL
+                    $display ($time, "\033[0;36m CTRL:\t[ERROR] ---> [STATE_FIFO_CMD] Rd IN: CMD_HOST_SET_VOLUME payload bytes: %d (expected 2 or 3). \033[0;0m",
+                                        payload_length);
+`endif
+                    error_task (`ERROR_INVALID_VOLUME_PAYLOAD);
+                end
+            end
+
+            `CMD_HOST_GET_COUNTER: begin
+                if (payload_length == 5'd0) begin
+`ifdef D_CTRL
+                    $display ($time, "\033[0;36m CTRL:\t---> [STATE_FIFO_CMD] Rd IN: CMD_HOST_GET_COUNTER: %d. \033[0;0m",
+                                        sample_count);
+`endif
+                    rd_in_fifo_en_o <= 1'b0;
+
+                    wr_data_index <= 5'd0;
+                    wr_data[0] <= {`CMD_FPGA_COUNTER, 5'd4};
+                    wr_data[1] <= sample_count[31:24];
+                    wr_data[2] <= sample_count[23:16];
+                    wr_data[3] <= sample_count[15:8];
+                    wr_data[4] <= sample_count[7:0];
+
+                    state_m <= STATE_WR_BUFFER;
+                    next_state_m <= STATE_RD;
+                end else begin
+`ifdef D_CTRL
+                    $display ($time, "\033[0;36m CTRL:\t[ERROR] ---> [STATE_FIFO_CMD] Rd IN: CMD_HOST_GET_COUNTER payload bytes: %d (expected 0). \033[0;0m",
+                                        payload_length);
+`endif
+                    error_task (`ERROR_INVALID_GET_COUNTER_PAYLOAD);
+                end
+            end
         endcase
     endtask
 
@@ -455,47 +773,181 @@ module control (
         (* parallel_case, full_case *)
         case (fifo_cmd)
             `CMD_HOST_SETUP_OUTPUT: begin
+                (* parallel_case, full_case *)
+                case (rd_payload_index)
+                    4'd0: begin
 `ifdef D_CTRL
-                $display ($time, "\033[0;36m CTRL:\t---> [STATE_FIFO_PAYLOAD for CMD_HOST_SETUP_OUTPUT] Rd IN: Type: %2b; sample rate: %3b; bit depth: %2b. \033[0;0m",
-                                    fifo_data[6:5], fifo_data[4:2], fifo_data[1:0]);
+                        $display ($time, "\033[0;36m CTRL:\t---> [STATE_FIFO_PAYLOAD for CMD_HOST_SETUP_OUTPUT] Rd IN: Type: %2b; DSD: %b; sample rate: %3b; bit depth: %2b. \033[0;0m",
+                                            fifo_data[7:6], fifo_data[5], fifo_data[4:2], fifo_data[1:0]);
 `endif
-                // The inputs are mapped to SPDIF or I2S types.
-                (* parallel_case, full_case *)
-                case (fifo_data[7:6])
-                    `OUTPUT_I2S: begin
-                        io_en[IO_TYPE_I2S_BIT] <= 1'b1; io_en[IO_TYPE_SPDIF_BIT] <= 1'b0;
+                        // The inputs are mapped to SPDIF or I2S types.
+                        (* parallel_case, full_case *)
+                        case (fifo_data[7:6])
+                            `OUTPUT_I2S: begin
+                                io_en[IO_TYPE_I2S_BIT] <= 1'b1; io_en[IO_TYPE_SPDIF_BIT] <= 1'b0;
+                                if (fifo_data[5] &&
+                                        (fifo_data[1:0] == `BIT_DEPTH_16 || fifo_data[1:0] == `BIT_DEPTH_32)) begin
+                                    error_task (`ERROR_INVALID_SETUP_STREAM);
+                                end
+                            end
+
+                            `OUTPUT_COAX: begin
+                                io_en[IO_TYPE_I2S_BIT] <= 1'b0; io_en[IO_TYPE_SPDIF_BIT] <= 1'b1;
+                                if (fifo_data[1:0] == `BIT_DEPTH_32 || fifo_data[1:0] == `BIT_DEPTH_DOP ||
+                                        (fifo_data[5] && fifo_data[1:0] == `BIT_DEPTH_16)) begin
+                                    error_task (`ERROR_INVALID_SETUP_STREAM);
+                                end
+                            end
+
+                            `OUTPUT_TOSLINK: begin
+                                io_en[IO_TYPE_I2S_BIT] <= 1'b0; io_en[IO_TYPE_SPDIF_BIT] <= 1'b1;
+                                if (fifo_data[1:0] == `BIT_DEPTH_32 || fifo_data[1:0] == `BIT_DEPTH_DOP ||
+                                        (fifo_data[5] && fifo_data[1:0] == `BIT_DEPTH_16)) begin
+                                    error_task (`ERROR_INVALID_SETUP_STREAM);
+                                end else if (fifo_data[4:2] == `STREAM_352800_HZ || fifo_data[4:2] == `STREAM_384000_HZ) begin
+                                    error_task (`ERROR_INVALID_SAMPLE_RATE);
+                                end
+                            end
+
+                            `OUTPUT_AES3: begin
+                                io_en[IO_TYPE_I2S_BIT] <= 1'b0; io_en[IO_TYPE_SPDIF_BIT] <= 1'b1;
+                                if (fifo_data[1:0] == `BIT_DEPTH_32 || fifo_data[1:0] == `BIT_DEPTH_DOP ||
+                                        (fifo_data[5] && fifo_data[1:0] == `BIT_DEPTH_16)) begin
+                                    error_task (`ERROR_INVALID_SETUP_STREAM);
+                                end
+                            end
+                        endcase
+
+                        sample_rate <= fifo_data[4:2];
+                        // DSD with BIT_DEPTH_24 is encoded to DoP: the transmitters send DoP frames.
+                        bit_depth <= fifo_data[5] ? `BIT_DEPTH_DOP : fifo_data[1:0];
+                        dsd_native <= fifo_data[5] && fifo_data[1:0] == `BIT_DEPTH_DOP;
+                        dop_encode <= fifo_data[5] && fifo_data[1:0] == `BIT_DEPTH_24;
+                        slot_width <= fifo_data[1:0];
                     end
 
-                    `OUTPUT_COAX: begin
-                        io_en[IO_TYPE_I2S_BIT] <= 1'b0; io_en[IO_TYPE_SPDIF_BIT] <= 1'b1;
-                        if (fifo_data[1:0] == `BIT_DEPTH_32 || fifo_data[1:0] == `BIT_DEPTH_DOP) begin
-                            error_task (`ERROR_INVALID_SETUP_STREAM);
+                    4'd1: begin
+`ifdef D_CTRL
+                        $display ($time, "\033[0;36m CTRL:\t---> [STATE_FIFO_PAYLOAD for CMD_HOST_SETUP_OUTPUT] Rd IN: Options: %b. \033[0;0m",
+                                            fifo_data);
+`endif
+                        start_at_option <= |(fifo_data & `SETUP_OPTION_START_AT);
+
+                        if (fifo_data[`SETUP_OPTION_TDM_SHIFT +: 2] != `TDM_OFF) begin
+                            // TDM is for PCM on the I2S port, with slots not narrower than the samples.
+                            if (~io_en[IO_TYPE_I2S_BIT] || bit_depth == `BIT_DEPTH_DOP ||
+                                    fifo_data[`SETUP_OPTION_TDM_SHIFT +: 2] == 2'b11 ||
+                                    (fifo_data[`SETUP_OPTION_SLOT_SHIFT +: 2] != 2'b00 &&
+                                        fifo_data[`SETUP_OPTION_SLOT_SHIFT +: 2] < bit_depth)) begin
+                                error_task (`ERROR_INVALID_SETUP_STREAM);
+                            end else if (i2s_bit_period (fifo_data[`SETUP_OPTION_TDM_SHIFT +: 2],
+                                            fifo_data[`SETUP_OPTION_SLOT_SHIFT +: 2] != 2'b00 ?
+                                                fifo_data[`SETUP_OPTION_SLOT_SHIFT +: 2] : bit_depth,
+                                            bit_depth, 1'b0, sample_rate) < 7'd3) begin
+                                // The bit clock would be faster than 49.152MHz.
+                                error_task (`ERROR_INVALID_SAMPLE_RATE);
+                            end else begin
+                                tdm <= fifo_data[`SETUP_OPTION_TDM_SHIFT +: 2];
+                                if (fifo_data[`SETUP_OPTION_SLOT_SHIFT +: 2] != 2'b00) begin
+                                    slot_width <= fifo_data[`SETUP_OPTION_SLOT_SHIFT +: 2];
+                                end
+                            end
+                        end
+
+                        if (fifo_data[`SETUP_OPTION_LINES_SHIFT +: 2] != `LINES_1) begin
+                            // More lines are for PCM on the I2S port, as many as there are pins for.
+                            if (~io_en[IO_TYPE_I2S_BIT] || bit_depth == `BIT_DEPTH_DOP ||
+                                    fifo_data[`SETUP_OPTION_LINES_SHIFT +: 2] == 2'b11 ||
+                                    (3'd1 << fifo_data[`SETUP_OPTION_LINES_SHIFT +: 2]) > `I2S_DATA_LINES) begin
+                                error_task (`ERROR_INVALID_SETUP_STREAM);
+                            end else begin
+                                lines <= fifo_data[`SETUP_OPTION_LINES_SHIFT +: 2];
+                            end
+                        end
+
+                        if (|(fifo_data & `SETUP_OPTION_OVERSAMPLE)) begin
+                            // Stereo PCM from the base rate of the family.
+                            if (bit_depth == `BIT_DEPTH_DOP || fifo_data[`SETUP_OPTION_TDM_SHIFT +: 2] != `TDM_OFF ||
+                                    fifo_data[`SETUP_OPTION_LINES_SHIFT +: 2] != `LINES_1 ||
+                                    sample_rate[1:0] == 2'd0) begin
+                                error_task (`ERROR_INVALID_SETUP_STREAM);
+                            end else begin
+                                oversampling <= sample_rate[1:0];
+                            end
                         end
                     end
 
-                    `OUTPUT_TOSLINK: begin
-                        io_en[IO_TYPE_I2S_BIT] <= 1'b0; io_en[IO_TYPE_SPDIF_BIT] <= 1'b1;
-                        if (fifo_data[1:0] == `BIT_DEPTH_32 || fifo_data[1:0] == `BIT_DEPTH_DOP) begin
+                    4'd2: start_at[31:24] <= fifo_data;
+                    4'd3: start_at[23:16] <= fifo_data;
+                    4'd4: start_at[15:8] <= fifo_data;
+
+                    4'd5: begin
+                        start_at[7:0] <= fifo_data;
+                        // start_at is stable before the sample counter sees the arm bit.
+                        start_armed <= start_at_option;
+`ifdef D_CTRL
+                        $display ($time, "\033[0;36m CTRL:\t---> [STATE_FIFO_PAYLOAD for CMD_HOST_SETUP_OUTPUT] Start at: %d (armed: %b). \033[0;0m",
+                                            {start_at[31:8], fifo_data}, start_at_option);
+`endif
+                    end
+
+                    4'd6: asrc_rate_msb[15:8] <= fifo_data;
+                    4'd7: asrc_rate_msb[7:0] <= fifo_data;
+
+                    4'd8: begin
+`ifdef D_CTRL
+                        $display ($time, "\033[0;36m CTRL:\t---> [STATE_FIFO_PAYLOAD for CMD_HOST_SETUP_OUTPUT] Stream rate: %d Hz. \033[0;0m",
+                                            {asrc_rate_msb, fifo_data});
+`endif
+                        // Stereo PCM from 8KHz up to the sample rate, converted unless it is the sample rate.
+                        if (bit_depth == `BIT_DEPTH_DOP || tdm != `TDM_OFF || lines != `LINES_1 ||
+                                oversampling != 2'd0) begin
                             error_task (`ERROR_INVALID_SETUP_STREAM);
-                        end else if (fifo_data[4:2] == `STREAM_352800_HZ || fifo_data[4:2] == `STREAM_384000_HZ) begin
+                        end else if ({asrc_rate_msb, fifo_data} < 24'd8000 ||
+                                        {asrc_rate_msb, fifo_data} > {5'd0, sample_rate_hz (sample_rate)}) begin
                             error_task (`ERROR_INVALID_SAMPLE_RATE);
+                        end else if ({asrc_rate_msb, fifo_data} != {5'd0, sample_rate_hz (sample_rate)}) begin
+                            asrc_rate <= {asrc_rate_msb[10:0], fifo_data};
                         end
                     end
 
-                    `OUTPUT_AES3: begin
-                        io_en[IO_TYPE_I2S_BIT] <= 1'b0; io_en[IO_TYPE_SPDIF_BIT] <= 1'b1;
-                        if (fifo_data[1:0] == `BIT_DEPTH_32 || fifo_data[1:0] == `BIT_DEPTH_DOP) begin
-                            error_task (`ERROR_INVALID_SETUP_STREAM);
-                        end
+                    default: begin
                     end
                 endcase
+            end
 
-                sample_rate <= fifo_data[4:2];
-                bit_depth <= fifo_data[1:0];
+            `CMD_HOST_SETUP_INPUT: begin
+`ifdef D_CTRL
+                $display ($time, "\033[0;36m CTRL:\t---> [STATE_FIFO_PAYLOAD for CMD_HOST_SETUP_INPUT] Rd IN: Type: %2b; sample rate: %3b; bit depth: %2b. \033[0;0m",
+                                    fifo_data[7:6], fifo_data[4:2], fifo_data[1:0]);
+`endif
+                if (fifo_data[7:6] == `OUTPUT_I2S) begin
+                    // The I2S input shares the clocks of the I2S output: same sample rate and bit depth.
+                    if (~io_en[IO_TYPE_I2S_BIT] || fifo_data[4:2] != sample_rate || fifo_data[1:0] != bit_depth ||
+                            fifo_data[1:0] == `BIT_DEPTH_DOP || tdm != `TDM_OFF) begin
+                        error_task (`ERROR_INVALID_SETUP_STREAM);
+                    end else begin
+                        input_i2s <= 1'b1;
+                        input_sample_rate <= fifo_data[4:2];
+                        input_bit_depth <= fifo_data[1:0];
+                        input_en <= 1'b1;
+                    end
+                end else if (fifo_data[1:0] == `BIT_DEPTH_32 || fifo_data[1:0] == `BIT_DEPTH_DOP) begin
+                    error_task (`ERROR_INVALID_SETUP_STREAM);
+                end else if (fifo_data[4:2] == `STREAM_352800_HZ || fifo_data[4:2] == `STREAM_384000_HZ) begin
+                    error_task (`ERROR_INVALID_SAMPLE_RATE);
+                end else begin
+                    input_i2s <= 1'b0;
+                    input_sample_rate <= fifo_data[4:2];
+                    input_bit_depth <= fifo_data[1:0];
+                    input_en <= 1'b1;
+                end
             end
 
             `CMD_HOST_STREAM_OUTPUT: begin
-                if (~is_wr_output_FIFO_full) begin
+                if (flush_pending) begin
+                    // Audio which would be flushed once played: dropped.
+                end else if (~is_wr_output_FIFO_full) begin
 `ifdef D_CTRL
                     $display ($time, "\033[0;36m CTRL:\t---> [STATE_FIFO_PAYLOAD for CMD_HOST_STREAM_OUTPUT] Rd IN: %d. \033[0;0m",
                                     fifo_data);
@@ -505,10 +957,41 @@ module control (
                 end
             end
 
-            `CMD_HOST_STOP: begin
+            `CMD_HOST_STOP, `CMD_HOST_FLUSH, `CMD_HOST_GET_COUNTER: begin
                 // Does not have a payload.
             end
 
+            `CMD_HOST_PAUSE: begin
+`ifdef D_CTRL
+                $display ($time, "\033[0;36m CTRL:\t---> [STATE_FIFO_PAYLOAD for CMD_HOST_PAUSE] Rd IN: %d. \033[0;0m",
+                                    fifo_data);
+`endif
+                (* parallel_case, full_case *)
+                case (fifo_data)
+                    `RESUME_OUTPUT: pause_output <= 1'b0;
+                    `PAUSE_OUTPUT: pause_output <= 1'b1;
+                    default: error_task (`ERROR_INVALID_PAUSE_PAYLOAD);
+                endcase
+            end
+
+            `CMD_HOST_SET_VOLUME: begin
+`ifdef D_CTRL
+                $display ($time, "\033[0;36m CTRL:\t---> [STATE_FIFO_PAYLOAD for CMD_HOST_SET_VOLUME] Rd IN: %d. \033[0;0m",
+                                    fifo_data);
+`endif
+                (* parallel_case, full_case *)
+                case (rd_payload_index)
+                    4'd0: gain_msb <= fifo_data;
+                    4'd1: gain <= {gain_msb, fifo_data};
+                    4'd2: begin
+                        dither <= |(fifo_data & `VOLUME_DITHER);
+                        noise_shaping <= |(fifo_data & `VOLUME_NOISE_SHAPING);
+                    end
+                    default: begin
+                    end
+                endcase
+            end
+
             default: begin
                 error_task (`ERROR_INVALID_PAYLOAD_CMD);
             end
@@ -530,6 +1013,77 @@ module control (
         next_state_m <= STATE_RD;
     endtask
 
+    //==================================================================================================================
+    // Playback position report task.
+    //==================================================================================================================
+    task position_task;
+`ifdef D_CTRL
+        $display ($time, "\033[0;36m CTRL:\t<--- Position: I2S: %d, SPDIF: %d. \033[0;0m", frames_i2s, frames_spdif);
+`endif
+        wr_data_index <= 5'd0;
+        wr_data[0] <= {`CMD_FPGA_POSITION, 5'd8};
+        wr_data[1] <= frames_i2s[31:24];
+        wr_data[2] <= frames_i2s[23:16];
+        wr_data[3] <= frames_i2s[15:8];
+        wr_data[4] <= frames_i2s[7:0];
+        wr_data[5] <= frames_spdif[31:24];
+        wr_data[6] <= frames_spdif[23:16];
+        wr_data[7] <= frames_spdif[15:8];
+        wr_data[8] <= frames_spdif[7:0];
+
+        state_m <= STATE_WR_BUFFER;
+        next_state_m <= STATE_RD;
+    endtask
+
+    //==================================================================================================================
+    // The captured input frame task. The frame is read on the clock on which the FIFO read enable is high.
+    //==================================================================================================================
+    task input_frame_task;
+`ifdef D_CTRL_FINE
+        $display ($time, "\033[0;36m CTRL:\t<--- Input frame: %h %h. \033[0;0m", rd_input_FIFO_data[63:32],
+                            rd_input_FIFO_data[31:0]);
+`endif
+        rd_input_FIFO_en <= 1'b0;
+
+        // The most significant bytes of the left justified samples, little endian.
+        wr_data_index <= 5'd0;
+        (* parallel_case, full_case *)
+        case (input_bit_depth)
+            `BIT_DEPTH_16: begin
+                wr_data[0] <= {`CMD_FPGA_INPUT, 5'd4};
+                wr_data[1] <= rd_input_FIFO_data[55:48];
+                wr_data[2] <= rd_input_FIFO_data[63:56];
+                wr_data[3] <= rd_input_FIFO_data[23:16];
+                wr_data[4] <= rd_input_FIFO_data[31:24];
+            end
+
+            `BIT_DEPTH_24, `BIT_DEPTH_DOP: begin
+                wr_data[0] <= {`CMD_FPGA_INPUT, 5'd6};
+                wr_data[1] <= rd_input_FIFO_data[47:40];
+                wr_data[2] <= rd_input_FIFO_data[55:48];
+                wr_data[3] <= rd_input_FIFO_data[63:56];
+                wr_data[4] <= rd_input_FIFO_data[15:8];
+                wr_data[5] <= rd_input_FIFO_data[23:16];
+                wr_data[6] <= rd_input_FIFO_data[31:24];
+            end
+
+            `BIT_DEPTH_32: begin
+                wr_data[0] <= {`CMD_FPGA_INPUT, 5'd8};
+                wr_data[1] <= rd_input_FIFO_data[39:32];
+                wr_data[2] <= rd_input_FIFO_data[47:40];
+                wr_data[3] <= rd_input_FIFO_data[55:48];
+                wr_data[4] <= rd_input_FIFO_data[63:56];
+                wr_data[5] <= rd_input_FIFO_data[7:0];
+                wr_data[6] <= rd_input_FIFO_data[15:8];
+                wr_data[7] <= rd_input_FIFO_data[23:16];
+                wr_data[8] <= rd_input_FIFO_data[31:24];
+            end
+        endcase
+
+        // next_state_m was set when the read started.
+        state_m <= STATE_WR_BUFFER;
+    endtask
+
     //==================================================================================================================
     // The error handler.
     //==================================================================================================================
@@ -582,6 +1136,7 @@ module control (
                 handle_cmd_task (fifo_data[7:5], fifo_data[4:0]);
 
                 last_fifo_cmd <= fifo_data[7:5];
+                rd_payload_index <= 4'd0;
                 if (fifo_data[4]) begin
                     fifo_state_m <= STATE_FIFO_PAYLOAD_LENGTH_1;
                 end else if (fifo_data[3:0] > 4'd0) begin
@@ -607,6 +1162,7 @@ module control (
             STATE_FIFO_PAYLOAD: begin
                 handle_payload_task (last_fifo_cmd, fifo_data);
 
+                rd_payload_index <= rd_payload_index + 4'd1;
                 rd_payload_bytes <= rd_payload_bytes - 16'd1;
                 if (rd_payload_bytes == 16'd1) begin
                     fifo_state_m <= STATE_FIFO_CMD;
@@ -627,8 +1183,26 @@ module control (
             wr_out_fifo_en_o <= 1'b0;
 
             io_en <= 2'b00;
+            input_en <= 1'b0;
+            input_i2s <= 1'b0;
+            rd_input_FIFO_en <= 1'b0;
             wr_output_en <= 1'b0;
+            dop_encode <= 1'b0;
+            tdm <= `TDM_OFF;
+            lines <= `LINES_1;
+            oversampling <= 2'd0;
+            asrc_rate <= 19'd0;
             have_saved_rd_data <= 1'b0;
+            flush_output <= 1'b0;
+            in_fifo_flushes_parsed <= 2'd0;
+            pause_output <= 1'b0;
+            gain <= `GAIN_UNITY;
+            dither <= 1'b0;
+            noise_shaping <= 1'b0;
+            start_at_option <= 1'b0;
+            start_armed <= 1'b0;
+            report_position_clocks <= 25'd0;
+            report_position <= 1'b0;
 
             state_m <= STATE_RD;
             fifo_state_m <= STATE_FIFO_CMD;
@@ -636,6 +1210,11 @@ module control (
         end else begin
             wr_output_en <= 1'b0;
 
+            report_position_clocks <= report_position_clocks + 25'd1;
+            if (&report_position_clocks) begin
+                report_position <= 1'b1;
+            end
+
             (* parallel_case, full_case *)
             case (state_m)
                 STATE_IDLE: begin
@@ -651,8 +1230,19 @@ module control (
                 end
 
                 STATE_RD: begin
-                    if (have_saved_rd_data) begin
-                        if (~is_wr_output_FIFO_full) begin
+                    if (report_position && ~rd_in_fifo_en_o) begin
+                        // Only between FIFO reads so that no byte that was read is lost.
+                        report_position <= 1'b0;
+                        if (output_streaming) begin
+                            position_task;
+                        end
+                    end else if (~rd_input_FIFO_empty && ~rd_in_fifo_en_o) begin
+                        // Forward a captured frame (also only between FIFO reads).
+                        rd_input_FIFO_en <= 1'b1;
+                        next_state_m <= STATE_RD;
+                        state_m <= STATE_RD_INPUT;
+                    end else if (have_saved_rd_data) begin
+                        if (can_process_rd_data) begin
 `ifdef D_CTRL_FINE
                             $display ($time, "\033[0;36m CTRL:\t[STATE_RD] Wr saved: %d. \033[0;0m", saved_rd_data);
 `endif
@@ -660,7 +1250,7 @@ module control (
                             have_saved_rd_data <= 1'b0;
                         end
                     end else if (~rd_in_fifo_empty_i) begin
-                        if (~is_wr_output_FIFO_full) begin
+                        if (can_process_rd_data) begin
                             if (rd_in_fifo_en_o) begin
                                 rd_in_fifo_en_o <= 1'b0;
                                 read_data_task (rd_in_fifo_data_i);
@@ -690,13 +1280,39 @@ module control (
                 STATE_WAIT_OUTPUT_TO_STOP: begin
                     if (~output_streaming) begin
                         io_en <= 2'b00;
+                        start_armed <= 1'b0;
                         stopped_task;
+                    end else if (~rd_input_FIFO_empty) begin
+                        // Keep forwarding the captured frames while the output drains.
+                        rd_input_FIFO_en <= 1'b1;
+                        next_state_m <= STATE_WAIT_OUTPUT_TO_STOP;
+                        state_m <= STATE_RD_INPUT;
+                    end
+                end
+
+                STATE_FLUSH_OUTPUT: begin
+                    // Keep the transmitters in reset long enough for both FIFO clock domains to see it.
+                    flush_output_clocks <= flush_output_clocks - 3'd1;
+                    if (flush_output_clocks == 3'd1) begin
+`ifdef D_CTRL
+                        $display ($time, "\033[0;36m CTRL:\t==== OUTPUT FLUSHED ====. \033[0;0m");
+`endif
+                        flush_output <= 1'b0;
+                        state_m <= STATE_RD;
                     end
                 end
 
+                STATE_RD_INPUT: begin
+                    input_frame_task;
+                end
+
                 STATE_WR_BUFFER: begin
                     write_buffer_task;
                 end
+
+                default: begin
+                    // Impossible case
+                end
             endcase
         end
     end
@@ -16,41 +16,170 @@
  **********************************************************************************************************************/
 
 /***********************************************************************************************************************
- * This module implements the clock divider for 24.576MHz and 22.5972MHz down to 48KHz, 96KHz, 192KHz, 384KHz and
- * 44.1KHz, 88.2KHz, 176.4KHz and 352.8KHz respectively.
+ * This module implements the rate generation of the transmitters. The transmitters run on the master clock of a clock
+ * family (3072 x 48KHz or 3072 x 44.1KHz) and advance on clock enable strobes generated by counters, so the bit clock
+ * and symbol rates are switched by changing a count instead of a clock.
  **********************************************************************************************************************/
 `timescale 1ps/1ps
 `default_nettype none
 
 //==================================================================================================================
-// Devide a clock by 2.
+// Clock enable strobe: en_o is set for one clock every period_i clocks. A new period is applied after the current one.
 //==================================================================================================================
-module divide_by_2(input wire reset_i, input wire clk_i, output logic clk_o);
+module clock_enable #(parameter WIDTH = 6)(
+    input wire reset_i,
+    input wire clk_i,
+    input wire [WIDTH-1:0] period_i,
+    output logic en_o);
+
+    logic [WIDTH-1:0] count;
+
     always @(posedge clk_i, posedge reset_i) begin
-        if (reset_i) clk_o <= 1'b0;
-        else clk_o <= ~clk_o;
+        if (reset_i) begin
+            count <= {WIDTH{1'b0}};
+            en_o <= 1'b0;
+        end else if (count == {WIDTH{1'b0}}) begin
+            count <= period_i - 1'b1;
+            en_o <= 1'b1;
+        end else begin
+            count <= count - 1'b1;
+            en_o <= 1'b0;
+        end
     end
 endmodule
 
 //==================================================================================================================
-// Divide by 8 the input clock
+// Bit clock edge strobes: en_o is set twice every period_i clocks, ceil(period_i / 2) then floor(period_i / 2) clocks
+// apart, so that a bit clock period can be an odd number of clocks (from 3). A new period is applied after the current
+// one.
 //==================================================================================================================
-module divide_by_8(input wire reset_i, input wire clk_i, output logic clk_o);
-    logic clk_out_1, clk_out_2;
+module bit_clock_enable #(parameter WIDTH = 7)(
+    input wire reset_i,
+    input wire clk_i,
+    input wire [WIDTH-1:0] period_i,
+    output logic en_o);
+
+    logic [WIDTH-1:0] count;
+    logic second_half;
 
-    divide_by_2 divide_by_2_1_m (.reset_i(reset_i), .clk_i(clk_i), .clk_o(clk_out_1));
-    divide_by_2 divide_by_2_2_m (.reset_i(reset_i), .clk_i(clk_out_1), .clk_o(clk_out_2));
-    divide_by_2 divide_by_2_3_m (.reset_i(reset_i), .clk_i(clk_out_2), .clk_o(clk_o));
+    always @(posedge clk_i, posedge reset_i) begin
+        if (reset_i) begin
+            count <= {WIDTH{1'b0}};
+            second_half <= 1'b0;
+            en_o <= 1'b0;
+        end else if (count == {WIDTH{1'b0}}) begin
+            count <= (second_half ? period_i >> 1 : period_i - (period_i >> 1)) - 1'b1;
+            second_half <= ~second_half;
+            en_o <= 1'b1;
+        end else begin
+            count <= count - 1'b1;
+            en_o <= 1'b0;
+        end
+    end
 endmodule
 
 //==================================================================================================================
-// Divide by 16 the input clock
+// Glitch-free selection of one of two unrelated clocks. The selected clock is enabled only after the other one was
+// disabled, so clk_o never has a short pulse when sel_i changes. On the FPGA this is the dynamic clock select of the
+// primary clock network (DCSC, positive edge mode) so that clk_o stays on the global clock routing; SEL1 selects
+// clk_1_i and SEL0 clk_0_i. The simulation model enables the selected clock on its falling edge.
 //==================================================================================================================
-module divide_by_16(input wire reset_i, input wire clk_i, output logic clk_o);
-    logic clk_out_1, clk_out_2, clk_out_3;
+module clock_select(
+    input wire reset_i,
+    input wire sel_i,
+    input wire clk_0_i,
+    input wire clk_1_i,
+    output logic clk_o);
+
+`ifdef SIMULATION
+    logic en_0, en_0_meta, en_1, en_1_meta;
 
-    divide_by_2 divide_by_2_1_m (.reset_i(reset_i), .clk_i(clk_i), .clk_o(clk_out_1));
-    divide_by_2 divide_by_2_2_m (.reset_i(reset_i), .clk_i(clk_out_1), .clk_o(clk_out_2));
-    divide_by_2 divide_by_2_3_m (.reset_i(reset_i), .clk_i(clk_out_2), .clk_o(clk_out_3));
-    divide_by_2 divide_by_2_4_m (.reset_i(reset_i), .clk_i(clk_out_3), .clk_o(clk_o));
+    always @(negedge clk_0_i, posedge reset_i) begin
+        if (reset_i) begin
+            en_0_meta <= 1'b0;
+            en_0 <= 1'b0;
+        end else begin
+            en_0_meta <= ~sel_i && ~en_1;
+            en_0 <= en_0_meta;
+        end
+    end
+
+    always @(negedge clk_1_i, posedge reset_i) begin
+        if (reset_i) begin
+            en_1_meta <= 1'b0;
+            en_1 <= 1'b0;
+        end else begin
+            en_1_meta <= sel_i && ~en_0;
+            en_1 <= en_1_meta;
+        end
+    end
+
+    assign clk_o = (clk_0_i && en_0) || (clk_1_i && en_1);
+`else
+    DCSC #(.DCSMODE("POS")) dcsc_m (
+        .CLK0               (clk_0_i),
+        .CLK1               (clk_1_i),
+        .SEL0               (~sel_i),
+        .SEL1               (sel_i),
+        .MODESEL            (1'b0),
+        .DCSOUT             (clk_o));
+`endif
+endmodule
+
+//==================================================================================================================
+// Clock output: clk_o is clk_i divided by 2^div_i (0 to 3) while en_i is set and low otherwise. It leaves the FPGA
+// from an output DDR register (ODDRX1F, which must drive the pin directly) clocked by clk_i: D0 is sent while clk_i is
+// high and D1 while it is low, so clk_i itself is sent as 1 then 0 and a divided clock as the same value twice. en_i
+// (synchronized here) and div_i are taken at the end of an output period so that clk_o never has a short pulse.
+//==================================================================================================================
+module clock_output(
+    input wire reset_i,
+    input wire clk_i,
+    input wire en_i,
+    input wire [1:0] div_i,
+    output logic clk_o);
+
+    logic en_meta;
+    DFF_META en_meta_m (reset_i, en_i, clk_i, en_meta);
+
+    logic run, d0, d1;
+    logic [1:0] div;
+    logic [2:0] count;
+    always @(posedge clk_i, posedge reset_i) begin
+        if (reset_i) begin
+            run <= 1'b0;
+            div <= 2'd0;
+            count <= 3'd0;
+            d0 <= 1'b0;
+            d1 <= 1'b0;
+        end else begin
+            if (count == (3'd7 >> (2'd3 - div))) begin
+                count <= 3'd0;
+                run <= en_meta;
+                div <= div_i;
+            end else begin
+                count <= count + 3'd1;
+            end
+
+            // High for the first half of the output period.
+            d0 <= run && (div == 2'd0 || ~count[div - 2'd1]);
+            d1 <= run && div != 2'd0 && ~count[div - 2'd1];
+        end
+    end
+
+`ifdef SIMULATION
+    logic q0, q1;
+    always @(posedge clk_i) begin
+        q0 <= d0;
+        q1 <= d1;
+    end
+    assign clk_o = clk_i ? q0 : q1;
+`else
+    ODDRX1F oddr_m (
+        .D0                 (d0),
+        .D1                 (d1),
+        .SCLK               (clk_i),
+        .RST                (reset_i),
+        .Q                  (clk_o));
+`endif
 endmodule
@@ -6,16 +6,25 @@
 helpFunction()
 {
     echo ""
-    echo "Usage: $0 [-a <FIFO address bits>] -e -h"
-    echo "    -a: Async FIFO address bits. Default is 5 (32 bytes FIFO)."
+    echo "Usage: $0 [-a <FIFO address bits>] [-r \"<FIFO address bits list>\"] [-D <flag>] -e -h"
+    echo "    -a: Async FIFO address bits. Default is 5 (32 bytes FIFO). Above 6 the FIFOs use block RAM."
+    echo "        The OUT FIFO is capped at 12 (4KB): above 12 only the IN FIFO grows."
+    echo "        Native DSD512 (5.6MB/s) needs the 64KB IN FIFO (16): 11.6ms of audio against USB scheduling gaps."
+    echo "    -r: Report the utilisation and fmax for each FIFO size in the list (e.g. -r \"5 10 14 15 16\"). The"
+    echo "        bitstream is not built. With the OUT FIFO capped at 12, -r \"14 15 16\" compares IN FIFO sizes"
+    echo "        only."
+    echo "    -D: Build flag (e.g. -r 5 -D CONTROL_CLK_24576000 reports the control module on the 24.576MHz clock; the"
+    echo "        default build reports it against the 117.9648MHz constraint nextpnr derives from the PLL)."
     echo "    -e: Enable extension."
     echo "    -h: Help."
     exit 1
 }
 
-while getopts 'a:eh' opt; do
+while getopts 'a:r:D:eh' opt; do
     case "$opt" in
         a ) OPTIONS="$OPTIONS -D FIFO_ADDR_BITS=${OPTARG}" ;;
+        r ) REPORT_ASIZES="${OPTARG}" ;;
+        D ) OPTIONS="$OPTIONS -D ${OPTARG}" ;;
         e ) OPTIONS="$OPTIONS -D EXT_A_ENABLED" ;;
         h ) helpFunction ;;
         ? ) helpFunction ;; # Print helpFunction in case parameter is non-existent
@@ -32,6 +41,26 @@ if [ -d "$BIN_PATH" ] && [[ ! $PATH =~ (^|:)$BIN_PATH(:|$) ]]; then
     PATH+=:$BIN_PATH
 fi
 
+SOURCES="utils.sv pll_22579200.v pll_24576000.v async_fifo.sv divider.sv sample_counter.sv ft2232_fifo.sv serializer.sv volume.sv \
+            asrc.sv oversampler.sv control.sv tx_i2s.sv tx_spdif.sv rx_spdif.sv rx_i2s.sv audio.sv"
+SPEED="6"
+LPF_FILE="audio_tx_rev_A.lpf"
+
+if [ -n "$REPORT_ASIZES" ]; then
+    # Synthesize and place and route for each FIFO size and print the utilisation and the max frequencies.
+    for ASIZE in $REPORT_ASIZES; do
+        echo "==================== FIFO address bits: $ASIZE ($((1 << ASIZE)) bytes) ===================="
+        yosys -q -p "synth_ecp5 -noabc9 -json out_report.json" $OPTIONS -D FIFO_ADDR_BITS=$ASIZE $SOURCES
+        if [ $? -eq 0 ]; then
+            nextpnr-ecp5 --package CABGA381 --25k --speed $SPEED --json out_report.json --lpf $LPF_FILE \
+                        --log out_report.log > /dev/null 2>&1
+            sed -n '/Device utilisation/,/^Info: *$/p' out_report.log | grep -E "TRELLIS_SLICE|TRELLIS_FF|DP16KD"
+            grep "Max frequency for clock" out_report.log | tail -n 8
+        fi
+    done
+    exit 0
+fi
+
 if test -f "out.bit"; then
     rm out.bit
 fi
@@ -44,10 +73,7 @@ if test -f "out.json"; then
     rm out.json
 fi
 
-yosys -p "synth_ecp5 -noabc9 -json out.json" $OPTIONS utils.sv pll_22579200.v pll_24576000.v async_fifo.sv divider.sv ft2232_fifo.sv control.sv tx_i2s.sv tx_spdif.sv audio.sv
-
-SPEED="6"
-LPF_FILE="audio_tx_rev_A.lpf"
+yosys -p "synth_ecp5 -noabc9 -json out.json" $OPTIONS $SOURCES
 
 if [ $? -eq 0 ]; then
     nextpnr-ecp5 --package CABGA381 --25k --speed $SPEED --json out.json --lpf $LPF_FILE --textcfg out.cfg
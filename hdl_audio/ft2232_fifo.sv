@@ -17,11 +17,17 @@
 
 /***********************************************************************************************************************
  * This module implements the FT2232 synchronous FIFO interface. Data received from the FT2232 is written to the
- * asynchronous IN FIFO and data from the asynchronous OUT FIFO is written to the FT2232.
+ * asynchronous IN FIFO and data from the asynchronous OUT FIFO is written to the FT2232. The bytes read from the FT2232
+ * go through a small skid FIFO which is written to the IN FIFO until it is full: a byte taken from the FT2232 after the
+ * IN FIFO became full waits in the skid FIFO and reads stop only when the skid FIFO is full.
+ * The packets written to the IN FIFO are followed so that a CMD_HOST_FLUSH is known to control as soon as it enters the
+ * IN FIFO: control then drops the audio queued ahead of it instead of waiting for the transmitters to play it.
  **********************************************************************************************************************/
 `timescale 1ps/1ps
 `default_nettype none
 
+`include "definitions.svh"
+
 module ft2232_fifo (
     input logic reset_i,
     // FT2232HQ FIFO
@@ -39,7 +45,8 @@ module ft2232_fifo (
     output logic wr_in_fifo_en_o,
     output logic [7:0] wr_in_fifo_data_o,
     input logic wr_in_fifo_full_i,
-    input logic wr_in_fifo_afull_i,
+    // The CMD_HOST_FLUSH commands written to the IN FIFO (gray code)
+    output logic [1:0] in_fifo_flushes_gray_o,
     // Output FIFO ports
     output logic rd_out_fifo_clk_o,
     output logic rd_out_fifo_en_o,
@@ -52,8 +59,98 @@ module ft2232_fifo (
     assign wr_in_fifo_clk_o = fifo_clk_i;
     assign rd_out_fifo_clk_o = fifo_clk_i;
 
+    //==================================================================================================================
+    // The skid FIFO between the FT2232 reads and the IN FIFO.
+    //==================================================================================================================
+    localparam SKID_DEPTH = 4;
+    logic [7:0] skid_data [0:SKID_DEPTH-1];
+    logic [1:0] skid_head, skid_tail;
+    logic [2:0] skid_count;
+    logic skid_push;
+
+    // Drain to the IN FIFO on every clock until it is full.
+    assign wr_in_fifo_en_o = skid_count != 3'd0 && ~wr_in_fifo_full_i;
+    assign wr_in_fifo_data_o = skid_data[skid_head];
+
+    always @(posedge fifo_clk_i, posedge reset_i) begin
+        if (reset_i) begin
+            skid_head <= 2'd0;
+            skid_tail <= 2'd0;
+            skid_count <= 3'd0;
+        end else begin
+            if (skid_push) skid_tail <= skid_tail + 1'b1;
+            if (wr_in_fifo_en_o) skid_head <= skid_head + 1'b1;
+            skid_count <= skid_count + skid_push - wr_in_fifo_en_o;
+        end
+    end
+
+    always @(posedge fifo_clk_i) begin
+        if (skid_push) begin
+            skid_data[skid_tail] <= fifo_data_i;
+        end
+    end
+
+    //==================================================================================================================
+    // The packets written to the IN FIFO, framed as control parses them: a command byte, then two length bytes (big
+    // endian) when bit 4 is set or the length in bits 3:0, then the payload.
+    //==================================================================================================================
+    localparam FRAME_CMD        = 2'd0;
+    localparam FRAME_LENGTH_1   = 2'd1;
+    localparam FRAME_LENGTH_2   = 2'd2;
+    localparam FRAME_PAYLOAD    = 2'd3;
+    logic [1:0] frame_state_m;
+    logic [15:0] frame_bytes;
+    logic [1:0] in_fifo_flushes;
+
+    always @(posedge fifo_clk_i, posedge reset_i) begin
+        if (reset_i) begin
+            frame_state_m <= FRAME_CMD;
+            frame_bytes <= 16'd0;
+            in_fifo_flushes <= 2'd0;
+            in_fifo_flushes_gray_o <= 2'd0;
+        end else begin
+            in_fifo_flushes_gray_o <= in_fifo_flushes ^ (in_fifo_flushes >> 1);
+
+            if (wr_in_fifo_en_o) begin
+                (* parallel_case, full_case *)
+                case (frame_state_m)
+                    FRAME_CMD: begin
+                        if (wr_in_fifo_data_o == {`CMD_HOST_FLUSH, 5'd0}) begin
+                            in_fifo_flushes <= in_fifo_flushes + 2'd1;
+                        end
+
+                        if (wr_in_fifo_data_o[4]) begin
+                            frame_state_m <= FRAME_LENGTH_1;
+                        end else if (wr_in_fifo_data_o[3:0] != 4'd0) begin
+                            frame_bytes <= {12'd0, wr_in_fifo_data_o[3:0]};
+                            frame_state_m <= FRAME_PAYLOAD;
+                        end
+                    end
+
+                    FRAME_LENGTH_1: begin
+                        frame_bytes[15:8] <= wr_in_fifo_data_o;
+                        frame_state_m <= FRAME_LENGTH_2;
+                    end
+
+                    FRAME_LENGTH_2: begin
+                        frame_bytes[7:0] <= wr_in_fifo_data_o;
+                        frame_state_m <= FRAME_PAYLOAD;
+                    end
+
+                    FRAME_PAYLOAD: begin
+                        frame_bytes <= frame_bytes - 16'd1;
+                        if (frame_bytes == 16'd1) begin
+                            frame_state_m <= FRAME_CMD;
+                        end
+                    end
+                endcase
+            end
+        end
+    end
+
+    // A read is started only when the skid FIFO has room for the byte: the count cannot grow until that byte arrives.
     logic can_read_from_ft2232_fifo, can_write_to_ft2232_fifo;
-    assign can_read_from_ft2232_fifo = ~fifo_rxf_n_i && (~wr_in_fifo_full_i && ~wr_in_fifo_afull_i);
+    assign can_read_from_ft2232_fifo = ~fifo_rxf_n_i && skid_count != SKID_DEPTH;
     assign can_write_to_ft2232_fifo = ~fifo_txe_n_i && ~rd_out_fifo_empty_i;
 
     // Input/output 8-bit data bus
@@ -65,14 +162,13 @@ module ft2232_fifo (
     localparam STATE_RD_IDLE            = 3'd0;
     localparam STATE_RD_DATA            = 3'd1;
     localparam STATE_RD_TURNAROUND      = 3'd2;
-    localparam STATE_RD_FLUSH_SAVED_DATA= 3'd3;
     localparam STATE_WR_IDLE            = 3'd4;
     localparam STATE_WR_DATA            = 3'd5;
     localparam STATE_WR_FLUSH_SAVED_DATA= 3'd6;
     logic [2:0] state_m;
 
-    logic [7:0] saved_rd_data;
-    logic have_saved_rd_data;
+    // The byte on the bus is taken when RD# is driven low.
+    assign skid_push = state_m == STATE_RD_DATA && ~fifo_rxf_n_i;
 
     logic [7:0] saved_wr_data;
     logic have_saved_wr_data;
@@ -92,16 +188,13 @@ module ft2232_fifo (
             fifo_wr_n_o <= 1'b1;
             fifo_rd_n_o <= 1'b1;
 
-            wr_in_fifo_en_o <= 1'b0;
             rd_out_fifo_en_o <= 1'b0;
 
-            have_saved_rd_data <= 1'b0;
             have_saved_wr_data <= 1'b0;
         end else begin
             case (state_m)
                 STATE_RD_IDLE: begin
                     // Enter this state machine with fifo_oe_n_o = 1'b0.
-                    wr_in_fifo_en_o <= 1'b0;
                     fifo_rd_n_o <= 1'b1;
 
                     // Check if there is data to write first
@@ -120,41 +213,16 @@ module ft2232_fifo (
                         rd_out_fifo_en_o <= 1'b1;
 
                         state_m <= STATE_WR_DATA;
-                    end else if (have_saved_rd_data) begin
-                        // If there is saved data write it to the IN FIFO.
-                        state_m <= STATE_RD_FLUSH_SAVED_DATA;
                     end else if (can_read_from_ft2232_fifo) begin
 `ifdef D_FT_FIFO_FINE
-                        $display ($time, " FT_FIFO:\t[STATE_RD_IDLE -> STATE_RD_DATA] (IN afull: %d, full: %d).",
-                                            wr_in_fifo_afull_i, wr_in_fifo_full_i);
+                        $display ($time, " FT_FIFO:\t[STATE_RD_IDLE -> STATE_RD_DATA] (skid: %d, IN full: %d).",
+                                            skid_count, wr_in_fifo_full_i);
 `endif
                         // Do another read
                         state_m <= STATE_RD_DATA;
                     end
                 end
 
-                STATE_RD_FLUSH_SAVED_DATA: begin
-                    if (~wr_in_fifo_afull_i && ~wr_in_fifo_full_i) begin
-                        if (have_saved_rd_data) begin
-                            have_saved_rd_data <= 1'b0;
-
-                            // Write the data to the input FIFO.
-                            wr_in_fifo_en_o <= 1'b1;
-                            wr_in_fifo_data_o <= saved_rd_data;
-`ifdef D_FT_FIFO
-                            $display ($time, " FT_FIFO:\t---> [STATE_RD_FLUSH_SAVED_DATA -> STATE_RD_IDLE] Wr IN: %d (IN afull: %d, full: %d).",
-                                                saved_rd_data, wr_in_fifo_afull_i, wr_in_fifo_full_i);
-`endif
-                        end else begin
-                            wr_in_fifo_en_o <= 1'b0;
-                        end
-                    end else begin
-                        wr_in_fifo_en_o <= 1'b0;
-                    end
-
-                    state_m <= STATE_RD_IDLE;
-                end
-
                 STATE_RD_TURNAROUND: begin
 `ifdef D_FT_FIFO_FINE
                     $display ($time, " FT_FIFO:\t[STATE_RD_TURNAROUND -> STATE_RD_DATA].");
@@ -166,37 +234,16 @@ module ft2232_fifo (
                     if (fifo_rxf_n_i) begin
                         // Stop reading; there is no data in the FT2232 FIFO.
                         fifo_rd_n_o <= 1'b1;
-                        // Stop writting to the IN FIFO.
-                        wr_in_fifo_en_o <= 1'b0;
 `ifdef D_FT_FIFO_FINE
-                        $display ($time, " FT_FIFO:\t---> [STATE_RD_DATA] fifo_rxf_n_i: 1. RD: 1 (IN afull: %d, full: %d).",
-                                            wr_in_fifo_afull_i, wr_in_fifo_full_i);
-`endif
-                    end else if (wr_in_fifo_afull_i || wr_in_fifo_full_i) begin
-                        // If the FIFO is almost full now it will become full with the value written
-                        // in the previous cycle and therefore a new value cannot be written to the FIFO in this cycle.
-
-                        // Advance the FT2232 FIFO pointer
-                        fifo_rd_n_o <= 1'b0;
-                        // Stop writting.
-                        wr_in_fifo_en_o <= 1'b0;
-
-                        // Save read data so we can write it to the IN FIFO when there will be room.
-                        have_saved_rd_data <= 1'b1;
-                        saved_rd_data <= fifo_data_i;
-`ifdef D_FT_FIFO
-                        $display ($time, " FT_FIFO:\t---> [STATE_RD_DATA] Wr IN delayed: %d. RD: 1 (IN afull: %d, full: %d).",
-                                            fifo_data_i, wr_in_fifo_afull_i, wr_in_fifo_full_i);
+                        $display ($time, " FT_FIFO:\t---> [STATE_RD_DATA] fifo_rxf_n_i: 1. RD: 1 (skid: %d, IN full: %d).",
+                                            skid_count, wr_in_fifo_full_i);
 `endif
                     end else begin
+                        // Advance the FT2232 FIFO pointer; the byte is pushed into the skid FIFO.
                         fifo_rd_n_o <= 1'b0;
-
-                        wr_in_fifo_en_o <= 1'b1;
-                        wr_in_fifo_data_o <= fifo_data_i;
-
 `ifdef D_FT_FIFO
-                        $display ($time, " FT_FIFO:\t---> [STATE_RD_DATA] Wr IN: %d (IN afull: %d, full: %d). RD : 0",
-                                                fifo_data_i, wr_in_fifo_afull_i, wr_in_fifo_full_i);
+                        $display ($time, " FT_FIFO:\t---> [STATE_RD_DATA] Rd: %d (skid: %d, IN full: %d). RD : 0",
+                                                fifo_data_i, skid_count, wr_in_fifo_full_i);
 `endif
                     end
 
@@ -206,12 +253,7 @@ module ft2232_fifo (
                 STATE_WR_IDLE: begin
                     // Enter this state machine with fifo_oe_n_o = 1'b1
                     fifo_wr_n_o <= 1'b1;
-                    if (have_saved_rd_data) begin
-                        // OE needs to be low (switching to read).
-                        fifo_oe_n_o <= 1'b0;
-                        // If there is saved read data write it to the IN FIFO.
-                        state_m <= STATE_RD_FLUSH_SAVED_DATA;
-                    end else if (can_read_from_ft2232_fifo) begin
+                    if (can_read_from_ft2232_fifo) begin
                         // OE needs to be low (switching to read).
                         fifo_oe_n_o <= 1'b0;
 `ifdef D_FT_FIFO_FINE
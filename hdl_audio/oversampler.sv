@@ -0,0 +1,400 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ * The oversampling filter between the volume stage and the transmitters. The host streams stereo PCM at the base rate
+ * of the clock family (44.1KHz or 48KHz) and the transmitters run at 2, 4 or 8 times that rate (ratio_i is log2 of the
+ * ratio, 0 bypasses the module). The filter is a cascade of half-band interpolators, each doubling the rate:
+ *  stage 0: 143 taps (36 distinct coefficients): flat to 20KHz within 0.0002dB, images above 24.1KHz down by 93dB.
+ *  stage 1:  27 taps (7): flat to 20KHz, images from 2x the base rate - 20KHz down by 102dB.
+ *  stage 2:  19 taps (5): flat to 20KHz, images from 4x the base rate - 20KHz down by 99dB.
+ * Half of the outputs of a half-band stage are its delayed input samples; the other half are the sum of the products
+ * of the even taps and the last input samples of the channel. The products are computed one per clock in two 18x18
+ * multipliers (MULT18X18D: the signed high and the unsigned low part of the left justified sample) and the
+ * coefficients (Q1.17) and the channel histories are in EBR. The samples are kept left justified on 32 bits between the
+ * stages and rounded to the bit depth, with saturation, when sent.
+ * An input frame is filtered into 2^ratio_i frames (about 420 clocks at 8x) which are then sent one byte per clock
+ * while ready_i is set. full_o holds off the writer meanwhile; the one frame which may still be in flight is kept.
+ **********************************************************************************************************************/
+`timescale 1ps/1ps
+`default_nettype none
+
+`include "definitions.svh"
+
+module oversampler (
+    input logic reset_i,
+    input logic clk_i,
+    // Stream configuration
+    input logic [1:0] bit_depth_i,
+    input logic [1:0] ratio_i,
+    // Audio bytes in and out
+    input logic en_i,
+    input logic [7:0] data_i,
+    input logic ready_i,
+    output logic en_o,
+    output logic [7:0] data_o,
+    output logic full_o);
+
+    // The number of distinct coefficients of each stage (half the even taps) and their address in the ROM.
+    localparam [6:0] TAPS_0 = 7'd36, TAPS_1 = 7'd7, TAPS_2 = 7'd5;
+    localparam [5:0] COEFFICIENTS_1 = 6'd36, COEFFICIENTS_2 = 6'd43;
+
+    logic bypass;
+    assign bypass = ratio_i == 2'd0;
+
+    // The index of the last byte of a sample.
+    logic [1:0] last_byte;
+    assign last_byte = bit_depth_i == `BIT_DEPTH_16 ? 2'd1 : bit_depth_i == `BIT_DEPTH_32 ? 2'd3 : 2'd2;
+
+    // The left justified sample of the last bytes received (the newest byte in bits[31:24]).
+    function [31:0] sample_of (input logic [31:0] bytes, input logic [1:0] bit_depth);
+        logic [31:0] word;
+`ifdef BIG_ENDIAN_SAMPLES
+        word = {bytes[7:0], bytes[15:8], bytes[23:16], bytes[31:24]};
+        (* parallel_case, full_case *)
+        case (bit_depth)
+            `BIT_DEPTH_16: sample_of = {word[15:0], 16'h0};
+            `BIT_DEPTH_24, `BIT_DEPTH_DOP: sample_of = {word[23:0], 8'h0};
+            `BIT_DEPTH_32: sample_of = word;
+        endcase
+`else
+        word = bytes;
+        (* parallel_case, full_case *)
+        case (bit_depth)
+            `BIT_DEPTH_16: sample_of = {word[31:16], 16'h0};
+            `BIT_DEPTH_24, `BIT_DEPTH_DOP: sample_of = {word[31:8], 8'h0};
+            `BIT_DEPTH_32: sample_of = word;
+        endcase
+`endif
+    endfunction
+
+    //==================================================================================================================
+    // The input frames. A complete frame waits in pending until the filter takes it.
+    //==================================================================================================================
+    logic [31:0] pack, pack_next;
+    assign pack_next = {data_i, pack[31:8]};
+    logic [1:0] in_index;
+    logic in_channel;
+    logic [31:0] in_left;
+    logic [63:0] pending;
+    logic pending_valid, take_pending;
+
+    always @(posedge clk_i, posedge reset_i) begin
+        if (reset_i) begin
+            in_index <= 2'd0;
+            in_channel <= 1'b0;
+            pending_valid <= 1'b0;
+        end else begin
+            if (take_pending) begin
+                pending_valid <= 1'b0;
+            end
+
+            if (en_i && ~bypass) begin
+                pack <= pack_next;
+                if (in_index == last_byte) begin
+                    in_index <= 2'd0;
+                    in_channel <= ~in_channel;
+                    if (in_channel) begin
+                        pending <= {in_left, sample_of (pack_next, bit_depth_i)};
+                        pending_valid <= 1'b1;
+                    end else begin
+                        in_left <= sample_of (pack_next, bit_depth_i);
+                    end
+                end else begin
+                    in_index <= in_index + 2'd1;
+                end
+            end
+        end
+    end
+
+    //==================================================================================================================
+    // The memories: the coefficients (ROM), the channel histories and the frames out of each stage.
+    //==================================================================================================================
+    // The coefficients of the even taps of the stages, the first half (the taps are symmetric).
+    logic signed [17:0] coefficients [0:47];
+    initial begin
+        // Stage 0
+        coefficients[0] = 18'sd0; coefficients[1] = 18'sd1; coefficients[2] = -18'sd2; coefficients[3] = 18'sd4;
+        coefficients[4] = -18'sd7; coefficients[5] = 18'sd12; coefficients[6] = -18'sd18; coefficients[7] = 18'sd28;
+        coefficients[8] = -18'sd41; coefficients[9] = 18'sd58; coefficients[10] = -18'sd81;
+        coefficients[11] = 18'sd111; coefficients[12] = -18'sd148; coefficients[13] = 18'sd196;
+        coefficients[14] = -18'sd256; coefficients[15] = 18'sd329; coefficients[16] = -18'sd418;
+        coefficients[17] = 18'sd525; coefficients[18] = -18'sd654; coefficients[19] = 18'sd808;
+        coefficients[20] = -18'sd991; coefficients[21] = 18'sd1207; coefficients[22] = -18'sd1462;
+        coefficients[23] = 18'sd1763; coefficients[24] = -18'sd2119; coefficients[25] = 18'sd2543;
+        coefficients[26] = -18'sd3052; coefficients[27] = 18'sd3672; coefficients[28] = -18'sd4441;
+        coefficients[29] = 18'sd5422; coefficients[30] = -18'sd6724; coefficients[31] = 18'sd8554;
+        coefficients[32] = -18'sd11354; coefficients[33] = 18'sd16280; coefficients[34] = -18'sd27567;
+        coefficients[35] = 18'sd83360;
+        // Stage 1
+        coefficients[36] = 18'sd1; coefficients[37] = -18'sd55; coefficients[38] = 18'sd479;
+        coefficients[39] = -18'sd2217; coefficients[40] = 18'sd7318; coefficients[41] = -18'sd20820;
+        coefficients[42] = 18'sd80830;
+        // Stage 2
+        coefficients[43] = 18'sd2; coefficients[44] = -18'sd307; coefficients[45] = 18'sd3128;
+        coefficients[46] = -18'sd15726; coefficients[47] = 18'sd78440;
+    end
+
+    // The last 128 (stage 0) or 16 (stages 1 and 2) samples of each channel: {stage, channel, index} (see
+    // history_address).
+    logic [31:0] history [0:511];
+    // The frames out of the stages, alternately in two areas: {area, frame, channel}.
+    logic [31:0] frames [0:31];
+
+    function [8:0] history_address (input logic [1:0] stage, input logic channel, input logic [6:0] index);
+        (* parallel_case, full_case *)
+        case (stage)
+            2'd0: history_address = {1'b0, channel, index};
+            2'd1: history_address = {4'b1000, channel, index[3:0]};
+            default: history_address = {4'b1001, channel, index[3:0]};
+        endcase
+    endfunction
+
+    //==================================================================================================================
+    // The filter state machine. Each input frame of a stage is written to the histories, then for each channel the even
+    // taps are summed into the first output sample and the delayed input sample is the second one. The frames out of
+    // the last stage are sent.
+    //==================================================================================================================
+    localparam [2:0] STATE_CLEAR = 3'd0,
+                     STATE_IDLE = 3'd1,
+                     STATE_WRITE = 3'd2,
+                     STATE_MAC = 3'd3,
+                     STATE_EVEN = 3'd4,
+                     STATE_ODD = 3'd5,
+                     STATE_SEND = 3'd6;
+    logic [2:0] state;
+    logic [1:0] stage, frame;
+    logic channel;
+    logic [63:0] current;
+
+    // The index of the newest sample in the histories of each stage.
+    logic [6:0] newest_0;
+    logic [3:0] newest_1, newest_2;
+    logic [6:0] newest;
+    assign newest = stage == 2'd0 ? newest_0 : stage == 2'd1 ? {3'd0, newest_1} : {3'd0, newest_2};
+
+    // The distinct coefficients of the stage and the tap being read (0 for the newest sample).
+    logic [6:0] taps, tap, mirrored_tap;
+    assign taps = stage == 2'd0 ? TAPS_0 : stage == 2'd1 ? TAPS_1 : TAPS_2;
+    assign mirrored_tap = tap < taps ? tap : {taps, 1'b0} - 7'd1 - tap;
+    logic [5:0] coefficient_address;
+    assign coefficient_address = (stage == 2'd0 ? 6'd0 : stage == 2'd1 ? COEFFICIENTS_1 : COEFFICIENTS_2) +
+                                    mirrored_tap[5:0];
+
+    // The frames: the input of a stage is read when written to the history, the output of the last one when sent.
+    logic [2:0] send_frame;
+    logic send_channel;
+    logic [1:0] send_byte;
+    logic [4:0] frame_read_address;
+    assign frame_read_address = state == STATE_SEND ? {stage[0], send_frame, send_channel} :
+                                                        {~stage[0], 1'b0, frame, channel};
+    logic [31:0] frame_sample;
+    assign frame_sample = frames[frame_read_address];
+
+    logic [8:0] clear_address;
+    logic history_write;
+    logic [8:0] history_write_address;
+    logic [31:0] history_write_data;
+    assign history_write = state == STATE_CLEAR || state == STATE_WRITE;
+    assign history_write_address = state == STATE_CLEAR ? clear_address : history_address (stage, channel, newest);
+    assign history_write_data = state == STATE_CLEAR ? 32'h0 : stage != 2'd0 ? frame_sample :
+                                    channel ? current[31:0] : current[63:32];
+
+    //==================================================================================================================
+    // The MAC pipeline: the memories are read, the products computed then summed, a clock each.
+    //==================================================================================================================
+    logic [31:0] history_q, center;
+    logic signed [17:0] coefficient_q;
+    logic read_valid, read_first, read_center, read_last;
+    logic signed [35:0] product_hi, product_lo;
+    logic product_valid, product_first, product_last;
+    logic signed [55:0] accumulator;
+    logic accumulator_done;
+
+    always @(posedge clk_i) begin
+        if (history_write) begin
+            history[history_write_address] <= history_write_data;
+        end
+        history_q <= history[history_address (stage, channel, newest - tap)];
+        coefficient_q <= coefficients[coefficient_address];
+
+        product_hi <= $signed(history_q[31:14]) * coefficient_q;
+        product_lo <= $signed({4'b0000, history_q[13:0]}) * coefficient_q;
+        if (read_center) begin
+            center <= history_q;
+        end
+
+        if (product_valid) begin
+            accumulator <= (product_first ? 56'sd0 : accumulator) + (product_hi <<< 14) + product_lo;
+        end
+    end
+
+    // The sum (17 fraction bits) rounded and saturated to a 32-bit sample.
+    logic signed [38:0] sum;
+    assign sum = (accumulator + 56'sd65536) >>> 17;
+    logic [31:0] even_sample;
+    assign even_sample = sum > 39'sh7fffffff ? 32'h7fffffff : sum < -39'sh80000000 ? 32'h80000000 : sum[31:0];
+
+    logic frame_write;
+    logic [4:0] frame_write_address;
+    assign frame_write = (state == STATE_EVEN && accumulator_done) || state == STATE_ODD;
+    assign frame_write_address = {stage[0], frame, state == STATE_ODD, channel};
+
+    always @(posedge clk_i) begin
+        if (frame_write) begin
+            frames[frame_write_address] <= state == STATE_ODD ? center : even_sample;
+        end
+    end
+
+    //==================================================================================================================
+    // The sent sample: rounded to the bit depth with saturation, right justified.
+    //==================================================================================================================
+    logic [32:0] send_rounded;
+    assign send_rounded = {frame_sample[31], frame_sample} +
+                            (bit_depth_i == `BIT_DEPTH_16 ? 33'h8000 : bit_depth_i == `BIT_DEPTH_32 ? 33'h0 : 33'h80);
+    logic [31:0] send_clipped, send_word;
+    assign send_clipped = send_rounded[32:31] == 2'b01 ? 32'h7fffffff : send_rounded[31:0];
+    assign send_word = bit_depth_i == `BIT_DEPTH_16 ? {16'h0, send_clipped[31:16]} :
+                        bit_depth_i == `BIT_DEPTH_32 ? send_clipped : {8'h0, send_clipped[31:8]};
+    logic [1:0] send_index;
+`ifdef BIG_ENDIAN_SAMPLES
+    // The most significant byte first.
+    assign send_index = last_byte - send_byte;
+`else
+    assign send_index = send_byte;
+`endif
+    logic [2:0] last_frame;
+    assign last_frame = {ratio_i == 2'd3, ratio_i[1], 1'b1};
+
+    logic send_en;
+    logic [7:0] send_data;
+    assign take_pending = state == STATE_IDLE && pending_valid;
+    assign full_o = ~bypass && (state != STATE_IDLE || pending_valid);
+    assign en_o = bypass ? en_i : send_en;
+    assign data_o = bypass ? data_i : send_data;
+
+    always @(posedge clk_i, posedge reset_i) begin
+        if (reset_i) begin
+            state <= STATE_CLEAR;
+            clear_address <= 9'd0;
+            newest_0 <= 7'd0;
+            newest_1 <= 4'd0;
+            newest_2 <= 4'd0;
+            read_valid <= 1'b0;
+            product_valid <= 1'b0;
+            accumulator_done <= 1'b0;
+            send_en <= 1'b0;
+        end else begin
+            read_valid <= state == STATE_MAC;
+            read_first <= tap == 7'd0;
+            read_center <= state == STATE_MAC && tap == taps - 7'd1;
+            read_last <= tap == {taps, 1'b0} - 7'd1;
+            product_valid <= read_valid;
+            product_first <= read_first;
+            product_last <= read_last;
+            accumulator_done <= product_valid && product_last;
+            send_en <= 1'b0;
+
+            (* parallel_case, full_case *)
+            case (state)
+                STATE_CLEAR: begin
+                    // The histories start silent.
+                    clear_address <= clear_address + 9'd1;
+                    if (clear_address == 9'h1ff) begin
+                        state <= STATE_IDLE;
+                    end
+                end
+
+                STATE_IDLE: begin
+                    stage <= 2'd0;
+                    frame <= 2'd0;
+                    channel <= 1'b0;
+                    if (pending_valid) begin
+                        current <= pending;
+                        state <= STATE_WRITE;
+                    end
+                end
+
+                STATE_WRITE: begin
+                    tap <= 7'd0;
+                    state <= STATE_MAC;
+                end
+
+                STATE_MAC: begin
+                    tap <= tap + 7'd1;
+                    if (tap == {taps, 1'b0} - 7'd1) begin
+                        state <= STATE_EVEN;
+                    end
+                end
+
+                STATE_EVEN: begin
+                    if (accumulator_done) begin
+                        state <= STATE_ODD;
+                    end
+                end
+
+                STATE_ODD: begin
+                    channel <= ~channel;
+                    state <= STATE_WRITE;
+                    if (channel) begin
+                        (* parallel_case, full_case *)
+                        case (stage)
+                            2'd0: newest_0 <= newest_0 + 7'd1;
+                            2'd1: newest_1 <= newest_1 + 4'd1;
+                            default: newest_2 <= newest_2 + 4'd1;
+                        endcase
+
+                        // Stage n filters 2^n frames.
+                        if (frame != {stage == 2'd2, stage != 2'd0}) begin
+                            frame <= frame + 2'd1;
+                        end else if (stage != ratio_i - 2'd1) begin
+                            stage <= stage + 2'd1;
+                            frame <= 2'd0;
+                        end else begin
+                            send_frame <= 3'd0;
+                            send_channel <= 1'b0;
+                            send_byte <= 2'd0;
+                            state <= STATE_SEND;
+                        end
+                    end
+                end
+
+                STATE_SEND: begin
+                    if (ready_i) begin
+                        send_en <= 1'b1;
+                        send_data <= send_word[{send_index, 3'b000} +: 8];
+                        send_byte <= send_byte + 2'd1;
+                        if (send_byte == last_byte) begin
+                            send_byte <= 2'd0;
+                            send_channel <= ~send_channel;
+                            if (send_channel) begin
+                                send_frame <= send_frame + 3'd1;
+                                if (send_frame == last_frame) begin
+                                    state <= STATE_IDLE;
+                                end
+                            end
+                        end
+                    end
+                end
+
+                default: begin
+                    state <= STATE_IDLE;
+                end
+            endcase
+        end
+    end
+endmodule
@@ -1,6 +1,6 @@
 /* Verilog netlist generated by SCUBA Diamond (64-bit) 3.14.0.75.2 */
 /* Module Version: 5.7 */
-/* C:\lscc\diamond\3.14\ispfpga\bin\nt64\scuba.exe -w -n pll_22579200 -lang verilog -synth lse -bus_exp 7 -bb -arch sa5p00 -type pll -fin 22.579200 -clkibuf LVCMOS33 -fclkop 22.579200 -fclkop_tol 0.0 -fclkos 16.934400 -fclkos_tol 0.0 -phases 0 -fclkos2 90.316800 -fclkos2_tol 0.0 -phases2 0 -phase_cntl STATIC -fb_mode 1 -fdc C:/lscc/diamond/3.14/bin/nt64/pll_22579200/pll_22579200.fdc  */
+/* C:\lscc\diamond\3.14\ispfpga\bin\nt64\scuba.exe -w -n pll_22579200 -lang verilog -synth lse -bus_exp 7 -bb -arch sa5p00 -type pll -fin 22.579200 -clkibuf LVCMOS33 -fclkop 22.579200 -fclkop_tol 0.0 -fclkos 135.475200 -fclkos_tol 0.0 -phases 0 -fclkos2 90.316800 -fclkos2_tol 0.0 -phases2 0 -phase_cntl STATIC -fb_mode 1 -fdc C:/lscc/diamond/3.14/bin/nt64/pll_22579200/pll_22579200.fdc  */
 /* Thu Oct 17 17:02:05 2024 */
 `timescale 1 ns / 1 ps
 `default_nettype none
@@ -39,7 +39,7 @@ module pll_22579200 (CLKI, CLKOP, CLKOS, CLKOS2)/* synthesis NGD_DRC_MASK=1 */;
     defparam PLLInst_0.CLKOS2_FPHASE = 0 ;
     defparam PLLInst_0.CLKOS2_CPHASE = 5 ;
     defparam PLLInst_0.CLKOS_FPHASE = 0 ;
-    defparam PLLInst_0.CLKOS_CPHASE = 31 ;
+    defparam PLLInst_0.CLKOS_CPHASE = 3 ;
     defparam PLLInst_0.CLKOP_FPHASE = 0 ;
     defparam PLLInst_0.CLKOP_CPHASE = 23 ;
     defparam PLLInst_0.PLL_LOCK_MODE = 0 ;
@@ -57,7 +57,7 @@ module pll_22579200 (CLKI, CLKOP, CLKOS, CLKOS2)/* synthesis NGD_DRC_MASK=1 */;
     defparam PLLInst_0.CLKOP_ENABLE = "ENABLED" ;
     defparam PLLInst_0.CLKOS3_DIV = 1 ;
     defparam PLLInst_0.CLKOS2_DIV = 6 ;
-    defparam PLLInst_0.CLKOS_DIV = 32 ;
+    defparam PLLInst_0.CLKOS_DIV = 4 ;
     defparam PLLInst_0.CLKOP_DIV = 24 ;
     defparam PLLInst_0.CLKFB_DIV = 1 ;
     defparam PLLInst_0.CLKI_DIV = 1 ;
@@ -69,7 +69,7 @@ module pll_22579200 (CLKI, CLKOP, CLKOS, CLKOS2)/* synthesis NGD_DRC_MASK=1 */;
         .ENCLKOS3(scuba_vlo), .CLKOP(CLKOP_t), .CLKOS(CLKOS_t), .CLKOS2(CLKOS2_t), 
         .CLKOS3(), .LOCK(LOCK), .INTLOCK(), .REFCLK(REFCLK), .CLKINTFB())
              /* synthesis FREQUENCY_PIN_CLKOS2="90.316800" */
-             /* synthesis FREQUENCY_PIN_CLKOS="16.934400" */
+             /* synthesis FREQUENCY_PIN_CLKOS="135.475200" */
              /* synthesis FREQUENCY_PIN_CLKOP="22.579200" */
              /* synthesis FREQUENCY_PIN_CLKI="22.579200" */
              /* synthesis ICP_CURRENT="10" */
@@ -83,7 +83,7 @@ module pll_22579200 (CLKI, CLKOP, CLKOS, CLKOS2)/* synthesis NGD_DRC_MASK=1 */;
     // exemplar begin
     // exemplar attribute Inst1_IB IO_TYPE LVCMOS33
     // exemplar attribute PLLInst_0 FREQUENCY_PIN_CLKOS2 90.316800
-    // exemplar attribute PLLInst_0 FREQUENCY_PIN_CLKOS 16.934400
+    // exemplar attribute PLLInst_0 FREQUENCY_PIN_CLKOS 135.475200
     // exemplar attribute PLLInst_0 FREQUENCY_PIN_CLKOP 22.579200
     // exemplar attribute PLLInst_0 FREQUENCY_PIN_CLKI 22.579200
     // exemplar attribute PLLInst_0 ICP_CURRENT 10
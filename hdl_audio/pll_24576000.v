@@ -1,19 +1,21 @@
 /* Verilog netlist generated by SCUBA Diamond (64-bit) 3.14.0.75.2 */
 /* Module Version: 5.7 */
-/* C:\lscc\diamond\3.14\ispfpga\bin\nt64\scuba.exe -w -n pll_24576000 -lang verilog -synth lse -bus_exp 7 -bb -arch sa5p00 -type pll -fin 24.576000 -clkibuf LVCMOS33 -fclkop 24.576 -fclkop_tol 0.1 -fclkos 18.432 -fclkos_tol 0.1 -phases 0 -fclkos2 98.304000 -fclkos2_tol 0.1 -phases2 0 -phase_cntl STATIC -fb_mode 1 -fdc C:/lscc/diamond/3.14/bin/nt64/pll_24576000/pll_24576000.fdc  */
+/* C:\lscc\diamond\3.14\ispfpga\bin\nt64\scuba.exe -w -n pll_24576000 -lang verilog -synth lse -bus_exp 7 -bb -arch sa5p00 -type pll -fin 24.576000 -clkibuf LVCMOS33 -fclkop 24.576 -fclkop_tol 0.1 -fclkos 147.456 -fclkos_tol 0.1 -phases 0 -fclkos2 98.304000 -fclkos2_tol 0.1 -phases2 0 -fclkos3 117.964800 -fclkos3_tol 0.1 -phases3 0 -phase_cntl STATIC -fb_mode 1 -fdc C:/lscc/diamond/3.14/bin/nt64/pll_24576000/pll_24576000.fdc  */
 /* Thu Oct 17 16:57:40 2024 */
 
 `timescale 1 ns / 1 ps
 `default_nettype none
 
-module pll_24576000 (CLKI, CLKOP, CLKOS, CLKOS2)/* synthesis NGD_DRC_MASK=1 */;
+module pll_24576000 (CLKI, CLKOP, CLKOS, CLKOS2, CLKOS3)/* synthesis NGD_DRC_MASK=1 */;
     input wire CLKI;
     output wire CLKOP;
     output wire CLKOS;
     output wire CLKOS2;
+    output wire CLKOS3;
 
     wire REFCLK;
     wire LOCK;
+    wire CLKOS3_t;
     wire CLKOS2_t;
     wire CLKOS_t;
     wire CLKOP_t;
@@ -35,11 +37,11 @@ module pll_24576000 (CLKI, CLKOP, CLKOS, CLKOS2)/* synthesis NGD_DRC_MASK=1 */;
     defparam PLLInst_0.STDBY_ENABLE = "DISABLED" ;
     defparam PLLInst_0.DPHASE_SOURCE = "DISABLED" ;
     defparam PLLInst_0.CLKOS3_FPHASE = 0 ;
-    defparam PLLInst_0.CLKOS3_CPHASE = 0 ;
+    defparam PLLInst_0.CLKOS3_CPHASE = 4 ;
     defparam PLLInst_0.CLKOS2_FPHASE = 0 ;
     defparam PLLInst_0.CLKOS2_CPHASE = 5 ;
     defparam PLLInst_0.CLKOS_FPHASE = 0 ;
-    defparam PLLInst_0.CLKOS_CPHASE = 31 ;
+    defparam PLLInst_0.CLKOS_CPHASE = 3 ;
     defparam PLLInst_0.CLKOP_FPHASE = 0 ;
     defparam PLLInst_0.CLKOP_CPHASE = 23 ;
     defparam PLLInst_0.PLL_LOCK_MODE = 0 ;
@@ -48,16 +50,16 @@ module pll_24576000 (CLKI, CLKOP, CLKOS, CLKOS2)/* synthesis NGD_DRC_MASK=1 */;
     defparam PLLInst_0.CLKOP_TRIM_DELAY = 0 ;
     defparam PLLInst_0.CLKOP_TRIM_POL = "FALLING" ;
     defparam PLLInst_0.OUTDIVIDER_MUXD = "DIVD" ;
-    defparam PLLInst_0.CLKOS3_ENABLE = "DISABLED" ;
+    defparam PLLInst_0.CLKOS3_ENABLE = "ENABLED" ;
     defparam PLLInst_0.OUTDIVIDER_MUXC = "DIVC" ;
     defparam PLLInst_0.CLKOS2_ENABLE = "ENABLED" ;
     defparam PLLInst_0.OUTDIVIDER_MUXB = "DIVB" ;
     defparam PLLInst_0.CLKOS_ENABLE = "ENABLED" ;
     defparam PLLInst_0.OUTDIVIDER_MUXA = "DIVA" ;
     defparam PLLInst_0.CLKOP_ENABLE = "ENABLED" ;
-    defparam PLLInst_0.CLKOS3_DIV = 1 ;
+    defparam PLLInst_0.CLKOS3_DIV = 5 ;
     defparam PLLInst_0.CLKOS2_DIV = 6 ;
-    defparam PLLInst_0.CLKOS_DIV = 32 ;
+    defparam PLLInst_0.CLKOS_DIV = 4 ;
     defparam PLLInst_0.CLKOP_DIV = 24 ;
     defparam PLLInst_0.CLKFB_DIV = 1 ;
     defparam PLLInst_0.CLKI_DIV = 1 ;
@@ -67,14 +69,16 @@ module pll_24576000 (CLKI, CLKOP, CLKOS, CLKOS2)/* synthesis NGD_DRC_MASK=1 */;
         .PHASELOADREG(scuba_vlo), .STDBY(scuba_vlo), .PLLWAKESYNC(scuba_vlo), 
         .RST(scuba_vlo), .ENCLKOP(scuba_vlo), .ENCLKOS(scuba_vlo), .ENCLKOS2(scuba_vlo), 
         .ENCLKOS3(scuba_vlo), .CLKOP(CLKOP_t), .CLKOS(CLKOS_t), .CLKOS2(CLKOS2_t), 
-        .CLKOS3(), .LOCK(LOCK), .INTLOCK(), .REFCLK(REFCLK), .CLKINTFB())
+        .CLKOS3(CLKOS3_t), .LOCK(LOCK), .INTLOCK(), .REFCLK(REFCLK), .CLKINTFB())
+             /* synthesis FREQUENCY_PIN_CLKOS3="117.964800" */
              /* synthesis FREQUENCY_PIN_CLKOS2="98.304000" */
-             /* synthesis FREQUENCY_PIN_CLKOS="18.432000" */
+             /* synthesis FREQUENCY_PIN_CLKOS="147.456000" */
              /* synthesis FREQUENCY_PIN_CLKOP="24.576000" */
              /* synthesis FREQUENCY_PIN_CLKI="24.576000" */
              /* synthesis ICP_CURRENT="5" */
              /* synthesis LPF_RESISTOR="16" */;
 
+    assign CLKOS3 = CLKOS3_t;
     assign CLKOS2 = CLKOS2_t;
     assign CLKOS = CLKOS_t;
     assign CLKOP = CLKOP_t;
@@ -82,8 +86,9 @@ module pll_24576000 (CLKI, CLKOP, CLKOS, CLKOS2)/* synthesis NGD_DRC_MASK=1 */;
 
     // exemplar begin
     // exemplar attribute Inst1_IB IO_TYPE LVCMOS33
+    // exemplar attribute PLLInst_0 FREQUENCY_PIN_CLKOS3 117.964800
     // exemplar attribute PLLInst_0 FREQUENCY_PIN_CLKOS2 98.304000
-    // exemplar attribute PLLInst_0 FREQUENCY_PIN_CLKOS 18.432000
+    // exemplar attribute PLLInst_0 FREQUENCY_PIN_CLKOS 147.456000
     // exemplar attribute PLLInst_0 FREQUENCY_PIN_CLKOP 24.576000
     // exemplar attribute PLLInst_0 FREQUENCY_PIN_CLKI 24.576000
     // exemplar attribute PLLInst_0 ICP_CURRENT 5
@@ -0,0 +1,125 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ * This module implements the I2S receiver (e.g. an ADC). It uses the bit clock and left/right clock generated by
+ * tx_i2s so capture runs while the I2S output is streaming, at the output sample rate and bit depth. It runs on the
+ * master clock of tx_i2s and the samples are shifted in on the rising edge strobe of the bit clock (one bit clock after
+ * the LRCK transition) and pushed as one stereo frame into a FIFO read by the control module. The FIFO holds 1024
+ * frames in block RAM (5.3ms at 192KHz) so that capture rides out the stalls of the USB path, which the captured frames
+ * share with the playback stream.
+ **********************************************************************************************************************/
+`timescale 1ps/1ps
+`default_nettype none
+
+`include "definitions.svh"
+
+module rx_i2s (
+    input logic reset_i,
+    // Streaming configuration
+    input logic [1:0] bit_depth_i,
+    // Input FIFO ports. Data: {left[31:0], right[31:0]}, left justified samples.
+    input logic rd_input_FIFO_clk_i,
+    input logic rd_input_FIFO_en_i,
+    output logic [63:0] rd_input_FIFO_data_o,
+    output logic rd_input_FIFO_empty_o,
+    // Status
+    output logic overrun_o,
+    // I2S inputs (bit_en_i and lrck_i are the tx_i2s outputs)
+    input logic clk_i,
+    input logic bit_en_i,
+    input logic lrck_i,
+    input logic sdata_i);
+
+    //==================================================================================================================
+    // The input FIFO containing stereo frames for the control module.
+    //==================================================================================================================
+    logic [63:0] wr_input_FIFO_data;
+    logic wr_input_FIFO_en, wr_input_FIFO_full;
+    async_fifo #(.DSIZE(64), .ASIZE(10), .EBR("TRUE")) input_FIFO_m (
+        // Write to FIFO
+        .wr_reset_i         (reset_i),
+        .wr_en_i            (wr_input_FIFO_en),
+        .wr_clk_i           (clk_i),
+        .wr_data_i          (wr_input_FIFO_data),
+        .wr_full_o          (wr_input_FIFO_full),
+        // Read from FIFO
+        .rd_reset_i         (reset_i),
+        .rd_en_i            (rd_input_FIFO_en_i),
+        .rd_clk_i           (rd_input_FIFO_clk_i),
+        .rd_data_o          (rd_input_FIFO_data_o),
+        .rd_empty_o         (rd_input_FIFO_empty_o));
+
+    logic prev_lrck, synced, have_left;
+    logic [31:0] shift, sample_l;
+    // The complete word including the bit sampled on this clock (the LSB when LRCK has just changed).
+    logic [31:0] word;
+    assign word = {shift[30:0], sdata_i};
+
+    // The word left justified at the configured bit depth.
+    logic [31:0] word_lj;
+    assign word_lj = bit_depth_i == `BIT_DEPTH_16 ? {word[15:0], 16'h0} :
+                        bit_depth_i == `BIT_DEPTH_32 ? word : {word[23:0], 8'h0};
+
+    //==================================================================================================================
+    // The I2S receiver
+    //==================================================================================================================
+    always @(posedge clk_i, posedge reset_i) begin
+        if (reset_i) begin
+`ifdef D_I2S_RX
+            $display ($time, " I2S RX:\t-- Reset.");
+`endif
+            prev_lrck <= 1'b1;
+            synced <= 1'b0;
+            have_left <= 1'b0;
+            overrun_o <= 1'b0;
+            wr_input_FIFO_en <= 1'b0;
+        end else if (~bit_en_i) begin
+            wr_input_FIFO_en <= 1'b0;
+        end else begin
+            wr_input_FIFO_en <= 1'b0;
+            prev_lrck <= lrck_i;
+            shift <= word;
+
+            if (prev_lrck != lrck_i) begin
+                // The first word after reset may be incomplete.
+                synced <= 1'b1;
+                if (synced) begin
+                    if (~prev_lrck) begin
+                        // LRCK low: left channel.
+                        sample_l <= word_lj;
+                        have_left <= 1'b1;
+                    end else if (have_left) begin
+                        have_left <= 1'b0;
+                        if (wr_input_FIFO_full) begin
+`ifdef D_I2S_RX
+                            if (~overrun_o) $display ($time, " I2S RX:\t----- FIFO overrun.");
+`endif
+                            overrun_o <= 1'b1;
+                        end else begin
+`ifdef D_I2S_RX
+                            $display ($time, " I2S RX:\tFrame: %h %h.", sample_l, word_lj);
+`endif
+                            wr_input_FIFO_data <= {sample_l, word_lj};
+                            wr_input_FIFO_en <= 1'b1;
+                        end
+                    end
+                end
+            end
+        end
+    end
+endmodule
@@ -0,0 +1,294 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ * This module implements the SPDIF receiver. The bi-phase mark input is sampled with an oversampling clock (98.304MHz)
+ * and the time between transitions is classified as 1T, 2T or 3T (T being half of a bit cell at the configured sample
+ * rate). The 3T pulses only appear in the preambles, which are used to align to the sub-frames. The 24-bit samples of
+ * the left and right sub-frames are pushed as one stereo frame into a FIFO read by the control module. The FIFO holds
+ * 1024 frames in block RAM (5.3ms at 192KHz) so that capture rides out the stalls of the USB path.
+ **********************************************************************************************************************/
+`timescale 1ps/1ps
+`default_nettype none
+
+`include "definitions.svh"
+
+module rx_spdif (
+    input logic reset_i,
+    // The oversampling clock (at least 4x the SPDIF symbol rate)
+    input logic clk_i,
+    // Streaming configuration
+    input logic [2:0] sample_rate_i,
+    // Input FIFO ports. Data: {left[23:0], right[23:0]}
+    input logic rd_input_FIFO_clk_i,
+    input logic rd_input_FIFO_en_i,
+    output logic [47:0] rd_input_FIFO_data_o,
+    output logic rd_input_FIFO_empty_o,
+    // Status
+    output logic locked_o,
+    output logic overrun_o,
+    // SPDIF input
+    input logic spdif_i);
+
+    //==================================================================================================================
+    // The input FIFO containing stereo frames for the control module.
+    //==================================================================================================================
+    logic [47:0] wr_input_FIFO_data;
+    logic wr_input_FIFO_en, wr_input_FIFO_full;
+    async_fifo #(.DSIZE(48), .ASIZE(10), .EBR("TRUE")) input_FIFO_m (
+        // Write to FIFO
+        .wr_reset_i         (reset_i),
+        .wr_en_i            (wr_input_FIFO_en),
+        .wr_clk_i           (clk_i),
+        .wr_data_i          (wr_input_FIFO_data),
+        .wr_full_o          (wr_input_FIFO_full),
+        // Read from FIFO
+        .rd_reset_i         (reset_i),
+        .rd_en_i            (rd_input_FIFO_en_i),
+        .rd_clk_i           (rd_input_FIFO_clk_i),
+        .rd_data_o          (rd_input_FIFO_data_o),
+        .rd_empty_o         (rd_input_FIFO_empty_o));
+
+    /*==================================================================================================================
+    Pulse width limits in oversampling clocks (98.304MHz). T = 98304000 / (sample rate x 128).
+    A pulse is 1T below 1.5T, 2T below 2.5T and 3T below 3.5T. Longer pulses are invalid.
+    --------------------------------------------------------------------------------------------------------------------
+    SR      T       1.5T    2.5T    3.5T
+    --------------------------------------------------------------------------------------------------------------------
+    48000   16      24      40      56
+    96000   8       12      20      28
+    192000  4       6       10      14
+
+    44100   17.41   27      44      61
+    88200   8.71    14      22      31
+    176400  4.35    7       11      16
+    ==================================================================================================================*/
+    logic [6:0] limit_1t, limit_2t, limit_3t;
+    always @(posedge clk_i) begin
+        (* parallel_case, full_case *)
+        case (sample_rate_i)
+            `STREAM_48000_HZ:   begin limit_1t <= 7'd24; limit_2t <= 7'd40; limit_3t <= 7'd56; end
+            `STREAM_96000_HZ:   begin limit_1t <= 7'd12; limit_2t <= 7'd20; limit_3t <= 7'd28; end
+            `STREAM_192000_HZ:  begin limit_1t <= 7'd6;  limit_2t <= 7'd10; limit_3t <= 7'd14; end
+            `STREAM_44100_HZ:   begin limit_1t <= 7'd27; limit_2t <= 7'd44; limit_3t <= 7'd61; end
+            `STREAM_88200_HZ:   begin limit_1t <= 7'd14; limit_2t <= 7'd22; limit_3t <= 7'd31; end
+            `STREAM_176400_HZ:  begin limit_1t <= 7'd7;  limit_2t <= 7'd11; limit_3t <= 7'd16; end
+            // 352.8KHz and 384KHz are not supported for SPDIF: every pulse is invalid.
+            default:            begin limit_1t <= 7'd0;  limit_2t <= 7'd0;  limit_3t <= 7'd0; end
+        endcase
+    end
+
+    //==================================================================================================================
+    // Transition detection. pulse_clocks counts the oversampling clocks since the last transition (saturated).
+    //==================================================================================================================
+    logic spdif_meta, spdif_prev, transition;
+    DFF_META spdif_meta_m (reset_i, spdif_i, clk_i, spdif_meta);
+    assign transition = spdif_meta != spdif_prev;
+
+    logic [6:0] pulse_clocks;
+    localparam PULSE_INVALID    = 2'd0;
+    localparam PULSE_1T         = 2'd1;
+    localparam PULSE_2T         = 2'd2;
+    localparam PULSE_3T         = 2'd3;
+    logic [1:0] pulse;
+    assign pulse = pulse_clocks < limit_1t ? PULSE_1T :
+                    pulse_clocks < limit_2t ? PULSE_2T :
+                    pulse_clocks < limit_3t ? PULSE_3T : PULSE_INVALID;
+
+    //==================================================================================================================
+    // Preambles as pulse sequences. All of them start with 3T and have 1T as the third pulse.
+    // B (left, block start): 3T 1T 1T 3T; M (left): 3T 3T 1T 1T; W (right): 3T 2T 1T 2T.
+    //==================================================================================================================
+    localparam RX_HUNT      = 2'd0;
+    localparam RX_PREAMBLE  = 2'd1;
+    localparam RX_DATA      = 2'd2;
+    logic [1:0] state_m;
+
+    logic [1:0] preamble_index, preamble_first;
+    logic [4:0] bit_index;
+    logic half_bit, left_sub_frame, have_left;
+    // Sub-frame time slots 4 to 31 (LSB first): [23:0] audio, [24] V, [25] U, [26] C, [27] P.
+    logic [27:0] sub_frame;
+    logic [23:0] sample_l, sample_r;
+
+    // The expected third pulse after the leading 3T of the preamble.
+    logic [1:0] preamble_last;
+    assign preamble_last = preamble_first == PULSE_1T ? PULSE_3T : preamble_first == PULSE_3T ? PULSE_1T : PULSE_2T;
+
+`ifdef D_SPDIF_RX
+    time first_transition_time = 0;
+`endif
+
+    //==================================================================================================================
+    // The reset task
+    //==================================================================================================================
+    task reset_task;
+        spdif_prev <= 1'b0;
+        pulse_clocks <= 7'd0;
+        state_m <= RX_HUNT;
+        locked_o <= 1'b0;
+        overrun_o <= 1'b0;
+        have_left <= 1'b0;
+        wr_input_FIFO_en <= 1'b0;
+        sample_l <= 24'd0;
+        sample_r <= 24'd0;
+`ifdef D_SPDIF_RX
+        first_transition_time <= 0;
+`endif
+    endtask
+
+    //==================================================================================================================
+    // Lock lost: wait for the next preamble.
+    //==================================================================================================================
+    task unlock_task;
+`ifdef D_SPDIF_RX
+        if (locked_o) $display ($time, " SPDIF RX:\t----- Lock lost [pulse: %0d clocks].", pulse_clocks);
+`endif
+        locked_o <= 1'b0;
+        have_left <= 1'b0;
+        state_m <= RX_HUNT;
+    endtask
+
+    //==================================================================================================================
+    // A complete sub-frame. Sub-frames with a parity error repeat the previous sample of the channel.
+    //==================================================================================================================
+    task sub_frame_task (input logic [27:0] data);
+        if (left_sub_frame) begin
+            if (~^data) sample_l <= data[23:0];
+            have_left <= 1'b1;
+        end else begin
+            if (~^data) sample_r <= data[23:0];
+            if (have_left) begin
+                have_left <= 1'b0;
+                if (wr_input_FIFO_full) begin
+`ifdef D_SPDIF_RX
+                    if (~overrun_o) $display ($time, " SPDIF RX:\t----- FIFO overrun.");
+`endif
+                    overrun_o <= 1'b1;
+                end else begin
+                    wr_input_FIFO_data <= {sample_l, ~^data ? data[23:0] : sample_r};
+                    wr_input_FIFO_en <= 1'b1;
+                end
+
+                locked_o <= 1'b1;
+`ifdef D_SPDIF_RX
+                if (~locked_o) begin
+                    $display ($time, " SPDIF RX:\t----- Locked in %0d ns.", ($time - first_transition_time) / 1000);
+                end
+`endif
+            end
+        end
+
+`ifdef D_SPDIF_RX
+        if (^data) $display ($time, " SPDIF RX:\tParity error: %h.", data);
+`endif
+    endtask
+
+    //==================================================================================================================
+    // The SPDIF decoder
+    //==================================================================================================================
+    always @(posedge clk_i, posedge reset_i) begin
+        if (reset_i) begin
+            reset_task;
+        end else begin
+            wr_input_FIFO_en <= 1'b0;
+            spdif_prev <= spdif_meta;
+
+            if (transition) begin
+                pulse_clocks <= 7'd1;
+`ifdef D_SPDIF_RX
+                if (first_transition_time == 0) first_transition_time <= $time;
+`endif
+
+                if (pulse == PULSE_INVALID) begin
+                    unlock_task;
+                end else begin
+                    (* parallel_case, full_case *)
+                    case (state_m)
+                        RX_HUNT: begin
+                            if (pulse == PULSE_3T) begin
+                                preamble_index <= 2'd0;
+                                state_m <= RX_PREAMBLE;
+                            end else if (locked_o) begin
+                                // A sub-frame is not followed by a preamble.
+                                unlock_task;
+                            end
+                        end
+
+                        RX_PREAMBLE: begin
+                            preamble_index <= preamble_index + 2'd1;
+                            (* parallel_case, full_case *)
+                            case (preamble_index)
+                                2'd0: preamble_first <= pulse;
+
+                                2'd1: begin
+                                    if (pulse != PULSE_1T) begin
+                                        unlock_task;
+                                    end
+                                end
+
+                                default: begin
+                                    if (pulse == preamble_last) begin
+                                        left_sub_frame <= preamble_first != PULSE_2T;
+                                        bit_index <= 5'd0;
+                                        half_bit <= 1'b0;
+                                        state_m <= RX_DATA;
+                                    end else if (pulse == PULSE_3T) begin
+                                        // This could be the leading 3T of a preamble.
+                                        preamble_index <= 2'd0;
+                                    end else begin
+                                        unlock_task;
+                                    end
+                                end
+                            endcase
+                        end
+
+                        RX_DATA: begin
+                            // Every bit cell starts with a transition. A 1 has another transition in the middle.
+                            if (pulse == PULSE_1T && ~half_bit) begin
+                                half_bit <= 1'b1;
+                            end else if ((pulse == PULSE_1T && half_bit) || (pulse == PULSE_2T && ~half_bit)) begin
+                                half_bit <= 1'b0;
+                                sub_frame <= {half_bit, sub_frame[27:1]};
+                                bit_index <= bit_index + 5'd1;
+                                if (bit_index == 5'd27) begin
+                                    sub_frame_task ({half_bit, sub_frame[27:1]});
+                                    state_m <= RX_HUNT;
+                                end
+                            end else if (pulse == PULSE_3T) begin
+                                unlock_task;
+                                preamble_index <= 2'd0;
+                                state_m <= RX_PREAMBLE;
+                            end else begin
+                                unlock_task;
+                            end
+                        end
+
+                        default: begin
+                            // Impossible case
+                        end
+                    endcase
+                end
+            end else if (~&pulse_clocks) begin
+                pulse_clocks <= pulse_clocks + 7'd1;
+            end else if (locked_o) begin
+                // No transitions.
+                unlock_task;
+            end
+        end
+    end
+endmodule
@@ -0,0 +1,80 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ * This module implements the free-running sample counter of one clock family (24.576MHz or 22.5792MHz). The counter
+ * advances at the highest sample rate of the family (384KHz or 352.8KHz = clock / 64) and is reported in samples of
+ * the configured sample rate. It also gates the start of a stream that is scheduled at a given sample count.
+ **********************************************************************************************************************/
+`timescale 1ps/1ps
+`default_nettype none
+
+module sample_counter (
+    input logic reset_i,
+    input logic clk_i,
+    // Streaming configuration (sample_rate[1:0]: 1x, 2x, 4x or 8x the base rate of the family)
+    input logic [1:0] rate_index_i,
+    // Scheduled start
+    input logic start_armed_i,
+    input logic [31:0] start_at_i,
+    output logic start_reached_o,
+    // The sample count (gray code) to be read in a different clock domain.
+    output logic [31:0] count_gray_o);
+
+    logic [5:0] frame_clks;
+    logic [34:0] tick_count;
+
+    logic [31:0] sample_count;
+    assign sample_count = rate_index_i == 2'd0 ? tick_count[34:3] :
+                            rate_index_i == 2'd1 ? tick_count[33:2] :
+                            rate_index_i == 2'd2 ? tick_count[32:1] : tick_count[31:0];
+
+    // start_at_i is written before start_armed_i is set so only the arm bit needs a synchronizer.
+    logic start_armed_meta;
+    DFF_META start_armed_meta_m (reset_i, start_armed_i, clk_i, start_armed_meta);
+
+    // The difference is evaluated as a signed value so that the comparison works across a counter wrap.
+    logic [31:0] start_diff;
+    assign start_diff = sample_count - start_at_i;
+
+    always @(posedge clk_i, posedge reset_i) begin
+        if (reset_i) begin
+            frame_clks <= 6'd0;
+            tick_count <= 35'd0;
+            count_gray_o <= 32'd0;
+            start_reached_o <= 1'b0;
+        end else begin
+            frame_clks <= frame_clks + 6'd1;
+            if (frame_clks == 6'd63) begin
+                tick_count <= tick_count + 35'd1;
+            end
+
+            count_gray_o <= sample_count ^ (sample_count >> 1);
+
+            // Once the start count is reached it stays reached (until disarmed) so that a stream restarts immediately
+            // after an underrun.
+            if (~start_armed_meta) begin
+                start_reached_o <= 1'b0;
+            end else if (~start_diff[31]) begin
+`ifdef D_CTRL
+                if (~start_reached_o) $display ($time, " COUNTER:\tScheduled start at: %d.", sample_count);
+`endif
+                start_reached_o <= 1'b1;
+            end
+        end
+    end
+endmodule
@@ -0,0 +1,204 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ * The building blocks shared by the transmitters: the DoP encoder, the frame packer, which turns the audio bytes
+ * written by the control module into stereo frames, and the shift register serializer.
+ **********************************************************************************************************************/
+`timescale 1ps/1ps
+`default_nettype none
+
+`include "definitions.svh"
+
+//======================================================================================================================
+// DoP (DSD over PCM) encoder. With enable_i the bytes are raw DSD bytes of both channels interleaved (L0 R0 L1 R1 ...,
+// the MSB of each byte first) and every 4 bytes become a 24-bit stereo frame (6 bytes, in the byte order of the 24-bit
+// samples): the marker in bits[23:16], alternating 0x05 and 0xFA, and the 2 DSD bytes of the channel in bits[15:0].
+// The frame bytes are queued and sent one per clock while ready_i is set; full_o holds off the writer while there is
+// no room for two more frames. Without enable_i the bytes go through unchanged.
+//======================================================================================================================
+module dop_encoder (
+    input logic reset_i,
+    input logic clk_i,
+    input logic enable_i,
+    input logic en_i,
+    input logic [7:0] data_i,
+    input logic ready_i,
+    output logic en_o,
+    output logic [7:0] data_o,
+    output logic full_o);
+
+    logic [1:0] in_index;
+    logic [7:0] first_l, first_r, marker;
+
+    // The 3 bytes of a 24-bit sample in the order the frame packer expects them.
+    function [23:0] sample_bytes (input logic [7:0] msb, input logic [7:0] mid, input logic [7:0] lsb);
+`ifdef BIG_ENDIAN_SAMPLES
+        sample_bytes = {lsb, mid, msb};
+`else
+        sample_bytes = {msb, mid, lsb};
+`endif
+    endfunction
+
+    // The queue: the next byte to send in queue[7:0].
+    logic [63:0] queue, queue_popped;
+    logic [3:0] count, count_popped;
+    logic pop, push;
+    logic [23:0] push_bytes;
+    assign pop = ready_i && count != 4'd0;
+    assign queue_popped = pop ? queue >> 8 : queue;
+    assign count_popped = count - {3'd0, pop};
+    // The left sample is queued with the second left byte and the right sample with the second right byte.
+    assign push = en_i && in_index[1];
+    assign push_bytes = sample_bytes (marker, in_index[0] ? first_r : first_l, data_i);
+
+    logic dop_en;
+    logic [7:0] dop_data;
+    assign full_o = enable_i && count > 4'd2;
+    assign en_o = enable_i ? dop_en : en_i;
+    assign data_o = enable_i ? dop_data : data_i;
+
+    always @(posedge clk_i, posedge reset_i) begin
+        if (reset_i) begin
+            in_index <= 2'd0;
+            marker <= 8'h05;
+            count <= 4'd0;
+            dop_en <= 1'b0;
+        end else begin
+            dop_en <= pop;
+            dop_data <= queue[7:0];
+            queue <= push ? queue_popped | ({40'h0, push_bytes} << {count_popped, 3'b000}) : queue_popped;
+            count <= count_popped + (push ? 4'd3 : 4'd0);
+
+            if (en_i && enable_i) begin
+                in_index <= in_index + 2'd1;
+                (* parallel_case, full_case *)
+                case (in_index)
+                    2'd0: first_l <= data_i;
+                    2'd1: first_r <= data_i;
+                    2'd2: begin end
+                    // 0x05 <-> 0xFA
+                    2'd3: marker <= ~marker;
+                endcase
+            end
+        end
+    end
+endmodule
+
+//======================================================================================================================
+// Frame packer. The bytes of a stereo frame (2, 3 or 4 bytes per sample for 16, 24/DOP and 32 bit) are shifted in and
+// the frame is output with the last byte: {left, right}, right justified samples of SAMPLE_BITS bits. With SAMPLE_BITS
+// 24 (tx_spdif) only 16 and 24-bit frames are packed: a 32-bit stream would be cut into 3-byte samples, so control
+// rejects 32-bit streams on the SPDIF outputs.
+//======================================================================================================================
+module frame_packer #(parameter SAMPLE_BITS = 32)(
+    input logic reset_i,
+    input logic clk_i,
+    input logic [1:0] bit_depth_i,
+    input logic en_i,
+    input logic [7:0] data_i,
+    output logic frame_en_o,
+    output logic [2*SAMPLE_BITS-1:0] frame_o);
+
+    // The last 8 bytes, the newest one in the most significant byte.
+    logic [63:0] pack, pack_next;
+    assign pack_next = {data_i, pack[63:8]};
+
+    logic [3:0] pack_bytes, frame_bytes;
+    assign frame_bytes = bit_depth_i == `BIT_DEPTH_16 ? 4'd2 * 4'd2 :
+                            (bit_depth_i == `BIT_DEPTH_32 && SAMPLE_BITS == 32) ? 4'd4 * 4'd2 : 4'd3 * 4'd2;
+
+    // The sample made of count bytes starting at byte first of the packed bytes.
+    function [31:0] sample_bytes (input logic [63:0] bytes, input integer first, input integer count);
+        integer k;
+        begin
+            sample_bytes = 32'h0;
+            for (k = 0; k < count; k = k + 1) begin
+`ifdef BIG_ENDIAN_SAMPLES
+                sample_bytes[8*(count-1-k) +: 8] = bytes[8*(first+k) +: 8];
+`else
+                sample_bytes[8*k +: 8] = bytes[8*(first+k) +: 8];
+`endif
+            end
+        end
+    endfunction
+
+    logic [31:0] left, right;
+    always @(*) begin
+        (* parallel_case, full_case *)
+        case (frame_bytes)
+            4'd4: begin
+                left = sample_bytes (pack_next, 4, 2);
+                right = sample_bytes (pack_next, 6, 2);
+            end
+
+            4'd8: begin
+                left = sample_bytes (pack_next, 0, 4);
+                right = sample_bytes (pack_next, 4, 4);
+            end
+
+            default: begin
+                left = sample_bytes (pack_next, 2, 3);
+                right = sample_bytes (pack_next, 5, 3);
+            end
+        endcase
+    end
+
+    always @(posedge clk_i, posedge reset_i) begin
+        if (reset_i) begin
+            pack_bytes <= 4'd0;
+            frame_en_o <= 1'b0;
+        end else begin
+            frame_en_o <= 1'b0;
+            if (en_i) begin
+                pack <= pack_next;
+                if (pack_bytes == frame_bytes - 4'd1) begin
+                    frame_o <= {left[SAMPLE_BITS-1:0], right[SAMPLE_BITS-1:0]};
+                    frame_en_o <= 1'b1;
+                    pack_bytes <= 4'd0;
+                end else begin
+                    pack_bytes <= pack_bytes + 4'd1;
+                end
+            end
+        end
+    end
+endmodule
+
+//======================================================================================================================
+// Shift register serializer. bit_o is the bit to send on this clock: the first bit of data_i when load_i is set or
+// the next bit of the loaded word. shift_i moves to the next bit at the end of the clock (with load_i, the first bit
+// of data_i is consumed on the loading clock).
+//======================================================================================================================
+module shift_serializer #(parameter WIDTH = 32, parameter LSB_FIRST = 0)(
+    input logic clk_i,
+    input logic load_i,
+    input logic shift_i,
+    input logic [WIDTH-1:0] data_i,
+    output logic bit_o);
+
+    logic [WIDTH-1:0] shift, word;
+    assign word = load_i ? data_i : shift;
+    assign bit_o = LSB_FIRST ? word[0] : word[WIDTH-1];
+
+    always @(posedge clk_i) begin
+        if (shift_i) begin
+            shift <= LSB_FIRST ? word >> 1 : word << 1;
+        end else if (load_i) begin
+            shift <= data_i;
+        end
+    end
+endmodule
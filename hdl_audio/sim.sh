@@ -6,9 +6,20 @@
 helpFunction()
 {
     echo ""
-    echo "Usage: $0 -f <bin file name> [-a <FIFO address bits>] [-D <flag>] -h"
+    echo "Usage: $0 -f <bin file name> [-a <FIFO address bits>] [-m \"<builds>\"] [-D <flag>] -h"
+    echo "       $0 -t <bench> [-a <FIFO address bits>] [-l <producer latency>] [-c <consumer clock period>]"
+    echo "                [-s <stall frames>] [-D <flag>] -h"
     echo "    -f: bin file name."
+    echo "    -m: run the simulation once per build in the list and print only the results (latencies and KB/s). A"
+    echo "        build is default or flags separated by commas (e.g. -m \"default CONTROL_ON_FIFO_CLK\")."
+    echo "    -t: run the test bench sim_<bench>.sv over its configurations: fifo, dsd, dop, tdm, lines, volume,"
+    echo "        oversampler, asrc, i2s or spdif."
     echo "    -a: Async FIFO address bits. Default is 5 (32 bytes FIFO)."
+    echo "    -l: fifo bench: clocks between the producer write decision and the write. Default is 2."
+    echo "    -c: fifo bench: consumer (control) clock period in ps. Default is 8477 (117.9648MHz), 40690 for"
+    echo "        24.576MHz."
+    echo "    -s: i2s and spdif benches: frame periods the reader stalls for. Default is 768 (3/4 of the 1024 frames of"
+    echo "        the receiver FIFO)."
     echo "    -D: debug flags (e.g. -D D_CORE ...)"
     echo "    -h: Help."
     exit 1
@@ -24,16 +35,44 @@ helpFunction()
 # D_CTRL:                   Controller messages.
 # D_SPDIF:                  SPDIF messages.
 # D_SPDIF_BC:               SPDIF bit clock messages.
+# D_SPDIF_RX:               SPDIF receiver messages (lock time, parity errors, overruns).
+# D_I2S_RX:                 I2S receiver messages (frames, overruns).
 # D_I2S:                    I2S messages.
 # D_I2S_BC:                 I2S bit clock messages.
+#
+# Other flags
+#
+# SPDIF_LOOPBACK:           Feed the SPDIF output to the SPDIF receiver (e.g. -D SPDIF_LOOPBACK -D D_SPDIF_RX with a
+#                           bin file generated with ft2232_file -i).
+# I2S_LOOPBACK:             Feed the I2S data output to the I2S receiver (full duplex with ft2232_file -o 0 -i).
+# SLOW_CONSUMER:            The control module pauses reading the IN FIFO for 256 of every 1024 clocks (FT2232 read
+#                           path workload; compare the KB/s printed when all the bytes are sent).
+# CONTROL_CLK_24576000:     Run the control module on the 24.576MHz clock instead of the 117.9648MHz system clock
+#                           (compare the KB/s printed when all the bytes are sent: -m "default CONTROL_CLK_24576000").
+# CONTROL_ON_FIFO_CLK:      Run the control module on the FT2232 clock: no clock domain crossing between the FT2232 and
+#                           control (compare the "First frame output" and "Flush" latencies with the default build).
 OPTIONS="-D SIMULATION -D D_FT2232 -D D_CORE -D D_CTRL"
 OUTPUT_FILE=out.sim
+# The benches only get the flags given with -D.
+BENCH=""
+BENCH_OPTIONS="-D SIMULATION"
+ASIZE=5
+LATENCY=2
+RD_CLK_PS=8477
+STALL_FRAMES=768
+BUILDS="default"
+RESULTS_ONLY=""
 
-while getopts 'f:a:D:h' opt; do
+while getopts 'f:m:t:a:l:c:s:D:h' opt; do
     case "$opt" in
         f ) OPTIONS="$OPTIONS -D BIN_FILE_NAME=\"${OPTARG}\"" ;;
-        a ) OPTIONS="$OPTIONS -D FIFO_ADDR_BITS=${OPTARG}" ;;
-        D ) OPTIONS="$OPTIONS -D ${OPTARG}" ;;
+        m ) BUILDS=${OPTARG}; RESULTS_ONLY="1" ;;
+        t ) BENCH=${OPTARG} ;;
+        a ) OPTIONS="$OPTIONS -D FIFO_ADDR_BITS=${OPTARG}"; ASIZE=${OPTARG} ;;
+        l ) LATENCY=${OPTARG} ;;
+        c ) RD_CLK_PS=${OPTARG} ;;
+        s ) STALL_FRAMES=${OPTARG} ;;
+        D ) OPTIONS="$OPTIONS -D ${OPTARG}"; BENCH_OPTIONS="$BENCH_OPTIONS -D ${OPTARG}" ;;
         h ) helpFunction ;;
         ? ) helpFunction ;; # Print helpFunction in case parameter is non-existent
     esac
@@ -48,14 +87,127 @@ if [ -d "$BIN_PATH" ] && [[ ! $PATH =~ (^|:)$BIN_PATH(:|$) ]]; then
     PATH+=:$BIN_PATH
 fi
 
-if test -f "$OUTPUT_FILE"; then
-    rm $OUTPUT_FILE
-fi
+# A test bench: its modules and the defines of each configuration (one configuration per line). The lines printed
+# by the bench start with "<BENCH> BENCH" (the results) or "<BENCH>:" (the errors).
+if [ -n "$BENCH" ]; then
+    TX_I2S_FILES="utils.sv async_fifo.sv divider.sv serializer.sv tx_i2s.sv"
+    RUNS=""
+    case "$BENCH" in
+        # The async FIFO throughput at various almost full / almost empty thresholds.
+        fifo )
+            FILES="async_fifo.sv"
+            for AWFULL in 1 2 4 8; do
+                for AREMPTY in 0 1 4 8; do
+                    RUNS+="BENCH_ASIZE=$ASIZE BENCH_WR_LATENCY=$LATENCY BENCH_AWFULL=$AWFULL BENCH_AREMPTY=$AREMPTY "
+                    RUNS+="BENCH_RD_CLK_PS=$RD_CLK_PS"$'\n'
+                done
+            done ;;
+        # The native DSD output of tx_i2s at DSD64 to DSD512 in both clock families.
+        dsd )
+            FILES=$TX_I2S_FILES
+            for SAMPLE_RATE in 0 1 2 3 4 5 6 7; do
+                RUNS+="BENCH_SAMPLE_RATE=$SAMPLE_RATE"$'\n'
+            done ;;
+        # The DoP encoder and the DoP output of tx_i2s at DSD64 and DSD128 in both clock families.
+        dop )
+            FILES=$TX_I2S_FILES
+            for SAMPLE_RATE in 2 3 6 7; do
+                RUNS+="BENCH_SAMPLE_RATE=$SAMPLE_RATE"$'\n'
+            done ;;
+        # TDM mode (1: TDM4, 2: TDM8), slot width, bit depth (1: 16, 2: 24, 3: 32) and sample rate.
+        tdm )
+            FILES=$TX_I2S_FILES
+            for CONFIG in "2 3 3 6" "2 3 2 5" "2 1 1 7" "1 2 2 2" "1 3 1 3"; do
+                set -- $CONFIG
+                RUNS+="BENCH_TDM=$1 BENCH_SLOT_WIDTH=$2 BENCH_BIT_DEPTH=$3 BENCH_SAMPLE_RATE=$4"$'\n'
+            done ;;
+        # Lines (0: 1, 1: 2, 2: 4), TDM mode (0: off, 1: TDM4, 2: TDM8), bit depth and sample rate.
+        lines )
+            FILES=$TX_I2S_FILES
+            for CONFIG in "2 0 3 6" "2 0 1 3" "1 0 2 5" "0 0 3 2" "1 1 2 2" "2 2 1 2"; do
+                set -- $CONFIG
+                RUNS+="BENCH_LINES=$1 BENCH_TDM=$2 BENCH_BIT_DEPTH=$3 BENCH_SAMPLE_RATE=$4"$'\n'
+            done ;;
+        # The gain, dither and noise shaping of the volume stage at 16, 24 and 32 bits.
+        volume )
+            FILES="volume.sv"
+            for BIT_DEPTH in 1 2 3; do
+                RUNS+="BENCH_BIT_DEPTH=$BIT_DEPTH"$'\n'
+            done ;;
+        # The frequency response of the oversampling filter at 2x, 4x and 8x.
+        oversampler )
+            FILES="oversampler.sv"
+            for RATIO in 1 2 3; do
+                RUNS+="BENCH_RATIO=$RATIO"$'\n'
+            done ;;
+        # The sample rate converter from rates the outputs do not run at (input rate:output rate).
+        asrc )
+            FILES="asrc.sv"
+            for RATES in 8000:48000 22050:44100 32000:44100 44100:48000 88200:96000 176400:192000 352800:384000; do
+                RUNS+="BENCH_INPUT_RATE=${RATES%:*} BENCH_OUTPUT_RATE=${RATES#*:}"$'\n'
+            done ;;
+        # The I2S loopback (tx_i2s to rx_i2s) with a reader stall: 192KHz at 32 and 16 bits, 96KHz and 176.4KHz
+        # at 32 bits.
+        i2s )
+            FILES="$TX_I2S_FILES rx_i2s.sv"
+            for CONFIG in "6 3" "6 1" "5 3" "2 3"; do
+                set -- $CONFIG
+                RUNS+="BENCH_SAMPLE_RATE=$1 BENCH_BIT_DEPTH=$2 BENCH_STALL_FRAMES=$STALL_FRAMES"$'\n'
+            done ;;
+        # The SPDIF receiver fed by tx_spdif at every supported sample rate (24-bit) with a reader stall.
+        spdif )
+            FILES="utils.sv async_fifo.sv divider.sv serializer.sv tx_spdif.sv rx_spdif.sv"
+            for SAMPLE_RATE in 0 1 2 4 5 6; do
+                RUNS+="BENCH_SAMPLE_RATE=$SAMPLE_RATE BENCH_STALL_FRAMES=$STALL_FRAMES"$'\n'
+            done ;;
+        * ) helpFunction ;;
+    esac
+
+    OUTPUT_FILE=out_$BENCH.sim
+    TAG=${BENCH^^}
+    while read -r RUN; do
+        if [ -z "$RUN" ]; then
+            continue
+        fi
+        DEFINES=""
+        for DEFINE in $RUN; do
+            DEFINES="$DEFINES -D $DEFINE"
+        done
 
-# echo $OPTIONS
+        if test -f "$OUTPUT_FILE"; then
+            rm $OUTPUT_FILE
+        fi
 
-iverilog -g2005-sv $OPTIONS -o $OUTPUT_FILE \
-            sim_trellis.sv utils.sv async_fifo.sv divider.sv ft2232_fifo.sv control.sv tx_i2s.sv tx_spdif.sv audio.sv sim_ft2232.sv sim_audio.sv
-if [ $? -eq 0 ]; then
-    vvp $OUTPUT_FILE
+        iverilog -g2005-sv $BENCH_OPTIONS $DEFINES -o $OUTPUT_FILE $FILES sim_$BENCH.sv
+        if [ $? -eq 0 ]; then
+            vvp $OUTPUT_FILE | grep "$TAG BENCH\|$TAG:"
+        fi
+    done <<< "$RUNS"
+    exit 0
 fi
+
+for BUILD in $BUILDS; do
+    BUILD_OPTIONS=$OPTIONS
+    if [ "$BUILD" != "default" ]; then
+        for FLAG in ${BUILD//,/ }; do
+            BUILD_OPTIONS="$BUILD_OPTIONS -D $FLAG"
+        done
+    fi
+
+    if test -f "$OUTPUT_FILE"; then
+        rm $OUTPUT_FILE
+    fi
+
+    # echo $BUILD_OPTIONS
+
+    iverilog -g2005-sv $BUILD_OPTIONS -o $OUTPUT_FILE \
+                sim_trellis.sv utils.sv async_fifo.sv divider.sv sample_counter.sv ft2232_fifo.sv serializer.sv volume.sv asrc.sv oversampler.sv control.sv tx_i2s.sv tx_spdif.sv rx_spdif.sv rx_i2s.sv audio.sv sim_ft2232.sv sim_audio.sv
+    if [ $? -eq 0 ]; then
+        if [ -n "$RESULTS_ONLY" ]; then
+            echo "==================== Build: $BUILD ===================="
+            vvp $OUTPUT_FILE | grep "SIM:.* after the\|KB/s"
+        else
+            vvp $OUTPUT_FILE
+        fi
+    fi
+done
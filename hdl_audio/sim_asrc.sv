@@ -0,0 +1,212 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+/***********************************************************************************************************************
+ * This is the top module for the sample rate converter test bench (sim.sh -t asrc). For each test tone the converter
+ * is reset and fed 24-bit stereo frames of a -6dBFS tone at the input rate (sine on the left, cosine on the right)
+ * while full_o is low, one byte every other clock as control does, and its output is read with random back pressure.
+ * After the transient the output is analyzed with a DFT: the gain at the tone and THD+N (all the other bins) are
+ * reported. The tones are on DFT bins of N output frames so no window is needed. The bench fails when the gain is off
+ * by more than 0.002dB, THD+N is above -80dB or the input frames taken do not follow the ratio of the rates, and
+ * reports the clocks the converter takes per output frame.
+ **********************************************************************************************************************/
+`timescale 1ps/1ps
+`default_nettype none
+
+`include "definitions.svh"
+
+module sim_asrc;
+`ifdef BENCH_INPUT_RATE
+    localparam INPUT_RATE = `BENCH_INPUT_RATE;
+`else
+    localparam INPUT_RATE = 32000;
+`endif
+`ifdef BENCH_OUTPUT_RATE
+    localparam OUTPUT_RATE = `BENCH_OUTPUT_RATE;
+`else
+    localparam OUTPUT_RATE = 44100;
+`endif
+    localparam N = 512;
+    localparam SKIP = 256;
+    localparam TONES = 2;
+    localparam real AMPLITUDE = 4194304.0; // 2^22: -6dBFS at 24-bit
+    localparam real PI = 3.14159265358979;
+
+    // A low tone and a tone at the top of the passband (0.38 x the input rate).
+    function integer tone_bin (input integer tone);
+        tone_bin = tone == 0 ? 12 : $rtoi (0.38 * INPUT_RATE * N / OUTPUT_RATE);
+    endfunction
+
+    // 117.9648MHz control clock -> 8477 ps
+    localparam CLK_PS = 8477;
+    logic clk = 1'b0;
+    always #(CLK_PS/2) clk = ~clk;
+
+    logic reset = 1'b1;
+    logic en, ready, out_en, full;
+    logic [7:0] data, out_data;
+    asrc asrc_m (
+        .reset_i            (reset),
+        .clk_i              (clk),
+        .bit_depth_i        (`BIT_DEPTH_24),
+        .input_rate_i       (INPUT_RATE[18:0]),
+        .output_rate_i      (OUTPUT_RATE[18:0]),
+        .en_i               (en),
+        .data_i             (data),
+        .ready_i            (ready),
+        .en_o               (out_en),
+        .data_o             (out_data),
+        .full_o             (full));
+
+    //==================================================================================================================
+    // The writer: the frames of the tone, little endian 24-bit samples.
+    //==================================================================================================================
+    integer tone = 0, wr_frame = 0, wr_byte = 0;
+    logic [23:0] wr_sample;
+
+    function [23:0] input_sample (input integer tone, input integer frame, input integer channel);
+        real phase;
+        phase = 2.0 * PI * tone_bin (tone) * OUTPUT_RATE / N * frame / INPUT_RATE + (channel ? PI / 2.0 : 0.0);
+        input_sample = $rtoi ($floor (AMPLITUDE * $sin (phase) + 0.5));
+    endfunction
+
+    always @(posedge clk) begin
+        ready <= ($urandom % 4) != 0;
+        if (reset) begin
+            en <= 1'b0;
+            wr_frame <= 0;
+            wr_byte <= 0;
+        end else begin
+            en <= 1'b0;
+            if (~en && ~full) begin
+                wr_sample = input_sample (tone, wr_frame, wr_byte / 3);
+                data <= wr_sample[8 * (wr_byte % 3) +: 8];
+                en <= 1'b1;
+                if (wr_byte == 5) begin
+                    wr_byte <= 0;
+                    wr_frame <= wr_frame + 1;
+                end else begin
+                    wr_byte <= wr_byte + 1;
+                end
+            end
+        end
+    end
+
+    // The clocks between two output frames (with the back pressure of the reader).
+    integer frame_clocks = 0, max_frame_clocks = 0;
+
+    //==================================================================================================================
+    // The reader: the output frames after the transient.
+    //==================================================================================================================
+    real output_samples [0:1][0:N-1];
+    integer rd_frame = 0, rd_byte = 0;
+    logic [23:0] rd_sample;
+
+    always @(posedge clk) begin
+        if (reset) begin
+            rd_frame = 0;
+            rd_byte = 0;
+            frame_clocks = 0;
+        end else begin
+            frame_clocks = frame_clocks + 1;
+            if (out_en) begin
+                rd_sample[8 * (rd_byte % 3) +: 8] = out_data;
+                if (rd_byte % 3 == 2 && rd_frame >= SKIP && rd_frame < SKIP + N) begin
+                    output_samples[rd_byte / 3][rd_frame - SKIP] = $signed(rd_sample);
+                end
+                if (rd_byte == 5) begin
+                    rd_byte = 0;
+                    rd_frame = rd_frame + 1;
+                    if (rd_frame > 1 && frame_clocks > max_frame_clocks) max_frame_clocks = frame_clocks;
+                    frame_clocks = 0;
+                end else begin
+                    rd_byte = rd_byte + 1;
+                end
+            end
+        end
+    end
+
+    //==================================================================================================================
+    // The analysis
+    //==================================================================================================================
+    // The level (relative to the tone amplitude) of a DFT bin of the output of a channel.
+    function real level (input integer channel, input integer bin);
+        integer i;
+        real re, im, phase;
+        re = 0.0;
+        im = 0.0;
+        for (i = 0; i < N; i = i + 1) begin
+            phase = 2.0 * PI * bin * i / N;
+            re = re + output_samples[channel][i] * $cos (phase);
+            im = im + output_samples[channel][i] * $sin (phase);
+        end
+        level = (bin == 0 ? 1.0 : 2.0) * $sqrt (re * re + im * im) / N / AMPLITUDE;
+    endfunction
+
+    integer errors = 0;
+    real gain, noise, thd_n, taken_ratio;
+
+    task analyze_task;
+        integer channel, k;
+        for (channel = 0; channel < 2; channel = channel + 1) begin
+            gain = level (channel, tone_bin (tone));
+            noise = 0.0;
+            for (k = 0; k < N / 2; k = k + 1) begin
+                if (k != tone_bin (tone)) noise = noise + level (channel, k) * level (channel, k);
+            end
+            thd_n = 20.0 * $log10 ($sqrt (noise) / gain + 1e-12);
+            gain = 20.0 * $log10 (gain + 1e-12);
+            $display ("ASRC BENCH: %0dHz to %0dHz, %0.0fHz, channel %0d: gain %0.5fdB, THD+N %0.1fdB",
+                            INPUT_RATE, OUTPUT_RATE, 1.0 * OUTPUT_RATE * tone_bin (tone) / N, channel, gain, thd_n);
+            if (gain > 0.002 || gain < -0.002 || thd_n > -80.0) begin
+                $display ("ASRC:\t[ERROR] tone %0d channel %0d out of specification", tone, channel);
+                errors = errors + 1;
+            end
+        end
+
+        // The frames taken may run ahead by the frames queued.
+        taken_ratio = 1.0 * wr_frame / (SKIP + N);
+        $display ("ASRC BENCH: %0d input frames for %0d output frames (%0.5f, expected %0.5f)",
+                        wr_frame, SKIP + N, taken_ratio, 1.0 * INPUT_RATE / OUTPUT_RATE);
+        if (wr_frame < (SKIP + N) * INPUT_RATE / OUTPUT_RATE ||
+                wr_frame > (SKIP + N) * INPUT_RATE / OUTPUT_RATE + 4) begin
+            $display ("ASRC:\t[ERROR] tone %0d: the input frames taken do not follow the ratio of the rates", tone);
+            errors = errors + 1;
+        end
+    endtask
+
+    //==================================================================================================================
+    // The initial block
+    //==================================================================================================================
+    initial begin
+        for (tone = 0; tone < TONES; tone = tone + 1) begin
+            reset = 1'b1;
+            #100000 reset = 1'b0;
+            wait (rd_frame == SKIP + N);
+            analyze_task;
+        end
+
+        $display ("ASRC BENCH: %0dHz to %0dHz, at most %0d clocks per output frame (%0d available), errors %0d.",
+                        INPUT_RATE, OUTPUT_RATE, max_frame_clocks, 117964800 / OUTPUT_RATE, errors);
+        $finish (0);
+    end
+
+    initial begin
+        #1000000000000
+        $display($time, " SIM: ---------------------- Simulation end [Timeout] ------------------------");
+        $finish (1);
+    end
+endmodule
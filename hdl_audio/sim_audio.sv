@@ -21,6 +21,8 @@
 `timescale 1ps/1ps
 `default_nettype none
 
+`include "definitions.svh"
+
 module sim_audio;
     //==================================================================================================================
     // Simulate the external clocks
@@ -96,6 +98,47 @@ module sim_audio;
         .fifo_rd_n_i            (fifo_rd_n),
         .fifo_data_io           (fifo_data));
 
+    //==================================================================================================================
+    // Command to output latency: the time from the first CMD_HOST_STREAM_OUTPUT written to the IN FIFO to the first
+    // stereo frame read by a transmitter (compare the default build with -D CONTROL_ON_FIFO_CLK).
+    // Seek latency: the time from a CMD_HOST_FLUSH written to the IN FIFO to the flush of the transmitters.
+    //==================================================================================================================
+    time first_stream_time = 0;
+    time flush_time = 0;
+    // A command byte written to the IN FIFO (FRAME_CMD in ft2232_fifo).
+    logic in_fifo_cmd;
+    logic [7:0] in_fifo_data;
+    assign in_fifo_cmd = audio_m.ft2232_fifo_m.wr_in_fifo_en_o && audio_m.ft2232_fifo_m.frame_state_m == 2'd0;
+    assign in_fifo_data = audio_m.ft2232_fifo_m.wr_in_fifo_data_o;
+    always @(posedge audio_m.ft2232_fifo_m.fifo_clk_i) begin
+        if (in_fifo_cmd) begin
+            if (first_stream_time == 0 && in_fifo_data[7:5] == `CMD_HOST_STREAM_OUTPUT) begin
+                first_stream_time = $time;
+            end
+            if (in_fifo_data == {`CMD_HOST_FLUSH, 5'd0}) begin
+                flush_time = $time;
+            end
+        end
+    end
+
+    logic first_frame_out = 1'b0;
+    always @(posedge audio_m.control_m.tx_clk) begin
+        if (~first_frame_out && first_stream_time != 0 && (audio_m.control_m.tx_i2s_m.rd_output_FIFO_en ||
+                                    audio_m.control_m.tx_spdif_m.rd_output_FIFO_en)) begin
+            first_frame_out <= 1'b1;
+            $display ($time, " SIM:\tFirst frame output %0d ns after the stream command.",
+                                ($time - first_stream_time) / 1000);
+        end
+    end
+
+    logic flush_output = 1'b0;
+    always @(posedge audio_m.control_m.clk) begin
+        flush_output <= audio_m.control_m.flush_output;
+        if (~flush_output && audio_m.control_m.flush_output && flush_time != 0) begin
+            $display ($time, " SIM:\tFlush %0d ns after the flush command.", ($time - flush_time) / 1000);
+        end
+    end
+
     //==================================================================================================================
     // The initial block
     //==================================================================================================================
@@ -0,0 +1,219 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ * This is the top module for the DoP encoder test bench (sim.sh -t dop). A writer at the control clock streams raw DSD
+ * bytes (L0 R0 L1 R1 ..., an 8-bit LFSR for the left channel and its complement for the right channel) to dop_encoder,
+ * which feeds tx_i2s in DoP mode at the DoP rate BENCH_SAMPLE_RATE. The I2S words are decoded (the MSB one bit clock
+ * after the lrck edge, left while lrck is low) and the DoP markers, the DSD bytes, the frame rate and the underruns
+ * are checked. The bytes written by the host are compared with the DoP bytes a host side packer would have sent.
+ **********************************************************************************************************************/
+`timescale 1ps/1ps
+`default_nettype none
+
+`include "definitions.svh"
+
+module sim_dop;
+`ifdef BENCH_SAMPLE_RATE
+    localparam logic [2:0] SAMPLE_RATE = `BENCH_SAMPLE_RATE;
+`else
+    localparam logic [2:0] SAMPLE_RATE = `STREAM_176400_HZ;
+`endif
+    localparam FRAMES = 256;
+
+    // 147.456MHz -> 6781 ps, 135.4752MHz -> 7381 ps, 117.9648MHz control clock -> 8477 ps
+    localparam TX_CLK_PS = SAMPLE_RATE[2] ? 6781 : 7381;
+    localparam WR_CLK_PS = 8477;
+    localparam real FRAME_HZ = (SAMPLE_RATE[2] ? 48000.0 : 44100.0) * (1 << SAMPLE_RATE[1:0]);
+
+    logic tx_clk = 1'b0, wr_clk = 1'b0;
+    always #(TX_CLK_PS/2) tx_clk = ~tx_clk;
+    always #(WR_CLK_PS/2) wr_clk = ~wr_clk;
+
+    logic reset = 1'b1;
+
+    // The bit clock strobes, as in control: i2s_bit_period of DoP (24-bit frames), 64 / 2^rate master clocks per bit.
+    logic bit_en;
+    bit_clock_enable bit_en_m (
+        .reset_i            (reset),
+        .clk_i              (tx_clk),
+        .period_i           (7'd64 >> SAMPLE_RATE[1:0]),
+        .en_o               (bit_en));
+
+    logic wr_en, tx_wr_en, dop_full, wr_afull, wr_full, streaming, sdata, bclk, lrck, mclk, dsd, bclk_rise;
+    logic [7:0] wr_data, tx_wr_data;
+    logic [31:0] frames_gray;
+    dop_encoder dop_encoder_m (
+        .reset_i            (reset),
+        .clk_i              (wr_clk),
+        .enable_i           (1'b1),
+        .en_i               (wr_en),
+        .data_i             (wr_data),
+        .ready_i            (~wr_afull && ~wr_full),
+        .en_o               (tx_wr_en),
+        .data_o             (tx_wr_data),
+        .full_o             (dop_full));
+
+    tx_i2s tx_i2s_m (
+        .reset_i            (reset),
+        .clk_i              (tx_clk),
+        .bit_en_i           (bit_en),
+        .mclk_i             (1'b0),
+        // Streaming configuration
+        .sample_rate_i      (SAMPLE_RATE),
+        .bit_depth_i        (`BIT_DEPTH_DOP),
+        .dsd_i              (1'b0),
+        .tdm_i              (`TDM_OFF),
+        .slot_width_i       (`BIT_DEPTH_32),
+        .lines_i            (`LINES_1),
+        .pause_i            (1'b0),
+        .start_i            (1'b1),
+        // Output FIFO ports
+        .wr_output_FIFO_clk_i   (wr_clk),
+        .wr_output_FIFO_en_i    (tx_wr_en),
+        .wr_output_FIFO_data_i  (tx_wr_data),
+        .wr_output_FIFO_afull_o (wr_afull),
+        .wr_output_FIFO_full_o  (wr_full),
+        .output_streaming_o     (streaming),
+        .frames_emitted_gray_o  (frames_gray),
+        // I2S outputs
+        .sdata_o            (sdata),
+        .bclk_o             (bclk),
+        .lrck_o             (lrck),
+        .mclk_o             (mclk),
+        .dsd_o              (dsd),
+        .bclk_rise_o        (bclk_rise));
+
+    function [7:0] lfsr_next (input logic [7:0] value);
+        lfsr_next = {value[6:0], value[7] ^ value[5] ^ value[4] ^ value[3]};
+    endfunction
+
+    //==================================================================================================================
+    // The writer: raw DSD bytes, left and right interleaved, as fast as the encoder accepts them (control writes at
+    // most every other clock).
+    //==================================================================================================================
+    logic [7:0] wr_lfsr_l, wr_lfsr_r;
+    integer wr_bytes, dop_bytes;
+
+    always @(posedge wr_clk) begin
+        if (reset) begin
+            wr_en <= 1'b0;
+            wr_lfsr_l <= 8'h01;
+            wr_lfsr_r <= 8'h01;
+            wr_bytes <= 0;
+            dop_bytes <= 0;
+        end else begin
+            wr_en <= 1'b0;
+            if (tx_wr_en) dop_bytes <= dop_bytes + 1;
+            if (~dop_full && ~wr_afull && ~wr_full && ~wr_en && wr_bytes < FRAMES * 4) begin
+                wr_en <= 1'b1;
+                wr_bytes <= wr_bytes + 1;
+                if (wr_bytes[0]) begin
+                    wr_data <= ~wr_lfsr_r;
+                    wr_lfsr_r <= lfsr_next (wr_lfsr_r);
+                end else begin
+                    wr_data <= wr_lfsr_l;
+                    wr_lfsr_l <= lfsr_next (wr_lfsr_l);
+                end
+            end
+        end
+    end
+
+    //==================================================================================================================
+    // The decoder: sdata is sampled on the falling edges and lrck on the rising edges of the bit clock.
+    //==================================================================================================================
+    logic [7:0] rd_lfsr_l = 8'h01, rd_lfsr_r = 8'h01, marker = 8'h05;
+    logic [23:0] shift;
+    logic lrck_rise, channel = 1'b1, synced = 1'b0;
+    integer bits = 0, words = 0, errors = 0, underruns = 0, dsd_low = 0;
+    longint first_word_time, last_word_time;
+
+    always @(posedge bclk) begin
+        lrck_rise = lrck;
+    end
+
+    // The word of the previous channel ends when lrck changes: it is checked against the next DSD bytes.
+    task word_task;
+        logic [23:0] expected;
+        if (~channel) begin
+            expected = {marker, rd_lfsr_l, lfsr_next (rd_lfsr_l)};
+            rd_lfsr_l = lfsr_next (lfsr_next (rd_lfsr_l));
+        end else begin
+            expected = {marker, ~rd_lfsr_r, ~lfsr_next (rd_lfsr_r)};
+            rd_lfsr_r = lfsr_next (lfsr_next (rd_lfsr_r));
+            marker = ~marker;
+        end
+
+        if (bits != 24 || shift != expected) begin
+            if (errors < 8) $display ($time, " DOP:\tword %0d (%s): %h, %0d bits (expected %h)", words,
+                                            channel ? "R" : "L", shift, bits, expected);
+            errors = errors + 1;
+        end
+        if (words == 0) first_word_time = $time;
+        last_word_time = $time;
+        words = words + 1;
+    endtask
+
+    always @(negedge bclk) begin
+        if (streaming) begin
+            if (~dsd) dsd_low = dsd_low + 1;
+            if (lrck_rise != channel) begin
+                // The first lrck edge starts the first left word.
+                if (synced) word_task;
+                synced = 1'b1;
+                channel = lrck_rise;
+                bits = 0;
+            end
+            shift = {shift[22:0], sdata};
+            bits = bits + 1;
+        end
+    end
+
+    // The stream stops after the last right word without a lrck edge. It must not stop before the last frame: the
+    // writer is faster than the DoP rate.
+    always @(negedge streaming) begin
+        if (channel && bits == 24) begin
+            word_task;
+            bits = 0;
+        end
+        if (words < FRAMES) underruns = underruns + 1;
+    end
+
+    //==================================================================================================================
+    // The initial block
+    //==================================================================================================================
+    initial begin
+        #200000 reset = 1'b0;
+
+        wait (words == FRAMES);
+        wait (~streaming);
+        $display ("DOP BENCH: rate %3b: %0d words, %.1f Hz (expected %.1f Hz), dsd_o low %0d bits, ",
+                        SAMPLE_RATE, words, (words - 1) * 1000000000000.0 / (last_word_time - first_word_time),
+                        2.0 * FRAME_HZ, dsd_low,
+                    "word errors %0d, underruns %0d, host bytes %0d (%0d DoP bytes).",
+                        errors, underruns, wr_bytes, dop_bytes);
+        $finish (0);
+    end
+
+    initial begin
+        #100000000000
+        $display($time, " SIM: ---------------------- Simulation end [Timeout] ------------------------");
+        $display ("DOP BENCH: rate %3b: timeout after %0d of %0d words (word errors %0d, underruns %0d).",
+                        SAMPLE_RATE, words, FRAMES, errors, underruns);
+        $finish (1);
+    end
+endmodule
@@ -0,0 +1,183 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ * This is the top module for the native DSD test bench (sim.sh -t dsd). tx_i2s runs in DSD mode on the master clock
+ * of the family of BENCH_SAMPLE_RATE with the bit clock strobes of control. A writer at the control clock streams
+ * FRAMES frames of two byte sequences (an 8-bit LFSR for the left channel and its complement for the right channel) as
+ * fast as the FIFO accepts them. The DSD outputs are decoded MSB first on the falling edges of the DSD bit clock; the
+ * bit order, the bit rate and the underruns (the stream stops before the last frame) are checked and printed.
+ **********************************************************************************************************************/
+`timescale 1ps/1ps
+`default_nettype none
+
+`include "definitions.svh"
+
+module sim_dsd;
+`ifdef BENCH_SAMPLE_RATE
+    localparam logic [2:0] SAMPLE_RATE = `BENCH_SAMPLE_RATE;
+`else
+    localparam logic [2:0] SAMPLE_RATE = `STREAM_352800_HZ;
+`endif
+    localparam FRAMES = 256;
+
+    // 147.456MHz -> 6781 ps, 135.4752MHz -> 7381 ps, 117.9648MHz control clock -> 8477 ps
+    localparam TX_CLK_PS = SAMPLE_RATE[2] ? 6781 : 7381;
+    localparam WR_CLK_PS = 8477;
+    // DSD64 x 2^rate: 64 x 44100 or 48000 x 2^rate
+    localparam real DSD_HZ = (SAMPLE_RATE[2] ? 3072000.0 : 2822400.0) * (1 << SAMPLE_RATE[1:0]);
+
+    logic tx_clk = 1'b0, wr_clk = 1'b0;
+    always #(TX_CLK_PS/2) tx_clk = ~tx_clk;
+    always #(WR_CLK_PS/2) wr_clk = ~wr_clk;
+
+    logic reset = 1'b1;
+
+    // The bit clock strobes, as in control: i2s_bit_period of native DSD, 48 / 2^rate master clocks per bit.
+    logic bit_en;
+    bit_clock_enable bit_en_m (
+        .reset_i            (reset),
+        .clk_i              (tx_clk),
+        .period_i           (7'd48 >> SAMPLE_RATE[1:0]),
+        .en_o               (bit_en));
+
+    logic wr_en, wr_afull, wr_full, streaming, sdata, bclk, lrck, mclk, dsd, bclk_rise;
+    logic [7:0] wr_data;
+    logic [31:0] frames_gray;
+    tx_i2s tx_i2s_m (
+        .reset_i            (reset),
+        .clk_i              (tx_clk),
+        .bit_en_i           (bit_en),
+        .mclk_i             (1'b0),
+        // Streaming configuration
+        .sample_rate_i      (SAMPLE_RATE),
+        .bit_depth_i        (`BIT_DEPTH_DOP),
+        .dsd_i              (1'b1),
+        .tdm_i              (`TDM_OFF),
+        .slot_width_i       (`BIT_DEPTH_32),
+        .lines_i            (`LINES_1),
+        .pause_i            (1'b0),
+        .start_i            (1'b1),
+        // Output FIFO ports
+        .wr_output_FIFO_clk_i   (wr_clk),
+        .wr_output_FIFO_en_i    (wr_en),
+        .wr_output_FIFO_data_i  (wr_data),
+        .wr_output_FIFO_afull_o (wr_afull),
+        .wr_output_FIFO_full_o  (wr_full),
+        .output_streaming_o     (streaming),
+        .frames_emitted_gray_o  (frames_gray),
+        // I2S outputs
+        .sdata_o            (sdata),
+        .bclk_o             (bclk),
+        .lrck_o             (lrck),
+        .mclk_o             (mclk),
+        .dsd_o              (dsd),
+        .bclk_rise_o        (bclk_rise));
+
+    function [7:0] lfsr_next (input logic [7:0] value);
+        lfsr_next = {value[6:0], value[7] ^ value[5] ^ value[4] ^ value[3]};
+    endfunction
+
+    //==================================================================================================================
+    // The writer: 4 left bytes then 4 right bytes per frame, in time order.
+    //==================================================================================================================
+    logic [7:0] wr_lfsr_l, wr_lfsr_r;
+    integer wr_bytes;
+
+    always @(posedge wr_clk) begin
+        if (reset) begin
+            wr_en <= 1'b0;
+            wr_lfsr_l <= 8'h01;
+            wr_lfsr_r <= 8'h01;
+            wr_bytes <= 0;
+        end else begin
+            wr_en <= 1'b0;
+            if (~wr_afull && ~wr_full && ~wr_en && wr_bytes < FRAMES * 8) begin
+                wr_en <= 1'b1;
+                wr_bytes <= wr_bytes + 1;
+                if (wr_bytes[2]) begin
+                    wr_data <= ~wr_lfsr_r;
+                    wr_lfsr_r <= lfsr_next (wr_lfsr_r);
+                end else begin
+                    wr_data <= wr_lfsr_l;
+                    wr_lfsr_l <= lfsr_next (wr_lfsr_l);
+                end
+            end
+        end
+    end
+
+    //==================================================================================================================
+    // The decoder
+    //==================================================================================================================
+    logic [7:0] byte_l, byte_r, rd_lfsr_l = 8'h01, rd_lfsr_r = 8'h01;
+    logic started = 1'b0;
+    integer bits = 0, errors = 0, underruns = 0, dsd_low = 0;
+    longint first_bit_time, last_bit_time;
+
+    // The bit clock rises with the first bit. The falling edge after the start of the stream comes before it.
+    always @(posedge bclk) begin
+        if (streaming) started = 1'b1;
+    end
+
+    always @(negedge bclk) begin
+        if (streaming && started) begin
+            if (~dsd) dsd_low = dsd_low + 1;
+            if (bits == 0) first_bit_time = $time;
+            last_bit_time = $time;
+            byte_l = {byte_l[6:0], sdata};
+            byte_r = {byte_r[6:0], lrck};
+            bits = bits + 1;
+            if (bits % 8 == 0) begin
+                if (byte_l != rd_lfsr_l || byte_r != ~rd_lfsr_r) begin
+                    if (errors < 8) $display ($time, " DSD:\tbyte %0d: L %h (expected %h) R %h (expected %h)",
+                                                    bits / 8 - 1, byte_l, rd_lfsr_l, byte_r, ~rd_lfsr_r);
+                    errors = errors + 1;
+                end
+                rd_lfsr_l = lfsr_next (rd_lfsr_l);
+                rd_lfsr_r = lfsr_next (rd_lfsr_r);
+            end
+        end
+    end
+
+    // The stream must not stop before the last frame: the writer is faster than the DSD rate.
+    always @(negedge streaming) begin
+        if (bits < FRAMES * 32) underruns = underruns + 1;
+    end
+
+    //==================================================================================================================
+    // The initial block
+    //==================================================================================================================
+    initial begin
+        #200000 reset = 1'b0;
+
+        wait (bits == FRAMES * 32);
+        wait (~streaming);
+        $display ("DSD BENCH: rate %3b: %0d bits per channel, %.1f Hz (expected %.1f Hz), dsd_o low %0d bits, ",
+                        SAMPLE_RATE, bits, (bits - 1) * 1000000000000.0 / (last_bit_time - first_bit_time), DSD_HZ,
+                        dsd_low,
+                    "byte errors %0d, underruns %0d.", errors, underruns);
+        $finish (0);
+    end
+
+    initial begin
+        #100000000000
+        $display($time, " SIM: ---------------------- Simulation end [Timeout] ------------------------");
+        $display ("DSD BENCH: rate %3b: timeout after %0d of %0d bits (byte errors %0d, underruns %0d).",
+                        SAMPLE_RATE, bits, FRAMES * 32, errors, underruns);
+        $finish (1);
+    end
+endmodule
@@ -0,0 +1,179 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ * This is the top module for the async FIFO benchmark (sim.sh -t fifo). A producer at the FT2232 clock writes a
+ * counter while wr_awfull_o is low. Its writes reach the FIFO BENCH_WR_LATENCY clocks after the decision, as the bytes
+ * in flight after RD# deassertion do. A consumer reads two clocks per word, as control does, and starts a burst when
+ * more than AREMPTY_LEVEL words are stored. The transfer rate, producer stalls, dropped words and data errors are
+ * printed at the end.
+ **********************************************************************************************************************/
+`timescale 1ps/1ps
+`default_nettype none
+
+module sim_fifo;
+`ifdef BENCH_ASIZE
+    localparam ASIZE = `BENCH_ASIZE;
+`else
+    localparam ASIZE = 5;
+`endif
+`ifdef BENCH_AWFULL
+    localparam AWFULL_LEVEL = `BENCH_AWFULL;
+`else
+    localparam AWFULL_LEVEL = 1;
+`endif
+`ifdef BENCH_AREMPTY
+    localparam AREMPTY_LEVEL = `BENCH_AREMPTY;
+`else
+    localparam AREMPTY_LEVEL = 1;
+`endif
+`ifdef BENCH_WR_LATENCY
+    localparam WR_LATENCY = `BENCH_WR_LATENCY;
+`else
+    localparam WR_LATENCY = 2;
+`endif
+    localparam WORDS = 100000;
+
+    // 60MHz FT2232 clock -> 16667 ps, 117.9648MHz control clock -> 8477 ps (24.576MHz -> 40690 ps)
+    localparam WR_CLK_PS = 16667;
+`ifdef BENCH_RD_CLK_PS
+    localparam RD_CLK_PS = `BENCH_RD_CLK_PS;
+`else
+    localparam RD_CLK_PS = 8477;
+`endif
+    logic wr_clk = 1'b0, rd_clk = 1'b0;
+    always #(WR_CLK_PS/2) wr_clk = ~wr_clk;
+    always #(RD_CLK_PS/2) rd_clk = ~rd_clk;
+
+    logic reset = 1'b1;
+
+    logic wr_en, wr_full, wr_awfull, rd_en, rd_empty, rd_arempty;
+    logic [7:0] wr_data, rd_data;
+    logic [ASIZE:0] wr_count, rd_count;
+    async_fifo #(.ASIZE(ASIZE), .AWFULL_LEVEL(AWFULL_LEVEL), .AREMPTY_LEVEL(AREMPTY_LEVEL)) fifo_m (
+        // Write to FIFO
+        .wr_reset_i         (reset),
+        .wr_en_i            (wr_en),
+        .wr_clk_i           (wr_clk),
+        .wr_data_i          (wr_data),
+        .wr_full_o          (wr_full),
+        .wr_awfull_o        (wr_awfull),
+        .wr_count_o         (wr_count),
+        // Read from FIFO
+        .rd_reset_i         (reset),
+        .rd_en_i            (rd_en),
+        .rd_clk_i           (rd_clk),
+        .rd_data_o          (rd_data),
+        .rd_empty_o         (rd_empty),
+        .rd_arempty_o       (rd_arempty),
+        .rd_count_o         (rd_count));
+
+    //==================================================================================================================
+    // The producer
+    //==================================================================================================================
+    logic [15:0] wr_pipe;
+    logic wr_issue, wr_done;
+    integer words_issued, wr_stalls, wr_drops, max_wr_count;
+    longint first_wr_time;
+
+    assign wr_issue = ~wr_awfull && ~wr_full && ~wr_done;
+    assign wr_en = wr_pipe[WR_LATENCY-1];
+
+    always @(posedge wr_clk) begin
+        if (reset) begin
+            wr_pipe <= 16'h0;
+            wr_data <= 8'h0;
+            wr_done <= 1'b0;
+            words_issued <= 0;
+            wr_stalls <= 0;
+            wr_drops <= 0;
+            max_wr_count <= 0;
+        end else begin
+            wr_pipe <= {wr_pipe[14:0], wr_issue};
+            if (wr_issue) begin
+                if (words_issued == 0) first_wr_time = $time;
+                words_issued <= words_issued + 1;
+                wr_done <= words_issued + 1 == WORDS;
+            end else if (~wr_done) begin
+                wr_stalls <= wr_stalls + 1;
+            end
+
+            if (wr_en) begin
+                // A word arriving while full is lost.
+                if (wr_full) wr_drops <= wr_drops + 1;
+                wr_data <= wr_data + 1'b1;
+            end
+
+            if (wr_count > max_wr_count) max_wr_count <= wr_count;
+        end
+    end
+
+    //==================================================================================================================
+    // The consumer
+    //==================================================================================================================
+    logic rd_active;
+    logic [7:0] rd_expected;
+    integer words_read, rd_errors, rd_bursts;
+
+    always @(posedge rd_clk) begin
+        if (reset) begin
+            rd_en <= 1'b0;
+            rd_active <= 1'b0;
+            rd_expected <= 8'h0;
+            words_read <= 0;
+            rd_errors <= 0;
+            rd_bursts <= 0;
+        end else if (rd_en) begin
+            if (rd_data != rd_expected) rd_errors <= rd_errors + 1;
+            // Resynchronize after a dropped word.
+            rd_expected <= rd_data + 1'b1;
+            words_read <= words_read + 1;
+            rd_en <= 1'b0;
+        end else if (rd_active) begin
+            if (~rd_empty) rd_en <= 1'b1;
+            else rd_active <= 1'b0;
+        end else if (~rd_arempty || (wr_done && ~rd_empty)) begin
+            // Start on the watermark. The tail of the stream is drained when the producer is done.
+            rd_active <= 1'b1;
+            rd_bursts <= rd_bursts + 1;
+        end
+    end
+
+    //==================================================================================================================
+    // The initial block
+    //==================================================================================================================
+    initial begin
+        #200000 reset = 1'b0;
+
+        wait (words_read + wr_drops == WORDS);
+        // Fixed width fields: the lines of a sim.sh -t fifo sweep form a table.
+        $display ("FIFO BENCH: ASIZE %2d AWFULL %2d AREMPTY %2d latency %2d rd clock %5d ps: %6d words in %8d ns, ",
+                        ASIZE, AWFULL_LEVEL, AREMPTY_LEVEL, WR_LATENCY, RD_CLK_PS, words_read,
+                        ($time - first_wr_time) / 1000,
+                    "%6.2f Mwords/s, ",
+                        words_read * 1000000.0 / ($time - first_wr_time),
+                    "producer stalls %5d, max count %5d, bursts %5d, drops %5d, errors %0d.",
+                        wr_stalls, max_wr_count, rd_bursts, wr_drops, rd_errors);
+        $finish (0);
+    end
+
+    initial begin
+        #100000000000
+        $display($time, " SIM: ---------------------- Simulation end [Timeout] ------------------------");
+        $finish (1);
+    end
+endmodule
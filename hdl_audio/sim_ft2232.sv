@@ -67,9 +67,15 @@ module sim_ft2232 (
 
     logic [3:0] in_payload_bytes, total_in_payload_bytes;
     logic [2:0] in_last_cmd;
+    logic [31:0] in_counter;
+    // Input frames received and the time of the first one (to measure the input frame rate).
+    logic [31:0] in_frames;
+    time in_first_frame_time;
 
     logic send_data, start_sending_data;
     logic [31:0] out_index;
+    // The time of the first byte sent to the FPGA (to measure the host to FPGA throughput).
+    time out_first_time;
 
     localparam STATE_IN_CMD             = 2'b00;
     localparam STATE_IN_PAYLOAD         = 2'b01;
@@ -122,10 +128,13 @@ module sim_ft2232 (
 `ifdef D_FT2232
             $display ($time, "\033[0;35m FT2232:\t%d bytes. \033[0;0m", out_index);
 `endif
+            if (out_index == 0) out_first_time = $time;
             fifo_data_o <= sound_data[out_index];
             out_index <= out_index + 1;
         end else begin
             send_data <= 1'b0;
+            $display ($time, "\033[0;35m FT2232:\tAll %0d bytes sent in %0d ns | %0d KB/s. \033[0;0m", out_index,
+                                ($time - out_first_time) / 1000, out_index * 1000000000 / ($time - out_first_time));
         end
     endtask
 
@@ -147,6 +156,23 @@ module sim_ft2232 (
                         in_state_m <= STATE_IN_PAYLOAD;
                     end
 
+                    `CMD_FPGA_COUNTER, `CMD_FPGA_POSITION: begin
+`ifdef D_FT2232
+                        $display ($time, "\033[0;35m FT2232:\t<--- [STATE_IN_CMD] %s [payload bytes: %d]. \033[0;0m",
+                                        fifo_data_i[7:5] == `CMD_FPGA_COUNTER ? "CMD_FPGA_COUNTER" : "CMD_FPGA_POSITION",
+                                        fifo_data_i[4:0]);
+`endif
+                        total_in_payload_bytes <= fifo_data_i[3:0];
+                        in_payload_bytes <= fifo_data_i[3:0];
+                        in_state_m <= STATE_IN_PAYLOAD;
+                    end
+
+                    `CMD_FPGA_INPUT: begin
+                        total_in_payload_bytes <= fifo_data_i[3:0];
+                        in_payload_bytes <= fifo_data_i[3:0];
+                        in_state_m <= STATE_IN_PAYLOAD;
+                    end
+
                     default: begin
 `ifdef D_FT2232
                         $display ($time, "\033[0;35m FT2232:\t<--- [STATE_IN_CMD] Unknown command %d. \033[0;0m",
@@ -200,6 +226,54 @@ module sim_ft2232 (
                             in_state_m <= STATE_IN_CMD;
                         end
                     end
+
+                    `CMD_FPGA_COUNTER: begin
+                        // Big endian sample count.
+                        in_counter <= {in_counter[23:0], fifo_data_i};
+                        in_payload_bytes <= in_payload_bytes - 4'd1;
+                        if (in_payload_bytes == 4'd1) begin
+`ifdef D_FT2232
+                            $display ($time, "\033[0;35m FT2232:\t<--- [STATE_IN_PAYLOAD for CMD_FPGA_COUNTER] Sample count: %d. \033[0;0m",
+                                            {in_counter[23:0], fifo_data_i});
+`endif
+                            in_state_m <= STATE_IN_CMD;
+                        end
+                    end
+
+                    `CMD_FPGA_POSITION: begin
+                        // Big endian I2S frames followed by SPDIF frames.
+                        in_counter <= {in_counter[23:0], fifo_data_i};
+                        in_payload_bytes <= in_payload_bytes - 4'd1;
+                        if (in_payload_bytes == 4'd5 || in_payload_bytes == 4'd1) begin
+`ifdef D_FT2232
+                            $display ($time, "\033[0;35m FT2232:\t<--- [STATE_IN_PAYLOAD for CMD_FPGA_POSITION] %s frames: %d. \033[0;0m",
+                                            in_payload_bytes == 4'd5 ? "I2S" : "SPDIF", {in_counter[23:0], fifo_data_i});
+`endif
+                        end
+                        if (in_payload_bytes == 4'd1) begin
+                            in_state_m <= STATE_IN_CMD;
+                        end
+                    end
+
+                    `CMD_FPGA_INPUT: begin
+                        // One stereo frame per packet.
+                        in_payload_bytes <= in_payload_bytes - 4'd1;
+                        if (in_payload_bytes == 4'd1) begin
+                            in_frames <= in_frames + 32'd1;
+                            if (in_frames == 32'd0) begin
+                                in_first_frame_time <= $time;
+`ifdef D_FT2232
+                                $display ($time, "\033[0;35m FT2232:\t<--- [STATE_IN_PAYLOAD for CMD_FPGA_INPUT] First input frame. \033[0;0m");
+`endif
+                            end else if (in_frames[11:0] == 12'd0) begin
+`ifdef D_FT2232
+                                $display ($time, "\033[0;35m FT2232:\t<--- [STATE_IN_PAYLOAD for CMD_FPGA_INPUT] Input frames: %0d | %0d Hz. \033[0;0m",
+                                                in_frames, 64'd1000000000000 * in_frames / ($time - in_first_frame_time));
+`endif
+                            end
+                            in_state_m <= STATE_IN_CMD;
+                        end
+                    end
                 endcase
             end
 
@@ -217,6 +291,7 @@ module sim_ft2232 (
     always @(posedge fifo_clk_o, negedge ft2232_reset_n_i) begin
         if (~ft2232_reset_n_i) begin
             in_state_m <= STATE_IN_CMD;
+            in_frames <= 32'd0;
 
             send_data <= 1'b1;
             start_sending_data <= 1'b1;
@@ -0,0 +1,213 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ * This is the top module for the I2S loopback test bench (sim.sh -t i2s). tx_i2s sends FRAMES frames at
+ * BENCH_SAMPLE_RATE and BENCH_BIT_DEPTH and its data line is fed back to rx_i2s, as with I2S_LOOPBACK. A writer at the
+ * control clock streams the frames (the frame number in the left sample and its complement in the right sample) and a
+ * reader at the control clock empties the input FIFO of the receiver, but stops reading for STALL_FRAMES frame periods
+ * after the first frames, as the capture does when the USB path stalls. The captured frames must follow each other
+ * without gaps or errors and the receiver must not report an overrun. The frame rate of the receiver is printed.
+ **********************************************************************************************************************/
+`timescale 1ps/1ps
+`default_nettype none
+
+`include "definitions.svh"
+
+module sim_i2s;
+`ifdef BENCH_SAMPLE_RATE
+    localparam logic [2:0] SAMPLE_RATE = `BENCH_SAMPLE_RATE;
+`else
+    localparam logic [2:0] SAMPLE_RATE = `STREAM_192000_HZ;
+`endif
+`ifdef BENCH_BIT_DEPTH
+    localparam logic [1:0] BIT_DEPTH = `BENCH_BIT_DEPTH;
+`else
+    localparam logic [1:0] BIT_DEPTH = `BIT_DEPTH_32;
+`endif
+    localparam FRAMES = 1536;
+`ifdef BENCH_STALL_FRAMES
+    localparam STALL_FRAMES = `BENCH_STALL_FRAMES;
+`else
+    // 3/4 of the 1024 frames of the input FIFO.
+    localparam STALL_FRAMES = 768;
+`endif
+    localparam SAMPLE_BITS = BIT_DEPTH == `BIT_DEPTH_16 ? 16 : BIT_DEPTH == `BIT_DEPTH_24 ? 24 : 32;
+    localparam SAMPLE_BYTES = SAMPLE_BITS / 8;
+    localparam logic [6:0] BIT_PERIOD = (3072 / (2 * SAMPLE_BITS)) >> SAMPLE_RATE[1:0];
+
+    // 147.456MHz -> 6781 ps, 135.4752MHz -> 7381 ps, 117.9648MHz control clock -> 8477 ps
+    localparam TX_CLK_PS = SAMPLE_RATE[2] ? 6781 : 7381;
+    localparam WR_CLK_PS = 8477;
+    localparam real FRAME_HZ = (SAMPLE_RATE[2] ? 48000.0 : 44100.0) * (1 << SAMPLE_RATE[1:0]);
+
+    logic tx_clk = 1'b0, wr_clk = 1'b0;
+    always #(TX_CLK_PS/2) tx_clk = ~tx_clk;
+    always #(WR_CLK_PS/2) wr_clk = ~wr_clk;
+
+    logic reset = 1'b1;
+
+    // The bit clock strobes, as in control: 3072 / (bits per frame x 2^rate) master clocks per bit.
+    logic bit_en;
+    bit_clock_enable bit_en_m (
+        .reset_i            (reset),
+        .clk_i              (tx_clk),
+        .period_i           (BIT_PERIOD),
+        .en_o               (bit_en));
+
+    logic wr_en, wr_afull, wr_full, streaming, sdata, bclk, lrck, mclk, dsd, bclk_rise;
+    logic [7:0] wr_data;
+    logic [31:0] frames_gray;
+    tx_i2s tx_i2s_m (
+        .reset_i            (reset),
+        .clk_i              (tx_clk),
+        .bit_en_i           (bit_en),
+        .mclk_i             (1'b0),
+        // Streaming configuration
+        .sample_rate_i      (SAMPLE_RATE),
+        .bit_depth_i        (BIT_DEPTH),
+        .dsd_i              (1'b0),
+        .tdm_i              (`TDM_OFF),
+        .slot_width_i       (BIT_DEPTH),
+        .lines_i            (`LINES_1),
+        .pause_i            (1'b0),
+        .start_i            (1'b1),
+        // Output FIFO ports
+        .wr_output_FIFO_clk_i   (wr_clk),
+        .wr_output_FIFO_en_i    (wr_en),
+        .wr_output_FIFO_data_i  (wr_data),
+        .wr_output_FIFO_afull_o (wr_afull),
+        .wr_output_FIFO_full_o  (wr_full),
+        .output_streaming_o     (streaming),
+        .frames_emitted_gray_o  (frames_gray),
+        // I2S outputs
+        .sdata_o            (sdata),
+        .bclk_o             (bclk),
+        .lrck_o             (lrck),
+        .mclk_o             (mclk),
+        .dsd_o              (dsd),
+        .bclk_rise_o        (bclk_rise));
+
+    // The receiver on the master clock, bit clock strobe and LRCK of the transmitter, as in control.
+    logic rd_en, rd_empty, overrun;
+    logic [63:0] rd_data;
+    rx_i2s rx_i2s_m (
+        .reset_i            (reset),
+        .bit_depth_i        (BIT_DEPTH),
+        .rd_input_FIFO_clk_i    (wr_clk),
+        .rd_input_FIFO_en_i     (rd_en),
+        .rd_input_FIFO_data_o   (rd_data),
+        .rd_input_FIFO_empty_o  (rd_empty),
+        .overrun_o          (overrun),
+        .clk_i              (tx_clk),
+        .bit_en_i           (bclk_rise),
+        .lrck_i             (lrck),
+        .sdata_i            (sdata));
+
+    //==================================================================================================================
+    // The writer: the bytes of the left then the right sample (little endian), at most a byte every other clock.
+    //==================================================================================================================
+    integer wr_bytes;
+    logic [31:0] wr_sample;
+    always @(*) begin
+        wr_sample = wr_bytes / (2 * SAMPLE_BYTES);
+        if ((wr_bytes / SAMPLE_BYTES) % 2 == 1) wr_sample = ~wr_sample;
+    end
+
+    always @(posedge wr_clk) begin
+        if (reset) begin
+            wr_en <= 1'b0;
+            wr_bytes <= 0;
+        end else begin
+            wr_en <= 1'b0;
+            if (~wr_afull && ~wr_full && ~wr_en && wr_bytes < FRAMES * 2 * SAMPLE_BYTES) begin
+                wr_en <= 1'b1;
+                wr_data <= wr_sample[8 * (wr_bytes % SAMPLE_BYTES) +: 8];
+                wr_bytes <= wr_bytes + 1;
+            end
+        end
+    end
+
+    //==================================================================================================================
+    // The receiver frame rate: the frames written to the input FIFO.
+    //==================================================================================================================
+    integer rx_frames = 0;
+    longint first_frame_time, last_frame_time;
+    always @(posedge tx_clk) begin
+        if (rx_i2s_m.wr_input_FIFO_en) begin
+            if (rx_frames == 0) first_frame_time = $time;
+            last_frame_time = $time;
+            rx_frames = rx_frames + 1;
+        end
+    end
+
+    //==================================================================================================================
+    // The reader: the first frame sets the expected frame number, then the frames must follow each other.
+    //==================================================================================================================
+    localparam logic [31:0] SAMPLE_MASK = SAMPLE_BITS == 32 ? 32'hffffffff : (32'd1 << SAMPLE_BITS) - 32'd1;
+    integer frames_read = 0, first_frame = -1, errors = 0;
+    longint stall_end_time = 0;
+    logic stalled = 1'b0;
+    logic [31:0] left, right, expected;
+    assign rd_en = ~rd_empty && ~stalled;
+
+    always @(posedge wr_clk) begin
+        if (rd_en) begin
+            // Right justified samples.
+            left = rd_data[63:32] >> (32 - SAMPLE_BITS);
+            right = rd_data[31:0] >> (32 - SAMPLE_BITS);
+            if (first_frame < 0) first_frame = left;
+            expected = (first_frame + frames_read) & SAMPLE_MASK;
+            if (left != expected || right != (~expected & SAMPLE_MASK)) begin
+                if (errors < 8) $display ($time, " I2S:\tframe %0d: %h %h (expected %h %h)", frames_read, left, right,
+                                                expected, ~expected & SAMPLE_MASK);
+                errors = errors + 1;
+            end
+            frames_read = frames_read + 1;
+            if (frames_read == 64) begin
+                stalled = 1'b1;
+                stall_end_time = $time + longint'(STALL_FRAMES * 1000000000000.0 / FRAME_HZ);
+            end
+        end
+
+        if (stalled && $time >= stall_end_time) stalled = 1'b0;
+    end
+
+    //==================================================================================================================
+    // The initial block
+    //==================================================================================================================
+    initial begin
+        #200000 reset = 1'b0;
+
+        // The first frames may be lost while the receiver synchronizes to LRCK.
+        wait (first_frame >= 0 && frames_read == FRAMES - first_frame - 1);
+        $display ("I2S BENCH: rate %3b, depth %2b: %0d frames read from frame %0d after a stall of %0d frames, ",
+                        SAMPLE_RATE, BIT_DEPTH, frames_read, first_frame, STALL_FRAMES,
+                    "%.1f Hz (expected %.1f Hz), errors %0d, overrun %0d.",
+                        (rx_frames - 1) * 1000000000000.0 / (last_frame_time - first_frame_time), FRAME_HZ, errors,
+                        overrun);
+        $finish (0);
+    end
+
+    initial begin
+        #100000000000
+        $display($time, " SIM: ---------------------- Simulation end [Timeout] ------------------------");
+        $display ("I2S BENCH: rate %3b, depth %2b: timeout after %0d frames (overrun %0d, errors %0d).", SAMPLE_RATE,
+                        BIT_DEPTH, frames_read, overrun, errors);
+        $finish (1);
+    end
+endmodule
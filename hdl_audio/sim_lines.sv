@@ -0,0 +1,261 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ * This is the top module for the data lines test bench (sim.sh -t lines). tx_i2s has I2S_DATA_LINES lines and sends
+ * the stream on BENCH_LINES of them, in I2S or in TDM mode BENCH_TDM (slots of the bit depth), at BENCH_SAMPLE_RATE
+ * and BENCH_BIT_DEPTH. A writer at the control clock streams FRAMES frames as fast as the FIFO accepts them (at most a
+ * byte every other clock, as control), the stereo frames going to the lines in order. Each sample holds its channel in
+ * the 5 MSBs and the frame number below. The frames of every line are decoded and the samples, the silence of the
+ * unused lines, the frame rate and the underruns are checked. Every change of every line must happen on the master
+ * clock of a rising edge of the bit clock: the lines have the same timing.
+ **********************************************************************************************************************/
+`timescale 1ps/1ps
+`default_nettype none
+
+`include "definitions.svh"
+
+module sim_lines;
+`ifdef BENCH_SAMPLE_RATE
+    localparam logic [2:0] SAMPLE_RATE = `BENCH_SAMPLE_RATE;
+`else
+    localparam logic [2:0] SAMPLE_RATE = `STREAM_192000_HZ;
+`endif
+`ifdef BENCH_BIT_DEPTH
+    localparam logic [1:0] BIT_DEPTH = `BENCH_BIT_DEPTH;
+`else
+    localparam logic [1:0] BIT_DEPTH = `BIT_DEPTH_32;
+`endif
+`ifdef BENCH_TDM
+    localparam logic [1:0] TDM = `BENCH_TDM;
+`else
+    localparam logic [1:0] TDM = `TDM_OFF;
+`endif
+`ifdef BENCH_LINES
+    localparam logic [1:0] LINES = `BENCH_LINES;
+`else
+    localparam logic [1:0] LINES = `LINES_4;
+`endif
+    localparam FRAMES = 128;
+    localparam LINE_COUNT = 1 << LINES;
+    localparam LINE_CHANNELS = TDM == `TDM_8 ? 8 : TDM == `TDM_4 ? 4 : 2;
+    localparam CHANNELS = LINE_COUNT * LINE_CHANNELS;
+    localparam SAMPLE_BITS = BIT_DEPTH == `BIT_DEPTH_16 ? 16 : BIT_DEPTH == `BIT_DEPTH_24 ? 24 : 32;
+    localparam SAMPLE_BYTES = SAMPLE_BITS / 8;
+    // The bits of a frame on each line.
+    localparam FRAME_BITS = LINE_CHANNELS * SAMPLE_BITS;
+    localparam logic [6:0] BIT_PERIOD = (3072 / FRAME_BITS) >> SAMPLE_RATE[1:0];
+
+    // 147.456MHz -> 6781 ps, 135.4752MHz -> 7381 ps, 117.9648MHz control clock -> 8477 ps
+    localparam TX_CLK_PS = SAMPLE_RATE[2] ? 6781 : 7381;
+    localparam WR_CLK_PS = 8477;
+    localparam real FRAME_HZ = (SAMPLE_RATE[2] ? 48000.0 : 44100.0) * (1 << SAMPLE_RATE[1:0]);
+
+    logic tx_clk = 1'b0, wr_clk = 1'b0;
+    always #(TX_CLK_PS/2) tx_clk = ~tx_clk;
+    always #(WR_CLK_PS/2) wr_clk = ~wr_clk;
+
+    logic reset = 1'b1;
+
+    // The bit clock strobes, as in control: 3072 / (bits per frame x 2^rate) master clocks per bit.
+    logic bit_en;
+    bit_clock_enable bit_en_m (
+        .reset_i            (reset),
+        .clk_i              (tx_clk),
+        .period_i           (BIT_PERIOD),
+        .en_o               (bit_en));
+
+    logic wr_en, wr_afull, wr_full, streaming, bclk, lrck, mclk, dsd, bclk_rise;
+    logic [`I2S_DATA_LINES-1:0] sdata;
+    logic [7:0] wr_data;
+    logic [31:0] frames_gray;
+    tx_i2s #(.LINES(`I2S_DATA_LINES)) tx_i2s_m (
+        .reset_i            (reset),
+        .clk_i              (tx_clk),
+        .bit_en_i           (bit_en),
+        .mclk_i             (1'b0),
+        // Streaming configuration
+        .sample_rate_i      (SAMPLE_RATE),
+        .bit_depth_i        (BIT_DEPTH),
+        .dsd_i              (1'b0),
+        .tdm_i              (TDM),
+        .slot_width_i       (BIT_DEPTH),
+        .lines_i            (LINES),
+        .pause_i            (1'b0),
+        .start_i            (1'b1),
+        // Output FIFO ports
+        .wr_output_FIFO_clk_i   (wr_clk),
+        .wr_output_FIFO_en_i    (wr_en),
+        .wr_output_FIFO_data_i  (wr_data),
+        .wr_output_FIFO_afull_o (wr_afull),
+        .wr_output_FIFO_full_o  (wr_full),
+        .output_streaming_o     (streaming),
+        .frames_emitted_gray_o  (frames_gray),
+        // I2S outputs
+        .sdata_o            (sdata),
+        .bclk_o             (bclk),
+        .lrck_o             (lrck),
+        .mclk_o             (mclk),
+        .dsd_o              (dsd),
+        .bclk_rise_o        (bclk_rise));
+
+    // The sample of a channel in a frame.
+    function [31:0] sample_of (input integer frame, input integer channel);
+        sample_of = ((channel & 31) << (SAMPLE_BITS - 5)) | (frame & ((1 << (SAMPLE_BITS - 5)) - 1));
+    endfunction
+
+    // The channel of the sample at a position of the host frame: the stereo frames (slot pairs) go to the lines in
+    // order and line l carries the channels l * LINE_CHANNELS and up.
+    function integer channel_of (input integer position);
+        channel_of = ((position / 2) % LINE_COUNT) * LINE_CHANNELS + (position / 2) / LINE_COUNT * 2 + position % 2;
+    endfunction
+
+    //==================================================================================================================
+    // The writer: the samples of a frame in host order, little endian.
+    //==================================================================================================================
+    integer wr_bytes;
+    logic [31:0] wr_sample;
+
+    always @(posedge wr_clk) begin
+        if (reset) begin
+            wr_en <= 1'b0;
+            wr_bytes <= 0;
+        end else begin
+            wr_en <= 1'b0;
+            if (~wr_afull && ~wr_full && ~wr_en && wr_bytes < FRAMES * CHANNELS * SAMPLE_BYTES) begin
+                wr_sample = sample_of (wr_bytes / (CHANNELS * SAMPLE_BYTES),
+                                        channel_of ((wr_bytes / SAMPLE_BYTES) % CHANNELS));
+                wr_data <= wr_sample[8 * (wr_bytes % SAMPLE_BYTES) +: 8];
+                wr_en <= 1'b1;
+                wr_bytes <= wr_bytes + 1;
+            end
+        end
+    end
+
+    //==================================================================================================================
+    // The timing check: on every master clock the lines change only with a rising edge of the bit clock.
+    //==================================================================================================================
+    logic [`I2S_DATA_LINES-1:0] sdata_prev = {`I2S_DATA_LINES{1'b1}};
+    logic bclk_prev = 1'b1;
+    integer skews = 0, edges [0:`I2S_DATA_LINES-1];
+
+    initial begin : edges_init
+        integer l;
+        for (l = 0; l < `I2S_DATA_LINES; l = l + 1) edges[l] = 0;
+    end
+
+    always @(posedge tx_clk) begin : timing
+        integer l;
+        for (l = 0; l < `I2S_DATA_LINES; l = l + 1) begin
+            if (sdata[l] != sdata_prev[l]) begin
+                edges[l] = edges[l] + 1;
+                if (bclk_prev || ~bclk) begin
+                    if (skews < 8) $display ($time, " LINES:\tline %0d changes without a bit clock edge", l);
+                    skews = skews + 1;
+                end
+            end
+        end
+        sdata_prev = sdata;
+        bclk_prev = bclk;
+    end
+
+    //==================================================================================================================
+    // The decoder: sdata is sampled on the falling edges and lrck on the rising edges of the bit clock.
+    //==================================================================================================================
+    logic [FRAME_BITS-1:0] shift [0:`I2S_DATA_LINES-1];
+    logic lrck_rise, lrck_prev = 1'b1, synced = 1'b0;
+    integer bits = 0, frames = 0, errors = 0, underruns = 0;
+    longint first_frame_time, last_frame_time;
+
+    always @(posedge bclk) begin
+        lrck_rise = lrck;
+    end
+
+    task frame_task;
+        integer l, c;
+        logic [SAMPLE_BITS-1:0] slot, expected;
+        for (l = 0; l < `I2S_DATA_LINES; l = l + 1) begin
+            for (c = 0; c < LINE_CHANNELS; c = c + 1) begin
+                slot = shift[l][FRAME_BITS - 1 - c * SAMPLE_BITS -: SAMPLE_BITS];
+                // The lines above the last one are silent.
+                expected = l < LINE_COUNT ? sample_of (frames, l * LINE_CHANNELS + c) : {SAMPLE_BITS{1'b0}};
+                if (bits != FRAME_BITS || slot != expected) begin
+                    if (errors < 8) $display ($time, " LINES:\tframe %0d line %0d slot %0d: %h, %0d bits (expected %h)",
+                                                    frames, l, c, slot, bits, expected);
+                    errors = errors + 1;
+                end
+            end
+        end
+        if (frames == 0) first_frame_time = $time;
+        last_frame_time = $time;
+        frames = frames + 1;
+    endtask
+
+    always @(negedge bclk) begin : decoder
+        integer l;
+        if (streaming) begin
+            // The falling edge of lrck starts a frame; its rising edge must be in the middle.
+            if (lrck_prev && ~lrck_rise) begin
+                if (synced) frame_task;
+                synced = 1'b1;
+                bits = 0;
+            end else if (~lrck_prev && lrck_rise && bits != FRAME_BITS / 2) begin
+                if (errors < 8) $display ($time, " LINES:\tframe %0d: lrck rises after %0d bits", frames, bits);
+                errors = errors + 1;
+            end
+            lrck_prev = lrck_rise;
+            for (l = 0; l < `I2S_DATA_LINES; l = l + 1) shift[l] = {shift[l][FRAME_BITS-2:0], sdata[l]};
+            bits = bits + 1;
+        end
+    end
+
+    // The stream stops after the last frame without a lrck edge. It must not stop before the last frame.
+    always @(negedge streaming) begin
+        if (synced && bits == FRAME_BITS) begin
+            frame_task;
+            bits = 0;
+        end
+        if (frames < FRAMES) underruns = underruns + 1;
+    end
+
+    //==================================================================================================================
+    // The initial block
+    //==================================================================================================================
+    initial begin
+        #200000 reset = 1'b0;
+
+        wait (frames == FRAMES);
+        wait (~streaming);
+        $display ("LINES BENCH: %0d line(s) of %0d channels, %0d-bit, rate %3b: %0d frames, ", LINE_COUNT,
+                        LINE_CHANNELS, SAMPLE_BITS, SAMPLE_RATE, frames,
+                    "%.1f Hz (expected %.1f Hz), ",
+                        (frames - 1) * 1000000000000.0 / (last_frame_time - first_frame_time), FRAME_HZ,
+                    "%.3f MB/s, line edges %0d %0d %0d %0d, ", FRAME_HZ * CHANNELS * SAMPLE_BYTES / 1000000.0,
+                        edges[0], edges[1], edges[2], edges[3],
+                    "skews %0d, errors %0d, underruns %0d.", skews, errors, underruns);
+        $finish (0);
+    end
+
+    initial begin
+        #100000000000
+        $display($time, " SIM: ---------------------- Simulation end [Timeout] ------------------------");
+        $display ("LINES BENCH: %0d line(s) of %0d channels, %0d-bit, rate %3b: timeout after %0d of %0d frames ",
+                        LINE_COUNT, LINE_CHANNELS, SAMPLE_BITS, SAMPLE_RATE, frames, FRAMES,
+                    "(skews %0d, errors %0d, underruns %0d).", skews, errors, underruns);
+        $finish (1);
+    end
+endmodule
@@ -0,0 +1,207 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+/***********************************************************************************************************************
+ * This is the top module for the oversampling test bench (sim.sh -t oversampler). For each test tone the oversampler
+ * is reset and fed 24-bit stereo frames of a -6dBFS tone (sine on the left, cosine on the right) while full_o is low,
+ * one byte every other clock as control does, and its output is read with random back pressure. After the transient
+ * the output is analyzed with a DFT: the gain at the tone and the level of its images (k x the input rate +/- the
+ * tone) are reported. The tones are on DFT bins (N input frames) so no window is needed. The bench fails when the gain
+ * is off by more than 0.001dB or an image is above -90dB, and reports the clocks the filter takes per input frame.
+ **********************************************************************************************************************/
+`timescale 1ps/1ps
+`default_nettype none
+
+`include "definitions.svh"
+
+module sim_oversampler;
+`ifdef BENCH_RATIO
+    localparam logic [1:0] RATIO = `BENCH_RATIO;
+`else
+    localparam logic [1:0] RATIO = 2'd3;
+`endif
+    localparam OUTPUT_FRAMES_PER_FRAME = 1 << RATIO;
+    // The input rate only names the frequencies.
+    localparam real INPUT_RATE = 44100.0;
+    localparam N = 512;
+    localparam SKIP = 128;
+    localparam TONES = 5;
+    localparam real AMPLITUDE = 4194304.0; // 2^22: -6dBFS at 24-bit
+    localparam real PI = 3.14159265358979;
+
+    function integer tone_bin (input integer tone);
+        case (tone)
+            0: tone_bin = 12;   // 1033Hz
+            1: tone_bin = 116;  // 9991Hz
+            2: tone_bin = 174;  // 14986Hz
+            3: tone_bin = 220;  // 18949Hz
+            default: tone_bin = 232; // 19982Hz
+        endcase
+    endfunction
+
+    // 117.9648MHz control clock -> 8477 ps
+    localparam CLK_PS = 8477;
+    logic clk = 1'b0;
+    always #(CLK_PS/2) clk = ~clk;
+
+    logic reset = 1'b1;
+    logic en, ready, out_en, full;
+    logic [7:0] data, out_data;
+    oversampler oversampler_m (
+        .reset_i            (reset),
+        .clk_i              (clk),
+        .bit_depth_i        (`BIT_DEPTH_24),
+        .ratio_i            (RATIO),
+        .en_i               (en),
+        .data_i             (data),
+        .ready_i            (ready),
+        .en_o               (out_en),
+        .data_o             (out_data),
+        .full_o             (full));
+
+    //==================================================================================================================
+    // The writer: the frames of the tone, little endian 24-bit samples.
+    //==================================================================================================================
+    integer tone = 0, wr_frame = 0, wr_byte = 0;
+    logic [23:0] wr_sample;
+
+    function [23:0] input_sample (input integer tone, input integer frame, input integer channel);
+        real phase;
+        phase = 2.0 * PI * tone_bin (tone) * (frame % N) / N + (channel ? PI / 2.0 : 0.0);
+        input_sample = $rtoi ($floor (AMPLITUDE * $sin (phase) + 0.5));
+    endfunction
+
+    always @(posedge clk) begin
+        ready <= ($urandom % 4) != 0;
+        if (reset) begin
+            en <= 1'b0;
+            wr_frame <= 0;
+            wr_byte <= 0;
+        end else begin
+            en <= 1'b0;
+            if (~en && ~full && wr_frame < SKIP + N) begin
+                wr_sample = input_sample (tone, wr_frame, wr_byte / 3);
+                data <= wr_sample[8 * (wr_byte % 3) +: 8];
+                en <= 1'b1;
+                if (wr_byte == 5) begin
+                    wr_byte <= 0;
+                    wr_frame <= wr_frame + 1;
+                end else begin
+                    wr_byte <= wr_byte + 1;
+                end
+            end
+        end
+    end
+
+    // The clocks the filter is busy with an input frame.
+    integer busy_clocks = 0, max_busy_clocks = 0;
+    always @(posedge clk) begin
+        if (~reset && full && wr_frame > 0) begin
+            busy_clocks = busy_clocks + 1;
+            if (busy_clocks > max_busy_clocks) max_busy_clocks = busy_clocks;
+        end else begin
+            busy_clocks = 0;
+        end
+    end
+
+    //==================================================================================================================
+    // The reader: the output frames after the transient.
+    //==================================================================================================================
+    real output_samples [0:1][0:N*OUTPUT_FRAMES_PER_FRAME-1];
+    integer rd_frame = 0, rd_byte = 0;
+    logic [23:0] rd_sample;
+
+    always @(posedge clk) begin
+        if (reset) begin
+            rd_frame = 0;
+            rd_byte = 0;
+        end else if (out_en) begin
+            rd_sample[8 * (rd_byte % 3) +: 8] = out_data;
+            if (rd_byte % 3 == 2 && rd_frame >= SKIP * OUTPUT_FRAMES_PER_FRAME &&
+                    rd_frame < (SKIP + N) * OUTPUT_FRAMES_PER_FRAME) begin
+                output_samples[rd_byte / 3][rd_frame - SKIP * OUTPUT_FRAMES_PER_FRAME] = $signed(rd_sample);
+            end
+            if (rd_byte == 5) begin
+                rd_byte = 0;
+                rd_frame = rd_frame + 1;
+            end else begin
+                rd_byte = rd_byte + 1;
+            end
+        end
+    end
+
+    //==================================================================================================================
+    // The analysis
+    //==================================================================================================================
+    // The level (dB relative to the tone amplitude) of a DFT bin of the output of a channel.
+    function real level (input integer channel, input integer bin);
+        integer i;
+        real re, im, phase;
+        re = 0.0;
+        im = 0.0;
+        for (i = 0; i < N * OUTPUT_FRAMES_PER_FRAME; i = i + 1) begin
+            phase = 2.0 * PI * bin * i / (N * OUTPUT_FRAMES_PER_FRAME);
+            re = re + output_samples[channel][i] * $cos (phase);
+            im = im + output_samples[channel][i] * $sin (phase);
+        end
+        level = 20.0 * $log10 (2.0 * $sqrt (re * re + im * im) / (N * OUTPUT_FRAMES_PER_FRAME) / AMPLITUDE + 1e-12);
+    endfunction
+
+    integer errors = 0;
+    real gain, image, worst_image;
+
+    task analyze_task;
+        integer channel, k;
+        for (channel = 0; channel < 2; channel = channel + 1) begin
+            gain = level (channel, tone_bin (tone));
+            worst_image = -200.0;
+            for (k = 1; k < OUTPUT_FRAMES_PER_FRAME; k = k + 1) begin
+                image = level (channel, k * N - tone_bin (tone));
+                if (image > worst_image) worst_image = image;
+                image = level (channel, k * N + tone_bin (tone));
+                if (image > worst_image) worst_image = image;
+            end
+            $display ("OVERSAMPLER BENCH: %0dx, %0.0fHz, channel %0d: gain %0.5fdB, highest image %0.1fdB",
+                            OUTPUT_FRAMES_PER_FRAME, INPUT_RATE * tone_bin (tone) / N, channel, gain, worst_image);
+            if (gain > 0.001 || gain < -0.001 || worst_image > -90.0) begin
+                $display ("OVERSAMPLER:\t[ERROR] tone %0d channel %0d out of specification", tone, channel);
+                errors = errors + 1;
+            end
+        end
+    endtask
+
+    //==================================================================================================================
+    // The initial block
+    //==================================================================================================================
+    initial begin
+        for (tone = 0; tone < TONES; tone = tone + 1) begin
+            reset = 1'b1;
+            #100000 reset = 1'b0;
+            wait (rd_frame == (SKIP + N) * OUTPUT_FRAMES_PER_FRAME);
+            analyze_task;
+        end
+
+        $display ("OVERSAMPLER BENCH: %0dx, at most %0d clocks per input frame (%0d available at 48KHz), errors %0d.",
+                        OUTPUT_FRAMES_PER_FRAME, max_busy_clocks, 117964800 / 48000, errors);
+        $finish (0);
+    end
+
+    initial begin
+        #1000000000000
+        $display($time, " SIM: ---------------------- Simulation end [Timeout] ------------------------");
+        $finish (1);
+    end
+endmodule
@@ -0,0 +1,208 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ * This is the top module for the volume test bench (sim.sh -t volume). Random BENCH_BIT_DEPTH stereo samples are
+ * written to the volume stage at the control clock, one byte every other clock as control does, in phases of
+ * PHASE_SAMPLES samples. The gain and the options of a phase are set right after the last byte of the previous phase so
+ * that a change must apply from the next sample. The phases check:
+ *  0: 0dB with dither and noise shaping: bit exact.
+ *  1: -6.02dB (0x4000) and 2: -9dB (0x2d6a) without dither: exact rounding of the scaled sample.
+ *  3: -9dB with TPDF dither: less than 1.5 LSB from the scaled sample.
+ *  4: -9dB with dither and noise shaping: the errors of a channel add up to less than 1.5 LSB (first order shaping).
+ *  5: +6dB (0xffff): saturation.
+ *  6: mute (0).
+ **********************************************************************************************************************/
+`timescale 1ps/1ps
+`default_nettype none
+
+`include "definitions.svh"
+
+module sim_volume;
+`ifdef BENCH_BIT_DEPTH
+    localparam logic [1:0] BIT_DEPTH = `BENCH_BIT_DEPTH;
+`else
+    localparam logic [1:0] BIT_DEPTH = `BIT_DEPTH_24;
+`endif
+    localparam SAMPLE_BITS = BIT_DEPTH == `BIT_DEPTH_16 ? 16 : BIT_DEPTH == `BIT_DEPTH_24 ? 24 : 32;
+    localparam SAMPLE_BYTES = SAMPLE_BITS / 8;
+    localparam PHASES = 7;
+    localparam PHASE_SAMPLES = 512;
+    localparam SAMPLES = PHASES * PHASE_SAMPLES;
+    localparam longint MAXIMUM = (64'sd1 <<< (SAMPLE_BITS - 1)) - 64'sd1;
+
+    // 117.9648MHz control clock -> 8477 ps
+    localparam CLK_PS = 8477;
+    logic clk = 1'b0;
+    always #(CLK_PS/2) clk = ~clk;
+
+    logic reset = 1'b1;
+
+    // The configuration of the phases.
+    function [15:0] phase_gain (input integer phase);
+        case (phase)
+            0: phase_gain = `GAIN_UNITY;
+            1: phase_gain = 16'h4000;
+            5: phase_gain = 16'hffff;
+            6: phase_gain = 16'h0000;
+            default: phase_gain = 16'h2d6a;
+        endcase
+    endfunction
+
+    function phase_dither (input integer phase);
+        phase_dither = phase == 0 || phase == 3 || phase == 4;
+    endfunction
+
+    function phase_shape (input integer phase);
+        phase_shape = phase == 0 || phase == 4;
+    endfunction
+
+    logic en, out_en, dither, noise_shaping;
+    logic [7:0] data, out_data;
+    logic [15:0] gain;
+    volume volume_m (
+        .reset_i            (reset),
+        .clk_i              (clk),
+        .bit_depth_i        (BIT_DEPTH),
+        .last_channel_i     (5'd1),
+        .gain_i             (gain),
+        .dither_i           (dither),
+        .noise_shaping_i    (noise_shaping),
+        .en_i               (en),
+        .data_i             (data),
+        .en_o               (out_en),
+        .data_o             (out_data));
+
+    //==================================================================================================================
+    // The writer: random samples, little endian.
+    //==================================================================================================================
+    logic signed [31:0] samples [0:SAMPLES-1];
+    integer wr_sample = 0, wr_byte = 0;
+
+    initial begin : samples_init
+        integer i;
+        for (i = 0; i < SAMPLES; i = i + 1) begin
+            samples[i] = $signed($urandom << (32 - SAMPLE_BITS)) >>> (32 - SAMPLE_BITS);
+        end
+    end
+
+    always @(posedge clk) begin
+        if (reset) begin
+            en <= 1'b0;
+            gain <= phase_gain (0);
+            dither <= phase_dither (0);
+            noise_shaping <= phase_shape (0);
+        end else begin
+            en <= 1'b0;
+            if (~en && wr_sample < SAMPLES) begin
+                // The next phase starts on the clock after the last byte of the previous one.
+                if (wr_byte == 0) begin
+                    gain <= phase_gain (wr_sample / PHASE_SAMPLES);
+                    dither <= phase_dither (wr_sample / PHASE_SAMPLES);
+                    noise_shaping <= phase_shape (wr_sample / PHASE_SAMPLES);
+                end
+                data <= samples[wr_sample][8 * wr_byte +: 8];
+                en <= 1'b1;
+                if (wr_byte == SAMPLE_BYTES - 1) begin
+                    wr_byte <= 0;
+                    wr_sample <= wr_sample + 1;
+                end else begin
+                    wr_byte <= wr_byte + 1;
+                end
+            end
+        end
+    end
+
+    //==================================================================================================================
+    // The checker
+    //==================================================================================================================
+    integer rd_sample = 0, rd_byte = 0, errors = 0, phase;
+    logic [31:0] rd_word;
+    longint product, expected, output_sample, error, max_error [0:PHASES-1], error_sum [0:1], max_shaped_sum;
+
+    initial begin : checker_init
+        integer p;
+        for (p = 0; p < PHASES; p = p + 1) max_error[p] = 0;
+        error_sum[0] = 0;
+        error_sum[1] = 0;
+        max_shaped_sum = 0;
+    end
+
+    task check_task;
+        phase = rd_sample / PHASE_SAMPLES;
+        output_sample = $signed(rd_word << (32 - SAMPLE_BITS)) >>> (32 - SAMPLE_BITS);
+        product = samples[rd_sample] * $signed({48'h0, phase_gain (phase)});
+        expected = (product + 16384) >>> 15;
+        expected = expected > MAXIMUM ? MAXIMUM : expected < -MAXIMUM - 1 ? -MAXIMUM - 1 : expected;
+        // The error in 1/32768 LSB.
+        error = (output_sample <<< 15) - product;
+        if (error < 0 ? -error > max_error[phase] : error > max_error[phase]) begin
+            max_error[phase] = error < 0 ? -error : error;
+        end
+
+        if (phase == 3 || phase == 4) begin
+            if (phase == 4) begin
+                error_sum[rd_sample % 2] = error_sum[rd_sample % 2] + error;
+                if (error_sum[rd_sample % 2] > max_shaped_sum) max_shaped_sum = error_sum[rd_sample % 2];
+                if (-error_sum[rd_sample % 2] > max_shaped_sum) max_shaped_sum = -error_sum[rd_sample % 2];
+            end
+            if ((phase == 3 && (error >= 49152 || error <= -49152)) ||
+                    (phase == 4 && (error_sum[rd_sample % 2] > 49152 || error_sum[rd_sample % 2] <= -49152))) begin
+                if (errors < 8) $display ($time, " VOLUME:\tsample %0d (phase %0d): %0d, input %0d, error %0d/32768",
+                                                rd_sample, phase, output_sample, samples[rd_sample], error);
+                errors = errors + 1;
+            end
+        end else if (output_sample != expected) begin
+            if (errors < 8) $display ($time, " VOLUME:\tsample %0d (phase %0d): %0d, input %0d (expected %0d)",
+                                            rd_sample, phase, output_sample, samples[rd_sample], expected);
+            errors = errors + 1;
+        end
+        rd_sample = rd_sample + 1;
+    endtask
+
+    always @(posedge clk) begin
+        if (out_en) begin
+            rd_word[8 * rd_byte +: 8] = out_data;
+            if (rd_byte == SAMPLE_BYTES - 1) begin
+                rd_byte = 0;
+                check_task;
+            end else begin
+                rd_byte = rd_byte + 1;
+            end
+        end
+    end
+
+    //==================================================================================================================
+    // The initial block
+    //==================================================================================================================
+    initial begin
+        #100000 reset = 1'b0;
+
+        wait (rd_sample == SAMPLES);
+        $display ("VOLUME BENCH: %0d-bit, %0d samples, max error (LSB/32768): %0d %0d %0d %0d %0d %0d %0d",
+                        SAMPLE_BITS, rd_sample, max_error[0], max_error[1], max_error[2], max_error[3], max_error[4],
+                        max_error[5], max_error[6]);
+        $display ("VOLUME BENCH: noise shaped error sum %0d, errors %0d.", max_shaped_sum, errors);
+        $finish (0);
+    end
+
+    initial begin
+        #10000000000
+        $display($time, " SIM: ---------------------- Simulation end [Timeout] ------------------------");
+        $finish (1);
+    end
+endmodule
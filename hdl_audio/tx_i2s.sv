@@ -14,19 +14,40 @@
  * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
  * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ * This module implements the I2S transmitter. The bytes written by the control module are packed into stereo frames
+ * ({left[31:0], right[31:0]}, right justified samples) and one frame is read from the FIFO per left channel word by
+ * the serializer. The module runs on the master clock of the clock family; bit_en_i strobes twice per bit clock period
+ * and bclk_o, lrck_o and sdata_o are generated as registers on the strobes.
+ * In native DSD mode (dsd_i) a frame holds 32 DSD bits of each channel. One frame is read per word; the left channel is
+ * sent on sdata_o and the right channel on lrck_o, both on the DSD bit clock bclk_o, and dsd_o is set.
+ * In TDM mode (tdm_i) a frame has 4 or 8 slots of slot_width_i bits, each stereo frame of the FIFO filling a pair of
+ * slots. A frame starts only when the FIFO holds all its pairs and lrck_o changes at the start and the middle of it.
+ * With LINES data lines the stream is sent on 1, 2 or 4 sdata_o lines (lines_i) on the same bclk_o and lrck_o. The
+ * stereo frames written by control go to the lines in order and a FIFO word holds one stereo frame of each line, so
+ * that all the lines load their words on the same bit clock edge. Unused lines send zeros.
+ **********************************************************************************************************************/
 `timescale 1ps/1ps
 `default_nettype none
 
 `include "definitions.svh"
 
-module tx_i2s (
+module tx_i2s #(parameter LINES = 1)(
     input logic reset_i,
-    input logic byte_clk_i,
-    input logic bit_clk_i,
+    input logic clk_i,
+    // Bit clock edge strobe (2 per bit clock period)
+    input logic bit_en_i,
     input logic mclk_i,
     // Streaming configuration
     input logic [2:0] sample_rate_i,
     input logic [1:0] bit_depth_i,
+    input logic dsd_i,
+    input logic [1:0] tdm_i,
+    input logic [1:0] slot_width_i,
+    input logic [1:0] lines_i,
+    input logic pause_i,
+    input logic start_i,
     // Output FIFO ports
     input logic wr_output_FIFO_clk_i,
     input logic wr_output_FIFO_en_i,
@@ -34,286 +55,237 @@ module tx_i2s (
     output logic wr_output_FIFO_afull_o,
     output logic wr_output_FIFO_full_o,
     output logic output_streaming_o,
+    output logic [31:0] frames_emitted_gray_o,
     // I2S outputs
-    output logic sdata_o,
+    output logic [LINES-1:0] sdata_o,
     output logic bclk_o,
     output logic lrck_o,
     output logic mclk_o,
-    output logic dsd_o);
+    output logic dsd_o,
+    // Strobe on the clocks where bclk_o rises (for the I2S receiver)
+    output logic bclk_rise_o);
 
-    assign bclk_o = bit_clk_en ? bit_clk_i : 1'b1;
-    assign mclk_o = bit_clk_en ? mclk_i : 1'b0;
+    // The MCLK is gated at its source (control) so that it goes from its output register straight to the pin.
+    assign mclk_o = mclk_i;
 
     //==================================================================================================================
-    // The output FIFO containing audio data.
+    // The bit clock. bclk_phase toggles on every strobe; the transmitter advances on the rising edges and lrck_o
+    // changes on the falling edges. bclk_o stays high while not streaming.
+    //==================================================================================================================
+    logic bclk_phase, bclk_rise, bclk_fall;
+    assign bclk_rise = bit_en_i && ~bclk_phase;
+    assign bclk_fall = bit_en_i && bclk_phase;
+    assign bclk_rise_o = bclk_rise && ~bclk_o;
+
+    always @(posedge clk_i, posedge reset_i) begin
+        if (reset_i) begin
+            bclk_phase <= 1'b0;
+            bclk_o <= 1'b1;
+        end else if (bit_en_i) begin
+            bclk_phase <= ~bclk_phase;
+            // streaming only changes on the rising edges.
+            bclk_o <= ~bclk_phase || ~streaming;
+        end
+    end
+
     //==================================================================================================================
-    logic [7:0] rd_output_FIFO_data;
+    // The frame packer. The bytes of a stereo frame (4, 6 or 8 bytes) are shifted in and the frame is written to the
+    // FIFO with the last byte. A DSD frame has the 8 bytes of a 32-bit frame.
+    //==================================================================================================================
+    logic [63:0] wr_frame_data;
+    logic wr_frame_en;
+    frame_packer #(.SAMPLE_BITS(32)) frame_packer_m (
+        .reset_i            (reset_i),
+        .clk_i              (wr_output_FIFO_clk_i),
+        .bit_depth_i        (dsd_i ? `BIT_DEPTH_32 : bit_depth_i),
+        .en_i               (wr_output_FIFO_en_i),
+        .data_i             (wr_output_FIFO_data_i),
+        .frame_en_o         (wr_frame_en),
+        .frame_o            (wr_frame_data));
+
+    //==================================================================================================================
+    // The line packer. The stereo frames go to the lines in order (line 0 in the LSBs) and the FIFO word is written
+    // with the frame of the last line. The lines above the last one are cleared with the frame of line 0.
+    //==================================================================================================================
+    logic [1:0] last_line, wr_line;
+    assign last_line = lines_i == `LINES_4 ? 2'd3 : lines_i == `LINES_2 ? 2'd1 : 2'd0;
+    logic [64*LINES-1:0] wr_lines_data;
+    logic wr_lines_en;
+    integer l;
+
+    always @(posedge wr_output_FIFO_clk_i, posedge reset_i) begin
+        if (reset_i) begin
+            wr_line <= 2'd0;
+            wr_lines_en <= 1'b0;
+        end else begin
+            wr_lines_en <= wr_frame_en && wr_line == last_line;
+            if (wr_frame_en) begin
+                for (l = 0; l < LINES; l = l + 1) begin
+                    if (l == wr_line) begin
+                        wr_lines_data[64*l +: 64] <= wr_frame_data;
+                    end else if (wr_line == 2'd0) begin
+                        wr_lines_data[64*l +: 64] <= 64'h0;
+                    end
+                end
+                wr_line <= wr_line == last_line ? 2'd0 : wr_line + 2'd1;
+            end
+        end
+    end
+
+    //==================================================================================================================
+    // The output FIFO containing a stereo frame of each line. The wide FIFO of several lines is in block RAM.
+    //==================================================================================================================
+    logic [64*LINES-1:0] rd_output_FIFO_data;
     logic rd_output_FIFO_en, rd_output_FIFO_empty;
-    async_fifo #(.ASIZE(4)) audio_FIFO_m (
+    logic [4:0] rd_output_FIFO_count;
+    async_fifo #(.DSIZE(64*LINES), .ASIZE(4), .EBR(LINES > 1 ? "TRUE" : "FALSE")) audio_FIFO_m (
         // Write to FIFO
         .wr_reset_i         (reset_i),
-        .wr_en_i            (wr_output_FIFO_en_i),
+        .wr_en_i            (wr_lines_en),
         .wr_clk_i           (wr_output_FIFO_clk_i),
-        .wr_data_i          (wr_output_FIFO_data_i),
+        .wr_data_i          (wr_lines_data),
         .wr_awfull_o        (wr_output_FIFO_afull_o),
         .wr_full_o          (wr_output_FIFO_full_o),
         // Read from FIFO
         .rd_reset_i         (reset_i),
         .rd_en_i            (rd_output_FIFO_en),
-        .rd_clk_i           (byte_clk_i),
+        .rd_clk_i           (clk_i),
         .rd_data_o          (rd_output_FIFO_data),
-        .rd_empty_o         (rd_output_FIFO_empty));
+        .rd_empty_o         (rd_output_FIFO_empty),
+        .rd_count_o         (rd_output_FIFO_count));
 
+    // Bit that indicates that this module is streaming audio.
     // The module using this signal will have to use a metastability FF to read this bit in a different clock domain.
-    assign output_streaming_o = rd_output_FIFO_en;
-
-    logic bit_clk_en;
-    logic [1:0] sample_byte_index;
-    logic [2:0] stream_stopping_clocks;
+    logic streaming;
+    assign output_streaming_o = streaming;
 
-    // These variables are written on the byte_clk_i clock and read on the bit clock.
-    // The byte_clk_i and bit clock are synchronized (bit clock is divided by 8 to obtain
-    // byte_clk_i).
-    logic tx_reset;
-    // 1'b0 left channel, 1'b1 right channel
-    logic sample_sel;
-    // Left and right channel samples are used as ping pong buffers with the TX always block.
-    logic [31:0] sample_l, sample_r;
+    // A scheduled stream waits for start_i before the first FIFO read.
+    logic start_meta;
+    DFF_META start_meta_m (reset_i, start_i, clk_i, start_meta);
 
-`ifdef D_I2S
-    time prev_time = 0;
-`endif
-
-    //==================================================================================================================
-    // The reset task
-    //==================================================================================================================
-    task reset_task;
-        tx_reset <= 1'b0;
-        bit_clk_en <= 1'b0;
-        rd_output_FIFO_en <= 1'b0;
-        // Start with the left channel
-        sample_sel <= 1'b0;
-        sample_byte_index <= 2'd0;
-        stream_stopping_clocks <= 3'd0;
-        dsd_o <= 1'b0;
-    endtask
+    // Pause is applied at the beginning of a left channel word. While paused the FIFO is not read and silence is sent
+    // so that the bit clock and LR clock keep running and resume is instant. DSD silence is the 0x69 idle pattern.
+    logic pause_meta;
+    DFF_META pause_meta_m (reset_i, pause_i, clk_i, pause_meta);
 
     //==================================================================================================================
-    // Audio sample receiver
+    // The serializer. A word is loaded after bit 0 of the previous word was sent (next_bit_to_send == 5'd31): the
+    // left word of a slot pair comes from the FIFO (or silence while paused) and the right word is the right sample of
+    // the same stereo frame. The stream stops at the beginning of a frame when the FIFO holds less than a frame. The
+    // pause and stop decisions are taken on the falling edge before the first word of a frame (with lrck_o) and kept
+    // until the rising edge.
     //==================================================================================================================
-    always @(posedge byte_clk_i, posedge reset_i) begin
-        if (reset_i) begin
-`ifdef D_I2S
-            $display ($time, " I2S:\t-- Reset.");
-`endif
-            reset_task;
-        end else if (|stream_stopping_clocks) begin
-            stream_stopping_clocks <= stream_stopping_clocks - 3'd1;
-            if (stream_stopping_clocks == 3'd1) begin
-`ifdef D_I2S
-                $display ($time, " I2S:\t----- Streaming stopped.");
-`endif
-                reset_task;
-            end
-        end else if (rd_output_FIFO_en) begin
-            if (tx_reset) tx_reset <= 1'b0;
-
-`ifdef D_I2S
-            prev_time <= $time;
-`endif
-            (* parallel_case, full_case *)
-            case (bit_depth_i)
-                `BIT_DEPTH_16: begin
-                    case (sample_byte_index)
-                        2'd0: begin
-`ifdef BIG_ENDIAN_SAMPLES
-                            if (sample_sel) sample_r[15:8] <= rd_output_FIFO_data;
-                            else sample_l[15:8] <= rd_output_FIFO_data;
-`else
-                            if (sample_sel) sample_r[7:0] <= rd_output_FIFO_data;
-                            else sample_l[7:0] <= rd_output_FIFO_data;
-`endif
-                            sample_byte_index <= 2'd1;
-                        end
-
-                        2'd1: begin
-`ifdef BIG_ENDIAN_SAMPLES
-                            if (sample_sel) sample_r[7:0] <= rd_output_FIFO_data;
-                            else sample_l[7:0] <= rd_output_FIFO_data;
-`else
-                            if (sample_sel) sample_r[15:8] <= rd_output_FIFO_data;
-                            else sample_l[15:8] <= rd_output_FIFO_data;
-`endif
-                            sample_byte_index <= 2'd0;
-                            sample_sel <= ~sample_sel;
-
-                            bit_clk_en <= 1'b1;
-`ifdef D_I2S_FRAME
-`ifdef BIG_ENDIAN_SAMPLES
-                            $display ($time, " I2S:\t16-bit sample: %h | %0d Hz",
-                                        {sample_sel ? sample_r[15:8] : sample_l[15:8], rd_output_FIFO_data},
-                                        1000000000000 / ($time - prev_time));
-`else
-                            $display ($time, " I2S:\t16-bit sample: %h | %0d Hz",
-                                        {rd_output_FIFO_data, sample_sel ? sample_r[7:0] : sample_l[7:0]},
-                                        1000000000000 / ($time - prev_time));
-`endif // BIG_ENDIAN_SAMPLES
-`endif
-                            dsd_o <= 1'b0;
-                        end
-                    endcase
-                end
-
-                `BIT_DEPTH_24, `BIT_DEPTH_DOP: begin
-                    case (sample_byte_index)
-                        2'd0: begin
-`ifdef BIG_ENDIAN_SAMPLES
-                            if (sample_sel) sample_r[23:16] <= rd_output_FIFO_data;
-                            else sample_l[23:16] <= rd_output_FIFO_data;
-`else
-                            if (sample_sel) sample_r[7:0] <= rd_output_FIFO_data;
-                            else sample_l[7:0] <= rd_output_FIFO_data;
-`endif
-                            sample_byte_index <= 2'd1;
-                        end
-
-                        2'd1: begin
-                            if (sample_sel) sample_r[15:8] <= rd_output_FIFO_data;
-                            else sample_l[15:8] <= rd_output_FIFO_data;
-                            sample_byte_index <= 2'd2;
-                        end
-
-                        2'd2: begin
-`ifdef BIG_ENDIAN_SAMPLES
-                            if (sample_sel) sample_r[7:0] <= rd_output_FIFO_data;
-                            else sample_l[7:0] <= rd_output_FIFO_data;
-`else
-                            if (sample_sel) sample_r[23:16] <= rd_output_FIFO_data;
-                            else sample_l[23:16] <= rd_output_FIFO_data;
+`ifdef D_I2S_BC
+    time prev_time_bit = 0;
 `endif
-                            sample_byte_index <= 2'd0;
-                            sample_sel <= ~sample_sel;
-
-                            bit_clk_en <= 1'b1;
-`ifdef D_I2S_FRAME
+    logic paused;
+    // The slot of the next word. The last slot is 1 for I2S, 3 or 7 for TDM and 0 for native DSD (one word per frame).
+    logic [2:0] next_slot, last_slot;
+    assign last_slot = dsd_i ? 3'd0 : tdm_i == `TDM_8 ? 3'd7 : tdm_i == `TDM_4 ? 3'd3 : 3'd1;
+    // The stereo frames of the FIFO per frame. lrck_o changes before slot 0 and before slot frame_pairs.
+    logic [2:0] frame_pairs;
+    assign frame_pairs = {1'b0, last_slot[2:1]} + 3'd1;
+    // The bits per slot, coded as the bit depth.
+    logic [1:0] slot_width;
+    assign slot_width = dsd_i ? `BIT_DEPTH_32 : tdm_i != `TDM_OFF ? slot_width_i : bit_depth_i;
+    logic [4:0] next_bit_to_send;
+    // The right samples of the stereo frames of the lines, kept for the right words.
+    logic [32*LINES-1:0] sample_r;
+    integer r;
+    // The right DSD channel output
+    logic dsd_r;
+
+    // The sample left aligned in the 32-bit word so that the MSB is sent first.
+    function [31:0] word_from_sample (input logic [31:0] sample, input logic [1:0] bit_depth);
+        (* parallel_case, full_case *)
+        case (bit_depth)
+            `BIT_DEPTH_16: word_from_sample = {sample[15:0], 16'h0};
+            `BIT_DEPTH_24, `BIT_DEPTH_DOP: word_from_sample = {sample[23:0], 8'h0};
+            `BIT_DEPTH_32: word_from_sample = sample;
+        endcase
+    endfunction
+
+    // The 4 DSD bytes of a channel in time order (the first byte in the MSB), undoing the sample byte order.
+    function [31:0] word_from_dsd (input logic [31:0] sample);
 `ifdef BIG_ENDIAN_SAMPLES
-                            $display ($time, " I2S:\t24-bit sample: %h | %0d Hz",
-                                        {sample_sel ? sample_r[23:8] : sample_l[23:8], rd_output_FIFO_data},
-                                        1000000000000 / ($time - prev_time));
+        word_from_dsd = sample;
 `else
-                            $display ($time, " I2S:\t24-bit sample: %h | %0d Hz",
-                                        {rd_output_FIFO_data, sample_sel ? sample_r[15:0] : sample_l[15:0]},
-                                        1000000000000 / ($time - prev_time));
-`endif // BIG_ENDIAN_SAMPLES
+        word_from_dsd = {sample[7:0], sample[15:8], sample[23:16], sample[31:24]};
 `endif
-                            dsd_o <= bit_depth_i == `BIT_DEPTH_DOP;
-                        end
-                    endcase
-                end
+    endfunction
 
-                `BIT_DEPTH_32: begin
-                    case (sample_byte_index)
-                        2'd0: begin
-`ifdef BIG_ENDIAN_SAMPLES
-                            if (sample_sel) sample_r[31:24] <= rd_output_FIFO_data;
-                            else sample_l[31:24] <= rd_output_FIFO_data;
-`else
-                            if (sample_sel) sample_r[7:0] <= rd_output_FIFO_data;
-                            else sample_l[7:0] <= rd_output_FIFO_data;
-`endif
-                            sample_byte_index <= 2'd1;
-                        end
+    logic tx_stop, tx_stop_next, tx_load, tx_bit_r;
+    logic [LINES-1:0] tx_bit;
+    assign tx_stop_next = next_slot == 3'd0 && ~pause_meta && rd_output_FIFO_count < {2'b00, frame_pairs};
+    assign tx_load = bclk_rise && streaming && next_bit_to_send == 5'd31 && ~tx_stop;
+    assign rd_output_FIFO_en = tx_load && ~next_slot[0] && ~paused;
 
-                        2'd1: begin
-`ifdef BIG_ENDIAN_SAMPLES
-                            if (sample_sel) sample_r[23:16] <= rd_output_FIFO_data;
-                            else sample_l[23:16] <= rd_output_FIFO_data;
-`else
-                            if (sample_sel) sample_r[15:8] <= rd_output_FIFO_data;
-                            else sample_l[15:8] <= rd_output_FIFO_data;
-`endif
-                            sample_byte_index <= 2'd2;
-                        end
+    logic [31:0] word_r;
+    assign word_r = paused ? 32'h69696969 : word_from_dsd (rd_output_FIFO_data[31:0]);
 
-                        2'd2: begin
-`ifdef BIG_ENDIAN_SAMPLES
-                            if (sample_sel) sample_r[15:8] <= rd_output_FIFO_data;
-                            else sample_l[15:8] <= rd_output_FIFO_data;
-`else
-                            if (sample_sel) sample_r[23:16] <= rd_output_FIFO_data;
-                            else sample_l[23:16] <= rd_output_FIFO_data;
-`endif
-                            sample_byte_index <= 2'd3;
-                        end
+    always @(posedge clk_i, posedge reset_i) begin
+        if (reset_i) begin
+            paused <= 1'b0;
+            tx_stop <= 1'b1;
+        end else if (bclk_fall) begin
+            // A TDM frame is never split.
+            if (next_slot == 3'd0) paused <= pause_meta;
+            tx_stop <= tx_stop_next;
+        end
+    end
 
-                        2'd3: begin
-`ifdef BIG_ENDIAN_SAMPLES
-                            if (sample_sel) sample_r[7:0] <= rd_output_FIFO_data;
-                            else sample_l[7:0] <= rd_output_FIFO_data;
-`else
-                            if (sample_sel) sample_r[31:24] <= rd_output_FIFO_data;
-                            else sample_l[31:24] <= rd_output_FIFO_data;
-`endif
-                            sample_byte_index <= 2'd0;
-                            sample_sel <= ~sample_sel;
+    // The serializers of the lines share the load and shift strobes. Native DSD is sent on line 0 only.
+    genvar line;
+    generate
+        for (line = 0; line < LINES; line = line + 1) begin : data_line
+            logic [31:0] word;
+            assign word = ~dsd_i ? word_from_sample (next_slot[0] ? sample_r[32*line +: 32] : paused ? 32'h0 :
+                                                        rd_output_FIFO_data[64*line+32 +: 32], bit_depth_i) :
+                            paused ? 32'h69696969 : word_from_dsd (rd_output_FIFO_data[64*line+32 +: 32]);
+
+            shift_serializer #(.WIDTH(32)) word_serializer_m (
+                .clk_i              (clk_i),
+                .load_i             (tx_load),
+                .shift_i            (bclk_rise && streaming),
+                .data_i             (word),
+                .bit_o              (tx_bit[line]));
+        end
+    endgenerate
 
-                            bit_clk_en <= 1'b1;
-`ifdef D_I2S_FRAME
-`ifdef BIG_ENDIAN_SAMPLES
-                            $display ($time, " I2S:\t32-bit sample: %h | %0d Hz",
-                                        {sample_sel ? sample_r[31:8] : sample_l[31:8], rd_output_FIFO_data},
-                                        1000000000000 / ($time - prev_time));
-`else
-                            $display ($time, " I2S:\t32-bit sample: %h | %0d Hz",
-                                        {rd_output_FIFO_data, sample_sel ? sample_r[23:0] : sample_l[23:0]},
-                                        1000000000000 / ($time - prev_time));
-`endif // BIG_ENDIAN_SAMPLES
-`endif
-                            dsd_o <= 1'b0;
-                        end
-                    endcase
-                end
-            endcase
+    // The right DSD channel
+    shift_serializer #(.WIDTH(32)) dsd_r_serializer_m (
+        .clk_i              (clk_i),
+        .load_i             (tx_load && dsd_i),
+        .shift_i            (bclk_rise && streaming && dsd_i),
+        .data_i             (word_r),
+        .bit_o              (tx_bit_r));
 
-            if (rd_output_FIFO_empty) begin
-                (* parallel_case, full_case *)
-                case (bit_depth_i)
-                    `BIT_DEPTH_16: stream_stopping_clocks <= 3'd2;
-                    `BIT_DEPTH_24, `BIT_DEPTH_DOP: stream_stopping_clocks <= 3'd3;
-                    `BIT_DEPTH_32: stream_stopping_clocks <= 3'd4;
-                    default: stream_stopping_clocks <= 3'd1;
-                endcase
-            end
+    //==================================================================================================================
+    // The count of stereo frames handed to the serializer. It is read in a different clock domain, hence the gray code.
+    // Silence sent while paused is not counted. A TDM frame is counted once.
+    //==================================================================================================================
+    logic [31:0] frames_emitted, frames_emitted_next;
+    assign frames_emitted_next = frames_emitted + 32'd1;
 
-        end else if (~rd_output_FIFO_empty) begin
-            tx_reset <= 1'b1;
-            rd_output_FIFO_en <= 1'b1;
-`ifdef D_I2S
-            prev_time <= $time;
-            $display ($time, " I2S:\t----- Streaming started.");
-`endif
-        end else begin
-            // The FIFO is empty and not even one full sample was received.
-            // This happens at the beginning of a stream.
+    always @(posedge clk_i, posedge reset_i) begin
+        if (reset_i) begin
+            frames_emitted <= 32'd0;
+            frames_emitted_gray_o <= 32'd0;
+        end else if (rd_output_FIFO_en && next_slot == 3'd0) begin
+            frames_emitted <= frames_emitted_next;
+            frames_emitted_gray_o <= frames_emitted_next ^ (frames_emitted_next >> 1);
         end
     end
 
-`ifdef D_I2S_BC
-    time prev_time_bit = 0;
-`endif
-    logic prev_sample_sel;
-    logic [4:0] next_bit_to_send;
-    logic [31:0] tx_sample;
-
     //==================================================================================================================
-    // TX reset task
+    // The TX reset task
     //==================================================================================================================
     task tx_reset_task;
-`ifdef D_I2S_BC
-        //$display ($time, " I2C_BC:\tTX reset.");
-`endif
-        prev_sample_sel <= 1'b0;
-        sdata_o <= 1'b1;
+        streaming <= 1'b0;
+        next_slot <= 3'd0;
+        sdata_o <= {LINES{1'b1}};
+        dsd_r <= 1'b1;
+        dsd_o <= 1'b0;
         // Make the lrck signal go low before the first bit.
         next_bit_to_send <= 5'd31;
     endtask
@@ -321,60 +293,57 @@ module tx_i2s (
     //==================================================================================================================
     // Audio sample transmitter
     //==================================================================================================================
-    always @(posedge bclk_o, posedge reset_i, posedge tx_reset) begin
+    always @(posedge clk_i, posedge reset_i) begin
         if (reset_i) begin
+`ifdef D_I2S
+            $display ($time, " I2S:\t-- Reset.");
+`endif
             tx_reset_task;
-        end else if (tx_reset) begin
+        end else if (~bclk_rise) begin
+            // Wait for the rising edge of the bit clock.
+        end else if (~streaming) begin
+            if (rd_output_FIFO_count >= {2'b00, frame_pairs} && start_meta) begin
+                streaming <= 1'b1;
+`ifdef D_I2S
+                $display ($time, " I2S:\t----- Streaming started.");
+`endif
+            end
+        end else if (next_bit_to_send == 5'd31 && tx_stop) begin
+            // The previous frame was the last one.
+`ifdef D_I2S
+            $display ($time, " I2S:\t----- Streaming stopped.");
+`endif
             tx_reset_task;
         end else begin
-            prev_sample_sel <= sample_sel;
-            if (prev_sample_sel != sample_sel) begin
-                tx_sample <= prev_sample_sel ? sample_r : sample_l;
-
-                (* parallel_case, full_case *)
-                case (bit_depth_i)
-                    `BIT_DEPTH_16: begin
-`ifdef D_I2S_BC
-                        prev_time_bit <= $time;
-                        $display ($time, " I2S_BC:\t16-bit sample: %h. Sending bit: 15 | %0d Hz",
-                                                    prev_sample_sel ? sample_r[15:0] : sample_l[15:0],
-                                                    1000000000000 / ($time - prev_time_bit));
-`endif
-                        sdata_o <= prev_sample_sel ? sample_r[5'd15] : sample_l[5'd15];
-                        next_bit_to_send <= 5'd14;
-                    end
-
-                    `BIT_DEPTH_24, `BIT_DEPTH_DOP: begin
 `ifdef D_I2S_BC
-                        prev_time_bit <= $time;
-                        $display ($time, " I2S_BC:\t24-bit sample: %h. Sending bit: 23 | %0d Hz",
-                                                    prev_sample_sel ? sample_r[23:0] : sample_l[23:0],
-                                                    1000000000000 / ($time - prev_time_bit));
+            prev_time_bit <= $time;
+            $display ($time, " I2S_BC:\tSending bit: %0d | %0d Hz", tx_load ? 5'd31 : next_bit_to_send,
+                                        1000000000000 / ($time - prev_time_bit));
 `endif
-                        sdata_o <= prev_sample_sel ? sample_r[5'd23] : sample_l[5'd23];
-
-                        next_bit_to_send <= 5'd22;
+            sdata_o <= tx_bit;
+            dsd_r <= tx_bit_r;
+            if (tx_load) begin
+                if (~next_slot[0]) begin
+                    // The right samples of the frames are kept for the next word.
+                    for (r = 0; r < LINES; r = r + 1) begin
+                        sample_r[32*r +: 32] <= paused ? 32'h0 : rd_output_FIFO_data[64*r +: 32];
                     end
-
-                    `BIT_DEPTH_32: begin
-`ifdef D_I2S_BC
-                        prev_time_bit <= $time;
-                        $display ($time, " I2S_BC:\t32-bit sample: %h. Sending bit: 31 | %0d Hz",
-                                                    prev_sample_sel ? sample_r : sample_l,
-                                                    1000000000000 / ($time - prev_time_bit));
+`ifdef D_I2S_FRAME
+                    if (~paused) $display ($time, " I2S:\tFrame: %h %h", rd_output_FIFO_data[63:32],
+                                                        rd_output_FIFO_data[31:0]);
 `endif
-                        sdata_o <= prev_sample_sel ? sample_r[5'd31] : sample_l[5'd31];
+                end
+                // A DSD frame is sent in one word on both channels.
+                next_slot <= next_slot == last_slot ? 3'd0 : next_slot + 3'd1;
+                dsd_o <= bit_depth_i == `BIT_DEPTH_DOP;
 
-                        next_bit_to_send <= 5'd30;
-                    end
+                (* parallel_case, full_case *)
+                case (slot_width)
+                    `BIT_DEPTH_16: next_bit_to_send <= 5'd14;
+                    `BIT_DEPTH_24, `BIT_DEPTH_DOP: next_bit_to_send <= 5'd22;
+                    `BIT_DEPTH_32: next_bit_to_send <= 5'd30;
                 endcase
             end else begin
-`ifdef D_I2S_BC
-                prev_time_bit <= $time;
-                $display ($time, " I2S_BC:\tSending bit: %0d | %0d Hz", next_bit_to_send,
-                                            1000000000000 / ($time - prev_time_bit));
-`endif
-                sdata_o <= tx_sample[next_bit_to_send];
                 // After bit 0 is sent next_bit_to_send == 5'd31. See below the generation of lrck_o.
                 next_bit_to_send <= next_bit_to_send - 5'd1;
             end
@@ -382,18 +351,25 @@ module tx_i2s (
     end
 
     //==================================================================================================================
-    // Generate the left/right clock.
+    // Generate the left/right clock (the TDM frame clock). It does not toggle when the stream stops at the end of a
+    // frame. The lrck_o pin carries the right DSD channel in native DSD mode.
     //==================================================================================================================
-    always @(negedge bclk_o, posedge reset_i, posedge tx_reset) begin
+    logic lrck;
+    assign lrck_o = dsd_i ? dsd_r : lrck;
+
+    always @(posedge clk_i, posedge reset_i) begin
         if (reset_i) begin
-            lrck_o <= 1'b1;
-        end else if (tx_reset) begin
-            lrck_o <= 1'b1;
-        end else if (next_bit_to_send == 5'd31) begin
+            lrck <= 1'b1;
+        end else if (~bclk_fall) begin
+            // Wait for the falling edge of the bit clock.
+        end else if (~streaming) begin
+            lrck <= 1'b1;
+        end else if (next_bit_to_send == 5'd31 && ~tx_stop_next &&
+                        (next_slot == 3'd0 || next_slot == frame_pairs)) begin
 `ifdef D_I2S_BC
-            $display ($time, " I2S_BC:\tlrck %h.", ~lrck_o);
+            $display ($time, " I2S_BC:\tlrck %h.", ~lrck);
 `endif
-            lrck_o <= ~lrck_o;
+            lrck <= ~lrck;
         end
     end
 endmodule
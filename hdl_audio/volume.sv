@@ -0,0 +1,244 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+
+/***********************************************************************************************************************
+ * The volume stage between the control module and the transmitters. The audio bytes are assembled into samples, each
+ * sample is multiplied by gain_i (Q1.15, GAIN_UNITY is 0dB) in two 18x18 multipliers (MULT18X18D), requantized to the
+ * bit depth with rounding, optional TPDF dither and optional first order noise shaping (error feedback per channel of
+ * the frame, up to 32 channels), saturated and sent on as bytes in the same order. At GAIN_UNITY neither dither nor
+ * noise shaping is applied so the samples go through bit for bit. DoP and native DSD (BIT_DEPTH_DOP) bypass the stage.
+ * The latency is fixed: the bytes of a sample leave one per clock from the 5th clock after its last byte came in. This
+ * relies on the control module writing at most one byte every other clock so that the samples never overlap.
+ * The gain and the options are taken with the last byte of each sample so a change applies from the next sample.
+ **********************************************************************************************************************/
+`timescale 1ps/1ps
+`default_nettype none
+
+`include "definitions.svh"
+
+module volume (
+    input logic reset_i,
+    input logic clk_i,
+    // Stream configuration
+    input logic [1:0] bit_depth_i,
+    input logic [4:0] last_channel_i,
+    input logic [15:0] gain_i,
+    input logic dither_i,
+    input logic noise_shaping_i,
+    // Audio bytes in and out
+    input logic en_i,
+    input logic [7:0] data_i,
+    output logic en_o,
+    output logic [7:0] data_o);
+
+    logic bypass;
+    assign bypass = bit_depth_i == `BIT_DEPTH_DOP;
+
+    // The index of the last byte of a sample.
+    logic [1:0] last_byte;
+    assign last_byte = bit_depth_i == `BIT_DEPTH_16 ? 2'd1 : bit_depth_i == `BIT_DEPTH_32 ? 2'd3 : 2'd2;
+
+    // The sign extended sample of the last bytes received (the newest byte in bits[31:24]).
+    function [31:0] sample_of (input logic [31:0] bytes, input logic [1:0] bit_depth);
+        logic [31:0] word;
+`ifdef BIG_ENDIAN_SAMPLES
+        // The first byte is the most significant one: the sample is in the low bytes of the reversed bytes.
+        word = {bytes[7:0], bytes[15:8], bytes[23:16], bytes[31:24]};
+        (* parallel_case, full_case *)
+        case (bit_depth)
+            `BIT_DEPTH_16: sample_of = {{16{word[15]}}, word[15:0]};
+            `BIT_DEPTH_24, `BIT_DEPTH_DOP: sample_of = {{8{word[23]}}, word[23:0]};
+            `BIT_DEPTH_32: sample_of = word;
+        endcase
+`else
+        word = bytes;
+        (* parallel_case, full_case *)
+        case (bit_depth)
+            `BIT_DEPTH_16: sample_of = {{16{word[31]}}, word[31:16]};
+            `BIT_DEPTH_24, `BIT_DEPTH_DOP: sample_of = {{8{word[31]}}, word[31:8]};
+            `BIT_DEPTH_32: sample_of = word;
+        endcase
+`endif
+    endfunction
+
+    //==================================================================================================================
+    // Stage 0: the sample assembly. The channel of each sample indexes the noise shaping state.
+    //==================================================================================================================
+    logic [31:0] pack, pack_next;
+    assign pack_next = {data_i, pack[31:8]};
+    logic [1:0] in_index;
+    logic [4:0] channel;
+
+    logic sample_en;
+    logic [31:0] sample;
+    logic [4:0] sample_channel;
+    logic [15:0] sample_gain;
+    logic sample_dither, sample_shape;
+
+    always @(posedge clk_i, posedge reset_i) begin
+        if (reset_i) begin
+            in_index <= 2'd0;
+            channel <= 5'd0;
+            sample_en <= 1'b0;
+        end else begin
+            sample_en <= 1'b0;
+            if (en_i && ~bypass) begin
+                pack <= pack_next;
+                if (in_index == last_byte) begin
+                    in_index <= 2'd0;
+                    sample <= sample_of (pack_next, bit_depth_i);
+                    sample_channel <= channel;
+                    sample_gain <= gain_i;
+                    sample_dither <= dither_i && gain_i != `GAIN_UNITY;
+                    sample_shape <= noise_shaping_i && gain_i != `GAIN_UNITY;
+                    channel <= channel == last_channel_i ? 5'd0 : channel + 5'd1;
+                    sample_en <= 1'b1;
+                end else begin
+                    in_index <= in_index + 2'd1;
+                end
+            end
+        end
+    end
+
+    //==================================================================================================================
+    // The dither source: a xorshift32 generator stepped once per sample. Two 15-bit fields give the TPDF dither.
+    //==================================================================================================================
+    logic [31:0] random, random_1, random_2;
+    assign random_1 = random ^ (random << 13);
+    assign random_2 = random_1 ^ (random_1 >> 17);
+
+    always @(posedge clk_i, posedge reset_i) begin
+        if (reset_i) begin
+            random <= 32'h2545f491;
+        end else if (sample_en) begin
+            random <= random_2 ^ (random_2 << 5);
+        end
+    end
+
+    //==================================================================================================================
+    // Stage 1: the products of the high (signed) and low (unsigned) parts of the sample, the rounding offset and the
+    // error of the previous sample of the channel.
+    //==================================================================================================================
+    logic signed [17:0] gain;
+    assign gain = {2'b00, sample_gain};
+
+    // The noise shaping state: the requantization error of the last sample of each channel (15 fraction bits).
+    logic signed [17:0] error [0:31];
+    logic [31:0] error_valid;
+
+    logic signed [35:0] product_hi, product_lo;
+    logic signed [17:0] error_r, offset;
+    logic mul_en, mul_shape;
+    logic [4:0] mul_channel;
+
+    always @(posedge clk_i, posedge reset_i) begin
+        if (reset_i) begin
+            mul_en <= 1'b0;
+        end else begin
+            mul_en <= sample_en;
+            product_hi <= $signed(sample[31:14]) * gain;
+            product_lo <= $signed({4'b0000, sample[13:0]}) * gain;
+            mul_channel <= sample_channel;
+            mul_shape <= sample_shape;
+            error_r <= sample_shape && error_valid[sample_channel] ? error[sample_channel] : 18'sd0;
+            // Rounding to the nearest value, with the TPDF dither (-1 to +1 LSB) centered on it.
+            offset <= sample_dither ? $signed({3'b000, random[14:0]}) + $signed({3'b000, random[29:15]}) -
+                                                18'sd16384 : 18'sd16384;
+        end
+    end
+
+    //==================================================================================================================
+    // Stage 2: the value to requantize (15 fraction bits) with the error feedback, and its rounded sum.
+    //==================================================================================================================
+    logic signed [49:0] value, rounded;
+    logic sum_en, sum_shape;
+    logic [4:0] sum_channel;
+
+    always @(posedge clk_i, posedge reset_i) begin
+        if (reset_i) begin
+            sum_en <= 1'b0;
+        end else begin
+            sum_en <= mul_en;
+            value <= (product_hi <<< 14) + product_lo - error_r;
+            rounded <= (product_hi <<< 14) + product_lo - error_r + offset;
+            sum_channel <= mul_channel;
+            sum_shape <= mul_shape;
+        end
+    end
+
+    //==================================================================================================================
+    // Stage 3: saturation to the bit depth and the new error of the channel. The error is cleared when clipping so that
+    // the feedback never winds up. The sample is then sent one byte per clock.
+    //==================================================================================================================
+    logic signed [34:0] quantized, maximum;
+    assign quantized = rounded[49:15];
+    assign maximum = bit_depth_i == `BIT_DEPTH_16 ? 35'sh7fff : bit_depth_i == `BIT_DEPTH_32 ? 35'sh7fffffff :
+                        35'sh7fffff;
+    logic clip_high, clip_low;
+    assign clip_high = quantized > maximum;
+    assign clip_low = quantized < -maximum - 35'sd1;
+    logic signed [49:0] requantization_error;
+    assign requantization_error = {rounded[49:15], 15'h0} - value;
+
+    logic [31:0] out_word, out_sample;
+    assign out_sample = clip_high ? maximum[31:0] : clip_low ? ~maximum[31:0] : quantized[31:0];
+    logic [2:0] out_bytes;
+    logic volume_en;
+    logic [7:0] volume_data;
+
+    assign en_o = bypass ? en_i : volume_en;
+    assign data_o = bypass ? data_i : volume_data;
+
+    always @(posedge clk_i) begin
+        if (sum_en) begin
+            error[sum_channel] <= sum_shape && ~clip_high && ~clip_low ? requantization_error[17:0] : 18'sd0;
+        end
+    end
+
+    always @(posedge clk_i, posedge reset_i) begin
+        if (reset_i) begin
+            out_bytes <= 3'd0;
+            volume_en <= 1'b0;
+            error_valid <= 32'h0;
+        end else begin
+            volume_en <= out_bytes != 3'd0;
+`ifdef BIG_ENDIAN_SAMPLES
+            volume_data <= out_word[31:24];
+`else
+            volume_data <= out_word[7:0];
+`endif
+
+            if (sum_en) begin
+                error_valid[sum_channel] <= 1'b1;
+                out_bytes <= {1'b0, last_byte} + 3'd1;
+`ifdef BIG_ENDIAN_SAMPLES
+                // The most significant byte first.
+                out_word <= out_sample << {~last_byte, 3'b000};
+`else
+                out_word <= out_sample;
+`endif
+            end else if (out_bytes != 3'd0) begin
+                out_bytes <= out_bytes - 3'd1;
+`ifdef BIG_ENDIAN_SAMPLES
+                out_word <= out_word << 8;
+`else
+                out_word <= out_word >> 8;
+`endif
+            end
+        end
+    end
+endmodule
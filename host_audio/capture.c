@@ -0,0 +1,452 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "capture.h"
+
+#define WAV_HEADER_SIZE            44
+// Buffers are aligned to the page size so that the file writes are aligned too.
+#define BUFFER_ALIGNMENT           4096
+
+//======================================================================================================================
+// A single producer, single consumer ring. head and tail count all the bytes written and read.
+struct capture_ring {
+    unsigned char* data;
+    size_t size;
+    size_t head;
+    size_t tail;
+    unsigned char closed;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+struct capture {
+    const struct capture_config* config;
+    capture_read_fn read_fn;
+    void* read_context;
+    int fd;
+    struct capture_ring raw_ring;
+    struct capture_ring payload_ring;
+    volatile unsigned char done;
+    int read_error;
+    int write_error;
+    unsigned long long bytes_read;
+};
+
+static int ring_init (struct capture_ring* ring, size_t size);
+static void ring_free (struct capture_ring* ring);
+static void ring_close (struct capture_ring* ring);
+static size_t ring_wait_space (struct capture_ring* ring, unsigned char** ptr);
+static void ring_commit (struct capture_ring* ring, size_t bytes);
+static size_t ring_wait_data (struct capture_ring* ring, size_t min_bytes, unsigned char** ptr);
+static void ring_release (struct capture_ring* ring, size_t bytes);
+
+static void* reader_thread (void* arg);
+static void* writer_thread (void* arg);
+static int copy_payload (struct capture* capture, const unsigned char* payload, size_t bytes);
+static int write_wav_header (int fd, const struct capture_config* config, unsigned long long data_bytes);
+
+//======================================================================================================================
+// Packet extractor state machine
+#define STATE_EX_CMD               1
+#define STATE_EX_PAYLOAD_LENGTH_1  2
+#define STATE_EX_PAYLOAD_LENGTH_2  3
+#define STATE_EX_STREAM_PAYLOAD    4
+#define STATE_EX_SKIP_PAYLOAD      5
+#define STATE_EX_STOPPED_PAYLOAD   6
+
+//======================================================================================================================
+int capture_run (const struct capture_config* config, capture_read_fn read_fn, void* read_context,
+                        const char* filename, struct capture_stats* stats) {
+    struct capture capture;
+    memset(&capture, 0, sizeof(struct capture));
+    memset(stats, 0, sizeof(struct capture_stats));
+    stats->stop_code = -1;
+
+    if ((config->ring_size & (config->ring_size - 1)) != 0 || config->ring_size % config->read_size != 0 ||
+            config->ring_size % config->write_size != 0 || config->write_size % BUFFER_ALIGNMENT != 0) {
+        printf("Invalid capture ring size: %d, read size: %d, write size: %d\r\n",
+                    config->ring_size, config->read_size, config->write_size);
+        return -1;
+    }
+
+    capture.config = config;
+    capture.read_fn = read_fn;
+    capture.read_context = read_context;
+
+    capture.fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (capture.fd < 0) {
+        printf("Cannot open file: %s\r\n", filename);
+        return -2;
+    }
+
+    // The sizes are written once the capture is complete.
+    if (write_wav_header (capture.fd, config, 0) != 0) {
+        close(capture.fd);
+        return -3;
+    }
+
+    if (ring_init (&capture.raw_ring, config->ring_size) != 0 ||
+            ring_init (&capture.payload_ring, config->ring_size) != 0) {
+        printf("Cannot allocate the capture rings: %d bytes\r\n", config->ring_size);
+        ring_free (&capture.raw_ring);
+        close(capture.fd);
+        return -4;
+    }
+
+    struct timeval tv_start;
+    gettimeofday(&tv_start, NULL);
+
+    pthread_t reader, writer;
+    pthread_create(&reader, NULL, reader_thread, &capture);
+    pthread_create(&writer, NULL, writer_thread, &capture);
+
+    // Extract the payload of the stream packets. Command and length bytes are parsed one at a time while payload
+    // spans are copied (or skipped) in bulk.
+    unsigned char ex_state_m = STATE_EX_CMD;
+    unsigned char cmd = 0;
+    size_t payload_bytes = 0;
+    int result = 0;
+    while (!capture.done) {
+        unsigned char* data;
+        size_t available = ring_wait_data (&capture.raw_ring, 1, &data);
+        if (available == 0) {
+            // The reader stopped
+            break;
+        }
+
+        size_t i = 0;
+        while (i < available && !capture.done) {
+            switch (ex_state_m) {
+                case STATE_EX_CMD: {
+                    cmd = data[i] & 0xe0;
+                    if (data[i] & 0x10) {
+                        ex_state_m = STATE_EX_PAYLOAD_LENGTH_1;
+                    } else {
+                        payload_bytes = data[i] & 0x0f;
+                        if (cmd == config->stopped_cmd) {
+                            // A stopped command without an error code ends the capture.
+                            ex_state_m = STATE_EX_STOPPED_PAYLOAD;
+                            capture.done = payload_bytes == 0;
+                        } else if (payload_bytes > 0) {
+                            ex_state_m = cmd == config->stream_cmd ? STATE_EX_STREAM_PAYLOAD : STATE_EX_SKIP_PAYLOAD;
+                        }
+                    }
+                    if (cmd == config->stream_cmd) {
+                        stats->packets++;
+                    }
+                    i++;
+                    break;
+                }
+
+                case STATE_EX_PAYLOAD_LENGTH_1: {
+                    payload_bytes = (size_t)data[i++] << 8;
+                    ex_state_m = STATE_EX_PAYLOAD_LENGTH_2;
+                    break;
+                }
+
+                case STATE_EX_PAYLOAD_LENGTH_2: {
+                    payload_bytes |= data[i++];
+                    if (payload_bytes == 0) {
+                        ex_state_m = STATE_EX_CMD;
+                    } else {
+                        ex_state_m = cmd == config->stream_cmd ? STATE_EX_STREAM_PAYLOAD :
+                                        cmd == config->stopped_cmd ? STATE_EX_STOPPED_PAYLOAD : STATE_EX_SKIP_PAYLOAD;
+                    }
+                    break;
+                }
+
+                case STATE_EX_STREAM_PAYLOAD: {
+                    size_t span = available - i < payload_bytes ? available - i : payload_bytes;
+                    if (copy_payload (&capture, data + i, span) != 0) {
+                        result = -5;
+                        capture.done = 1;
+                        break;
+                    }
+
+                    i += span;
+                    payload_bytes -= span;
+                    if (payload_bytes == 0) {
+                        ex_state_m = STATE_EX_CMD;
+                    }
+                    break;
+                }
+
+                case STATE_EX_SKIP_PAYLOAD: {
+                    size_t span = available - i < payload_bytes ? available - i : payload_bytes;
+                    i += span;
+                    payload_bytes -= span;
+                    if (payload_bytes == 0) {
+                        ex_state_m = STATE_EX_CMD;
+                    }
+                    break;
+                }
+
+                case STATE_EX_STOPPED_PAYLOAD: {
+                    stats->stop_code = data[i++];
+                    capture.done = 1;
+                    break;
+                }
+            }
+        }
+
+        ring_release (&capture.raw_ring, i);
+    }
+
+    // Stop the reader (it may be waiting for room in the raw ring) and let the writer drain the payload ring.
+    capture.done = 1;
+    ring_close (&capture.raw_ring);
+    pthread_join(reader, NULL);
+    ring_close (&capture.payload_ring);
+    pthread_join(writer, NULL);
+
+    struct timeval tv_stop;
+    gettimeofday(&tv_stop, NULL);
+    stats->duration_us = (tv_stop.tv_sec - tv_start.tv_sec)*1000000LL + (tv_stop.tv_usec - tv_start.tv_usec);
+    stats->bytes_read = capture.bytes_read;
+    stats->payload_bytes = capture.payload_ring.tail;
+
+    if (capture.read_error) {
+        printf("Capture read failed: %d\r\n", capture.read_error);
+        result = -6;
+    }
+    if (capture.write_error) {
+        printf("Capture write failed: %s\r\n", filename);
+        result = -7;
+    }
+    if (write_wav_header (capture.fd, config, stats->payload_bytes) != 0) {
+        result = -8;
+    }
+
+    close(capture.fd);
+    ring_free (&capture.raw_ring);
+    ring_free (&capture.payload_ring);
+    return result;
+}
+
+//======================================================================================================================
+static void* reader_thread (void* arg) {
+    struct capture* capture = arg;
+    while (!capture->done) {
+        unsigned char* space;
+        size_t length = ring_wait_space (&capture->raw_ring, &space);
+        if (length == 0) {
+            break;
+        }
+
+        if (length > capture->config->read_size) {
+            length = capture->config->read_size;
+        }
+
+        unsigned int bytes_read = 0;
+        int status = capture->read_fn (capture->read_context, space, length, &bytes_read);
+        if (status < 0) {
+            capture->read_error = status;
+            break;
+        }
+
+        capture->bytes_read += bytes_read;
+        ring_commit (&capture->raw_ring, bytes_read);
+    }
+
+    // Wake up the extractor if it waits for data.
+    ring_close (&capture->raw_ring);
+    return NULL;
+}
+
+//======================================================================================================================
+static void* writer_thread (void* arg) {
+    struct capture* capture = arg;
+    size_t write_size = capture->config->write_size;
+    while (1) {
+        // Whole write_size blocks are written until the capture ends; the ring size is a multiple of write_size so a
+        // block never wraps.
+        unsigned char* data;
+        size_t available = ring_wait_data (&capture->payload_ring, write_size, &data);
+        if (available == 0) {
+            break;
+        }
+
+        if (available > write_size) {
+            available = write_size;
+        }
+
+        if (!capture->write_error) {
+            ssize_t written = write(capture->fd, data, available);
+            if (written != (ssize_t)available) {
+                capture->write_error = 1;
+            }
+        }
+
+        ring_release (&capture->payload_ring, available);
+    }
+
+    return NULL;
+}
+
+//======================================================================================================================
+static int copy_payload (struct capture* capture, const unsigned char* payload, size_t bytes) {
+    if (capture->config->check_counter) {
+        // The hdl_test TEST_SEND payload is a byte counter continuing across packets.
+        unsigned char expected = (unsigned char)capture->payload_ring.head;
+        for (size_t i = 0; i < bytes; i++, expected++) {
+            if (payload[i] != expected) {
+                printf("Got: %d, Expected: %d\r\n", payload[i], expected);
+                return -1;
+            }
+        }
+    }
+
+    while (bytes > 0) {
+        unsigned char* space;
+        size_t length = ring_wait_space (&capture->payload_ring, &space);
+        if (length == 0) {
+            return -2;
+        }
+
+        if (length > bytes) {
+            length = bytes;
+        }
+
+        memcpy(space, payload, length);
+        ring_commit (&capture->payload_ring, length);
+        payload += length;
+        bytes -= length;
+    }
+
+    return 0;
+}
+
+//======================================================================================================================
+static void put_le (unsigned char* buffer, unsigned int value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        buffer[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static int write_wav_header (int fd, const struct capture_config* config, unsigned long long data_bytes) {
+    unsigned char header[WAV_HEADER_SIZE];
+    unsigned int block_align = config->num_channels * (config->bits_per_sample >> 3);
+    unsigned int data_size = data_bytes > 0xffffffffULL - 36 ? 0xffffffffU - 36 : (unsigned int)data_bytes;
+
+    memcpy(header, "RIFF", 4);
+    put_le (header + 4, 36 + data_size, 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put_le (header + 16, 16, 4);
+    put_le (header + 20, 1, 2); // PCM
+    put_le (header + 22, config->num_channels, 2);
+    put_le (header + 24, config->sample_rate, 4);
+    put_le (header + 28, config->sample_rate * block_align, 4);
+    put_le (header + 32, block_align, 2);
+    put_le (header + 34, config->bits_per_sample, 2);
+    memcpy(header + 36, "data", 4);
+    put_le (header + 40, data_size, 4);
+
+    if (pwrite(fd, header, WAV_HEADER_SIZE, 0) != WAV_HEADER_SIZE) {
+        printf("Cannot write the WAV header\r\n");
+        return -1;
+    }
+
+    if (lseek(fd, 0, SEEK_END) < 0) {
+        return -2;
+    }
+    return 0;
+}
+
+//======================================================================================================================
+static int ring_init (struct capture_ring* ring, size_t size) {
+    memset(ring, 0, sizeof(struct capture_ring));
+    if (posix_memalign((void**)&ring->data, BUFFER_ALIGNMENT, size) != 0) {
+        ring->data = NULL;
+        return -1;
+    }
+
+    ring->size = size;
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->cond, NULL);
+    return 0;
+}
+
+static void ring_free (struct capture_ring* ring) {
+    if (ring->data != NULL) {
+        free (ring->data);
+        ring->data = NULL;
+        pthread_mutex_destroy(&ring->lock);
+        pthread_cond_destroy(&ring->cond);
+    }
+}
+
+static void ring_close (struct capture_ring* ring) {
+    pthread_mutex_lock(&ring->lock);
+    ring->closed = 1;
+    pthread_cond_broadcast(&ring->cond);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+// Waits for free space and returns the contiguous free bytes (0 if the ring was closed).
+static size_t ring_wait_space (struct capture_ring* ring, unsigned char** ptr) {
+    pthread_mutex_lock(&ring->lock);
+    while (!ring->closed && ring->head - ring->tail == ring->size) {
+        pthread_cond_wait(&ring->cond, &ring->lock);
+    }
+
+    size_t length = 0;
+    if (!ring->closed) {
+        size_t offset = ring->head & (ring->size - 1);
+        size_t free_bytes = ring->size - (ring->head - ring->tail);
+        length = ring->size - offset < free_bytes ? ring->size - offset : free_bytes;
+        *ptr = ring->data + offset;
+    }
+    pthread_mutex_unlock(&ring->lock);
+    return length;
+}
+
+static void ring_commit (struct capture_ring* ring, size_t bytes) {
+    pthread_mutex_lock(&ring->lock);
+    ring->head += bytes;
+    pthread_cond_broadcast(&ring->cond);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+// Waits for at least min_bytes (or less once the ring is closed) and returns the contiguous bytes available
+// (0 if the ring was closed and is empty).
+static size_t ring_wait_data (struct capture_ring* ring, size_t min_bytes, unsigned char** ptr) {
+    pthread_mutex_lock(&ring->lock);
+    while (!ring->closed && ring->head - ring->tail < min_bytes) {
+        pthread_cond_wait(&ring->cond, &ring->lock);
+    }
+
+    size_t offset = ring->tail & (ring->size - 1);
+    size_t available = ring->head - ring->tail;
+    size_t length = ring->size - offset < available ? ring->size - offset : available;
+    *ptr = ring->data + offset;
+    pthread_mutex_unlock(&ring->lock);
+    return length;
+}
+
+static void ring_release (struct capture_ring* ring, size_t bytes) {
+    pthread_mutex_lock(&ring->lock);
+    ring->tail += bytes;
+    pthread_cond_broadcast(&ring->cond);
+    pthread_mutex_unlock(&ring->lock);
+}
@@ -0,0 +1,52 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+/***********************************************************************************************************************
+ * The capture engine for FPGA to host streams. A reader thread fills a ring with large reads, the calling thread
+ * extracts the payload of the stream packets span by span and a writer thread streams the payload to a WAV file with
+ * large writes straight out of a second ring.
+ **********************************************************************************************************************/
+
+// Reads up to length bytes from the FPGA (or an emulator). Returns a negative value on error.
+typedef int (*capture_read_fn) (void* context, unsigned char* buffer, unsigned int length, unsigned int* bytes_read);
+
+struct capture_config {
+    unsigned char stream_cmd;       // The command (bits[7:5]) of the packets whose payload is captured
+    unsigned char stopped_cmd;      // The command (bits[7:5]) which ends the capture. Payload byte[0] is the error code.
+    int num_channels;               // WAV format of the captured payload
+    int sample_rate;
+    int bits_per_sample;
+    unsigned int read_size;         // Maximum bytes requested by one read
+    unsigned int write_size;        // Bytes written to the file at once (multiple of 4096)
+    unsigned int ring_size;         // Size of each ring (power of 2, multiple of read_size and write_size)
+    unsigned char check_counter;    // Check the incrementing byte pattern of the hdl_test TEST_SEND stream
+};
+
+struct capture_stats {
+    unsigned long long bytes_read;      // All the bytes read from the FPGA
+    unsigned long long payload_bytes;   // The bytes written to the WAV file (without the header)
+    unsigned int packets;               // The stream packets received
+    int stop_code;                      // The error code of the stopped command or -1 if the stream did not stop
+    long long duration_us;
+};
+
+int capture_run (const struct capture_config* config, capture_read_fn read_fn, void* read_context,
+                        const char* filename, struct capture_stats* stats);
+
+#endif // CAPTURE_H
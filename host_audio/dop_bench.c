@@ -0,0 +1,175 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "dsd_reader.h"
+#include "dop_packer.h"
+//======================================================================================================================
+// Benchmark of the DoP packer: the SSSE3 packer against the scalar reference on MSB first (DFF) and LSB first (DSF)
+// channel data. The outputs are compared byte for byte and the scalar output is decoded back to the DSD bytes with
+// the marker sequence checked. The rates are DSD input bytes (both channels) per second.
+//
+// With -f the channels of a DSF or DFF file are packed instead of random data.
+//======================================================================================================================
+long long time_us (void);
+int check_dop (const unsigned char* left, const unsigned char* right, size_t bytes, unsigned char lsb_first,
+                        const unsigned char* frames);
+
+//======================================================================================================================
+int main(int argc, char *argv[]) {
+    int opt;
+    char* filename = NULL;
+    unsigned int size_mb = 64;
+    unsigned int passes = 8;
+    while ((opt = getopt(argc, argv, "f:s:n:h")) != -1) {
+        switch (opt) {
+            case 'f': filename = optarg; break;
+            case 's': size_mb = strtoul (optarg, NULL, 10); break;
+            case 'n': passes = strtoul (optarg, NULL, 10); break;
+            default: {
+                printf("Usage: %s [-f <DSF or DFF file>] [-s <MB per channel>] [-n <passes>]\r\n", argv[0]);
+                return 1;
+            }
+        }
+    }
+
+    size_t bytes = (size_t)size_mb << 20;
+    unsigned char file_lsb_first = 0;
+    FILE* fp = NULL;
+    struct dsd_file df;
+    if (filename != NULL) {
+        struct wav_header wh;
+        fp = fopen(filename, "rb");
+        if (fp == NULL || read_dsd_file (fp, &df, &wh) != 0) {
+            printf("Invalid DSD file: %s\r\n", filename);
+            if (fp != NULL) {
+                fclose(fp);
+            }
+            return 1;
+        }
+
+        bytes = (size_t)df.samples * DSD_CHANNEL_SAMPLE_BYTES;
+        file_lsb_first = df.lsb_first;
+    }
+
+    unsigned char* left = malloc (bytes);
+    unsigned char* right = malloc (bytes);
+    unsigned char* scalar_out = malloc (bytes * 3);
+    unsigned char* simd_out = malloc (bytes * 3);
+    if (left == NULL || right == NULL || scalar_out == NULL || simd_out == NULL) {
+        printf("Cannot allocate the buffers for %zu bytes per channel\r\n", bytes);
+        return 1;
+    }
+
+    if (fp != NULL) {
+        bytes = read_dsd_channels (fp, &df, left, right, (unsigned int)bytes);
+        close_dsd_file (&df);
+        fclose(fp);
+    } else {
+        srand(1);
+        for (size_t i = 0; i < bytes; i++) {
+            left[i] = (unsigned char)rand();
+            right[i] = (unsigned char)rand();
+        }
+    }
+
+    printf("DoP packer: %zu bytes per channel, %u passes, SIMD (SSSE3): %s\r\n", bytes, passes,
+                dop_pack_simd () ? "yes" : "no");
+
+    int failed = 0;
+    for (unsigned char lsb_first = 0; lsb_first <= 1; lsb_first++) {
+        // A file is packed in its own bit order only.
+        if (fp != NULL && lsb_first != file_lsb_first) {
+            continue;
+        }
+
+        // The first pass maps the output pages.
+        struct dop_packer packer;
+        dop_init (&packer, lsb_first);
+        dop_pack_scalar (&packer, left, right, bytes, scalar_out);
+        dop_init (&packer, lsb_first);
+        dop_pack (&packer, left, right, bytes, simd_out);
+
+        long long scalar_us = 0, simd_us = 0;
+        for (unsigned int pass = 0; pass < passes; pass++) {
+            dop_init (&packer, lsb_first);
+            long long start_us = time_us ();
+            dop_pack_scalar (&packer, left, right, bytes, scalar_out);
+            scalar_us += time_us () - start_us;
+
+            dop_init (&packer, lsb_first);
+            start_us = time_us ();
+            dop_pack (&packer, left, right, bytes, simd_out);
+            simd_us += time_us () - start_us;
+        }
+
+        int exact = memcmp(scalar_out, simd_out, bytes * 3) == 0;
+        int decoded = check_dop (left, right, bytes, lsb_first, scalar_out) == 0;
+        double scalar_mbps = (double)bytes * 2 * passes / (scalar_us > 0 ? scalar_us : 1);
+        double simd_mbps = (double)bytes * 2 * passes / (simd_us > 0 ? simd_us : 1);
+        printf("%s first: scalar %.1f MB/s, SIMD %.1f MB/s (x%.2f), bit exact: %s, DoP decode: %s\r\n",
+                    lsb_first ? "LSB" : "MSB", scalar_mbps, simd_mbps, simd_mbps / scalar_mbps, exact ? "yes" : "NO",
+                    decoded ? "ok" : "FAILED");
+        failed |= !exact || !decoded;
+    }
+
+    free (left);
+    free (right);
+    free (scalar_out);
+    free (simd_out);
+    return failed;
+}
+
+//======================================================================================================================
+// Decodes the frames back to the DSD bytes of both channels and checks the alternating markers.
+int check_dop (const unsigned char* left, const unsigned char* right, size_t bytes, unsigned char lsb_first,
+                        const unsigned char* frames) {
+    for (size_t i = 0; i + 1 < bytes; i += 2) {
+        const unsigned char* frame = frames + i / 2 * DOP_FRAME_BYTES;
+        unsigned char marker = (i / 2) & 1 ? DOP_MARKER_1 : DOP_MARKER_0;
+        // Little endian 24-bit samples: the first DSD byte is in bits[15:8].
+        unsigned int sample_l = frame[0] | frame[1] << 8 | frame[2] << 16;
+        unsigned int sample_r = frame[3] | frame[4] << 8 | frame[5] << 16;
+        unsigned int expected_l = marker << 16, expected_r = marker << 16;
+        for (int b = 0; b < 16; b++) {
+            // DSD bit b of the frame in time order
+            unsigned char byte_l = left[i + b / 8], byte_r = right[i + b / 8];
+            int shift = lsb_first ? b % 8 : 7 - b % 8;
+            expected_l |= ((byte_l >> shift) & 1) << (15 - b);
+            expected_r |= ((byte_r >> shift) & 1) << (15 - b);
+        }
+
+        if (sample_l != expected_l || sample_r != expected_r) {
+            printf("DoP frame %zu: %06x %06x, expected %06x %06x\r\n", i / 2, sample_l, sample_r, expected_l,
+                        expected_r);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+//======================================================================================================================
+long long time_us (void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
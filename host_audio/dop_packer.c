@@ -0,0 +1,236 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+#include <stdio.h>
+#include <string.h>
+
+#include "dop_packer.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DOP_SSSE3
+#endif
+
+// 16 bytes of each channel make 8 frames (48 bytes) per SIMD iteration.
+#define DOP_SIMD_BYTES              16
+#define DOP_SIMD_OUT_BYTES          (DOP_SIMD_BYTES / 2 * DOP_FRAME_BYTES)
+
+static unsigned char reverse_table[256];
+// For each output byte of an iteration: the left and right channel byte (0x80 for none), the marker bytes and the
+// markers of the odd frames.
+static unsigned char shuffle_left[DOP_SIMD_OUT_BYTES], shuffle_right[DOP_SIMD_OUT_BYTES];
+static unsigned char marker_bytes[DOP_SIMD_OUT_BYTES], odd_marker_bytes[DOP_SIMD_OUT_BYTES];
+static int tables_ready = 0;
+
+static void init_tables (void);
+
+//======================================================================================================================
+void dop_init (struct dop_packer* packer, unsigned char lsb_first) {
+    init_tables ();
+    packer->marker = DOP_MARKER_0;
+    packer->lsb_first = lsb_first;
+}
+
+//======================================================================================================================
+// A frame is: left DSD byte 1, left DSD byte 0, marker, right DSD byte 1, right DSD byte 0, marker.
+size_t dop_pack_scalar (struct dop_packer* packer, const unsigned char* left, const unsigned char* right, size_t bytes,
+                        unsigned char* out) {
+    unsigned char marker = packer->marker;
+    for (size_t i = 0; i + 1 < bytes; i += 2) {
+        if (packer->lsb_first) {
+            out[0] = reverse_table[left[i + 1]];
+            out[1] = reverse_table[left[i]];
+            out[3] = reverse_table[right[i + 1]];
+            out[4] = reverse_table[right[i]];
+        } else {
+            out[0] = left[i + 1];
+            out[1] = left[i];
+            out[3] = right[i + 1];
+            out[4] = right[i];
+        }
+
+        out[2] = marker;
+        out[5] = marker;
+        // 0x05 <-> 0xFA
+        marker ^= 0xff;
+        out += DOP_FRAME_BYTES;
+    }
+
+    packer->marker = marker;
+    return bytes / 2 * DOP_FRAME_BYTES;
+}
+
+#ifdef DOP_SSSE3
+//======================================================================================================================
+// The bits are reversed with two nibble lookups. An iteration has an even number of frames so the markers of the
+// frames keep their parity.
+__attribute__((target("ssse3")))
+static size_t dop_pack_ssse3 (struct dop_packer* packer, const unsigned char* left, const unsigned char* right,
+                        size_t bytes, unsigned char* out) {
+    static const unsigned char reverse_low[16] = {
+        0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0, 0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0};
+    static const unsigned char reverse_high[16] = {
+        0x00, 0x08, 0x04, 0x0c, 0x02, 0x0a, 0x06, 0x0e, 0x01, 0x09, 0x05, 0x0d, 0x03, 0x0b, 0x07, 0x0f};
+    const __m128i nibble_mask = _mm_set1_epi8(0x0f);
+    const __m128i rev_low = _mm_loadu_si128((const __m128i*)reverse_low);
+    const __m128i rev_high = _mm_loadu_si128((const __m128i*)reverse_high);
+    const __m128i marker = _mm_set1_epi8((char)packer->marker);
+
+    __m128i shuffle_l[3], shuffle_r[3], markers[3];
+    for (int k = 0; k < 3; k++) {
+        shuffle_l[k] = _mm_loadu_si128((const __m128i*)(shuffle_left + 16 * k));
+        shuffle_r[k] = _mm_loadu_si128((const __m128i*)(shuffle_right + 16 * k));
+        markers[k] = _mm_xor_si128(_mm_and_si128(marker, _mm_loadu_si128((const __m128i*)(marker_bytes + 16 * k))),
+                                    _mm_loadu_si128((const __m128i*)(odd_marker_bytes + 16 * k)));
+    }
+
+    size_t done = 0;
+    for (; done + DOP_SIMD_BYTES <= bytes; done += DOP_SIMD_BYTES) {
+        __m128i l = _mm_loadu_si128((const __m128i*)(left + done));
+        __m128i r = _mm_loadu_si128((const __m128i*)(right + done));
+        if (packer->lsb_first) {
+            l = _mm_or_si128(_mm_shuffle_epi8(rev_low, _mm_and_si128(l, nibble_mask)),
+                                _mm_shuffle_epi8(rev_high, _mm_and_si128(_mm_srli_epi16(l, 4), nibble_mask)));
+            r = _mm_or_si128(_mm_shuffle_epi8(rev_low, _mm_and_si128(r, nibble_mask)),
+                                _mm_shuffle_epi8(rev_high, _mm_and_si128(_mm_srli_epi16(r, 4), nibble_mask)));
+        }
+
+        for (int k = 0; k < 3; k++) {
+            __m128i frames = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(l, shuffle_l[k]),
+                                                        _mm_shuffle_epi8(r, shuffle_r[k])), markers[k]);
+            _mm_storeu_si128((__m128i*)(out + done / 2 * DOP_FRAME_BYTES + 16 * k), frames);
+        }
+    }
+
+    return done / 2 * DOP_FRAME_BYTES +
+                dop_pack_scalar (packer, left + done, right + done, bytes - done, out + done / 2 * DOP_FRAME_BYTES);
+}
+#endif
+
+//======================================================================================================================
+size_t dop_pack (struct dop_packer* packer, const unsigned char* left, const unsigned char* right, size_t bytes,
+                        unsigned char* out) {
+#ifdef DOP_SSSE3
+    if (dop_pack_simd ()) {
+        return dop_pack_ssse3 (packer, left, right, bytes, out);
+    }
+#endif
+    return dop_pack_scalar (packer, left, right, bytes, out);
+}
+
+int dop_pack_simd (void) {
+#ifdef DOP_SSSE3
+    return __builtin_cpu_supports("ssse3");
+#else
+    return 0;
+#endif
+}
+
+//======================================================================================================================
+size_t dop_interleave (const struct dop_packer* packer, const unsigned char* left, const unsigned char* right,
+                        size_t bytes, unsigned char* out) {
+    for (size_t i = 0; i < bytes; i++) {
+        out[2 * i] = packer->lsb_first ? reverse_table[left[i]] : left[i];
+        out[2 * i + 1] = packer->lsb_first ? reverse_table[right[i]] : right[i];
+    }
+
+    return 2 * bytes;
+}
+
+//======================================================================================================================
+int dop_stream_header (const struct dsd_file* df, int mode, struct wav_header* wh) {
+    unsigned int sample_rate = df->dsd_rate / 16;
+    if (sample_rate != 176400 && sample_rate != 352800 && sample_rate != 192000 && sample_rate != 384000) {
+        printf("DoP supports DSD64 and DSD128 only: %u Hz\r\n", df->dsd_rate);
+        return -1;
+    }
+
+    wh->fmt_subchunk.num_channels = 2;
+    wh->fmt_subchunk.sample_rate = sample_rate;
+    unsigned int frame_bytes = mode == DOP_FPGA ? DOP_RAW_FRAME_BYTES : DOP_FRAME_BYTES;
+    wh->fmt_subchunk.block_align = (int)frame_bytes;
+    wh->fmt_subchunk.byte_rate = sample_rate * frame_bytes;
+    wh->fmt_subchunk.bits_per_sample = (int)(frame_bytes * 4);
+    wh->data_subchunk.subchunk2_size = (int)(df->samples * DOP_FRAMES_PER_SAMPLE * frame_bytes);
+    return 0;
+}
+
+//======================================================================================================================
+unsigned int read_dop_data (FILE* fp, struct dsd_file* df, struct dop_packer* packer, unsigned char* buffer,
+                        unsigned int length) {
+    unsigned char left[1024], right[1024];
+    const unsigned int sample_bytes = DOP_FRAMES_PER_SAMPLE * DOP_FRAME_BYTES;
+    unsigned int bytes = 0;
+    while (length - bytes >= sample_bytes) {
+        unsigned int channel_bytes = (length - bytes) / sample_bytes * DSD_CHANNEL_SAMPLE_BYTES;
+        channel_bytes = channel_bytes < sizeof(left) ? channel_bytes : sizeof(left);
+        channel_bytes = read_dsd_channels (fp, df, left, right, channel_bytes);
+        if (channel_bytes == 0) {
+            break;
+        }
+
+        bytes += (unsigned int)dop_pack (packer, left, right, channel_bytes, buffer + bytes);
+    }
+
+    return bytes;
+}
+
+//======================================================================================================================
+unsigned int read_dop_raw_data (FILE* fp, struct dsd_file* df, const struct dop_packer* packer, unsigned char* buffer,
+                        unsigned int length) {
+    unsigned char left[1024], right[1024];
+    unsigned int bytes = 0;
+    while (length - bytes >= DSD_SAMPLE_BYTES) {
+        unsigned int channel_bytes = (length - bytes) / DSD_SAMPLE_BYTES * DSD_CHANNEL_SAMPLE_BYTES;
+        channel_bytes = channel_bytes < sizeof(left) ? channel_bytes : sizeof(left);
+        channel_bytes = read_dsd_channels (fp, df, left, right, channel_bytes);
+        if (channel_bytes == 0) {
+            break;
+        }
+
+        bytes += (unsigned int)dop_interleave (packer, left, right, channel_bytes, buffer + bytes);
+    }
+
+    return bytes;
+}
+
+//======================================================================================================================
+static void init_tables (void) {
+    if (tables_ready) {
+        return;
+    }
+
+    for (int i = 0; i < 256; i++) {
+        unsigned char value = 0;
+        for (int b = 0; b < 8; b++) {
+            if (i & (1 << b)) {
+                value |= 0x80 >> b;
+            }
+        }
+        reverse_table[i] = value;
+    }
+
+    for (int p = 0; p < DOP_SIMD_OUT_BYTES; p++) {
+        int frame = p / DOP_FRAME_BYTES;
+        int j = p % DOP_FRAME_BYTES;
+        shuffle_left[p] = j == 0 ? 2 * frame + 1 : j == 1 ? 2 * frame : 0x80;
+        shuffle_right[p] = j == 3 ? 2 * frame + 1 : j == 4 ? 2 * frame : 0x80;
+        marker_bytes[p] = j == 2 || j == 5 ? 0xff : 0x00;
+        odd_marker_bytes[p] = (frame & 1) ? marker_bytes[p] : 0x00;
+    }
+
+    tables_ready = 1;
+}
@@ -0,0 +1,83 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+#ifndef DOP_PACKER_H
+#define DOP_PACKER_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "wav_reader.h"
+#include "dsd_reader.h"
+
+/***********************************************************************************************************************
+ * The DoP (DSD over PCM) packer. 16 DSD bits of each channel are carried in a 24-bit stereo frame at 1/16 of the DSD
+ * rate: the marker in bits[23:16], alternating 0x05 and 0xFA from frame to frame, and the DSD bits in bits[15:0], the
+ * first bit in bit 15. The frames are written as the FPGA expects 24-bit samples: left then right, little endian.
+ * DSD64 and DSD128 map to 176.4/192kHz and 352.8/384kHz.
+ *
+ * The channel bytes come from read_dsd_channels: DSF data is LSB first and is bit reversed by the packer. The SSSE3
+ * packer reverses the bits and shuffles 16 bytes of each channel into 8 frames per iteration; the scalar packer is the
+ * reference (see dop_bench.c).
+ *
+ * With DOP_FPGA the FPGA encodes the frames (see SETUP_FORMAT_DSD in hdl_audio/definitions.svh): the host sends the raw
+ * DSD bytes of both channels interleaved, MSB first, 4 bytes per DoP frame instead of 6.
+ **********************************************************************************************************************/
+
+#define DOP_MARKER_0                0x05
+#define DOP_MARKER_1                0xfa
+#define DOP_FRAME_BYTES             6
+// The raw DSD bytes of a DoP frame encoded by the FPGA
+#define DOP_RAW_FRAME_BYTES         4
+// The DoP frames per DSD sample of the stream (8 bytes per channel)
+#define DOP_FRAMES_PER_SAMPLE       (DSD_CHANNEL_SAMPLE_BYTES / 2)
+
+// Where the DoP frames are packed
+#define DOP_HOST                    1
+#define DOP_FPGA                    2
+
+struct dop_packer {
+    unsigned char marker;           // The marker of the next frame
+    unsigned char lsb_first;        // The DSD bytes are LSB first
+};
+
+void dop_init (struct dop_packer* packer, unsigned char lsb_first);
+// Packs bytes (even) DSD bytes of each channel into bytes / 2 frames. Returns the bytes written to out (3 x bytes).
+size_t dop_pack_scalar (struct dop_packer* packer, const unsigned char* left, const unsigned char* right, size_t bytes,
+                        unsigned char* out);
+// As dop_pack_scalar, with SSSE3 when the CPU supports it.
+size_t dop_pack (struct dop_packer* packer, const unsigned char* left, const unsigned char* right, size_t bytes,
+                        unsigned char* out);
+// Returns 1 if dop_pack uses SIMD.
+int dop_pack_simd (void);
+
+// Interleaves bytes DSD bytes of each channel (L0 R0 L1 R1 ...), MSB first, for the FPGA encoder. Returns the bytes
+// written to out (2 x bytes).
+size_t dop_interleave (const struct dop_packer* packer, const unsigned char* left, const unsigned char* right,
+                        size_t bytes, unsigned char* out);
+
+// Describes the DoP stream of a DSD file packed by mode (DOP_HOST or DOP_FPGA): the FPGA stream is 16 bits per channel
+// at the DoP rate. Returns a negative value if the DSD rate has no DoP sample rate.
+int dop_stream_header (const struct dsd_file* df, int mode, struct wav_header* wh);
+// Reads and packs up to length bytes (whole DSD samples, 24 bytes each) of DoP frames. Returns the bytes written.
+unsigned int read_dop_data (FILE* fp, struct dsd_file* df, struct dop_packer* packer, unsigned char* buffer,
+                        unsigned int length);
+// Reads up to length bytes (whole DSD samples, 16 bytes each) of raw DSD bytes for the FPGA encoder. Returns the bytes
+// written.
+unsigned int read_dop_raw_data (FILE* fp, struct dsd_file* df, const struct dop_packer* packer, unsigned char* buffer,
+                        unsigned int length);
+
+#endif // DOP_PACKER_H
@@ -0,0 +1,381 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dsd_reader.h"
+
+static int read_dsf_header (FILE* fp, struct dsd_file* df);
+static int read_dff_header (FILE* fp, struct dsd_file* df);
+static unsigned long long read_le (FILE* fp, int bytes, int* error);
+static unsigned long long read_be (FILE* fp, int bytes, int* error);
+static unsigned char reverse_bits (unsigned char value);
+
+//======================================================================================================================
+int read_dsd_file (FILE* fp, struct dsd_file* df, struct wav_header* wh) {
+    char id[4];
+    memset(df, 0, sizeof(struct dsd_file));
+    df->block_index = -1;
+
+    if (fseek(fp, 0, SEEK_SET) != 0 || fread(id, 1, 4, fp) != 4) {
+        return 1;
+    }
+
+    int result;
+    if (memcmp(id, "DSD ", 4) == 0) {
+        df->format = DSD_FILE_DSF;
+        result = read_dsf_header (fp, df);
+    } else if (memcmp(id, "FRM8", 4) == 0) {
+        df->format = DSD_FILE_DFF;
+        result = read_dff_header (fp, df);
+    } else {
+        // Other readers start from the beginning of the file.
+        fseek(fp, 0, SEEK_SET);
+        return 1;
+    }
+
+    if (result != 0) {
+        return result;
+    }
+
+    // The DSD rate is 64 x one of the sample rates of the FPGA.
+    unsigned int sample_rate = df->dsd_rate / 64;
+    if (df->dsd_rate % 64 != 0 || (sample_rate != 44100 && sample_rate != 88200 && sample_rate != 176400 &&
+            sample_rate != 352800 && sample_rate != 48000 && sample_rate != 96000 && sample_rate != 192000 &&
+            sample_rate != 384000)) {
+        printf("Unsupported DSD rate: %u Hz\r\n", df->dsd_rate);
+        return -2;
+    }
+
+    df->samples = (df->channel_bytes + DSD_BITS_PER_SAMPLE / 8 - 1) / (DSD_BITS_PER_SAMPLE / 8);
+    if (df->format == DSD_FILE_DSF) {
+        df->block = malloc (2 * df->block_size);
+        if (df->block == NULL) {
+            printf("Cannot allocate the DSF block buffer: %u\r\n", 2 * df->block_size);
+            return -3;
+        }
+    }
+
+    if (seek_dsd_data (fp, df, 0) != 0) {
+        close_dsd_file (df);
+        return -4;
+    }
+
+    memset(wh, 0, sizeof(struct wav_header));
+    memcpy(wh->fmt_subchunk.subchunk1_id, "fmt ", 4);
+    wh->fmt_subchunk.num_channels = 2;
+    wh->fmt_subchunk.sample_rate = df->dsd_rate / 64;
+    wh->fmt_subchunk.block_align = DSD_SAMPLE_BYTES;
+    wh->fmt_subchunk.byte_rate = wh->fmt_subchunk.sample_rate * DSD_SAMPLE_BYTES;
+    wh->fmt_subchunk.bits_per_sample = DSD_BITS_PER_SAMPLE;
+    memcpy(wh->data_subchunk.subchunk2_id, "data", 4);
+    wh->data_subchunk.subchunk2_size = (int)(df->samples * DSD_SAMPLE_BYTES);
+    wh->data_offset = df->data_offset;
+
+    printf("%s file: DSD%u (%u Hz), %llu bytes per channel, %.3f s\r\n", df->format == DSD_FILE_DSF ? "DSF" : "DFF",
+                df->dsd_rate / (df->dsd_rate % 44100 == 0 ? 44100 : 48000),
+                df->dsd_rate, df->channel_bytes, (double)df->channel_bytes * 8 / df->dsd_rate);
+    return 0;
+}
+
+//======================================================================================================================
+// DSF: "DSD " chunk (28 bytes), "fmt " chunk (52 bytes) and "data" chunk, little endian. The data is made of blocks of
+// block_size bytes per channel, channel after channel.
+static int read_dsf_header (FILE* fp, struct dsd_file* df) {
+    char id[4];
+    int error = 0;
+
+    unsigned long long chunk_size = read_le (fp, 8, &error);
+    if (error || chunk_size != 28 || fseek(fp, 28, SEEK_SET) != 0) {
+        printf("Invalid DSF header\r\n");
+        return -1;
+    }
+
+    if (fread(id, 1, 4, fp) != 4 || memcmp(id, "fmt ", 4) != 0) {
+        printf("Invalid DSF fmt chunk\r\n");
+        return -1;
+    }
+
+    chunk_size = read_le (fp, 8, &error);
+    unsigned int format_version = read_le (fp, 4, &error);
+    unsigned int format_id = read_le (fp, 4, &error);
+    unsigned int channel_type = read_le (fp, 4, &error);
+    unsigned int channels = read_le (fp, 4, &error);
+    df->dsd_rate = read_le (fp, 4, &error);
+    unsigned int bits_per_sample = read_le (fp, 4, &error);
+    unsigned long long sample_count = read_le (fp, 8, &error);
+    df->block_size = read_le (fp, 4, &error);
+    if (error || format_version != 1 || format_id != 0) {
+        printf("Unsupported DSF format: version %u, id %u\r\n", format_version, format_id);
+        return -1;
+    }
+
+    // Channel type 2 is stereo.
+    if (channel_type != 2 || channels != 2) {
+        printf("Unsupported DSF channels: type %u, %u channels\r\n", channel_type, channels);
+        return -1;
+    }
+
+    // The samples are read 8 bytes at a time from a channel block.
+    if ((bits_per_sample != 1 && bits_per_sample != 8) || df->block_size == 0 || df->block_size % 8 != 0) {
+        printf("Unsupported DSF bits per sample %u or block size %u\r\n", bits_per_sample, df->block_size);
+        return -1;
+    }
+
+    df->lsb_first = bits_per_sample == 1;
+    df->channel_bytes = (sample_count + 7) / 8;
+
+    if (fseek(fp, 28 + (long)chunk_size, SEEK_SET) != 0 || fread(id, 1, 4, fp) != 4 || memcmp(id, "data", 4) != 0) {
+        printf("Invalid DSF data chunk\r\n");
+        return -1;
+    }
+
+    read_le (fp, 8, &error);
+    df->data_offset = ftell(fp);
+    return error ? -1 : 0;
+}
+
+//======================================================================================================================
+// DSDIFF: "FRM8" container of form "DSD " with big endian 64-bit chunk sizes. The sample rate and channels are in the
+// "PROP" chunk; the "DSD " chunk holds the bytes of the channels interleaved. Chunks are padded to an even size.
+static int read_dff_header (FILE* fp, struct dsd_file* df) {
+    char id[4];
+    int error = 0;
+
+    unsigned long long form_size = read_be (fp, 8, &error);
+    if (error || fread(id, 1, 4, fp) != 4 || memcmp(id, "DSD ", 4) != 0) {
+        printf("Invalid DFF header\r\n");
+        return -1;
+    }
+
+    long form_end = 12 + (long)form_size;
+    unsigned int channels = 0;
+    while (ftell(fp) + 12 <= form_end) {
+        if (fread(id, 1, 4, fp) != 4) {
+            break;
+        }
+
+        unsigned long long chunk_size = read_be (fp, 8, &error);
+        long chunk_end = ftell(fp) + (long)chunk_size + (long)(chunk_size & 1);
+        if (error) {
+            break;
+        }
+
+        if (memcmp(id, "PROP", 4) == 0) {
+            // "SND " property chunk with local chunks
+            if (fread(id, 1, 4, fp) != 4 || memcmp(id, "SND ", 4) != 0) {
+                printf("Unsupported DFF property chunk\r\n");
+                return -1;
+            }
+
+            while (ftell(fp) + 12 <= chunk_end) {
+                if (fread(id, 1, 4, fp) != 4) {
+                    break;
+                }
+
+                unsigned long long local_size = read_be (fp, 8, &error);
+                long local_end = ftell(fp) + (long)local_size + (long)(local_size & 1);
+                if (memcmp(id, "FS  ", 4) == 0) {
+                    df->dsd_rate = read_be (fp, 4, &error);
+                } else if (memcmp(id, "CHNL", 4) == 0) {
+                    channels = read_be (fp, 2, &error);
+                } else if (memcmp(id, "CMPR", 4) == 0) {
+                    if (fread(id, 1, 4, fp) != 4 || memcmp(id, "DSD ", 4) != 0) {
+                        printf("Compressed (DST) DFF files are not supported\r\n");
+                        return -1;
+                    }
+                }
+
+                if (error || fseek(fp, local_end, SEEK_SET) != 0) {
+                    printf("Invalid DFF property chunk\r\n");
+                    return -1;
+                }
+            }
+        } else if (memcmp(id, "DSD ", 4) == 0) {
+            if (channels != 2) {
+                printf("Unsupported DFF channels: %u\r\n", channels);
+                return -1;
+            }
+
+            df->data_offset = ftell(fp);
+            df->channel_bytes = chunk_size / 2;
+            return 0;
+        } else if (memcmp(id, "DST ", 4) == 0) {
+            printf("Compressed (DST) DFF files are not supported\r\n");
+            return -1;
+        }
+
+        if (fseek(fp, chunk_end, SEEK_SET) != 0) {
+            break;
+        }
+    }
+
+    printf("Invalid DFF file: no DSD data chunk\r\n");
+    return -1;
+}
+
+//======================================================================================================================
+unsigned int read_dsd_channels (FILE* fp, struct dsd_file* df, unsigned char* left, unsigned char* right,
+                        unsigned int length) {
+    unsigned long long samples = length / DSD_CHANNEL_SAMPLE_BYTES;
+    if (samples > df->samples - df->position) {
+        samples = df->samples - df->position;
+    }
+
+    unsigned int bytes = (unsigned int)samples * DSD_CHANNEL_SAMPLE_BYTES;
+    unsigned long long channel_offset = df->position * DSD_CHANNEL_SAMPLE_BYTES;
+    // Bytes past the end of the data are idle.
+    unsigned char idle = df->lsb_first ? reverse_bits (DSD_IDLE_PATTERN) : DSD_IDLE_PATTERN;
+    unsigned int done = 0;
+    while (done < bytes) {
+        unsigned int count;
+        if (df->format == DSD_FILE_DFF) {
+            // The file bytes alternate L, R.
+            unsigned char interleaved[4096];
+            count = bytes - done < sizeof(interleaved) / 2 ? bytes - done : sizeof(interleaved) / 2;
+            size_t bytes_read = 0;
+            if (channel_offset + done < df->channel_bytes) {
+                unsigned long long remaining = df->channel_bytes - channel_offset - done;
+                bytes_read = fread(interleaved, 1, 2 * (count < remaining ? count : (unsigned int)remaining), fp);
+            }
+
+            for (unsigned int i = 0; i < count; i++) {
+                left[done + i] = 2 * i < bytes_read ? interleaved[2 * i] : idle;
+                right[done + i] = 2 * i + 1 < bytes_read ? interleaved[2 * i + 1] : idle;
+            }
+        } else {
+            // The samples of a block are copied at once. The last blocks may be short.
+            long long block_index = (long long)((channel_offset + done) / df->block_size);
+            unsigned int block_offset = (unsigned int)((channel_offset + done) % df->block_size);
+            if (block_index != df->block_index) {
+                memset(df->block, idle, 2 * df->block_size);
+                if (fseek(fp, df->data_offset + (long)block_index * 2 * df->block_size, SEEK_SET) != 0 ||
+                        fread(df->block, 1, 2 * df->block_size, fp) == 0) {
+                    printf("Cannot read DSF block %lld\r\n", block_index);
+                    break;
+                }
+                df->block_index = block_index;
+            }
+
+            count = df->block_size - block_offset < bytes - done ? df->block_size - block_offset : bytes - done;
+            memcpy(left + done, df->block + block_offset, count);
+            memcpy(right + done, df->block + df->block_size + block_offset, count);
+            // Block padding is not audio.
+            for (unsigned int i = 0; i < count; i++) {
+                if (channel_offset + done + i >= df->channel_bytes) {
+                    left[done + i] = idle;
+                    right[done + i] = idle;
+                }
+            }
+        }
+
+        done += count;
+    }
+
+    done -= done % DSD_CHANNEL_SAMPLE_BYTES;
+    df->position += done / DSD_CHANNEL_SAMPLE_BYTES;
+    return done;
+}
+
+//======================================================================================================================
+unsigned int read_dsd_data (FILE* fp, struct dsd_file* df, unsigned char* buffer, unsigned int length) {
+    unsigned char left[512], right[512];
+    unsigned int bytes = 0;
+    while (length - bytes >= DSD_SAMPLE_BYTES) {
+        unsigned int channel_bytes = (length - bytes) / 2;
+        channel_bytes = channel_bytes < sizeof(left) ? channel_bytes : sizeof(left);
+        channel_bytes = read_dsd_channels (fp, df, left, right, channel_bytes);
+        if (channel_bytes == 0) {
+            break;
+        }
+
+        for (unsigned int k = 0; k < channel_bytes; k++) {
+            // Byte i of a sample of each channel goes to frame i / 4.
+            unsigned int i = k % DSD_CHANNEL_SAMPLE_BYTES;
+            unsigned char* frame = buffer + bytes + (k - i) * 2 + (i >> 2) * DSD_FRAME_BYTES;
+            frame[i & 3] = df->lsb_first ? reverse_bits (left[k]) : left[k];
+            frame[4 + (i & 3)] = df->lsb_first ? reverse_bits (right[k]) : right[k];
+        }
+
+        bytes += 2 * channel_bytes;
+    }
+
+    return bytes;
+}
+
+//======================================================================================================================
+int seek_dsd_data (FILE* fp, struct dsd_file* df, unsigned long long sample) {
+    if (sample > df->samples) {
+        return -1;
+    }
+
+    df->position = sample;
+    if (df->format == DSD_FILE_DFF) {
+        // DSF blocks are read on demand.
+        unsigned long long offset = sample * DSD_SAMPLE_BYTES;
+        if (offset > df->channel_bytes * 2) {
+            offset = df->channel_bytes * 2;
+        }
+
+        return fseek(fp, df->data_offset + (long)offset, SEEK_SET) == 0 ? 0 : -2;
+    }
+
+    return 0;
+}
+
+//======================================================================================================================
+void close_dsd_file (struct dsd_file* df) {
+    free (df->block);
+    df->block = NULL;
+}
+
+//======================================================================================================================
+static unsigned long long read_le (FILE* fp, int bytes, int* error) {
+    unsigned char data[8];
+    unsigned long long value = 0;
+    if (fread(data, 1, bytes, fp) != (size_t)bytes) {
+        *error = 1;
+        return 0;
+    }
+
+    for (int i = bytes - 1; i >= 0; i--) {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+static unsigned long long read_be (FILE* fp, int bytes, int* error) {
+    unsigned char data[8];
+    unsigned long long value = 0;
+    if (fread(data, 1, bytes, fp) != (size_t)bytes) {
+        *error = 1;
+        return 0;
+    }
+
+    for (int i = 0; i < bytes; i++) {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+static unsigned char reverse_bits (unsigned char value) {
+    value = (unsigned char)((value & 0xf0) >> 4 | (value & 0x0f) << 4);
+    value = (unsigned char)((value & 0xcc) >> 2 | (value & 0x33) << 2);
+    value = (unsigned char)((value & 0xaa) >> 1 | (value & 0x55) << 1);
+    return value;
+}
@@ -0,0 +1,67 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+#ifndef DSD_READER_H
+#define DSD_READER_H
+
+#include <stdio.h>
+
+#include "wav_reader.h"
+
+/***********************************************************************************************************************
+ * The reader of DSF and DSDIFF (.dff) stereo DSD files. The DSD data is converted to the native DSD stream of the FPGA
+ * (see SETUP_FORMAT_DSD in hdl_audio/definitions.svh): 8 byte frames of 4 left channel bytes then 4 right channel
+ * bytes, in time order, the MSB of each byte first.
+ *
+ * The stream is described with a wav_header so that the rate, position and seek arithmetic of the players applies: a
+ * sample is two frames (64 DSD bits per channel, 16 bytes) at 1/64 of the DSD rate, which is the sample rate of the
+ * FPGA rate code (44100Hz for DSD64 up to 352800Hz for DSD512). The last sample is padded with the DSD idle pattern.
+ **********************************************************************************************************************/
+
+#define DSD_FILE_DSF                1
+#define DSD_FILE_DFF                2
+
+#define DSD_BITS_PER_SAMPLE         64
+#define DSD_SAMPLE_BYTES            16
+#define DSD_CHANNEL_SAMPLE_BYTES    8
+#define DSD_FRAME_BYTES             8
+#define DSD_IDLE_PATTERN            0x69
+
+struct dsd_file {
+    int format;                     // DSD_FILE_DSF or DSD_FILE_DFF
+    unsigned int dsd_rate;          // DSD bits per second per channel (2822400 for DSD64)
+    unsigned long long channel_bytes;   // DSD bytes per channel in the file
+    long data_offset;               // Offset in the file of the first byte of DSD data
+    unsigned int block_size;        // DSF: bytes per channel block
+    unsigned char lsb_first;        // DSF: the first DSD bit is bit 0 of each byte
+    unsigned long long samples;     // Samples of the stream (see above)
+    unsigned long long position;    // The next sample to read
+    unsigned char* block;           // DSF: the blocks of both channels containing position
+    long long block_index;          // DSF: the index of the blocks in block, -1 if none
+};
+
+// Returns 0 for a DSD file, 1 if the file is not a DSF or DSDIFF file and a negative value for an unsupported file.
+int read_dsd_file (FILE* fp, struct dsd_file* df, struct wav_header* wh);
+// Reads up to length bytes (whole samples) of each channel as stored in the file: LSB first when lsb_first is set.
+// Returns the bytes read per channel.
+unsigned int read_dsd_channels (FILE* fp, struct dsd_file* df, unsigned char* left, unsigned char* right,
+                        unsigned int length);
+// Converts up to length bytes (whole samples) of DSD data to the FPGA stream. Returns the bytes written to buffer.
+unsigned int read_dsd_data (FILE* fp, struct dsd_file* df, unsigned char* buffer, unsigned int length);
+int seek_dsd_data (FILE* fp, struct dsd_file* df, unsigned long long sample);
+void close_dsd_file (struct dsd_file* df);
+
+#endif // DSD_READER_H
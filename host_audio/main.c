@@ -18,11 +18,18 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <math.h>
 #include <sys/time.h>
+#include <sys/select.h>
 
 #include "WinTypes.h"
 #include "ftd2xx.h"
 #include "wav_reader.h"
+#include "dsd_reader.h"
+#include "dop_packer.h"
+#include "tdm_map.h"
+#include "resampler.h"
+#include "pcm_convert.h"
 //======================================================================================================================
 // FPGA definitions (see hdl_audio/definitions.sv)
 // Bit rates
@@ -30,6 +37,9 @@
 #define BIT_DEPTH_16        0x01
 #define BIT_DEPTH_24        0x02
 #define BIT_DEPTH_32        0x03
+// Native DSD on the I2S port, with BIT_DEPTH_DOP. The sample rate is the DSD rate / 64. With BIT_DEPTH_24, raw DSD
+// bytes encoded to DoP by the FPGA. The sample rate is the DSD rate / 16.
+#define SETUP_FORMAT_DSD    0x20
 
 // Sample rate
 // CMD_SETUP_OUTPUT payload byte[0] bits[4:2]
@@ -46,29 +56,157 @@
 // Commands from the host to the FPGA.
 // Command byte bits[7:5]. Bits[4:0] represent the length of the frame.
 #define CMD_HOST_SETUP_OUTPUT      0x00
+#define CMD_HOST_SETUP_INPUT       0x20
 #define CMD_HOST_STREAM_OUTPUT     0x40
 #define CMD_HOST_STOP              0x60
+#define CMD_HOST_FLUSH             0x80
+#define CMD_HOST_PAUSE             0xa0
+#define CMD_HOST_GET_COUNTER       0xc0
+#define CMD_HOST_SET_VOLUME        0xe0
+
+// CMD_HOST_PAUSE payload byte[0]
+#define RESUME_OUTPUT              0x00
+#define PAUSE_OUTPUT               0x01
+
+// CMD_HOST_SET_VOLUME payload: bytes[0-1] the gain (big endian, Q1.15: GAIN_UNITY is 0dB, up to +6dB), byte[2] options
+#define GAIN_UNITY                 0x8000
+#define VOLUME_DITHER              0x01
+#define VOLUME_NOISE_SHAPING       0x02
+
+// CMD_HOST_SETUP_OUTPUT optional payload byte[1] options. With SETUP_OPTION_START_AT, bytes[2-5] hold the sample
+// count at which the stream starts.
+#define SETUP_OPTION_START_AT      0x01
+// Stereo PCM streamed at the base rate (44.1KHz or 48KHz) and oversampled by the FPGA up to the sample rate of byte[0].
+#define SETUP_OPTION_OVERSAMPLE    0x80
+// Optional payload bytes[6-8]: the rate in Hz of stereo PCM converted by the FPGA to the sample rate of byte[0].
+#define SETUP_PAYLOAD_STREAM_RATE  9
 
 // Commands from the FPGA to the host.
+#define CMD_FPGA_INPUT             0x20
 #define CMD_FPGA_STOPPED           0x60
+#define CMD_FPGA_COUNTER           0xc0
+// Payload: stereo frames emitted by I2S (bytes[0-3]) and SPDIF (bytes[4-7]), big endian. Restarts at 0 after a flush.
+#define CMD_FPGA_POSITION          0x80
+
+// CMD_FPGA_STOPPED error codes
+#define ERROR_INPUT_OVERRUN        11
 
 //======================================================================================================================
 int rx_data (unsigned char* rx_buffer, unsigned int rx_bytes, unsigned char* pStopped);
 int tx_data (FILE* fp, struct wav_header wh, unsigned int packet_length, unsigned char output_port,
                         unsigned char* tx_buffer, unsigned int* tx_bytes_to_send);
+void console_cmd (FILE* fp, struct wav_header wh);
+long long time_us (void);
+void position_sent (unsigned int stream_bytes);
+void position_report (unsigned int frames_emitted);
+unsigned int setup_start_at (unsigned char* tx_buffer, unsigned int start_at);
+unsigned int setup_payload (unsigned char* tx_buffer, unsigned char start_option, unsigned int start_at);
+unsigned int volume_gain (double db);
+int seek_stream (FILE* fp, struct wav_header wh, unsigned long long sample_offset);
+int record_wav_header (FILE* fp, struct wav_header wh, unsigned int data_bytes);
+size_t read_stream_frames (void* context, unsigned char* frames, size_t count);
 
 //======================================================================================================================
 #define STATE_RX_CMD               1
 #define STATE_RX_STOPPED_PAYLOAD   2
 #define STATE_RX_DONE              3
+#define STATE_RX_COUNTER_PAYLOAD   4
+#define STATE_RX_POSITION_PAYLOAD  5
+#define STATE_RX_INPUT_PAYLOAD     6
 unsigned char rx_state_m = STATE_RX_CMD;
+// The last sample count reported by the FPGA.
+unsigned int rx_counter;
+unsigned char rx_counter_bytes;
+unsigned char rx_counter_valid = 0;
+// The position report payload
+unsigned char rx_position[8];
+unsigned char rx_position_bytes;
+
+//======================================================================================================================
+// Full duplex recording: the I2S receiver captures with the clocks of the I2S output, so the recording has the
+// format of the played file. The input is stopped after the output and its stopped command reports any overrun.
+FILE* rec_fp = NULL;
+unsigned int rec_bytes = 0;
+unsigned char rec_frame[8];
+unsigned char rec_frame_bytes;
+unsigned char rec_frame_length;
+// The input runs until the second CMD_FPGA_STOPPED.
+unsigned char rec_input_running = 0;
+
+//======================================================================================================================
+// Playback position. The time at which each audio packet was written is kept so that the frames reported by the FPGA
+// can be matched with the packet that carried them.
+#define POSITION_RECORDS           1024
+struct position_record {
+    long long us;
+    unsigned long long bytes_sent;
+};
+struct position_record pos_records[POSITION_RECORDS];
+unsigned int pos_record_count = 0;
+unsigned long long pos_bytes_sent = 0;
+unsigned int pos_block_align;
+unsigned int pos_sample_rate;
+// The FPGA counts the frames of the stream at the rate it sends them (oversampled or converted).
+unsigned int pos_output_rate;
+// I2S (output port 0) or SPDIF
+unsigned char pos_i2s;
+// The first report used to measure the drift of the audio clock against the host clock.
+unsigned char pos_drift_valid = 0;
+long long pos_drift_us;
+unsigned int pos_drift_frames;
 
 //======================================================================================================================
 #define STATE_TX_START_CMD         1
 #define STATE_TX_STREAM_CMD        2
 #define STATE_TX_STOP_CMD          3
 #define STATE_TX_DONE              4
+#define STATE_TX_FLUSH_CMD         5
+#define STATE_TX_PAUSE_CMD         6
+#define STATE_TX_PAUSED            7
+#define STATE_TX_RESUME_CMD        8
+#define STATE_TX_GET_COUNTER_CMD   9
+#define STATE_TX_WAIT_COUNTER      10
+#define STATE_TX_START_INPUT_CMD   11
+#define STATE_TX_STOP_INPUT_CMD    12
+#define STATE_TX_VOLUME_CMD        13
 unsigned char tx_state_m = STATE_TX_START_CMD;
+// Scheduled start: the stream is prebuffered in the FPGA and starts when its sample counter reaches tx_start_at.
+// With a start delay the sample counter is read first and tx_start_at = counter + delay.
+unsigned char tx_start_at_valid = 0;
+unsigned int tx_start_at;
+unsigned char tx_start_delay_valid = 0;
+unsigned int tx_start_delay_ms;
+unsigned char tx_setup_format;
+// The file position is kept while paused so that streaming continues where it left off.
+unsigned char tx_paused = 0;
+// The DSD file being streamed, NULL for a WAV file. With tx_dop it is sent as DoP (24-bit frames at the DSD rate / 16)
+// packed by the host (DOP_HOST) or encoded by the FPGA from the raw DSD bytes (DOP_FPGA).
+struct dsd_file* tx_dsd = NULL;
+unsigned char tx_dop = 0;
+struct dop_packer tx_dop_packer;
+// The slots of the channels of a WAV file: TDM for more than 2 channels, with slots of tx_slot_bits (0: bit depth),
+// on tx_lines sdata lines.
+struct tdm_map tx_tdm;
+int tx_slot_bits = 0;
+int tx_lines = 1;
+unsigned char tx_setup_options = 0;
+// The rate the FPGA oversamples or converts the WAV file to, 0 to play it at its own rate.
+unsigned int tx_output_rate = 0;
+// The rate of the WAV file when the FPGA converts it to tx_output_rate (no output runs at it), 0 otherwise.
+unsigned int tx_stream_rate = 0;
+// The WAV file is converted to tx_output_rate on the host, when the FPGA cannot do it or with -H.
+unsigned char tx_host_convert = 0;
+unsigned char tx_resampling = 0;
+struct resampler tx_resampler;
+// The converted frames of multichannel files before they are interleaved into the TDM frames.
+unsigned char* tx_converted_frames = NULL;
+// The PCM frames of float, 8-bit and mono WAV files (or with -b or -m) are converted to the FPGA formats on the host.
+unsigned char tx_converting = 0;
+struct pcm_converter tx_converter;
+int tx_output_bits = 0;
+// The volume set by the console, applied by the FPGA from the next sample of the stream.
+unsigned int tx_gain = GAIN_UNITY;
+unsigned char tx_volume_options = 0;
 //unsigned int tx_total_bytes_read;
 
 //======================================================================================================================
@@ -78,23 +216,60 @@ int main(int argc, char *argv[])
     char* filename;
     unsigned int packet_length = 8192; // Default packet length
     unsigned char output_port = 0;
+    char* rec_filename = NULL;
+    int channel_map[PCM_MAX_CHANNELS];
+    int map_channels = 0;
     if (argc <= 1) {
-        printf("Usage: %s -f <file name> -o <output port 0..3> -p <packet length 1..16383>\r\n", argv[0]);
+        printf("Usage: %s -f <file name> -o <output port 0..3> -p <packet length 1..16383> "
+                    "[-d <start delay ms> | -a <start sample count>] [-r <record file name>] [-D (DSD as DoP)] "
+                    "[-E (DSD as DoP encoded by the FPGA)] [-w <TDM slot width 16|24|32>] "
+                    "[-l <I2S data lines 1|2|4>] [-u <oversampled rate>] "
+                    "[-H (convert the sample rate on the host)] [-b <bit depth 16|24|32>] "
+                    "[-m <file channel of each output channel, e.g. 1,0>]\r\n", argv[0]);
         return 1;
     } else {
-        while ((opt = getopt(argc, argv, "f:p:o:")) != -1) {
+        while ((opt = getopt(argc, argv, "f:p:o:d:a:r:DEw:l:u:Hb:m:")) != -1) {
             switch (opt) {
-                case 'f': filename = argv[2]; break;
-                case 'o': output_port = strtol (argv[4], NULL, 10); break;
-                case 'p': packet_length = strtol (argv[6], NULL, 10); break;
+                case 'f': filename = optarg; break;
+                case 'o': output_port = strtol (optarg, NULL, 10); break;
+                case 'p': packet_length = strtol (optarg, NULL, 10); break;
+                case 'd': tx_start_delay_ms = strtoul (optarg, NULL, 10); tx_start_delay_valid = 1; break;
+                case 'a': tx_start_at = strtoul (optarg, NULL, 10); tx_start_at_valid = 1; break;
+                case 'r': rec_filename = optarg; break;
+                case 'D': tx_dop = DOP_HOST; break;
+                case 'E': tx_dop = DOP_FPGA; break;
+                case 'w': tx_slot_bits = strtol (optarg, NULL, 10); break;
+                case 'l': tx_lines = strtol (optarg, NULL, 10); break;
+                case 'u': tx_output_rate = strtoul (optarg, NULL, 10); break;
+                case 'H': tx_host_convert = 1; break;
+                case 'b': tx_output_bits = strtol (optarg, NULL, 10); break;
+                case 'm': {
+                    char* next = optarg;
+                    for (map_channels = 0; map_channels < PCM_MAX_CHANNELS && *next != '\0'; map_channels++) {
+                        channel_map[map_channels] = strtol (next, &next, 10);
+                        next += *next == ',';
+                    }
+                    break;
+                }
                 default: {
-                    printf("Usage: %s -f <file name> -o <output port 0..3> -p <packet length 1..16383>\r\n", argv[0]);
+                    printf("Usage: %s -f <file name> -o <output port 0..3> -p <packet length 1..16383> "
+                                "[-d <start delay ms> | -a <start sample count>] [-r <record file name>] "
+                                "[-D (DSD as DoP)] [-E (DSD as DoP encoded by the FPGA)] "
+                                "[-w <TDM slot width 16|24|32>] [-l <I2S data lines 1|2|4>] "
+                                "[-u <oversampled rate>] [-H (convert the sample rate on the host)] "
+                                "[-b <bit depth 16|24|32>] [-m <file channel of each output channel, e.g. 1,0>]\r\n",
+                                argv[0]);
                     return 1;
                 }
             }
         }
     }
 
+    if (rec_filename != NULL && output_port != 0) {
+        printf("Recording requires the I2S output port (0)\r\n");
+        return 1;
+    }
+
     // Open the wav file
     FILE* fp = fopen(filename, "rb");
     if (fp == NULL) {
@@ -102,15 +277,150 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    // Read the wav header
+    // Read the DSD (DSF or DFF) or wav header
     struct wav_header wh;
+    struct dsd_file df;
     memset(&wh, 0, sizeof(struct wav_header));
-    if (read_wav_file (fp, &wh) != 0) {
-        printf("Invalid WAV file: %s\r\n", filename);
+    int dsd_result = read_dsd_file (fp, &df, &wh);
+    if (dsd_result == 0) {
+        tx_dsd = &df;
+    } else if (dsd_result < 0 || read_wav_file (fp, &wh) != 0) {
+        printf("Invalid WAV or DSD file: %s\r\n", filename);
         fclose(fp);
         return 1;
     }
 
+    // DoP encoded by the FPGA plays on any output port.
+    if (tx_dsd != NULL && ((output_port != 0 && tx_dop != DOP_FPGA) || rec_filename != NULL || tx_lines != 1)) {
+        printf("DSD requires the I2S output port (0) unless encoded by the FPGA, plays on one data line and cannot be "
+                    "recorded\r\n");
+        close_dsd_file (tx_dsd);
+        fclose(fp);
+        return 1;
+    }
+
+    if (tx_dsd != NULL && tx_dop) {
+        if (dop_stream_header (tx_dsd, tx_dop, &wh) != 0) {
+            close_dsd_file (tx_dsd);
+            fclose(fp);
+            return 1;
+        }
+        dop_init (&tx_dop_packer, tx_dsd->lsb_first);
+    }
+
+    // The FPGA takes 16, 24 or 32-bit integers and at least 2 channels: the other files are converted, and the files
+    // whose bit depth or channels are changed by -b or -m. The stream is then described by the converted header.
+    if (tx_dsd == NULL) {
+        int format = pcm_format_of (&wh);
+        if ((format != PCM_FORMAT_S16 && format != PCM_FORMAT_S24 && format != PCM_FORMAT_S32) ||
+                wh.fmt_subchunk.num_channels == 1 || tx_output_bits != 0 || map_channels != 0) {
+            // 8-bit files are widened to 16 bits, float files quantized to 24 bits.
+            int output_bits = tx_output_bits != 0 ? tx_output_bits : format == PCM_FORMAT_U8 ? 16 :
+                                    format == PCM_FORMAT_F32 || format == PCM_FORMAT_F64 ? 24 :
+                                    wh.fmt_subchunk.bits_per_sample;
+            int output_channels = map_channels != 0 ? map_channels : wh.fmt_subchunk.num_channels == 1 ? 2 :
+                                    wh.fmt_subchunk.num_channels;
+            tx_converted_frames = malloc (packet_length);
+            if (tx_converted_frames == NULL || pcm_converter_init (&tx_converter, &wh, output_bits,
+                    map_channels != 0 ? channel_map : NULL, output_channels, 1) != 0) {
+                printf("Cannot convert the PCM frames of %s\r\n", filename);
+                pcm_converter_free (&tx_converter);
+                fclose(fp);
+                return 1;
+            }
+            printf("The host converts %d channels of %s to %d channels of %d bits\r\n",
+                        wh.fmt_subchunk.num_channels, pcm_format_name (format), output_channels, output_bits);
+            pcm_stream_header (&tx_converter, &wh);
+            tx_converting = 1;
+        }
+    }
+
+    // More than 2 channels play on the TDM output or on several data lines of the I2S port.
+    if (tx_dsd == NULL) {
+        if (tdm_map_init (&tx_tdm, &wh, tx_lines) != 0) {
+            fclose(fp);
+            return 1;
+        }
+
+        if (tx_tdm.positions != 0 && (output_port != 0 || rec_filename != NULL)) {
+            printf("Multichannel files require the I2S output port (0) and cannot be recorded\r\n");
+            fclose(fp);
+            return 1;
+        }
+
+        if (tx_slot_bits != 0 && (tx_tdm.slots == 0 || (tx_slot_bits != 16 && tx_slot_bits != 24 &&
+                tx_slot_bits != 32) || tx_slot_bits < wh.fmt_subchunk.bits_per_sample)) {
+            printf("Invalid TDM slot width: %d\r\n", tx_slot_bits);
+            fclose(fp);
+            return 1;
+        }
+    }
+
+    // The FPGA oversamples stereo PCM from the base rate of a clock family by 2, 4 or 8.
+    if (tx_output_rate != 0) {
+        unsigned int ratio = tx_output_rate / (unsigned int)wh.fmt_subchunk.sample_rate;
+        if (tx_dsd != NULL || tx_tdm.positions != 0 || rec_filename != NULL ||
+                (wh.fmt_subchunk.sample_rate != 44100 && wh.fmt_subchunk.sample_rate != 48000) ||
+                ratio * (unsigned int)wh.fmt_subchunk.sample_rate != tx_output_rate ||
+                (ratio != 2 && ratio != 4 && ratio != 8)) {
+            printf("Oversampling takes stereo PCM at 44100Hz or 48000Hz to 2, 4 or 8 times that rate and cannot be "
+                        "recorded\r\n");
+            if (tx_dsd != NULL) {
+                close_dsd_file (tx_dsd);
+            }
+            fclose(fp);
+            return 1;
+        }
+    } else if (tx_dsd == NULL) {
+        // The rates the outputs do not run at are converted to the next rate up, the higher rates to the top rate of
+        // their family. The FPGA converts stereo PCM from 8000Hz up, the host the other streams.
+        static const unsigned int output_rates[] = {44100, 48000, 88200, 96000, 176400, 192000, 352800, 384000};
+        unsigned int sample_rate = (unsigned int)wh.fmt_subchunk.sample_rate;
+        for (unsigned int r = 0; r < sizeof(output_rates) / sizeof(output_rates[0]) && tx_output_rate == 0; r++) {
+            if (output_rates[r] == sample_rate) {
+                break;
+            } else if (output_rates[r] > sample_rate) {
+                tx_output_rate = output_rates[r];
+                tx_stream_rate = sample_rate;
+            }
+        }
+        if (sample_rate > 384000) {
+            tx_output_rate = sample_rate % 44100 == 0 ? 352800 : 384000;
+        }
+
+        if (tx_output_rate != 0 && (tx_host_convert || tx_stream_rate == 0 || tx_tdm.positions != 0 ||
+                rec_filename != NULL || sample_rate < 8000)) {
+            tx_stream_rate = 0;
+            tx_converted_frames = tx_converted_frames != NULL ? tx_converted_frames : malloc (packet_length);
+            if (tx_converted_frames == NULL || resampler_init (&tx_resampler, sample_rate, tx_output_rate,
+                    wh.fmt_subchunk.num_channels, wh.fmt_subchunk.bits_per_sample,
+                    (int)sysconf(_SC_NPROCESSORS_ONLN)) != 0) {
+                printf("Cannot convert %uHz to %uHz\r\n", sample_rate, tx_output_rate);
+                fclose(fp);
+                return 1;
+            }
+            tx_resampling = 1;
+            printf("The host converts %uHz to %uHz (%s, %d threads)\r\n", sample_rate, tx_output_rate,
+                        resampler_simd (), tx_resampler.threads);
+        } else if (tx_stream_rate != 0) {
+            printf("The FPGA converts %uHz to %uHz\r\n", sample_rate, tx_output_rate);
+        }
+    }
+
+    if (rec_filename != NULL) {
+        rec_fp = fopen(rec_filename, "wb");
+        if (rec_fp == NULL || record_wav_header (rec_fp, wh, 0) != 0) {
+            printf("Cannot create the record file: %s\r\n", rec_filename);
+            if (rec_fp != NULL) {
+                fclose(rec_fp);
+            }
+            fclose(fp);
+            return 1;
+        }
+
+        rec_frame_length = (unsigned char)wh.fmt_subchunk.block_align;
+    }
+
     FT_HANDLE ftHandle;
     FT_STATUS ftStatus;
     unsigned char Mask = 0xff;
@@ -178,8 +488,17 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    // The FPGA counts native DSD frames of 32 bits per channel and TDM frames of all the slots.
+    pos_block_align = tx_dsd != NULL && !tx_dop ? DSD_FRAME_BYTES :
+                            tx_dsd == NULL ? tdm_frame_bytes (&tx_tdm) : (unsigned int)wh.fmt_subchunk.block_align;
+    pos_sample_rate = tx_dsd != NULL && !tx_dop ? tx_dsd->dsd_rate / 32 : tx_resampling ? tx_output_rate :
+                            (unsigned int)wh.fmt_subchunk.sample_rate;
+    pos_output_rate = tx_output_rate != 0 ? tx_output_rate : pos_sample_rate;
+    pos_i2s = output_port == 0;
+
     printf("Start streaming %s to output port: %d. Packet length is %d bytes.\r\n",
                     filename, output_port, packet_length);
+    printf("Seek with 't <seconds>' or 's <sample offset>', pause with 'p' and resume with 'r' followed by Enter.\r\n");
     // Get the start time
     struct timeval tv_start;
     gettimeofday(&tv_start, NULL);
@@ -216,6 +535,9 @@ int main(int argc, char *argv[])
         }
 
         if (tx_bytes_to_send == 0) {
+            // Console commands are applied between packets so that a packet is never split.
+            console_cmd (fp, wh);
+
             if (tx_data (fp, wh, packet_length, output_port, tx_buffer, &tx_bytes_to_send) < 0) {
                 break;
             }
@@ -231,6 +553,9 @@ int main(int argc, char *argv[])
             }
 
             tx_total_bytes_sent += tx_bytes_written;
+            if (tx_buffer[0] == (CMD_HOST_STREAM_OUTPUT | 0x10)) {
+                position_sent (tx_bytes_written - 3);
+            }
 
             // This buffer was sent
             tx_bytes_to_send = 0;
@@ -246,10 +571,29 @@ int main(int argc, char *argv[])
     printf("%d bytes sent, %d bytes received in %ld ms. Tx: %ld KBps, Rx: %ld KBps\r\n",
                 tx_total_bytes_sent, rx_total_bytes_received, duration, tx_total_bytes_sent / duration,
                 rx_total_bytes_received / duration);
+    if (rec_fp != NULL) {
+        printf("%u bytes recorded to %s\r\n", rec_bytes, rec_filename);
+        // Patch the sizes in the header.
+        if (fseek(rec_fp, 0, SEEK_SET) != 0 || record_wav_header (rec_fp, wh, rec_bytes) != 0) {
+            printf("Cannot update the header of the record file\r\n");
+        }
+        fclose(rec_fp);
+    }
+
     // Cleanup
     free (tx_buffer);
     free (rx_buffer);
+    if (tx_resampling) {
+        resampler_free (&tx_resampler);
+    }
+    if (tx_converting) {
+        pcm_converter_free (&tx_converter);
+    }
+    free (tx_converted_frames);
     FT_Close(ftHandle);
+    if (tx_dsd != NULL) {
+        close_dsd_file (tx_dsd);
+    }
     fclose(fp);
     return 0;
 }
@@ -259,28 +603,26 @@ int tx_data (FILE* fp, struct wav_header wh, unsigned int packet_length, unsigne
                         unsigned char* tx_buffer, unsigned int* tx_bytes_to_send) {
     switch (tx_state_m) {
         case STATE_TX_START_CMD: {
-            switch (wh.fmt_subchunk.num_channels) {
-                case 2: break; // Only two channels are supported. Mono will be supported later.
-                default: {
-                    printf("Unsupported number of channels: %d\r\n", wh.fmt_subchunk.num_channels);
-                    return -1;
-                }
-            }
-
+            // The number of channels was checked by tdm_map_init.
             tx_buffer[0] = CMD_HOST_SETUP_OUTPUT | 1;
             // Set the bit depth
-            switch (wh.fmt_subchunk.bits_per_sample) {
-                case 16: tx_buffer[1] = BIT_DEPTH_16; break;
-                case 24: tx_buffer[1] = BIT_DEPTH_24; break;
-                case 32: tx_buffer[1] = BIT_DEPTH_32; break;
-                default: {
-                    printf("Unsupported bit depth: %d\r\n", wh.fmt_subchunk.bits_per_sample);
-                    return -2;
+            if (tx_dsd != NULL) {
+                tx_buffer[1] = tx_dop == DOP_FPGA ? BIT_DEPTH_24 | SETUP_FORMAT_DSD :
+                                    tx_dop ? BIT_DEPTH_DOP : BIT_DEPTH_DOP | SETUP_FORMAT_DSD;
+            } else {
+                switch (wh.fmt_subchunk.bits_per_sample) {
+                    case 16: tx_buffer[1] = BIT_DEPTH_16; break;
+                    case 24: tx_buffer[1] = BIT_DEPTH_24; break;
+                    case 32: tx_buffer[1] = BIT_DEPTH_32; break;
+                    default: {
+                        printf("Unsupported bit depth: %d\r\n", wh.fmt_subchunk.bits_per_sample);
+                        return -2;
+                    }
                 }
             }
 
-            // Set the sampling rate
-            switch (wh.fmt_subchunk.sample_rate) {
+            // Set the sampling rate: the oversampled or converted rate when the FPGA changes it.
+            switch (tx_output_rate != 0 ? tx_output_rate : (unsigned int)wh.fmt_subchunk.sample_rate) {
                 case 44100: tx_buffer[1] |= STREAM_44100_HZ; break;
                 case 88200: tx_buffer[1] |= STREAM_88200_HZ; break;
                 case 176400: tx_buffer[1] |= STREAM_176400_HZ; break;
@@ -299,17 +641,103 @@ int tx_data (FILE* fp, struct wav_header wh, unsigned int packet_length, unsigne
 
             // Set the output_port
             tx_buffer[1] |= output_port << 6;
+            tx_setup_format = tx_buffer[1];
 
             *tx_bytes_to_send = 2;
+            tx_setup_options = tx_dsd == NULL ? tdm_setup_options (&tx_tdm, tx_slot_bits) : 0;
+            if (tx_output_rate != 0 && tx_stream_rate == 0 && !tx_resampling) {
+                tx_setup_options |= SETUP_OPTION_OVERSAMPLE;
+            }
+            if (tx_stream_rate != 0) {
+                *tx_bytes_to_send = setup_payload (tx_buffer, 0, 0);
+            } else if (tx_setup_options != 0) {
+                tx_buffer[0] = CMD_HOST_SETUP_OUTPUT | 2;
+                tx_buffer[2] = tx_setup_options;
+                *tx_bytes_to_send = 3;
+            }
 
-            tx_state_m = STATE_TX_STREAM_CMD;
+            if (tx_start_at_valid) {
+                *tx_bytes_to_send = setup_start_at (tx_buffer, tx_start_at);
+                tx_state_m = rec_fp != NULL ? STATE_TX_START_INPUT_CMD : STATE_TX_STREAM_CMD;
+            } else if (tx_start_delay_valid) {
+                // The sample count is reported in samples of the sample rate that was just set up.
+                tx_state_m = STATE_TX_GET_COUNTER_CMD;
+            } else {
+                tx_state_m = rec_fp != NULL ? STATE_TX_START_INPUT_CMD : STATE_TX_STREAM_CMD;
+            }
             //tx_total_bytes_read = 0;
             break;
         }
 
+        case STATE_TX_GET_COUNTER_CMD: {
+            tx_buffer[0] = CMD_HOST_GET_COUNTER;
+            *tx_bytes_to_send = 1;
+
+            rx_counter_valid = 0;
+            tx_state_m = STATE_TX_WAIT_COUNTER;
+            break;
+        }
+
+        case STATE_TX_WAIT_COUNTER: {
+            if (rx_counter_valid) {
+                // Unsigned arithmetic wraps the same way as the FPGA sample counter (at the output rate).
+                unsigned int start_at = rx_counter + (unsigned int)((unsigned long long)tx_start_delay_ms *
+                            (tx_output_rate != 0 ? tx_output_rate : (unsigned int)wh.fmt_subchunk.sample_rate) / 1000);
+                *tx_bytes_to_send = setup_start_at (tx_buffer, start_at);
+                tx_state_m = rec_fp != NULL ? STATE_TX_START_INPUT_CMD : STATE_TX_STREAM_CMD;
+            } else {
+                *tx_bytes_to_send = 0;
+            }
+            break;
+        }
+
+        case STATE_TX_START_INPUT_CMD: {
+            // Capture with the format of the output that was just set up.
+            tx_buffer[0] = CMD_HOST_SETUP_INPUT | 1;
+            tx_buffer[1] = tx_setup_format;
+            *tx_bytes_to_send = 2;
+
+            rec_input_running = 1;
+            tx_state_m = STATE_TX_STREAM_CMD;
+            break;
+        }
+
+        case STATE_TX_STOP_INPUT_CMD: {
+            // An empty payload stops the input.
+            tx_buffer[0] = CMD_HOST_SETUP_INPUT;
+            *tx_bytes_to_send = 1;
+
+            tx_state_m = STATE_TX_DONE;
+            break;
+        }
+
         case STATE_TX_STREAM_CMD: {
             size_t bytes_read;
-            bytes_read = fread(tx_buffer + 3, 1, packet_length - 3, fp);
+            if (tx_dsd != NULL && tx_dop == DOP_FPGA) {
+                bytes_read = read_dop_raw_data (fp, tx_dsd, &tx_dop_packer, tx_buffer + 3, packet_length - 3);
+            } else if (tx_dsd != NULL && tx_dop) {
+                bytes_read = read_dop_data (fp, tx_dsd, &tx_dop_packer, tx_buffer + 3, packet_length - 3);
+            } else if (tx_dsd != NULL) {
+                bytes_read = read_dsd_data (fp, tx_dsd, tx_buffer + 3, packet_length - 3);
+            } else if ((tx_resampling || tx_converting) && tx_tdm.positions != 0 && !tx_tdm.in_order) {
+                // Converted in file order, then interleaved.
+                unsigned int frame_bytes = (unsigned int)wh.fmt_subchunk.block_align;
+                unsigned int frames = (packet_length - 3) / tdm_frame_bytes (&tx_tdm);
+                frames = (tx_resampling ? read_resampled_data (read_stream_frames, fp, &tx_resampler,
+                                tx_converted_frames, frames * frame_bytes) :
+                                read_pcm_data (fp, &tx_converter, tx_converted_frames, frames * frame_bytes)) /
+                                frame_bytes;
+                bytes_read = tdm_interleave (&tx_tdm, tx_converted_frames, frames, tx_buffer + 3);
+            } else if (tx_resampling) {
+                bytes_read = read_resampled_data (read_stream_frames, fp, &tx_resampler, tx_buffer + 3,
+                                packet_length - 3);
+            } else if (tx_converting) {
+                bytes_read = read_pcm_data (fp, &tx_converter, tx_buffer + 3, packet_length - 3);
+            } else if (tx_tdm.positions != 0) {
+                bytes_read = read_tdm_data (fp, &tx_tdm, tx_buffer + 3, packet_length - 3);
+            } else {
+                bytes_read = fread(tx_buffer + 3, 1, packet_length - 3, fp);
+            }
             //printf("Read %ld bytes, requested %d\r\n", (unsigned long) bytes_read, packet_length);
             //tx_total_bytes_read += bytes_read;
             //printf("Read total %d bytes\r\n", tx_total_bytes_read);
@@ -338,11 +766,219 @@ int tx_data (FILE* fp, struct wav_header wh, unsigned int packet_length, unsigne
             *tx_bytes_to_send = 0;
             break;
         }
+
+        case STATE_TX_FLUSH_CMD: {
+            // Discard the audio buffered in the FPGA; streaming continues from the new file position.
+            tx_buffer[0] = CMD_HOST_FLUSH;
+            *tx_bytes_to_send = 1;
+
+            // The FPGA frame counts restart at 0.
+            pos_record_count = 0;
+            pos_bytes_sent = 0;
+            pos_drift_valid = 0;
+
+            // A seek while paused refills the FPGA only after resume.
+            tx_state_m = tx_paused ? STATE_TX_PAUSED : STATE_TX_STREAM_CMD;
+            break;
+        }
+
+        case STATE_TX_PAUSE_CMD: {
+            tx_buffer[0] = CMD_HOST_PAUSE | 1;
+            tx_buffer[1] = PAUSE_OUTPUT;
+            *tx_bytes_to_send = 2;
+
+            tx_paused = 1;
+            pos_drift_valid = 0;
+            tx_state_m = STATE_TX_PAUSED;
+            break;
+        }
+
+        case STATE_TX_PAUSED: {
+            // The FPGA holds the buffered audio; nothing to send until resume.
+            *tx_bytes_to_send = 0;
+            break;
+        }
+
+        case STATE_TX_RESUME_CMD: {
+            tx_buffer[0] = CMD_HOST_PAUSE | 1;
+            tx_buffer[1] = RESUME_OUTPUT;
+            *tx_bytes_to_send = 2;
+
+            tx_paused = 0;
+            pos_drift_valid = 0;
+            tx_state_m = STATE_TX_STREAM_CMD;
+            break;
+        }
+
+        case STATE_TX_VOLUME_CMD: {
+            tx_buffer[0] = CMD_HOST_SET_VOLUME | 3;
+            tx_buffer[1] = (unsigned char)(tx_gain >> 8);
+            tx_buffer[2] = (unsigned char)tx_gain;
+            tx_buffer[3] = tx_volume_options;
+            *tx_bytes_to_send = 4;
+
+            tx_state_m = tx_paused ? STATE_TX_PAUSED : STATE_TX_STREAM_CMD;
+            break;
+        }
+    }
+
+    return 0;
+}
+
+//======================================================================================================================
+unsigned int setup_start_at (unsigned char* tx_buffer, unsigned int start_at) {
+    printf("Stream is scheduled to start at sample count %u\r\n", start_at);
+    return setup_payload (tx_buffer, SETUP_OPTION_START_AT, start_at);
+}
+
+//======================================================================================================================
+unsigned int setup_payload (unsigned char* tx_buffer, unsigned char start_option, unsigned int start_at) {
+    tx_buffer[0] = CMD_HOST_SETUP_OUTPUT | 6;
+    tx_buffer[1] = tx_setup_format;
+    tx_buffer[2] = start_option | tx_setup_options;
+    tx_buffer[3] = (unsigned char)(start_at >> 24);
+    tx_buffer[4] = (unsigned char)(start_at >> 16);
+    tx_buffer[5] = (unsigned char)(start_at >> 8);
+    tx_buffer[6] = (unsigned char)start_at;
+    if (tx_stream_rate == 0) {
+        return 7;
+    }
+
+    tx_buffer[0] = CMD_HOST_SETUP_OUTPUT | SETUP_PAYLOAD_STREAM_RATE;
+    tx_buffer[7] = (unsigned char)(tx_stream_rate >> 16);
+    tx_buffer[8] = (unsigned char)(tx_stream_rate >> 8);
+    tx_buffer[9] = (unsigned char)tx_stream_rate;
+    return 10;
+}
+
+//======================================================================================================================
+unsigned int volume_gain (double db) {
+    // Q1.15, rounded and limited to the +6dB the FPGA multiplies by.
+    double gain = floor(pow(10.0, db / 20.0) * GAIN_UNITY + 0.5);
+    return gain > 0xffff ? 0xffff : (unsigned int)gain;
+}
+
+//======================================================================================================================
+void console_cmd (FILE* fp, struct wav_header wh) {
+    fd_set fds;
+    struct timeval tv = {0, 0};
+
+    FD_ZERO(&fds);
+    FD_SET(STDIN_FILENO, &fds);
+    if (select(STDIN_FILENO + 1, &fds, NULL, NULL, &tv) <= 0) {
+        return;
+    }
+
+    char line[64];
+    if (fgets(line, sizeof(line), stdin) == NULL) {
+        return;
+    }
+
+    if (tx_state_m != STATE_TX_STREAM_CMD && tx_state_m != STATE_TX_PAUSED) {
+        printf("Commands are only accepted while streaming\r\n");
+        return;
+    }
+
+    switch (line[0]) {
+        case 'p': {
+            if (tx_state_m == STATE_TX_STREAM_CMD) {
+                printf("Pause\r\n");
+                tx_state_m = STATE_TX_PAUSE_CMD;
+            }
+            break;
+        }
+
+        case 'r': {
+            if (tx_state_m == STATE_TX_PAUSED) {
+                printf("Resume\r\n");
+                tx_state_m = STATE_TX_RESUME_CMD;
+            }
+            break;
+        }
+
+        case 't': {
+            double seconds = strtod(line + 1, NULL);
+            if (seconds < 0) {
+                printf("Invalid seek time: %f\r\n", seconds);
+                break;
+            }
+
+            seek_stream (fp, wh, (unsigned long long)(seconds * wh.fmt_subchunk.sample_rate));
+            break;
+        }
+
+        case 's': {
+            seek_stream (fp, wh, strtoull(line + 1, NULL, 10));
+            break;
+        }
+
+        case 'v': {
+            // v <dB> [d] [n]: the gain with TPDF dither and noise shaping. The DSD formats are not affected.
+            char* options;
+            double db = strtod(line + 1, &options);
+            tx_gain = volume_gain (db);
+            tx_volume_options = (strchr(options, 'd') != NULL ? VOLUME_DITHER : 0) |
+                                    (strchr(options, 'n') != NULL ? VOLUME_NOISE_SHAPING : 0);
+            printf("Volume %.2f dB (gain 0x%04x)%s%s\r\n", db, tx_gain,
+                        tx_volume_options & VOLUME_DITHER ? ", dither" : "",
+                        tx_volume_options & VOLUME_NOISE_SHAPING ? ", noise shaping" : "");
+            tx_state_m = STATE_TX_VOLUME_CMD;
+            break;
+        }
+
+        default: {
+            printf("Unknown command. Use 't <seconds>', 's <sample offset>', 'p', 'r' or 'v <dB> [d] [n]'\r\n");
+            break;
+        }
+    }
+}
+
+//======================================================================================================================
+int seek_stream (FILE* fp, struct wav_header wh, unsigned long long sample_offset) {
+    unsigned long long total_samples = (unsigned int)wh.data_subchunk.subchunk2_size / wh.fmt_subchunk.block_align;
+    if (sample_offset >= total_samples) {
+        printf("Seek offset %llu is past the end of the stream (%llu samples)\r\n", sample_offset, total_samples);
+        return -1;
+    }
+
+    // The DoP frames are packed from whole DSD samples.
+    if (tx_dsd != NULL && tx_dop) {
+        sample_offset -= sample_offset % DOP_FRAMES_PER_SAMPLE;
+    }
+
+    // The offset is a multiple of block_align so the FPGA restarts on the left channel of a sample (of the frames of
+    // the file when they are converted).
+    long offset = wh.data_offset + (long)(sample_offset * (tx_converting ? tx_converter.input_frame_bytes :
+                        (unsigned int)wh.fmt_subchunk.block_align));
+    if (tx_dsd != NULL) {
+        if (seek_dsd_data (fp, tx_dsd, tx_dop ? sample_offset / DOP_FRAMES_PER_SAMPLE : sample_offset) != 0) {
+            printf("Cannot seek to DSD sample %llu\r\n", sample_offset);
+            return -2;
+        }
+    } else if (fseek(fp, offset, SEEK_SET) != 0) {
+        printf("Cannot seek to file offset %ld\r\n", offset);
+        return -2;
+    } else if (tx_resampling) {
+        resampler_reset (&tx_resampler);
     }
 
+    printf("Seek to sample %llu (%.3f s)\r\n", sample_offset, (double)sample_offset / wh.fmt_subchunk.sample_rate);
+    tx_state_m = STATE_TX_FLUSH_CMD;
     return 0;
 }
 
+//======================================================================================================================
+// The frames of the WAV file taken by the sample rate converter, converted to the FPGA formats first when needed.
+size_t read_stream_frames (void* context, unsigned char* frames, size_t count) {
+    FILE* fp = context;
+    const unsigned int frame_bytes = (unsigned int)(tx_resampler.channels * tx_resampler.sample_bytes);
+    if (tx_converting) {
+        return read_pcm_data (fp, &tx_converter, frames, (unsigned int)count * frame_bytes) / frame_bytes;
+    }
+
+    return fread(frames, frame_bytes, count, fp);
+}
+
 //======================================================================================================================
 int rx_data (unsigned char* rx_buffer, unsigned int rx_bytes, unsigned char* pStopped) {
 
@@ -367,6 +1003,43 @@ int rx_data (unsigned char* rx_buffer, unsigned int rx_bytes, unsigned char* pSt
                         break;
                     }
 
+                    case CMD_FPGA_COUNTER: {
+                        if (rx_payload_length == 4) {
+                            rx_counter = 0;
+                            rx_counter_bytes = 0;
+                            rx_state_m = STATE_RX_COUNTER_PAYLOAD;
+                        } else {
+                            printf("CMD_FPGA_COUNTER invalid payload: %d\r\n", rx_payload_length);
+                            return -3;
+                        }
+
+                        break;
+                    }
+
+                    case CMD_FPGA_INPUT: {
+                        if (rx_payload_length == rec_frame_length && rec_fp != NULL) {
+                            rec_frame_bytes = 0;
+                            rx_state_m = STATE_RX_INPUT_PAYLOAD;
+                        } else {
+                            printf("CMD_FPGA_INPUT invalid payload: %d\r\n", rx_payload_length);
+                            return -5;
+                        }
+
+                        break;
+                    }
+
+                    case CMD_FPGA_POSITION: {
+                        if (rx_payload_length == 8) {
+                            rx_position_bytes = 0;
+                            rx_state_m = STATE_RX_POSITION_PAYLOAD;
+                        } else {
+                            printf("CMD_FPGA_POSITION invalid payload: %d\r\n", rx_payload_length);
+                            return -4;
+                        }
+
+                        break;
+                    }
+
                     default: {
                         printf("Bad command: %d with payload: %d\r\n", rx_cmd, rx_payload_length);
                         return -2;
@@ -377,8 +1050,21 @@ int rx_data (unsigned char* rx_buffer, unsigned int rx_bytes, unsigned char* pSt
             }
 
             case STATE_RX_STOPPED_PAYLOAD: {
+                    if (rec_input_running) {
+                        rec_input_running = 0;
+                        if (rx_buffer[i] == 0) {
+                            // The output has stopped; stop the input and wait for its stopped command.
+                            printf("Output stopped, stopping the input\r\n");
+                            tx_state_m = STATE_TX_STOP_INPUT_CMD;
+                            rx_state_m = STATE_RX_CMD;
+                            break;
+                        }
+                    }
+
                     if (rx_buffer[i] == 0) {
                         printf("===== Test OK =====\r\n");
+                    } else if (rx_buffer[i] == ERROR_INPUT_OVERRUN) {
+                        printf("===== Test failed (input overrun, captured frames were dropped) =====\r\n");
                     } else {
                         printf("===== Test failed (error code %d) =====\r\n", rx_buffer[i]);
                     }
@@ -388,6 +1074,41 @@ int rx_data (unsigned char* rx_buffer, unsigned int rx_bytes, unsigned char* pSt
                 break;
             }
 
+            case STATE_RX_COUNTER_PAYLOAD: {
+                // Big endian sample count
+                rx_counter = (rx_counter << 8) | rx_buffer[i];
+                if (++rx_counter_bytes == 4) {
+                    printf("FPGA sample count: %u\r\n", rx_counter);
+                    rx_counter_valid = 1;
+                    rx_state_m = STATE_RX_CMD;
+                }
+                break;
+            }
+
+            case STATE_RX_POSITION_PAYLOAD: {
+                rx_position[rx_position_bytes++] = rx_buffer[i];
+                if (rx_position_bytes == 8) {
+                    unsigned char* frames = pos_i2s ? rx_position : rx_position + 4;
+                    position_report ((frames[0] << 24) | (frames[1] << 16) | (frames[2] << 8) | frames[3]);
+                    rx_state_m = STATE_RX_CMD;
+                }
+                break;
+            }
+
+            case STATE_RX_INPUT_PAYLOAD: {
+                rec_frame[rec_frame_bytes++] = rx_buffer[i];
+                if (rec_frame_bytes == rec_frame_length) {
+                    if (fwrite(rec_frame, 1, rec_frame_length, rec_fp) != rec_frame_length) {
+                        printf("Cannot write to the record file\r\n");
+                        return -6;
+                    }
+
+                    rec_bytes += rec_frame_length;
+                    rx_state_m = STATE_RX_CMD;
+                }
+                break;
+            }
+
             case STATE_RX_DONE: {
                 *pStopped = 1;
                 break;
@@ -397,3 +1118,88 @@ int rx_data (unsigned char* rx_buffer, unsigned int rx_bytes, unsigned char* pSt
 
     return 0;
 }
+
+//======================================================================================================================
+long long time_us (void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec*1000000LL + tv.tv_usec;
+}
+
+//======================================================================================================================
+void position_sent (unsigned int stream_bytes) {
+    pos_bytes_sent += stream_bytes;
+
+    struct position_record* record = &pos_records[pos_record_count % POSITION_RECORDS];
+    record->us = time_us();
+    record->bytes_sent = pos_bytes_sent;
+    pos_record_count++;
+}
+
+//======================================================================================================================
+void position_report (unsigned int frames_emitted) {
+    long long now_us = time_us();
+    // The frames of the stream sent.
+    frames_emitted = (unsigned int)((unsigned long long)frames_emitted * pos_sample_rate / pos_output_rate);
+    unsigned long long bytes_emitted = (unsigned long long)frames_emitted * pos_block_align;
+    if (bytes_emitted > pos_bytes_sent) {
+        // A report sent before a flush was processed.
+        return;
+    }
+
+    // The audio written but not yet emitted.
+    double buffered_ms = (double)(pos_bytes_sent - bytes_emitted) / pos_block_align * 1000.0 / pos_sample_rate;
+
+    // The latency of the last emitted frame: the time since the packet carrying it was written.
+    double latency_ms = -1.0;
+    unsigned int first = pos_record_count > POSITION_RECORDS ? pos_record_count - POSITION_RECORDS : 0;
+    for (unsigned int r = first; r < pos_record_count && frames_emitted > 0; r++) {
+        struct position_record* record = &pos_records[r % POSITION_RECORDS];
+        if (record->bytes_sent >= bytes_emitted) {
+            latency_ms = (now_us - record->us) / 1000.0;
+            break;
+        }
+    }
+
+    // The drift of the audio clock against the host clock, averaged since the first report.
+    if (!pos_drift_valid || frames_emitted < pos_drift_frames) {
+        pos_drift_valid = 1;
+        pos_drift_us = now_us;
+        pos_drift_frames = frames_emitted;
+    }
+
+    if (now_us - pos_drift_us >= 1000000LL) {
+        double rate = (double)(frames_emitted - pos_drift_frames) * 1000000.0 / (now_us - pos_drift_us);
+        printf("Position: %u frames; buffered: %.1f ms; latency: %.1f ms; audio clock drift: %+.1f ppm\r\n",
+                    frames_emitted, buffered_ms, latency_ms, (rate / pos_sample_rate - 1.0) * 1000000.0);
+    } else {
+        printf("Position: %u frames; buffered: %.1f ms; latency: %.1f ms\r\n",
+                    frames_emitted, buffered_ms, latency_ms);
+    }
+}
+
+//======================================================================================================================
+static void put_le (unsigned char* buffer, unsigned int value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        buffer[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+int record_wav_header (FILE* fp, struct wav_header wh, unsigned int data_bytes) {
+    unsigned char header[44];
+    memcpy(header, "RIFF", 4);
+    put_le(header + 4, 36 + data_bytes, 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put_le(header + 16, 16, 4);
+    put_le(header + 20, 1, 2);
+    put_le(header + 22, wh.fmt_subchunk.num_channels, 2);
+    // The recording runs at the rate of the stream sent.
+    unsigned int sample_rate = tx_resampling ? tx_output_rate : (unsigned int)wh.fmt_subchunk.sample_rate;
+    put_le(header + 24, sample_rate, 4);
+    put_le(header + 28, sample_rate * wh.fmt_subchunk.block_align, 4);
+    put_le(header + 32, wh.fmt_subchunk.block_align, 2);
+    put_le(header + 34, wh.fmt_subchunk.bits_per_sample, 2);
+    memcpy(header + 36, "data", 4);
+    put_le(header + 40, data_bytes, 4);
+    return fwrite(header, 1, sizeof(header), fp) == sizeof(header) ? 0 : -1;
+}
@@ -0,0 +1,329 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "WinTypes.h"
+#include "ftd2xx.h"
+#include "capture.h"
+//======================================================================================================================
+// Benchmark of the capture engine with the hdl_test TEST_SEND stream: the FPGA sends packet_count packets of
+// payload_length bytes (a byte counter) followed by CMD_FPGA_STOPPED. With -e the stream is generated by an emulator
+// instead of the FPGA so that the host side can be measured on its own.
+//
+// With -i the hdl_audio SPDIF input is captured for -t seconds: CMD_HOST_SETUP_INPUT starts the receiver, the frames
+// arrive in CMD_FPGA_INPUT packets and an empty CMD_HOST_SETUP_INPUT stops it (answered with CMD_FPGA_STOPPED).
+//======================================================================================================================
+// hdl_test definitions (see hdl_test/test_definitions.svh)
+// Commands from the host to the FPGA.
+#define CMD_HOST_START             0x00
+// Commands from the FPGA to the host.
+#define CMD_FPGA_DATA              0x20
+#define CMD_FPGA_STOPPED           0x60
+// Test number
+#define TEST_SEND                  2
+
+// hdl_audio definitions (see hdl_audio/definitions.svh)
+#define CMD_HOST_SETUP_INPUT       0x20
+#define CMD_FPGA_INPUT             0x20
+
+// Bit depth
+#define BIT_DEPTH_16               0x01
+#define BIT_DEPTH_24               0x02
+
+// Sample rate
+#define STREAM_44100_HZ            0x00
+#define STREAM_88200_HZ            0x04
+#define STREAM_176400_HZ           0x08
+
+#define STREAM_48000_HZ            0x10
+#define STREAM_96000_HZ            0x14
+#define STREAM_192000_HZ           0x18
+
+//======================================================================================================================
+struct emulator {
+    unsigned short payload_length;
+    unsigned int packets_left;
+    unsigned char header[3];
+    unsigned int header_index;
+    unsigned int payload_left;
+    unsigned char next_value;
+    unsigned char stopped_sent;
+};
+
+// The audio input is stopped from the reader thread once the capture duration has elapsed.
+struct input_reader {
+    FT_HANDLE ftHandle;
+    long long stop_at_us;
+    unsigned char stop_sent;
+};
+
+int ft_read (void* context, unsigned char* buffer, unsigned int length, unsigned int* bytes_read);
+int input_read (void* context, unsigned char* buffer, unsigned int length, unsigned int* bytes_read);
+long long time_us (void);
+int emulator_read (void* context, unsigned char* buffer, unsigned int length, unsigned int* bytes_read);
+
+//======================================================================================================================
+int main(int argc, char *argv[])
+{
+    int opt;
+    char* filename = NULL;
+    unsigned short payload_length = 16384;
+    unsigned short packet_count = 1024;
+    unsigned char emulate = 0;
+    // Audio input capture
+    unsigned char input_port = 0;
+    unsigned int seconds = 10;
+    struct capture_config config = {
+        .stream_cmd = CMD_FPGA_DATA,
+        .stopped_cmd = CMD_FPGA_STOPPED,
+        .num_channels = 2,
+        .sample_rate = 48000,
+        .bits_per_sample = 16,
+        .read_size = 0x10000,
+        .write_size = 0x100000,
+        .ring_size = 0x1000000,
+        .check_counter = 1,
+    };
+
+    if (argc <= 1) {
+        printf("Usage: %s -f <file name> [-p <payload length>] [-c <packet count>] [-e emulate] [-n no check] "
+                    "[-i <input port 1..3> -s <sample rate> -b <bits 16|24> -t <seconds>]\r\n", argv[0]);
+        return 1;
+    } else {
+        while ((opt = getopt(argc, argv, "f:p:c:eni:s:b:t:")) != -1) {
+            switch (opt) {
+                case 'f': filename = optarg; break;
+                case 'p': payload_length = strtol (optarg, NULL, 10); break;
+                case 'c': packet_count = strtol (optarg, NULL, 10); break;
+                case 'e': emulate = 1; break;
+                case 'n': config.check_counter = 0; break;
+                case 'i': input_port = strtol (optarg, NULL, 10); break;
+                case 's': config.sample_rate = strtol (optarg, NULL, 10); break;
+                case 'b': config.bits_per_sample = strtol (optarg, NULL, 10); break;
+                case 't': seconds = strtol (optarg, NULL, 10); break;
+                default: {
+                    printf("Usage: %s -f <file name> [-p <payload length>] [-c <packet count>] [-e emulate] "
+                                "[-n no check] [-i <input port 1..3> -s <sample rate> -b <bits 16|24> -t <seconds>]\r\n",
+                                argv[0]);
+                    return 1;
+                }
+            }
+        }
+    }
+
+    if (filename == NULL) {
+        printf("Missing file name\r\n");
+        return 1;
+    }
+
+    // The SETUP_INPUT format byte: [7:6] input port, [4:2] sample rate, [1:0] bit depth.
+    unsigned char input_format = input_port << 6;
+    if (input_port > 0) {
+        if (input_port > 3 || emulate) {
+            printf("Invalid input port: %d\r\n", input_port);
+            return 1;
+        }
+
+        switch (config.sample_rate) {
+            case 44100: input_format |= STREAM_44100_HZ; break;
+            case 88200: input_format |= STREAM_88200_HZ; break;
+            case 176400: input_format |= STREAM_176400_HZ; break;
+            case 48000: input_format |= STREAM_48000_HZ; break;
+            case 96000: input_format |= STREAM_96000_HZ; break;
+            case 192000: input_format |= STREAM_192000_HZ; break;
+            default: {
+                printf("Unsupported sample rate: %d\r\n", config.sample_rate);
+                return 1;
+            }
+        }
+
+        switch (config.bits_per_sample) {
+            case 16: input_format |= BIT_DEPTH_16; break;
+            case 24: input_format |= BIT_DEPTH_24; break;
+            default: {
+                printf("Unsupported bit depth: %d\r\n", config.bits_per_sample);
+                return 1;
+            }
+        }
+
+        config.stream_cmd = CMD_FPGA_INPUT;
+        config.check_counter = 0;
+    }
+
+    struct capture_stats stats;
+    int result;
+    if (emulate) {
+        struct emulator emulator;
+        memset(&emulator, 0, sizeof(struct emulator));
+        emulator.payload_length = payload_length;
+        emulator.packets_left = packet_count;
+        emulator.header_index = 3;
+
+        printf("Start emulated capture: payload length: %d, packet count: %d\r\n", payload_length, packet_count);
+        result = capture_run (&config, emulator_read, &emulator, filename, &stats);
+    } else {
+        FT_HANDLE ftHandle;
+        FT_STATUS ftStatus;
+        unsigned char Mask = 0xff;
+
+        ftStatus = FT_Open(0, &ftHandle);
+        if(ftStatus != FT_OK) {
+            printf("FT_Open failed! %d\r\n", ftStatus);
+            return 1;
+        }
+
+        // Set interface into FT245 Synchronous FIFO mode
+        ftStatus = FT_SetBitMode(ftHandle, Mask, 0x00);
+        if (ftStatus != FT_OK) {
+            printf("FT_SetBitMode RESET failed! %d\r\n", ftStatus);
+            FT_Close(ftHandle);
+            return 1;
+        }
+
+        usleep(1000000);
+
+        ftStatus = FT_SetBitMode(ftHandle, Mask, 0x40);
+        if (ftStatus != FT_OK) {
+            printf("FT_SetBitMode SYNC FIFO MODE failed! %d\r\n", ftStatus);
+            FT_Close(ftHandle);
+            return 1;
+        }
+
+        FT_SetLatencyTimer(ftHandle, 2);
+        FT_SetUSBParameters(ftHandle, 0x10000, 0x10000);
+        FT_SetFlowControl(ftHandle, FT_FLOW_RTS_CTS, 0x0, 0x0);
+        // Large reads return what was received when the timeout expires.
+        FT_SetTimeouts(ftHandle, 100, 1000);
+        FT_Purge(ftHandle, FT_PURGE_RX | FT_PURGE_TX);
+
+        unsigned int bytes_written;
+        if (input_port > 0) {
+            unsigned char setup[2] = {CMD_HOST_SETUP_INPUT | 1, input_format};
+            ftStatus = FT_Write(ftHandle, setup, sizeof(setup), &bytes_written);
+            if (ftStatus != FT_OK || bytes_written != sizeof(setup)) {
+                printf("FT_Write failed! ftStatus = %d\r\n", ftStatus);
+                FT_Close(ftHandle);
+                return 1;
+            }
+
+            struct input_reader reader = {.ftHandle = ftHandle, .stop_at_us = time_us() + seconds * 1000000LL};
+            printf("Start input capture: port: %d, %d Hz, %d bits, %d s\r\n", input_port, config.sample_rate,
+                        config.bits_per_sample, seconds);
+            result = capture_run (&config, input_read, &reader, filename, &stats);
+        } else {
+            unsigned char start[6] = {CMD_HOST_START | 5, TEST_SEND, payload_length >> 8,
+                                        (unsigned char)payload_length, packet_count >> 8, (unsigned char)packet_count};
+            ftStatus = FT_Write(ftHandle, start, sizeof(start), &bytes_written);
+            if (ftStatus != FT_OK || bytes_written != sizeof(start)) {
+                printf("FT_Write failed! ftStatus = %d\r\n", ftStatus);
+                FT_Close(ftHandle);
+                return 1;
+            }
+
+            printf("Start capture: payload length: %d, packet count: %d\r\n", payload_length, packet_count);
+            result = capture_run (&config, ft_read, ftHandle, filename, &stats);
+        }
+        FT_Close(ftHandle);
+    }
+
+    long long duration_ms = stats.duration_us / 1000 > 0 ? stats.duration_us / 1000 : 1;
+    printf("%llu bytes read, %llu payload bytes in %u packets written in %lld ms. Rx: %llu KBps\r\n",
+                stats.bytes_read, stats.payload_bytes, stats.packets, duration_ms, stats.bytes_read / duration_ms);
+    if (result == 0 && stats.stop_code == 0) {
+        printf("===== Test OK =====\r\n");
+    } else {
+        printf("===== Test failed (error code %d, result %d) =====\r\n", stats.stop_code, result);
+    }
+
+    return result == 0 && stats.stop_code == 0 ? 0 : 1;
+}
+
+//======================================================================================================================
+int ft_read (void* context, unsigned char* buffer, unsigned int length, unsigned int* bytes_read) {
+    FT_STATUS ftStatus = FT_Read((FT_HANDLE)context, buffer, length, bytes_read);
+    if (ftStatus != FT_OK) {
+        printf("FT_Read failed! ftStatus = %d\r\n", ftStatus);
+        return -1;
+    }
+
+    return 0;
+}
+
+//======================================================================================================================
+int input_read (void* context, unsigned char* buffer, unsigned int length, unsigned int* bytes_read) {
+    struct input_reader* reader = context;
+    if (!reader->stop_sent && time_us() >= reader->stop_at_us) {
+        // An empty SETUP_INPUT stops the input. The capture ends with CMD_FPGA_STOPPED.
+        unsigned char stop = CMD_HOST_SETUP_INPUT;
+        unsigned int bytes_written;
+        FT_STATUS ftStatus = FT_Write(reader->ftHandle, &stop, 1, &bytes_written);
+        if (ftStatus != FT_OK || bytes_written != 1) {
+            printf("FT_Write failed! ftStatus = %d\r\n", ftStatus);
+            return -1;
+        }
+        reader->stop_sent = 1;
+    }
+
+    return ft_read (reader->ftHandle, buffer, length, bytes_read);
+}
+
+//======================================================================================================================
+long long time_us (void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec*1000000LL + tv.tv_usec;
+}
+
+//======================================================================================================================
+int emulator_read (void* context, unsigned char* buffer, unsigned int length, unsigned int* bytes_read) {
+    struct emulator* emulator = context;
+    unsigned int count = 0;
+    while (count < length) {
+        if (emulator->payload_left > 0) {
+            unsigned int span = length - count < emulator->payload_left ? length - count : emulator->payload_left;
+            for (unsigned int i = 0; i < span; i++) {
+                buffer[count + i] = emulator->next_value++;
+            }
+            count += span;
+            emulator->payload_left -= span;
+        } else if (emulator->header_index < 3) {
+            buffer[count++] = emulator->header[emulator->header_index++];
+            if (emulator->header_index == 3) {
+                emulator->payload_left = emulator->payload_length;
+            }
+        } else if (emulator->packets_left > 0) {
+            emulator->header[0] = CMD_FPGA_DATA | 0x10;
+            emulator->header[1] = emulator->payload_length >> 8;
+            emulator->header[2] = (unsigned char)emulator->payload_length;
+            emulator->header_index = 0;
+            emulator->packets_left--;
+        } else if (!emulator->stopped_sent && length - count >= 2) {
+            buffer[count++] = CMD_FPGA_STOPPED | 1;
+            buffer[count++] = 0;
+            emulator->stopped_sent = 1;
+        } else {
+            break;
+        }
+    }
+
+    *bytes_read = count;
+    return 0;
+}
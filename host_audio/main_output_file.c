@@ -18,14 +18,20 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <math.h>
 
 #include "wav_reader.h"
+#include "dsd_reader.h"
+#include "dop_packer.h"
+#include "tdm_map.h"
 
 // Bit rates
 #define BIT_DEPTH_DOP      0x00
 #define BIT_DEPTH_16       0x01
 #define BIT_DEPTH_24       0x02
 #define BIT_DEPTH_32       0x03
+// Native DSD on the I2S port, with BIT_DEPTH_DOP. With BIT_DEPTH_24, raw DSD bytes encoded to DoP by the FPGA.
+#define SETUP_FORMAT_DSD   0x20
 
 // Sample rate.
 #define STREAM_44100_HZ    0x00
@@ -38,15 +44,28 @@
 #define STREAM_192000_HZ   0x18
 #define STREAM_384000_HZ   0x1c
 
+// CMD_HOST_SETUP_OUTPUT payload byte[1]: stereo PCM at the base rate oversampled by the FPGA up to the sample rate.
+#define SETUP_OPTION_OVERSAMPLE 0x80
+// CMD_HOST_SETUP_OUTPUT optional payload bytes[6-8]: the rate in Hz of stereo PCM converted by the FPGA to the sample
+// rate (bytes[2-5] hold the start sample count, unused).
+#define SETUP_PAYLOAD_STREAM_RATE 9
+
 //======================================================================================================================
 int tx_data (FILE* fp, struct wav_header wh,  unsigned int packet_length, unsigned char output_port,
-                        unsigned char* tx_buffer, unsigned int* tx_bytes_to_send);
+                        unsigned char input_loopback, unsigned char* tx_buffer, unsigned int* tx_bytes_to_send);
 void build_file_name (char output_port, struct wav_header wh, char *output_filename);
 //======================================================================================================================
 // Commands from the host to the FPGA.
 #define CMD_HOST_SETUP_OUTPUT      0x00
+#define CMD_HOST_SETUP_INPUT       0x20
 #define CMD_HOST_STREAM_OUTPUT     0x40
 #define CMD_HOST_STOP              0x60
+#define CMD_HOST_SET_VOLUME        0xe0
+
+// CMD_HOST_SET_VOLUME payload: bytes[0-1] the gain (big endian, Q1.15), byte[2] options
+#define GAIN_UNITY                 0x8000
+#define VOLUME_DITHER              0x01
+#define VOLUME_NOISE_SHAPING       0x02
 
 // Send state machine
 #define STATE_TX_START_CMD         1
@@ -56,23 +75,63 @@ void build_file_name (char output_port, struct wav_header wh, char *output_filen
 unsigned char tx_state_m = STATE_TX_START_CMD;
 
 unsigned int tx_total_bytes_read;
+// The DSD file being converted, NULL for a WAV file. With tx_dop it is sent as DoP packed by the host (DOP_HOST) or as
+// raw DSD bytes encoded by the FPGA (DOP_FPGA).
+struct dsd_file* tx_dsd = NULL;
+unsigned char tx_dop = 0;
+struct dop_packer tx_dop_packer;
+// The slots of the channels of a WAV file: TDM for more than 2 channels, with slots of tx_slot_bits (0: bit depth),
+// on tx_lines sdata lines.
+struct tdm_map tx_tdm;
+int tx_slot_bits = 0;
+int tx_lines = 1;
+// The volume sent after the setup (-g <dB>[d][n]), none at 0dB without options.
+unsigned int tx_gain = GAIN_UNITY;
+unsigned char tx_volume_options = 0;
+// The rate the FPGA oversamples the WAV file to (-u <rate>) or converts it to, 0 to play it at its own rate.
+unsigned int tx_output_rate = 0;
+// The rate of the WAV file when the FPGA converts it to tx_output_rate (no output runs at it), 0 otherwise.
+unsigned int tx_stream_rate = 0;
 //======================================================================================================================
 int main(int argc, char *argv[]) {
     int opt;
     char* filename;
     unsigned int packet_length = 4096; // Default packet length
     unsigned char output_port = 0;
+    // Also capture the output with the receiver of the output port (simulation with SPDIF_LOOPBACK or I2S_LOOPBACK).
+    unsigned char input_loopback = 0;
     if (argc <= 1) {
-        printf("Usage: %s -f file name [-o output_port 0..3] -p <packet length 1..16383>\r\n", argv[0]);
+        printf("Usage: %s -f file name [-o output_port 0..3] -p <packet length 1..16383> [-i input loopback] "
+                    "[-D (DSD as DoP)] [-E (DSD as DoP encoded by the FPGA)] [-w <TDM slot width 16|24|32>] "
+                    "[-l <I2S data lines 1|2|4>] [-g <gain dB>[d (dither)][n (noise shaping)]] "
+                    "[-u <oversampled rate>]\r\n", argv[0]);
         return 1;
     } else {
-        while ((opt = getopt(argc, argv, "f:o:p")) != -1) {
+        while ((opt = getopt(argc, argv, "f:o:p:iDEw:l:g:u:")) != -1) {
             switch (opt) {
-                case 'f': filename = argv[2]; break;
-                case 'o': output_port = strtol (argv[4], NULL, 10); break;
-                case 'p': packet_length = strtol (argv[6], NULL, 10); break;
+                case 'f': filename = optarg; break;
+                case 'o': output_port = strtol (optarg, NULL, 10); break;
+                case 'p': packet_length = strtol (optarg, NULL, 10); break;
+                case 'i': input_loopback = 1; break;
+                case 'D': tx_dop = DOP_HOST; break;
+                case 'E': tx_dop = DOP_FPGA; break;
+                case 'w': tx_slot_bits = strtol (optarg, NULL, 10); break;
+                case 'l': tx_lines = strtol (optarg, NULL, 10); break;
+                case 'u': tx_output_rate = strtoul (optarg, NULL, 10); break;
+                case 'g': {
+                    char* options;
+                    // Q1.15, rounded and limited to the +6dB the FPGA multiplies by.
+                    double gain = floor(pow(10.0, strtod (optarg, &options) / 20.0) * GAIN_UNITY + 0.5);
+                    tx_gain = gain > 0xffff ? 0xffff : (unsigned int)gain;
+                    tx_volume_options = (strchr(options, 'd') != NULL ? VOLUME_DITHER : 0) |
+                                            (strchr(options, 'n') != NULL ? VOLUME_NOISE_SHAPING : 0);
+                    break;
+                }
                 default: {
-                    printf("Usage: %s -f file name [-o output_port 0..3] [-p <packet length 1..16383>]\r\n", argv[0]);
+                    printf("Usage: %s -f file name [-o output_port 0..3] [-p <packet length 1..16383>] "
+                                "[-i input loopback] [-D (DSD as DoP)] [-E (DSD as DoP encoded by the FPGA)] "
+                                "[-w <TDM slot width 16|24|32>] [-l <I2S data lines 1|2|4>] "
+                                "[-g <gain dB>[d (dither)][n (noise shaping)]] [-u <oversampled rate>]\r\n", argv[0]);
                     return 1;
                 }
             }
@@ -91,15 +150,94 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    // Read the wav header
+    // Read the DSD (DSF or DFF) or wav header
     struct wav_header wh;
+    struct dsd_file df;
     memset(&wh, 0, sizeof(struct wav_header));
-    if (read_wav_file (fp, &wh) != 0) {
-        printf("Invalid WAV file: %s\r\n", filename);
+    int dsd_result = read_dsd_file (fp, &df, &wh);
+    if (dsd_result == 0) {
+        tx_dsd = &df;
+    } else if (dsd_result < 0 || read_wav_file (fp, &wh) != 0) {
+        printf("Invalid WAV or DSD file: %s\r\n", filename);
+        fclose(fp);
+        return 1;
+    }
+
+    // DoP encoded by the FPGA plays on any output port.
+    if (tx_dsd != NULL && ((output_port != 0 && tx_dop != DOP_FPGA) || input_loopback || tx_lines != 1)) {
+        printf("DSD requires the I2S output port (0) unless encoded by the FPGA, on one data line without input "
+                    "loopback\r\n");
+        close_dsd_file (tx_dsd);
         fclose(fp);
         return 1;
     }
 
+    if (tx_dsd != NULL && tx_dop) {
+        if (dop_stream_header (tx_dsd, tx_dop, &wh) != 0) {
+            close_dsd_file (tx_dsd);
+            fclose(fp);
+            return 1;
+        }
+        dop_init (&tx_dop_packer, tx_dsd->lsb_first);
+    }
+
+    // More than 2 channels play on the TDM output or on several data lines of the I2S port.
+    if (tx_dsd == NULL) {
+        if (tdm_map_init (&tx_tdm, &wh, tx_lines) != 0) {
+            fclose(fp);
+            return 1;
+        }
+
+        if (tx_tdm.positions != 0 && (output_port != 0 || input_loopback)) {
+            printf("Multichannel files require the I2S output port (0) without input loopback\r\n");
+            fclose(fp);
+            return 1;
+        }
+
+        if (tx_slot_bits != 0 && (tx_tdm.slots == 0 || (tx_slot_bits != 16 && tx_slot_bits != 24 &&
+                tx_slot_bits != 32) || tx_slot_bits < wh.fmt_subchunk.bits_per_sample)) {
+            printf("Invalid TDM slot width: %d\r\n", tx_slot_bits);
+            fclose(fp);
+            return 1;
+        }
+    }
+
+    // The FPGA oversamples stereo PCM from the base rate of a clock family by 2, 4 or 8.
+    if (tx_output_rate != 0) {
+        unsigned int ratio = tx_output_rate / (unsigned int)wh.fmt_subchunk.sample_rate;
+        if (tx_dsd != NULL || tx_tdm.positions != 0 || input_loopback ||
+                (wh.fmt_subchunk.sample_rate != 44100 && wh.fmt_subchunk.sample_rate != 48000) ||
+                ratio * (unsigned int)wh.fmt_subchunk.sample_rate != tx_output_rate ||
+                (ratio != 2 && ratio != 4 && ratio != 8)) {
+            printf("Oversampling takes stereo PCM at 44100Hz or 48000Hz to 2, 4 or 8 times that rate without input "
+                        "loopback\r\n");
+            if (tx_dsd != NULL) {
+                close_dsd_file (tx_dsd);
+            }
+            fclose(fp);
+            return 1;
+        }
+    } else if (tx_dsd == NULL) {
+        // The FPGA converts stereo PCM at the rates the outputs do not run at to the next rate up.
+        static const unsigned int output_rates[] = {44100, 48000, 88200, 96000, 176400, 192000, 352800, 384000};
+        unsigned int sample_rate = (unsigned int)wh.fmt_subchunk.sample_rate;
+        for (unsigned int r = 0; r < sizeof(output_rates) / sizeof(output_rates[0]) && tx_output_rate == 0; r++) {
+            if (output_rates[r] == sample_rate) {
+                break;
+            } else if (output_rates[r] > sample_rate) {
+                tx_output_rate = output_rates[r];
+                tx_stream_rate = sample_rate;
+            }
+        }
+
+        if (tx_stream_rate != 0 && (tx_tdm.positions != 0 || input_loopback || sample_rate < 8000)) {
+            printf("Sample rate %uHz: only stereo PCM from 8000Hz is converted, without input loopback\r\n",
+                        sample_rate);
+            fclose(fp);
+            return 1;
+        }
+    }
+
     // Form the file name from the audio output, sample rate and bit depth
     char output_filename[32] = "";
     build_file_name (output_port, wh, output_filename);
@@ -116,7 +254,7 @@ int main(int argc, char *argv[]) {
 
     FILE* fpb = fopen(output_filename, "wb");
     do {
-        if (tx_data (fp, wh, packet_length, output_port, tx_buffer, &tx_bytes_to_send) < 0) {
+        if (tx_data (fp, wh, packet_length, output_port, input_loopback, tx_buffer, &tx_bytes_to_send) < 0) {
             break;
         }
         fwrite(tx_buffer, 1, tx_bytes_to_send, fpb);
@@ -125,29 +263,37 @@ int main(int argc, char *argv[]) {
     free (tx_buffer);
 
     fclose(fpb);
+    if (tx_dsd != NULL) {
+        close_dsd_file (tx_dsd);
+    }
     fclose(fp);
     return 0;
 }
 
 //======================================================================================================================
 int tx_data (FILE* fp, struct wav_header wh, unsigned int packet_length, unsigned char output_port,
-                        unsigned char* tx_buffer, unsigned int* tx_bytes_to_send) {
+                        unsigned char input_loopback, unsigned char* tx_buffer, unsigned int* tx_bytes_to_send) {
     switch (tx_state_m) {
         case STATE_TX_START_CMD: {
             tx_buffer[0] = CMD_HOST_SETUP_OUTPUT | 1;
             // Set the bit depth
-            switch (wh.fmt_subchunk.bits_per_sample) {
-                case 16: tx_buffer[1] = BIT_DEPTH_16; break;
-                case 24: tx_buffer[1] = BIT_DEPTH_24; break;
-                case 32: tx_buffer[1] = BIT_DEPTH_32; break;
-                default: {
-                    printf("Unsupported bit depth: %d\r\n", wh.fmt_subchunk.bits_per_sample);
-                    return -1;
+            if (tx_dsd != NULL) {
+                tx_buffer[1] = tx_dop == DOP_FPGA ? BIT_DEPTH_24 | SETUP_FORMAT_DSD :
+                                    tx_dop ? BIT_DEPTH_DOP : BIT_DEPTH_DOP | SETUP_FORMAT_DSD;
+            } else {
+                switch (wh.fmt_subchunk.bits_per_sample) {
+                    case 16: tx_buffer[1] = BIT_DEPTH_16; break;
+                    case 24: tx_buffer[1] = BIT_DEPTH_24; break;
+                    case 32: tx_buffer[1] = BIT_DEPTH_32; break;
+                    default: {
+                        printf("Unsupported bit depth: %d\r\n", wh.fmt_subchunk.bits_per_sample);
+                        return -1;
+                    }
                 }
             }
 
-            // Set the sampling rate
-            switch (wh.fmt_subchunk.sample_rate) {
+            // Set the sampling rate: the oversampled rate when the FPGA oversamples.
+            switch (tx_output_rate != 0 ? tx_output_rate : (unsigned int)wh.fmt_subchunk.sample_rate) {
                 case 44100: tx_buffer[1] |= STREAM_44100_HZ; break;
                 case 88200: tx_buffer[1] |= STREAM_88200_HZ; break;
                 case 176400: tx_buffer[1] |= STREAM_176400_HZ; break;
@@ -167,14 +313,41 @@ int tx_data (FILE* fp, struct wav_header wh, unsigned int packet_length, unsigne
             // Set the output_port
             tx_buffer[1] |= output_port << 6;
 
-            switch (wh.fmt_subchunk.num_channels) {
-                case 2: break; // Only two channels are supported. Mono will be supported later.
-                default: {
-                    printf("Unsupported number of channels: %d\r\n", wh.fmt_subchunk.num_channels);
-                    return -3;
-                }
-            }
+            // The number of channels was checked by tdm_map_init.
             *tx_bytes_to_send = 2;
+            unsigned char options = tx_dsd == NULL ? tdm_setup_options (&tx_tdm, tx_slot_bits) : 0;
+            if (tx_output_rate != 0 && tx_stream_rate == 0) {
+                options |= SETUP_OPTION_OVERSAMPLE;
+            }
+            if (tx_stream_rate != 0) {
+                tx_buffer[0] = CMD_HOST_SETUP_OUTPUT | SETUP_PAYLOAD_STREAM_RATE;
+                tx_buffer[2] = options;
+                memset (tx_buffer + 3, 0, 4);
+                tx_buffer[7] = (unsigned char)(tx_stream_rate >> 16);
+                tx_buffer[8] = (unsigned char)(tx_stream_rate >> 8);
+                tx_buffer[9] = (unsigned char)tx_stream_rate;
+                *tx_bytes_to_send = 10;
+            } else if (options != 0) {
+                tx_buffer[0] = CMD_HOST_SETUP_OUTPUT | 2;
+                tx_buffer[2] = options;
+                *tx_bytes_to_send = 3;
+            }
+
+            if (input_loopback) {
+                // Capture with the same format.
+                tx_buffer[2] = CMD_HOST_SETUP_INPUT | 1;
+                tx_buffer[3] = tx_buffer[1];
+                *tx_bytes_to_send = 4;
+            }
+
+            if (tx_gain != GAIN_UNITY || tx_volume_options != 0) {
+                unsigned char* volume = tx_buffer + *tx_bytes_to_send;
+                volume[0] = CMD_HOST_SET_VOLUME | 3;
+                volume[1] = (unsigned char)(tx_gain >> 8);
+                volume[2] = (unsigned char)tx_gain;
+                volume[3] = tx_volume_options;
+                *tx_bytes_to_send += 4;
+            }
 
             tx_state_m = STATE_TX_STREAM_CMD;
             tx_total_bytes_read = 0;
@@ -186,13 +359,33 @@ int tx_data (FILE* fp, struct wav_header wh, unsigned int packet_length, unsigne
             *tx_bytes_to_send = 0;
             size_t bytes_read;
             unsigned int bytes_per_sample = wh.fmt_subchunk.num_channels * (wh.fmt_subchunk.bits_per_sample >> 3);
+            // DoP frames are packed from whole DSD samples.
+            if (tx_dsd != NULL && tx_dop) {
+                bytes_per_sample *= DOP_FRAMES_PER_SAMPLE;
+            } else if (tx_dsd == NULL && tx_tdm.positions != 0) {
+                bytes_per_sample = tdm_frame_bytes (&tx_tdm);
+            }
             while (1) {
                 if (*tx_bytes_to_send + bytes_per_sample < packet_length) {
-                    bytes_read = fread(tx_buffer + *tx_bytes_to_send + 3, 1, bytes_per_sample, fp);
+                    if (tx_dsd != NULL && tx_dop == DOP_FPGA) {
+                        bytes_read = read_dop_raw_data (fp, tx_dsd, &tx_dop_packer, tx_buffer + *tx_bytes_to_send + 3,
+                                                        bytes_per_sample);
+                    } else if (tx_dsd != NULL && tx_dop) {
+                        bytes_read = read_dop_data (fp, tx_dsd, &tx_dop_packer, tx_buffer + *tx_bytes_to_send + 3,
+                                                        bytes_per_sample);
+                    } else if (tx_dsd != NULL) {
+                        bytes_read = read_dsd_data (fp, tx_dsd, tx_buffer + *tx_bytes_to_send + 3, bytes_per_sample);
+                    } else if (tx_tdm.positions != 0) {
+                        bytes_read = read_tdm_data (fp, &tx_tdm, tx_buffer + *tx_bytes_to_send + 3, bytes_per_sample);
+                    } else {
+                        bytes_read = fread(tx_buffer + *tx_bytes_to_send + 3, 1, bytes_per_sample, fp);
+                    }
                     //printf("Read %ld bytes, requested %d\r\n", (unsigned long) bytes_read, bytes_per_sample);
                     *tx_bytes_to_send += bytes_read;
 
-                    tx_total_bytes_read += bytes_read;
+                    // The unused TDM slots are not in the file.
+                    tx_total_bytes_read += tx_dsd == NULL && tx_tdm.positions != 0 ?
+                            bytes_read / bytes_per_sample * wh.fmt_subchunk.block_align : bytes_read;
                     if ((unsigned int)wh.data_subchunk.subchunk2_size == tx_total_bytes_read) {
                         printf("Read all the data %d bytes from the WAV file.\r\n", tx_total_bytes_read);
                         if (*tx_bytes_to_send > 0) {
@@ -245,7 +438,22 @@ int tx_data (FILE* fp, struct wav_header wh, unsigned int packet_length, unsigne
 
 //======================================================================================================================
 void build_file_name (char output_port, struct wav_header wh, char *output_filename) {
-    if (output_port == 0 || output_port == 1) {
+    if (tx_stream_rate != 0) {
+        strcat (output_filename, "asrc_");
+    } else if (tx_output_rate != 0) {
+        unsigned int ratio = tx_output_rate / (unsigned int)wh.fmt_subchunk.sample_rate;
+        strcat (output_filename, ratio == 8 ? "x8_" : ratio == 4 ? "x4_" : "x2_");
+    }
+
+    if (tx_dsd == NULL && tx_tdm.lines != 1) {
+        strcat (output_filename, tx_tdm.lines == 4 ? "lines4_" : "lines2_");
+    }
+
+    if (tx_dsd == NULL && tx_tdm.slots != 0) {
+        strcat (output_filename, tx_tdm.slots == 8 ? "tdm8_" : "tdm4_");
+    } else if (tx_dsd == NULL && tx_tdm.positions != 0) {
+        strcat (output_filename, "i2s_");
+    } else if (output_port == 0 || output_port == 1) {
         strcat (output_filename, "i2s_");
     } else {
         strcat (output_filename, "spdif_");
@@ -263,15 +471,20 @@ void build_file_name (char output_port, struct wav_header wh, char *output_filen
         case 384000: strcat (output_filename, "384000_"); break;
 
         default: {
+            if (tx_stream_rate != 0) {
+                sprintf (output_filename + strlen (output_filename), "%u_", tx_stream_rate);
+                break;
+            }
             printf("Unsupported sample rate %d bytes\r\n", wh.fmt_subchunk.sample_rate);
             return;
         }
     }
 
     switch (wh.fmt_subchunk.bits_per_sample) {
-        case 16: strcat (output_filename, "16.bin"); break;
-        case 24: strcat (output_filename, "24.bin"); break;
+        case 16: strcat (output_filename, tx_dsd != NULL ? "dop_raw.bin" : "16.bin"); break;
+        case 24: strcat (output_filename, tx_dsd != NULL ? "dop.bin" : "24.bin"); break;
         case 32: strcat (output_filename, "32.bin"); break;
+        case DSD_BITS_PER_SAMPLE: strcat (output_filename, "dsd.bin"); break;
         default: {
             printf("Unsupported bit depth: %d\r\n", wh.fmt_subchunk.bits_per_sample);
             return;
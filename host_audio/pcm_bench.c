@@ -0,0 +1,181 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "pcm_convert.h"
+//======================================================================================================================
+// Benchmark of the PCM conversion kernels. Each kernel (every input format to 16, 24 and 32 bits, mono to stereo and
+// a remap of the channels) converts a buffer of frames in memory PCM_BLOCK_FRAMES at a time, as read_pcm_data does.
+// The rate is input bytes per second (GB/s).
+//
+// The benchmark also checks the conversions: widened integers must match the input exactly, float full scale must
+// clip to the output range without wrapping, and dither must stay within +/-1 LSB of the rounded value.
+//======================================================================================================================
+long long time_us (void);
+void fill_input (unsigned char* in, size_t samples, int format);
+int check (const struct pcm_converter* pc, const unsigned char* in, const unsigned char* out, size_t frames);
+
+//======================================================================================================================
+int main(int argc, char *argv[]) {
+    int opt;
+    double megabytes = 64.0;
+    int dither = 1;
+    while ((opt = getopt(argc, argv, "m:nh")) != -1) {
+        switch (opt) {
+            case 'm': megabytes = strtod (optarg, NULL); break;
+            case 'n': dither = 0; break;
+            default: {
+                printf("Usage: %s [-m <megabytes of input per kernel>] [-n (no dither)]\r\n", argv[0]);
+                return 1;
+            }
+        }
+    }
+
+    printf("PCM conversion: %.0f MB of input per kernel, dither %s\r\n", megabytes, dither ? "on" : "off");
+    int failed = 0;
+    // The input formats to each output format in stereo, then mono to stereo and the channels of stereo swapped.
+    for (int test = 0; test < PCM_FORMATS * 3 + 2; test++) {
+        const int in_format = test < PCM_FORMATS * 3 ? test / 3 : PCM_FORMAT_S24;
+        const int output_bits = test < PCM_FORMATS * 3 ? 16 + 8 * (test % 3) : 24;
+        const int in_channels = test == PCM_FORMATS * 3 ? 1 : 2;
+        static const int swapped[2] = {1, 0};
+
+        struct wav_header wh;
+        memset(&wh, 0, sizeof(wh));
+        wh.fmt_subchunk.audio_format = in_format >= PCM_FORMAT_F32 ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM;
+        wh.fmt_subchunk.num_channels = in_channels;
+        wh.fmt_subchunk.bits_per_sample = pcm_format_bytes (in_format) * 8;
+
+        struct pcm_converter pc;
+        if (pcm_converter_init (&pc, &wh, output_bits, test == PCM_FORMATS * 3 + 1 ? swapped : NULL, 2, dither) != 0) {
+            printf("Cannot set up the conversion of %s\r\n", pcm_format_name (in_format));
+            return 1;
+        }
+
+        const size_t frames = (size_t)(megabytes * 1e6) / pc.input_frame_bytes / PCM_BLOCK_FRAMES * PCM_BLOCK_FRAMES;
+        unsigned char* in = malloc(frames * pc.input_frame_bytes);
+        unsigned char* out = malloc(frames * pc.output_frame_bytes);
+        if (in == NULL || out == NULL) {
+            printf("Cannot allocate the buffers for %zu frames\r\n", frames);
+            return 1;
+        }
+        fill_input (in, frames * in_channels, in_format);
+        // Touch the output once so that page faults are not timed.
+        memset(out, 0, frames * pc.output_frame_bytes);
+
+        long long start_us = time_us ();
+        for (size_t f = 0; f < frames; f += PCM_BLOCK_FRAMES) {
+            pcm_convert (&pc, in + f * pc.input_frame_bytes, PCM_BLOCK_FRAMES, out + f * pc.output_frame_bytes);
+        }
+        long long elapsed_us = time_us () - start_us;
+        int errors = check (&pc, in, out, frames);
+
+        printf("%s x%d to s%d x2%s: %.2f GB/s in, %.2f GB/s out, %.0f Mframes/s%s\r\n", pcm_format_name (in_format),
+                    in_channels, output_bits, test == PCM_FORMATS * 3 + 1 ? " (swapped)" : "",
+                    (double)frames * pc.input_frame_bytes / 1e3 / (elapsed_us > 0 ? elapsed_us : 1),
+                    (double)frames * pc.output_frame_bytes / 1e3 / (elapsed_us > 0 ? elapsed_us : 1),
+                    (double)frames / (elapsed_us > 0 ? elapsed_us : 1), errors != 0 ? ", WRONG OUTPUT" : "");
+        failed |= errors != 0;
+
+        pcm_converter_free (&pc);
+        free(in);
+        free(out);
+    }
+
+    printf("%s\r\n", failed ? "FAILED" : "ok");
+    return failed;
+}
+
+//======================================================================================================================
+// A pseudo random signal over the whole range of the format, with float samples beyond full scale and a few NaN.
+void fill_input (unsigned char* in, size_t samples, int format) {
+    unsigned int seed = 1;
+    for (size_t i = 0; i < samples; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        if (format == PCM_FORMAT_F32) {
+            float value = i % 4099 == 0 ? NAN : (float)((int)seed / 1.9e9);
+            memcpy(in + i * 4, &value, 4);
+        } else if (format == PCM_FORMAT_F64) {
+            double value = i % 4099 == 0 ? NAN : (int)seed / 1.9e9;
+            memcpy(in + i * 8, &value, 8);
+        } else {
+            for (int byte = 0; byte < pcm_format_bytes (format); byte++) {
+                in[i * pcm_format_bytes (format) + byte] = (unsigned char)(seed >> (32 - 8 * pcm_format_bytes (format)
+                                                                                        + 8 * byte));
+            }
+        }
+    }
+}
+
+//======================================================================================================================
+// The conversions which do not match the reference.
+int check (const struct pcm_converter* pc, const unsigned char* in, const unsigned char* out, size_t frames) {
+    const int in_bytes = pcm_format_bytes (pc->input_format);
+    const int out_bytes = pcm_format_bytes (pc->output_format);
+    const int out_bits = 8 * out_bytes;
+    const double scale = ldexp(1.0, out_bits - 1);
+    const int widened = pc->input_format <= PCM_FORMAT_S32 && in_bytes <= out_bytes;
+    int errors = 0;
+    for (size_t f = 0; f < frames; f++) {
+        for (int c = 0; c < pc->output_channels; c++) {
+            const unsigned char* sample = in + f * pc->input_frame_bytes + pc->channel_of_output[c] * in_bytes;
+            const unsigned char* converted = out + f * pc->output_frame_bytes + c * out_bytes;
+            // The reference at the scale of the output.
+            double x;
+            if (pc->input_format == PCM_FORMAT_F32) {
+                float value;
+                memcpy(&value, sample, 4);
+                x = value != value ? 0.0 : value * scale;
+            } else if (pc->input_format == PCM_FORMAT_F64) {
+                double value;
+                memcpy(&value, sample, 8);
+                x = value != value ? 0.0 : value * scale;
+            } else {
+                unsigned int word = 0;
+                for (int byte = 0; byte < in_bytes; byte++) {
+                    word |= (unsigned int)sample[byte] << (8 * byte + 32 - 8 * in_bytes);
+                }
+                word ^= pc->input_format == PCM_FORMAT_U8 ? 0x80000000u : 0;
+                x = ldexp((int)word, out_bits - 32);
+            }
+            x = x > scale - 1.0 ? scale - 1.0 : x < -scale ? -scale : x;
+
+            unsigned int word = 0;
+            for (int byte = 0; byte < out_bytes; byte++) {
+                word |= (unsigned int)converted[byte] << (8 * byte + 32 - out_bits);
+            }
+            double y = ldexp((int)word, out_bits - 32);
+            // Exact when widened, else within the dither of the rounded value.
+            double tolerance = widened ? 0.0 : pc->dither_state != 0 ? 1.5 : 0.5;
+            errors += fabs(y - x) > tolerance;
+        }
+    }
+
+    return errors;
+}
+
+//======================================================================================================================
+long long time_us (void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
@@ -0,0 +1,288 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "pcm_convert.h"
+
+#define PCM_INLINE static inline __attribute__((always_inline))
+
+//======================================================================================================================
+int pcm_format_of (const struct wav_header* wh) {
+    const int bits = wh->fmt_subchunk.bits_per_sample;
+    if (wh->fmt_subchunk.audio_format == WAVE_FORMAT_PCM) {
+        return bits == 8 ? PCM_FORMAT_U8 : bits == 16 ? PCM_FORMAT_S16 : bits == 24 ? PCM_FORMAT_S24 :
+                    bits == 32 ? PCM_FORMAT_S32 : -1;
+    } else if (wh->fmt_subchunk.audio_format == WAVE_FORMAT_IEEE_FLOAT) {
+        return bits == 32 ? PCM_FORMAT_F32 : bits == 64 ? PCM_FORMAT_F64 : -1;
+    }
+
+    return -1;
+}
+
+const char* pcm_format_name (int format) {
+    static const char* names[PCM_FORMATS] = {"u8", "s16", "s24", "s32", "f32", "f64"};
+    return format >= 0 && format < PCM_FORMATS ? names[format] : "?";
+}
+
+int pcm_format_bytes (int format) {
+    static const int bytes[PCM_FORMATS] = {1, 2, 3, 4, 4, 8};
+    return bytes[format];
+}
+
+//======================================================================================================================
+// The samples. The formats are constants in each kernel so the switches compile away.
+PCM_INLINE int format_bytes (const int format) {
+    return format == PCM_FORMAT_U8 ? 1 : format == PCM_FORMAT_S16 ? 2 : format == PCM_FORMAT_S24 ? 3 :
+                format == PCM_FORMAT_F64 ? 8 : 4;
+}
+
+PCM_INLINE int format_bits (const int format) {
+    return format == PCM_FORMAT_U8 ? 8 : format == PCM_FORMAT_S16 ? 16 : format == PCM_FORMAT_S24 ? 24 : 32;
+}
+
+// An integer sample, left justified.
+PCM_INLINE int load_integer (const unsigned char* p, const int format) {
+    switch (format) {
+        case PCM_FORMAT_U8: return (int)((unsigned int)(p[0] ^ 0x80) << 24);
+        case PCM_FORMAT_S16: return (int)((unsigned int)p[0] << 16 | (unsigned int)p[1] << 24);
+        case PCM_FORMAT_S24: return (int)((unsigned int)p[0] << 8 | (unsigned int)p[1] << 16 |
+                                (unsigned int)p[2] << 24);
+        default: return (int)((unsigned int)p[0] | (unsigned int)p[1] << 8 | (unsigned int)p[2] << 16 |
+                                (unsigned int)p[3] << 24);
+    }
+}
+
+PCM_INLINE double load_float (const unsigned char* p, const int format) {
+    if (format == PCM_FORMAT_F32) {
+        float value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    } else {
+        double value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+}
+
+// A right justified sample.
+PCM_INLINE void store (unsigned char* p, int value, const int format) {
+    p[0] = (unsigned char)value;
+    p[1] = (unsigned char)(value >> 8);
+    if (format != PCM_FORMAT_S16) {
+        p[2] = (unsigned char)(value >> 16);
+    }
+    if (format == PCM_FORMAT_S32) {
+        p[3] = (unsigned char)(value >> 24);
+    }
+}
+
+// Two uniform 32-bit values (xorshift64*).
+PCM_INLINE unsigned long long next_random (unsigned long long* state) {
+    unsigned long long x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545f4914f6cdd1dULL;
+}
+
+//======================================================================================================================
+// A sample of the input converted to the output, right justified.
+PCM_INLINE int convert_sample (const unsigned char* sample, unsigned long long* state, const int dither,
+                        const int in_format, const int out_format) {
+    const int out_bits = format_bits (out_format);
+    // The integers narrowed to the output drop shift bits.
+    const int shift = 32 - out_bits;
+    const double scale = (double)(1u << (out_bits - 1));
+    if (in_format == PCM_FORMAT_F32 || in_format == PCM_FORMAT_F64) {
+        double x = load_float (sample, in_format) * scale + 0.5;
+        if (dither) {
+            // TPDF: the sum of two uniform values of 1 LSB.
+            unsigned long long r = next_random (state);
+            x += ((double)(r >> 32) + (double)(r & 0xffffffffu)) * (1.0 / 4294967296.0) - 1.0;
+        }
+        x = x != x ? 0.5 : x >= scale ? scale - 0.5 : x < -scale ? -scale : x;
+        // Rounded down: the offset value is positive and truncated.
+        return (int)((long long)(x + scale) - (long long)scale);
+    } else if (format_bits (in_format) > out_bits) {
+        long long x = load_integer (sample, in_format);
+        if (dither) {
+            unsigned long long r = next_random (state);
+            x += (long long)((r >> 32) >> out_bits) + (long long)((r & 0xffffffffu) >> out_bits) - (1LL << shift);
+        }
+        x = (x + (1LL << (shift - 1))) >> shift;
+        return (int)(x > (long long)scale - 1 ? (long long)scale - 1 : x < -(long long)scale ? -(long long)scale : x);
+    } else {
+        // Widened exactly (the arithmetic shift keeps the sign).
+        return load_integer (sample, in_format) >> shift;
+    }
+}
+
+// The channels in order are converted sample by sample, the others looked up in the channel map.
+PCM_INLINE void convert_frames (struct pcm_converter* pc, const unsigned char* in, size_t frames, unsigned char* out,
+                        const int in_format, const int out_format, const int in_order) {
+    const int in_bytes = format_bytes (in_format);
+    const int out_bytes = format_bytes (out_format);
+    const int dither = pc->dither_state != 0;
+    unsigned long long state = pc->dither_state;
+
+    if (in_order) {
+        const size_t samples = frames * (size_t)pc->output_channels;
+        for (size_t i = 0; i < samples; i++) {
+            store (out + i * out_bytes, convert_sample (in + i * in_bytes, &state, dither, in_format, out_format),
+                        out_format);
+        }
+    } else {
+        for (size_t f = 0; f < frames; f++) {
+            for (int c = 0; c < pc->output_channels; c++) {
+                store (out + c * out_bytes, convert_sample (in + pc->channel_of_output[c] * in_bytes, &state, dither,
+                            in_format, out_format), out_format);
+            }
+            in += pc->input_frame_bytes;
+            out += pc->output_frame_bytes;
+        }
+    }
+
+    if (dither) {
+        pc->dither_state = state;
+    }
+}
+
+#define PCM_KERNEL(IN, OUT) \
+    static void kernel_##IN##_##OUT (struct pcm_converter* pc, const unsigned char* in, size_t frames, \
+                        unsigned char* out) { \
+        convert_frames (pc, in, frames, out, PCM_FORMAT_##IN, PCM_FORMAT_##OUT, 1); \
+    } \
+    static void kernel_##IN##_##OUT##_mapped (struct pcm_converter* pc, const unsigned char* in, size_t frames, \
+                        unsigned char* out) { \
+        convert_frames (pc, in, frames, out, PCM_FORMAT_##IN, PCM_FORMAT_##OUT, 0); \
+    }
+#define PCM_KERNELS(IN) PCM_KERNEL(IN, S16) PCM_KERNEL(IN, S24) PCM_KERNEL(IN, S32)
+
+PCM_KERNELS(U8)
+PCM_KERNELS(S16)
+PCM_KERNELS(S24)
+PCM_KERNELS(S32)
+PCM_KERNELS(F32)
+PCM_KERNELS(F64)
+
+// [input format][output format - PCM_FORMAT_S16][channels in order, mapped]
+static const pcm_kernel_fn kernels[PCM_FORMATS][3][2] = {
+    {{kernel_U8_S16, kernel_U8_S16_mapped}, {kernel_U8_S24, kernel_U8_S24_mapped},
+        {kernel_U8_S32, kernel_U8_S32_mapped}},
+    {{kernel_S16_S16, kernel_S16_S16_mapped}, {kernel_S16_S24, kernel_S16_S24_mapped},
+        {kernel_S16_S32, kernel_S16_S32_mapped}},
+    {{kernel_S24_S16, kernel_S24_S16_mapped}, {kernel_S24_S24, kernel_S24_S24_mapped},
+        {kernel_S24_S32, kernel_S24_S32_mapped}},
+    {{kernel_S32_S16, kernel_S32_S16_mapped}, {kernel_S32_S24, kernel_S32_S24_mapped},
+        {kernel_S32_S32, kernel_S32_S32_mapped}},
+    {{kernel_F32_S16, kernel_F32_S16_mapped}, {kernel_F32_S24, kernel_F32_S24_mapped},
+        {kernel_F32_S32, kernel_F32_S32_mapped}},
+    {{kernel_F64_S16, kernel_F64_S16_mapped}, {kernel_F64_S24, kernel_F64_S24_mapped},
+        {kernel_F64_S32, kernel_F64_S32_mapped}}
+};
+
+static void kernel_copy (struct pcm_converter* pc, const unsigned char* in, size_t frames, unsigned char* out) {
+    memcpy(out, in, frames * pc->output_frame_bytes);
+}
+
+//======================================================================================================================
+int pcm_converter_init (struct pcm_converter* pc, const struct wav_header* wh, int output_bits, const int* channel_map,
+                        int output_channels, int dither) {
+    memset(pc, 0, sizeof(*pc));
+    pc->input_format = pcm_format_of (wh);
+    pc->output_format = output_bits == 16 ? PCM_FORMAT_S16 : output_bits == 24 ? PCM_FORMAT_S24 :
+                            output_bits == 32 ? PCM_FORMAT_S32 : -1;
+    pc->input_channels = wh->fmt_subchunk.num_channels;
+    pc->output_channels = output_channels;
+    if (pc->input_format < 0 || pc->output_format < 0 || pc->input_channels < 1 ||
+            pc->input_channels > PCM_MAX_CHANNELS || output_channels < 1 || output_channels > PCM_MAX_CHANNELS) {
+        printf("Unsupported conversion: %d channels of %d bits (format %d) to %d channels of %d bits\r\n",
+                    pc->input_channels, wh->fmt_subchunk.bits_per_sample, wh->fmt_subchunk.audio_format,
+                    output_channels, output_bits);
+        return -1;
+    }
+
+    int identity = output_channels == pc->input_channels;
+    for (int c = 0; c < output_channels; c++) {
+        pc->channel_of_output[c] = channel_map != NULL ? channel_map[c] : pc->input_channels == 1 ? 0 : c;
+        if (pc->channel_of_output[c] < 0 || pc->channel_of_output[c] >= pc->input_channels) {
+            printf("Invalid channel %d for output channel %d (%d channels)\r\n", pc->channel_of_output[c], c,
+                        pc->input_channels);
+            return -1;
+        }
+        identity &= pc->channel_of_output[c] == c;
+    }
+
+    pc->input_frame_bytes = (unsigned int)(pc->input_channels * pcm_format_bytes (pc->input_format));
+    pc->output_frame_bytes = (unsigned int)(output_channels * pcm_format_bytes (pc->output_format));
+    const int narrowed = pc->input_format >= PCM_FORMAT_F32 || pc->input_format > pc->output_format;
+    pc->kernel = identity && pc->input_format == pc->output_format ? kernel_copy :
+                    kernels[pc->input_format][pc->output_format - PCM_FORMAT_S16][identity ? 0 : 1];
+    // Dither is only added when bits are dropped.
+    pc->dither_state = dither && narrowed ? 0x9e3779b97f4a7c15ULL : 0;
+    pc->file_frames = malloc((size_t)PCM_BLOCK_FRAMES * pc->input_frame_bytes);
+    return pc->file_frames != NULL ? 0 : -2;
+}
+
+void pcm_converter_free (struct pcm_converter* pc) {
+    free(pc->file_frames);
+    pc->file_frames = NULL;
+}
+
+//======================================================================================================================
+void pcm_stream_header (const struct pcm_converter* pc, struct wav_header* wh) {
+    unsigned int frames = (unsigned int)wh->data_subchunk.subchunk2_size / pc->input_frame_bytes;
+    int identity = pc->output_channels == pc->input_channels;
+    for (int c = 0; c < pc->output_channels; c++) {
+        identity &= pc->channel_of_output[c] == c;
+    }
+
+    wh->fmt_subchunk.audio_format = WAVE_FORMAT_PCM;
+    wh->fmt_subchunk.num_channels = pc->output_channels;
+    wh->fmt_subchunk.bits_per_sample = pcm_format_bytes (pc->output_format) * 8;
+    wh->fmt_subchunk.block_align = (int)pc->output_frame_bytes;
+    wh->fmt_subchunk.byte_rate = wh->fmt_subchunk.sample_rate * (int)pc->output_frame_bytes;
+    // The speaker positions hold for the channels in order only.
+    wh->fmt_subchunk.channel_mask = identity ? wh->fmt_subchunk.channel_mask : 0;
+    wh->data_subchunk.subchunk2_size = (int)(frames * pc->output_frame_bytes);
+}
+
+//======================================================================================================================
+size_t pcm_convert (struct pcm_converter* pc, const unsigned char* in, size_t frames, unsigned char* out) {
+    pc->kernel (pc, in, frames, out);
+    return frames * pc->output_frame_bytes;
+}
+
+unsigned int read_pcm_data (FILE* fp, struct pcm_converter* pc, unsigned char* buffer, unsigned int length) {
+    unsigned int bytes = 0;
+    while (length - bytes >= pc->output_frame_bytes) {
+        size_t frames = (length - bytes) / pc->output_frame_bytes;
+        frames = frames < PCM_BLOCK_FRAMES ? frames : PCM_BLOCK_FRAMES;
+        frames = fread(pc->file_frames, pc->input_frame_bytes, frames, fp);
+        if (frames == 0) {
+            break;
+        }
+
+        bytes += (unsigned int)pcm_convert (pc, pc->file_frames, frames, buffer + bytes);
+    }
+
+    return bytes;
+}
@@ -0,0 +1,91 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+#ifndef PCM_CONVERT_H
+#define PCM_CONVERT_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "wav_reader.h"
+
+/***********************************************************************************************************************
+ * The conversion of the PCM frames of WAV files to the formats of the FPGA (16, 24 or 32-bit little endian integers):
+ * 8-bit unsigned, 16, 24 and 32-bit integers and IEEE float (32 and 64-bit) samples, with the channels of the output
+ * frames taken from any channel of the file (mono to stereo duplicates the channel).
+ *
+ * Integer samples are widened exactly. Float samples (full scale +/-1.0) and integers narrowed to fewer bits are
+ * requantized with TPDF dither of +/-1 LSB of the output (two uniform values of a xorshift generator) and rounded,
+ * then clipped to the output range; NaN gives silence.
+ *
+ * Each pair of input and output formats has its own kernel: the copy loop is an inline function of the formats that
+ * each kernel calls with constants, so that the per sample format switches are resolved at compile time. A plain copy
+ * is used when nothing changes (see pcm_bench.c).
+ **********************************************************************************************************************/
+
+#define WAVE_FORMAT_PCM         1
+#define WAVE_FORMAT_IEEE_FLOAT  3
+
+// The sample formats
+#define PCM_FORMAT_U8           0
+#define PCM_FORMAT_S16          1
+#define PCM_FORMAT_S24          2
+#define PCM_FORMAT_S32          3
+#define PCM_FORMAT_F32          4
+#define PCM_FORMAT_F64          5
+#define PCM_FORMATS             6
+
+#define PCM_MAX_CHANNELS        32
+// The file frames converted at once
+#define PCM_BLOCK_FRAMES        1024
+
+struct pcm_converter;
+typedef void (*pcm_kernel_fn) (struct pcm_converter* pc, const unsigned char* in, size_t frames, unsigned char* out);
+
+struct pcm_converter {
+    int input_format;
+    int output_format;                          // PCM_FORMAT_S16, S24 or S32
+    int input_channels;
+    int output_channels;
+    unsigned int input_frame_bytes;
+    unsigned int output_frame_bytes;
+    int channel_of_output[PCM_MAX_CHANNELS];    // The channel of the file of each output channel
+    unsigned long long dither_state;            // The xorshift state, 0 without dither
+    pcm_kernel_fn kernel;
+    unsigned char* file_frames;                 // PCM_BLOCK_FRAMES frames read from the file
+};
+
+// The sample format of a WAV file, -1 if it is not supported.
+int pcm_format_of (const struct wav_header* wh);
+// The name of a sample format ("u8", "s16", "s24", "s32", "f32" or "f64").
+const char* pcm_format_name (int format);
+// The bytes of a sample of a format.
+int pcm_format_bytes (int format);
+
+// Sets up the conversion of the frames of a file to output_channels channels of output_bits (16, 24 or 32). The
+// channel map gives the channel of the file of each output channel (NULL: the channels in order, mono duplicated to
+// stereo when output_channels is 2). Returns a negative value for unsupported formats or maps.
+int pcm_converter_init (struct pcm_converter* pc, const struct wav_header* wh, int output_bits, const int* channel_map,
+                        int output_channels, int dither);
+void pcm_converter_free (struct pcm_converter* pc);
+// Describes the converted stream: the header of the file with the output format and channels.
+void pcm_stream_header (const struct pcm_converter* pc, struct wav_header* wh);
+// Converts frames file frames. Returns the bytes written to out.
+size_t pcm_convert (struct pcm_converter* pc, const unsigned char* in, size_t frames, unsigned char* out);
+// Reads and converts up to length bytes (whole frames) of output frames. Returns the bytes written to buffer.
+unsigned int read_pcm_data (FILE* fp, struct pcm_converter* pc, unsigned char* buffer, unsigned int length);
+
+#endif // PCM_CONVERT_H
@@ -0,0 +1,425 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "resampler.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RESAMPLER_X86
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RESAMPLER_NEON
+#endif
+
+#define RESAMPLER_BASE_TAPS     128
+#define RESAMPLER_MAX_TAPS      1024
+#define RESAMPLER_KAISER_BETA   12.0
+#define RESAMPLER_CUTOFF        0.47
+
+static void* worker_main (void* context);
+static void convert_channels (struct resampler* r, int first);
+static double bessel_i0 (double x);
+
+//======================================================================================================================
+// The dot products. The samples are not aligned.
+float resampler_dot_scalar (const float* coefficients, const float* samples, unsigned int taps) {
+    float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for (unsigned int t = 0; t < taps; t += 4) {
+        sum[0] += coefficients[t] * samples[t];
+        sum[1] += coefficients[t + 1] * samples[t + 1];
+        sum[2] += coefficients[t + 2] * samples[t + 2];
+        sum[3] += coefficients[t + 3] * samples[t + 3];
+    }
+    return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+
+#ifdef RESAMPLER_X86
+static float dot_sse (const float* coefficients, const float* samples, unsigned int taps) {
+    __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+    for (unsigned int t = 0; t < taps; t += 8) {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(coefficients + t), _mm_loadu_ps(samples + t)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(coefficients + t + 4), _mm_loadu_ps(samples + t + 4)));
+    }
+    sum0 = _mm_add_ps(sum0, sum1);
+    sum0 = _mm_add_ps(sum0, _mm_movehl_ps(sum0, sum0));
+    sum0 = _mm_add_ss(sum0, _mm_shuffle_ps(sum0, sum0, 1));
+    return _mm_cvtss_f32(sum0);
+}
+
+__attribute__((target("avx2,fma")))
+static float dot_avx2 (const float* coefficients, const float* samples, unsigned int taps) {
+    __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+    for (unsigned int t = 0; t < taps; t += 16) {
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(coefficients + t), _mm256_loadu_ps(samples + t), sum0);
+        sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(coefficients + t + 8), _mm256_loadu_ps(samples + t + 8), sum1);
+    }
+    sum0 = _mm256_add_ps(sum0, sum1);
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum0), _mm256_extractf128_ps(sum0, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+#endif
+
+#ifdef RESAMPLER_NEON
+static float dot_neon (const float* coefficients, const float* samples, unsigned int taps) {
+    float32x4_t sum0 = vdupq_n_f32(0.0f), sum1 = vdupq_n_f32(0.0f);
+    for (unsigned int t = 0; t < taps; t += 8) {
+        sum0 = vmlaq_f32(sum0, vld1q_f32(coefficients + t), vld1q_f32(samples + t));
+        sum1 = vmlaq_f32(sum1, vld1q_f32(coefficients + t + 4), vld1q_f32(samples + t + 4));
+    }
+    sum0 = vaddq_f32(sum0, sum1);
+    float32x2_t sum = vadd_f32(vget_low_f32(sum0), vget_high_f32(sum0));
+    return vget_lane_f32(vpadd_f32(sum, sum), 0);
+}
+#endif
+
+const char* resampler_simd (void) {
+#ifdef RESAMPLER_X86
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ? "AVX2" : "SSE";
+#elif defined(RESAMPLER_NEON)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
+
+//======================================================================================================================
+int resampler_init (struct resampler* r, unsigned int input_rate, unsigned int output_rate, int channels,
+                        int bits_per_sample, int threads) {
+    memset(r, 0, sizeof(*r));
+    unsigned int a = input_rate, b = output_rate;
+    while (b != 0) {
+        unsigned int t = a % b;
+        a = b;
+        b = t;
+    }
+    if (input_rate == 0 || output_rate == 0 || channels < 1 || channels > RESAMPLER_MAX_CHANNELS ||
+            (bits_per_sample != 16 && bits_per_sample != 24 && bits_per_sample != 32)) {
+        return -1;
+    }
+
+    r->input_rate = input_rate;
+    r->output_rate = output_rate;
+    r->phases = output_rate / a;
+    r->step = input_rate / a;
+    r->branches = r->phases > RESAMPLER_MAX_PHASES ? RESAMPLER_MAX_PHASES : r->phases;
+    r->channels = channels;
+    r->sample_bytes = bits_per_sample / 8;
+
+    // More taps for as long a filter at the input rate when the rate goes down.
+    unsigned int taps = (unsigned int)(((unsigned long long)RESAMPLER_BASE_TAPS * r->step + r->phases - 1) / r->phases);
+    taps = taps < RESAMPLER_BASE_TAPS ? RESAMPLER_BASE_TAPS : (taps + 15) / 16 * 16;
+    if (taps > RESAMPLER_MAX_TAPS) {
+        return -1;
+    }
+    r->taps = taps;
+
+    // The prototype: tap k of branch p is tap p + k x B of the filter at B (branches) times the input rate. Branch B,
+    // one input sample after branch 0, is the upper end of the interpolation from branch B - 1.
+    size_t length = (size_t)r->branches * taps;
+    double center = (length - 1) / 2.0;
+    double cutoff = RESAMPLER_CUTOFF * (input_rate < output_rate ? input_rate : output_rate) /
+                        ((double)r->branches * input_rate);
+    r->coefficients = malloc((length + taps) * sizeof(float));
+    r->file_frames = malloc((size_t)RESAMPLER_BLOCK * channels * r->sample_bytes);
+    if (r->coefficients == NULL || r->file_frames == NULL) {
+        resampler_free (r);
+        return -2;
+    }
+    for (unsigned int p = 0; p <= r->branches; p++) {
+        double sum = 0.0;
+        float* phase = r->coefficients + (size_t)p * taps;
+        for (unsigned int k = 0; k < taps; k++) {
+            double x = p + (double)k * r->branches - center;
+            double w = 1.0 - (x / (center + 0.5)) * (x / (center + 0.5));
+            double h = x == 0.0 ? 1.0 : sin(2.0 * M_PI * cutoff * x) / (2.0 * M_PI * cutoff * x);
+            h *= bessel_i0 (RESAMPLER_KAISER_BETA * sqrt(w > 0.0 ? w : 0.0)) / bessel_i0 (RESAMPLER_KAISER_BETA);
+            // The newest sample (k = 0) is the last one of the dot product.
+            phase[taps - 1 - k] = (float)h;
+            sum += h;
+        }
+        for (unsigned int k = 0; k < taps; k++) {
+            phase[k] = (float)(phase[k] / sum);
+        }
+    }
+
+    for (int c = 0; c < channels; c++) {
+        r->input[c] = malloc((taps + RESAMPLER_BLOCK) * sizeof(float));
+        r->output[c] = malloc(RESAMPLER_BLOCK * sizeof(float));
+        if (r->input[c] == NULL || r->output[c] == NULL) {
+            resampler_free (r);
+            return -2;
+        }
+    }
+
+    r->dot = resampler_dot_scalar;
+#ifdef RESAMPLER_X86
+    r->dot = strcmp(resampler_simd (), "AVX2") == 0 ? dot_avx2 : dot_sse;
+#elif defined(RESAMPLER_NEON)
+    r->dot = dot_neon;
+#endif
+    resampler_reset (r);
+
+    r->threads = threads < 1 ? 1 : threads > channels ? channels : threads > RESAMPLER_MAX_THREADS ?
+                        RESAMPLER_MAX_THREADS : threads;
+    pthread_mutex_init(&r->mutex, NULL);
+    pthread_cond_init(&r->start, NULL);
+    pthread_cond_init(&r->done, NULL);
+    for (int w = 1; w < r->threads; w++) {
+        r->workers[w].r = r;
+        r->workers[w].index = w;
+        if (pthread_create(&r->workers[w].thread, NULL, worker_main, &r->workers[w]) != 0) {
+            r->threads = w;
+            resampler_free (r);
+            return -3;
+        }
+    }
+
+    return 0;
+}
+
+//======================================================================================================================
+void resampler_free (struct resampler* r) {
+    if (r->threads > 0) {
+        pthread_mutex_lock(&r->mutex);
+        r->quit = 1;
+        pthread_cond_broadcast(&r->start);
+        pthread_mutex_unlock(&r->mutex);
+        for (int w = 1; w < r->threads; w++) {
+            pthread_join(r->workers[w].thread, NULL);
+        }
+        pthread_mutex_destroy(&r->mutex);
+        pthread_cond_destroy(&r->start);
+        pthread_cond_destroy(&r->done);
+        r->threads = 0;
+    }
+
+    for (int c = 0; c < RESAMPLER_MAX_CHANNELS; c++) {
+        free(r->input[c]);
+        free(r->output[c]);
+        r->input[c] = NULL;
+        r->output[c] = NULL;
+    }
+    free(r->coefficients);
+    free(r->file_frames);
+    r->coefficients = NULL;
+    r->file_frames = NULL;
+}
+
+//======================================================================================================================
+void resampler_reset (struct resampler* r) {
+    // taps - 1 samples of silence come before the first input sample.
+    for (int c = 0; c < r->channels; c++) {
+        memset(r->input[c], 0, (r->taps - 1) * sizeof(float));
+    }
+    r->filled = r->taps - 1;
+    r->next = r->taps - 1;
+    r->phase = 0;
+    r->padded = 0;
+}
+
+//======================================================================================================================
+size_t resampler_write (struct resampler* r, const unsigned char* in, size_t frames) {
+    // Drop the samples older than the taps of the next output frame (which may be ahead of the input when the rate
+    // goes down).
+    unsigned int first = r->next - (r->taps - 1);
+    first = first < r->filled ? first : r->filled;
+    if (first > 0) {
+        for (int c = 0; c < r->channels; c++) {
+            memmove(r->input[c], r->input[c] + first, (r->filled - first) * sizeof(float));
+        }
+        r->filled -= first;
+        r->next -= first;
+    }
+
+    size_t space = r->taps + RESAMPLER_BLOCK - r->filled;
+    frames = frames < space ? frames : space;
+    const int frame_bytes = r->channels * r->sample_bytes;
+    for (int c = 0; c < r->channels; c++) {
+        float* samples = r->input[c] + r->filled;
+        const unsigned char* sample = in + c * r->sample_bytes;
+        switch (r->sample_bytes) {
+            case 2: {
+                for (size_t i = 0; i < frames; i++, sample += frame_bytes) {
+                    samples[i] = (short)(sample[0] | sample[1] << 8) * (1.0f / 32768.0f);
+                }
+                break;
+            }
+            case 3: {
+                for (size_t i = 0; i < frames; i++, sample += frame_bytes) {
+                    samples[i] = (int)((unsigned int)(sample[0] << 8 | sample[1] << 16 | sample[2] << 24)) *
+                                        (1.0f / 2147483648.0f);
+                }
+                break;
+            }
+            default: {
+                for (size_t i = 0; i < frames; i++, sample += frame_bytes) {
+                    samples[i] = (int)((unsigned int)sample[0] | sample[1] << 8 | sample[2] << 16 |
+                                        (unsigned int)sample[3] << 24) * (1.0f / 2147483648.0f);
+                }
+                break;
+            }
+        }
+    }
+    r->filled += (unsigned int)frames;
+    return frames;
+}
+
+//======================================================================================================================
+size_t resampler_read (struct resampler* r, unsigned char* out, size_t frames) {
+    size_t done = 0;
+    while (done < frames) {
+        // The input samples and phases of a block of output frames.
+        unsigned int n = 0;
+        while (n < RESAMPLER_BLOCK && done + n < frames && r->next < r->filled) {
+            // Phase p of L is at p x B / L branches (the branch itself when B is L).
+            unsigned long long position = (unsigned long long)r->phase * r->branches;
+            r->block_start[n] = r->next - (r->taps - 1);
+            r->block_phase[n] = (unsigned int)(position / r->phases);
+            r->block_fraction[n] = (float)(position % r->phases) / (float)r->phases;
+            r->phase += r->step;
+            r->next += r->phase / r->phases;
+            r->phase %= r->phases;
+            n++;
+        }
+        if (n == 0) {
+            break;
+        }
+
+        // The workers take their channels of the block and the calling thread the first ones.
+        r->block_frames = n;
+        if (r->threads > 1) {
+            pthread_mutex_lock(&r->mutex);
+            r->pending = r->threads - 1;
+            r->generation++;
+            pthread_cond_broadcast(&r->start);
+            pthread_mutex_unlock(&r->mutex);
+        }
+        convert_channels (r, 0);
+        if (r->threads > 1) {
+            pthread_mutex_lock(&r->mutex);
+            while (r->pending > 0) {
+                pthread_cond_wait(&r->done, &r->mutex);
+            }
+            pthread_mutex_unlock(&r->mutex);
+        }
+
+        // Rounded and clipped to the sample size.
+        const int frame_bytes = r->channels * r->sample_bytes;
+        const double scale = r->sample_bytes == 2 ? 32768.0 : r->sample_bytes == 3 ? 8388608.0 : 2147483648.0;
+        for (int c = 0; c < r->channels; c++) {
+            unsigned char* sample = out + done * frame_bytes + c * r->sample_bytes;
+            for (unsigned int i = 0; i < n; i++, sample += frame_bytes) {
+                double value = floor(r->output[c][i] * scale + 0.5);
+                value = value > scale - 1.0 ? scale - 1.0 : value < -scale ? -scale : value;
+                int word = (int)value;
+                for (int byte = 0; byte < r->sample_bytes; byte++) {
+                    sample[byte] = (unsigned char)(word >> (8 * byte));
+                }
+            }
+        }
+        done += n;
+    }
+
+    return done;
+}
+
+//======================================================================================================================
+unsigned int read_resampled_data (resampler_source_fn source, void* context, struct resampler* r,
+                        unsigned char* buffer, unsigned int length) {
+    const unsigned int frame_bytes = (unsigned int)(r->channels * r->sample_bytes);
+    unsigned int frames = length / frame_bytes, done = 0;
+    while (done < frames) {
+        done += (unsigned int)resampler_read (r, buffer + done * frame_bytes, frames - done);
+        if (done == frames) {
+            break;
+        }
+
+        size_t read = source (context, r->file_frames, RESAMPLER_BLOCK);
+        if (read == 0 && r->padded) {
+            break;
+        } else if (read == 0) {
+            // The last input samples reach the output through the second half of the taps.
+            memset(r->file_frames, 0, (size_t)RESAMPLER_BLOCK * frame_bytes);
+            read = r->taps / 2 < RESAMPLER_BLOCK ? r->taps / 2 : RESAMPLER_BLOCK;
+            r->padded = 1;
+        }
+
+        // The input is used up so the block fits.
+        resampler_write (r, r->file_frames, read);
+    }
+
+    return done * frame_bytes;
+}
+
+//======================================================================================================================
+static void convert_channels (struct resampler* r, int first) {
+    for (int c = first; c < r->channels; c += r->threads) {
+        const float* input = r->input[c];
+        float* output = r->output[c];
+        for (unsigned int i = 0; i < r->block_frames; i++) {
+            const float* coefficients = r->coefficients + (size_t)r->block_phase[i] * r->taps;
+            output[i] = r->dot (coefficients, input + r->block_start[i], r->taps);
+            if (r->block_fraction[i] != 0.0f) {
+                float next = r->dot (coefficients + r->taps, input + r->block_start[i], r->taps);
+                output[i] += r->block_fraction[i] * (next - output[i]);
+            }
+        }
+    }
+}
+
+static void* worker_main (void* context) {
+    struct resampler_worker* worker = context;
+    struct resampler* r = worker->r;
+    unsigned int generation = 0;
+    for (;;) {
+        pthread_mutex_lock(&r->mutex);
+        while (r->generation == generation && !r->quit) {
+            pthread_cond_wait(&r->start, &r->mutex);
+        }
+        generation = r->generation;
+        int quit = r->quit;
+        pthread_mutex_unlock(&r->mutex);
+        if (quit) {
+            return NULL;
+        }
+
+        convert_channels (r, worker->index);
+
+        pthread_mutex_lock(&r->mutex);
+        if (--r->pending == 0) {
+            pthread_cond_signal(&r->done);
+        }
+        pthread_mutex_unlock(&r->mutex);
+    }
+}
+
+//======================================================================================================================
+// The modified Bessel function of the first kind, order 0 (for the Kaiser window).
+static double bessel_i0 (double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 50 && term > sum * 1e-17; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
@@ -0,0 +1,115 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <pthread.h>
+
+/***********************************************************************************************************************
+ * The host sample rate converter, for the streams the FPGA cannot convert (see hdl_audio/asrc.sv): multichannel PCM,
+ * recordings (the I2S input runs at the output rate) and rates outside of 8000Hz to 384000Hz. It converts PCM frames of
+ * the file to a rate of the FPGA before they are packetized.
+ *
+ * The converter is a rational polyphase filter: the output rate is L / M times the input rate (reduced) and output
+ * frame n is the dot product of phase (n x M) mod L of the prototype with the input samples up to (n x M) / L. The
+ * prototype is a Kaiser windowed sinc (beta 12) at L times the input rate, cut off at 0.47 of the lower of the two
+ * rates, with 128 taps per phase (times the decimation ratio when the rate goes down). Each phase is normalized to a
+ * gain of 1. When L is above RESAMPLER_MAX_PHASES (e.g. 44056Hz or 47999Hz to 48000Hz) the prototype has
+ * RESAMPLER_MAX_PHASES branches instead and, as in asrc.sv, phase p of L falls between two branches: the output is
+ * interpolated linearly between the dot products of both branches.
+ *
+ * The samples are converted to float and kept per channel. The dot products run with AVX2 and FMA when the CPU
+ * supports them, SSE otherwise on x86 and NEON on ARM (resampler_simd). The channels are shared by up to
+ * RESAMPLER_MAX_THREADS threads: the calling thread and workers which wait for each block of output frames.
+ **********************************************************************************************************************/
+
+#define RESAMPLER_MAX_THREADS   8
+#define RESAMPLER_MAX_CHANNELS  8
+// The largest number of branches of the prototype (above it the phases are interpolated between branches)
+#define RESAMPLER_MAX_PHASES    2048
+// The output frames computed at once and the input frames kept per channel besides the taps.
+#define RESAMPLER_BLOCK         2048
+
+struct resampler;
+
+struct resampler_worker {
+    pthread_t thread;
+    struct resampler* r;
+    int index;                      // The channels of the worker are index, index + threads, ...
+};
+
+struct resampler {
+    unsigned int input_rate;
+    unsigned int output_rate;
+    unsigned int phases;            // L
+    unsigned int step;              // M
+    unsigned int branches;          // The phases of the prototype: L, or RESAMPLER_MAX_PHASES when L is above it
+    unsigned int taps;              // Per phase, a multiple of 16
+    int channels;
+    int sample_bytes;               // 2, 3 or 4 bytes of little endian PCM
+    float* coefficients;            // [branches + 1][taps], in the order of the input samples (oldest first)
+    float* input[RESAMPLER_MAX_CHANNELS];   // taps + RESAMPLER_BLOCK samples per channel
+    float* output[RESAMPLER_MAX_CHANNELS];  // RESAMPLER_BLOCK samples per channel
+    unsigned int filled;            // The samples in input
+    unsigned int next;              // The newest input sample of the next output frame
+    unsigned int phase;             // The phase of the next output frame
+    unsigned int block_start[RESAMPLER_BLOCK];  // The first input sample, the branch and the fraction of the way to
+    unsigned int block_phase[RESAMPLER_BLOCK];  // the next branch of each frame of a block
+    float block_fraction[RESAMPLER_BLOCK];
+    unsigned int block_frames;
+    float (*dot) (const float* coefficients, const float* samples, unsigned int taps);
+    unsigned char* file_frames;     // The frames read from the source
+    int padded;                     // The end of the file was padded with silence
+
+    int threads;
+    struct resampler_worker workers[RESAMPLER_MAX_THREADS];
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned int generation;        // Incremented for each block given to the workers
+    int pending;                    // The workers still computing the block
+    int quit;
+};
+
+// Sets up the conversion of PCM frames of channels x bits_per_sample (16, 24 or 32) from input_rate to output_rate on
+// up to threads threads (at most the channels and RESAMPLER_MAX_THREADS). Returns a negative value if the rates or the
+// format are not supported, or on allocation or thread errors.
+int resampler_init (struct resampler* r, unsigned int input_rate, unsigned int output_rate, int channels,
+                        int bits_per_sample, int threads);
+void resampler_free (struct resampler* r);
+// Forgets the input (e.g. after a seek): the output restarts from silence.
+void resampler_reset (struct resampler* r);
+// Takes up to frames PCM frames. Returns the frames taken.
+size_t resampler_write (struct resampler* r, const unsigned char* in, size_t frames);
+// Converts up to frames PCM frames from the frames taken. Returns the frames written to out.
+size_t resampler_read (struct resampler* r, unsigned char* out, size_t frames);
+// Reads up to count PCM frames of the stream (e.g. from a file, converted or not). Returns the frames read, 0 at its
+// end.
+typedef size_t (*resampler_source_fn) (void* context, unsigned char* frames, size_t count);
+// Reads up to length bytes (whole frames) of converted frames from the source, padded with silence at its end. Returns
+// the bytes written to buffer.
+unsigned int read_resampled_data (resampler_source_fn source, void* context, struct resampler* r,
+                        unsigned char* buffer, unsigned int length);
+// The instruction set of the dot products ("AVX2", "SSE", "NEON" or "scalar").
+const char* resampler_simd (void);
+
+// The dot product of taps (a multiple of 16) coefficients and samples, without SIMD: the reference of the benchmark.
+float resampler_dot_scalar (const float* coefficients, const float* samples, unsigned int taps);
+
+#endif // RESAMPLER_H
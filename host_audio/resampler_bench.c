@@ -0,0 +1,243 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "resampler.h"
+//======================================================================================================================
+// Benchmark of the host sample rate converter. For each pair of rates a -6dBFS tone per channel (997Hz on the even
+// channels, 0.42 x the lower rate on the odd ones) is converted from memory by the scalar reference on one thread, then
+// with SIMD on one thread and on -j threads. The rates are input frames per second and times real time.
+//
+// THD+N is measured against the reference tone: a sine of the output frequency (with its phase and the DC offset) is
+// fitted by least squares to the output after the transient and THD+N is the RMS of the residue over the RMS of the
+// fit. The benchmark fails when a gain is off by more than 0.01dB or THD+N is above -110dB (-85dB at 16 bits, the
+// quantization of the output is at -98dB), or when the SIMD output
+// differs from the scalar output by more than -120dBFS (the sums are in another order).
+//======================================================================================================================
+long long time_us (void);
+size_t convert (struct resampler* r, const unsigned char* in, size_t in_frames, unsigned char* out, size_t out_frames);
+double thd_n (const unsigned char* out, size_t frames, int channels, int channel, int sample_bytes, double frequency,
+                        double* gain_db);
+
+static const unsigned int rate_pairs[][2] = {
+    {44100, 48000}, {48000, 44100}, {32000, 44100}, {22050, 48000}, {11025, 44100}, {88200, 96000},
+    {705600, 352800}, {768000, 384000}, {8000, 48000}, {44056, 48000}, {47999, 48000}
+};
+
+//======================================================================================================================
+int main(int argc, char *argv[]) {
+    int opt;
+    unsigned int input_rate = 0, output_rate = 0;
+    int channels = 2, bits = 24, threads = 2;
+    double seconds = 10.0;
+    while ((opt = getopt(argc, argv, "i:o:c:b:j:s:h")) != -1) {
+        switch (opt) {
+            case 'i': input_rate = strtoul (optarg, NULL, 10); break;
+            case 'o': output_rate = strtoul (optarg, NULL, 10); break;
+            case 'c': channels = strtol (optarg, NULL, 10); break;
+            case 'b': bits = strtol (optarg, NULL, 10); break;
+            case 'j': threads = strtol (optarg, NULL, 10); break;
+            case 's': seconds = strtod (optarg, NULL); break;
+            default: {
+                printf("Usage: %s [-i <input rate> -o <output rate>] [-c <channels>] [-b <bits 16|24|32>] "
+                            "[-j <threads>] [-s <seconds>]\r\n", argv[0]);
+                return 1;
+            }
+        }
+    }
+
+    const size_t pairs = input_rate != 0 && output_rate != 0 ? 1 : sizeof(rate_pairs) / sizeof(rate_pairs[0]);
+    const int sample_bytes = bits / 8;
+    const int frame_bytes = channels * sample_bytes;
+    printf("Sample rate converter: %d channels of %d bits, %.1f s per pair, SIMD: %s, %d threads\r\n", channels, bits,
+                seconds, resampler_simd (), threads);
+
+    int failed = 0;
+    for (size_t pair = 0; pair < pairs; pair++) {
+        unsigned int in_rate = pairs == 1 ? input_rate : rate_pairs[pair][0];
+        unsigned int out_rate = pairs == 1 ? output_rate : rate_pairs[pair][1];
+        size_t in_frames = (size_t)(seconds * in_rate);
+        size_t out_frames = (size_t)((double)in_frames * out_rate / in_rate) + 1;
+        unsigned char* in = malloc(in_frames * frame_bytes);
+        unsigned char* scalar_out = malloc(out_frames * frame_bytes);
+        unsigned char* simd_out = malloc(out_frames * frame_bytes);
+        if (in == NULL || scalar_out == NULL || simd_out == NULL) {
+            printf("Cannot allocate the buffers for %zu frames\r\n", in_frames);
+            return 1;
+        }
+
+        double frequency[2] = {997.0, 0.42 * (in_rate < out_rate ? in_rate : out_rate)};
+        const double scale = bits == 16 ? 32768.0 : bits == 24 ? 8388608.0 : 2147483648.0;
+        for (size_t i = 0; i < in_frames; i++) {
+            for (int c = 0; c < channels; c++) {
+                int word = (int)floor(0.5 * scale * sin(2.0 * M_PI * frequency[c & 1] * i / in_rate) + 0.5);
+                for (int byte = 0; byte < sample_bytes; byte++) {
+                    in[i * frame_bytes + c * sample_bytes + byte] = (unsigned char)(word >> (8 * byte));
+                }
+            }
+        }
+
+        struct resampler r;
+        if (resampler_init (&r, in_rate, out_rate, channels, bits, 1) != 0) {
+            printf("%u Hz to %u Hz: cannot be converted\r\n", in_rate, out_rate);
+            failed = 1;
+            continue;
+        }
+        unsigned int taps = r.taps, phases = r.phases;
+
+        // The scalar reference, then SIMD on one thread and on several threads.
+        r.dot = resampler_dot_scalar;
+        long long start_us = time_us ();
+        size_t frames = convert (&r, in, in_frames, scalar_out, out_frames);
+        long long scalar_us = time_us () - start_us;
+
+        resampler_free (&r);
+        resampler_init (&r, in_rate, out_rate, channels, bits, 1);
+        start_us = time_us ();
+        convert (&r, in, in_frames, simd_out, out_frames);
+        long long simd_us = time_us () - start_us;
+        resampler_free (&r);
+
+        resampler_init (&r, in_rate, out_rate, channels, bits, threads);
+        start_us = time_us ();
+        convert (&r, in, in_frames, simd_out, out_frames);
+        long long threads_us = time_us () - start_us;
+        int used_threads = r.threads;
+        resampler_free (&r);
+
+        // The largest difference between the SIMD and the scalar output.
+        int max_lsb = 0;
+        for (size_t i = 0; i < frames * channels; i++) {
+            int a = 0, b = 0;
+            for (int byte = 0; byte < sample_bytes; byte++) {
+                a |= scalar_out[i * sample_bytes + byte] << (8 * byte);
+                b |= simd_out[i * sample_bytes + byte] << (8 * byte);
+            }
+            a = (int)((unsigned int)a << (32 - bits)) >> (32 - bits);
+            b = (int)((unsigned int)b << (32 - bits)) >> (32 - bits);
+            max_lsb = abs(a - b) > max_lsb ? abs(a - b) : max_lsb;
+        }
+
+        printf("%u Hz to %u Hz (%u phases of %u taps): scalar %.0fx, %s %.0fx, %d threads %.0fx real time "
+                    "(%.1f Mframes/s), SIMD vs scalar: %d LSB\r\n", in_rate, out_rate, phases, taps,
+                    seconds * 1e6 / (scalar_us > 0 ? scalar_us : 1), resampler_simd (),
+                    seconds * 1e6 / (simd_us > 0 ? simd_us : 1), used_threads,
+                    seconds * 1e6 / (threads_us > 0 ? threads_us : 1), in_frames / (threads_us > 0 ? threads_us : 1.0),
+                    max_lsb);
+        failed |= 20.0 * log10(max_lsb / scale + 1e-20) > -120.0;
+
+        for (int c = 0; c < channels && c < 2; c++) {
+            double gain_db;
+            double level = thd_n (simd_out, frames, channels, c, sample_bytes, frequency[c] * 1.0 / out_rate,
+                                    &gain_db);
+            printf("    %.0f Hz: gain %+.4f dB, THD+N %.1f dB\r\n", frequency[c], gain_db, level);
+            failed |= level > (bits == 16 ? -85.0 : -110.0) || fabs(gain_db) > 0.01;
+        }
+
+        free(in);
+        free(scalar_out);
+        free(simd_out);
+    }
+
+    printf("%s\r\n", failed ? "FAILED" : "ok");
+    return failed;
+}
+
+//======================================================================================================================
+// Converts the frames in memory. Returns the output frames.
+size_t convert (struct resampler* r, const unsigned char* in, size_t in_frames, unsigned char* out, size_t out_frames) {
+    const size_t frame_bytes = (size_t)(r->channels * r->sample_bytes);
+    size_t taken = 0, done = 0;
+    while (done < out_frames) {
+        done += resampler_read (r, out + done * frame_bytes, out_frames - done);
+        if (taken == in_frames) {
+            break;
+        }
+        taken += resampler_write (r, in + taken * frame_bytes, in_frames - taken);
+    }
+
+    return done;
+}
+
+//======================================================================================================================
+// THD+N (dB) of a channel of the output against a tone of frequency (cycles per frame), skipping the transients at
+// both ends.
+double thd_n (const unsigned char* out, size_t frames, int channels, int channel, int sample_bytes, double frequency,
+                        double* gain_db) {
+    const size_t skip = frames / 10;
+    const double scale = sample_bytes == 2 ? 32768.0 : sample_bytes == 3 ? 8388608.0 : 2147483648.0;
+    // The normal equations of the fit of a sin + b cos + c.
+    double m[3][3] = {{0.0}}, v[3] = {0.0};
+    for (size_t i = skip; i < frames - skip; i++) {
+        const unsigned char* sample = out + (i * channels + channel) * sample_bytes;
+        int word = 0;
+        for (int byte = 0; byte < sample_bytes; byte++) {
+            word |= sample[byte] << (8 * byte);
+        }
+        double y = ((int)((unsigned int)word << (32 - 8 * sample_bytes)) >> (32 - 8 * sample_bytes)) / scale;
+        double basis[3] = {sin(2.0 * M_PI * frequency * i), cos(2.0 * M_PI * frequency * i), 1.0};
+        for (int row = 0; row < 3; row++) {
+            for (int col = 0; col < 3; col++) {
+                m[row][col] += basis[row] * basis[col];
+            }
+            v[row] += basis[row] * y;
+        }
+    }
+
+    // Cramer's rule
+    double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+                    m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    double x[3];
+    for (int k = 0; k < 3; k++) {
+        double a[3][3];
+        memcpy(a, m, sizeof(a));
+        for (int row = 0; row < 3; row++) {
+            a[row][k] = v[row];
+        }
+        x[k] = (a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1]) - a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0]) +
+                    a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0])) / det;
+    }
+
+    double residue = 0.0, count = 0.0;
+    for (size_t i = skip; i < frames - skip; i++) {
+        const unsigned char* sample = out + (i * channels + channel) * sample_bytes;
+        int word = 0;
+        for (int byte = 0; byte < sample_bytes; byte++) {
+            word |= sample[byte] << (8 * byte);
+        }
+        double y = ((int)((unsigned int)word << (32 - 8 * sample_bytes)) >> (32 - 8 * sample_bytes)) / scale;
+        double e = y - x[0] * sin(2.0 * M_PI * frequency * i) - x[1] * cos(2.0 * M_PI * frequency * i) - x[2];
+        residue += e * e;
+        count += 1.0;
+    }
+
+    double amplitude = sqrt(x[0] * x[0] + x[1] * x[1]);
+    *gain_db = 20.0 * log10(amplitude / 0.5);
+    return 20.0 * log10(sqrt(residue / count) / (amplitude / sqrt(2.0)) + 1e-20);
+}
+
+//======================================================================================================================
+long long time_us (void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
@@ -0,0 +1,183 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+#include <stdio.h>
+#include <string.h>
+
+#include "tdm_map.h"
+
+// The TDM8 slot of the speaker positions of the channel mask (bits 0-10: FL FR FC LFE BL BR FLC FRC BC SL SR), -1 for
+// the positions without a slot.
+static const int tdm8_slot_of_position[11] = {0, 1, 2, 3, 4, 5, -1, -1, -1, 6, 7};
+
+//======================================================================================================================
+// The position in the sent frame of a slot of a line: the FPGA takes a stereo frame (slot pair) for each line in turn.
+static int position_of_slot (const struct tdm_map* map, int line, int slot) {
+    return ((slot / 2) * map->lines + line) * 2 + slot % 2;
+}
+
+int tdm_map_init (struct tdm_map* map, const struct wav_header* wh, int lines) {
+    memset(map, 0, sizeof(struct tdm_map));
+    map->lines = lines;
+    map->channels = wh->fmt_subchunk.num_channels;
+    map->sample_bytes = wh->fmt_subchunk.bits_per_sample >> 3;
+
+    if (lines != 1 && lines != 2 && lines != TDM_MAX_LINES) {
+        printf("Unsupported number of lines: %d\r\n", lines);
+        return -1;
+    }
+
+    if (map->channels < 2 || map->channels > TDM_MAX_SLOTS * lines) {
+        printf("Unsupported number of channels: %d on %d line(s)\r\n", map->channels, lines);
+        return -1;
+    } else if (map->channels == 2 && lines == 1) {
+        map->slots = 0;
+        map->positions = 0;
+        map->in_order = 1;
+        return 0;
+    }
+
+    // The fewest slots per line that fit the channels.
+    map->slots = map->channels <= 2 * lines ? 0 : map->channels <= 4 * lines ? 4 : 8;
+    const int line_channels = map->slots == 0 ? 2 : map->slots;
+    map->positions = line_channels * lines;
+
+    int used[TDM_MAX_POSITIONS] = {0};
+    for (int c = 0; c < map->channels; c++) {
+        map->position_of_channel[c] = -1;
+    }
+
+    // The channels of the mask are stored in the order of their positions.
+    unsigned int mask = wh->fmt_subchunk.channel_mask;
+    if (map->slots == 8 && lines == 1 && mask != 0) {
+        int c = 0;
+        for (int position = 0; position < 32 && c < map->channels; position++) {
+            if (mask & (1u << position)) {
+                int slot = position < 11 ? tdm8_slot_of_position[position] : -1;
+                if (slot >= 0) {
+                    map->position_of_channel[c] = slot;
+                    used[slot] = 1;
+                }
+                c++;
+            }
+        }
+    }
+
+    // The other channels take the free slots in order, filling line 0 first.
+    int free_slot = 0;
+    for (int c = 0; c < map->channels; c++) {
+        if (map->position_of_channel[c] < 0) {
+            while (used[position_of_slot (map, free_slot / line_channels, free_slot % line_channels)]) {
+                free_slot++;
+            }
+            int position = position_of_slot (map, free_slot / line_channels, free_slot % line_channels);
+            map->position_of_channel[c] = position;
+            used[position] = 1;
+        }
+    }
+
+    map->in_order = map->channels == map->positions;
+    for (int c = 0; c < map->channels; c++) {
+        map->in_order &= map->position_of_channel[c] == c;
+    }
+
+    if (lines == 1) {
+        printf("TDM%d:", map->slots);
+        for (int c = 0; c < map->channels; c++) {
+            printf(" %d", map->position_of_channel[c]);
+        }
+        printf(" (slot of each channel)\r\n");
+    } else {
+        printf("%d lines, %s:", lines, map->slots == 8 ? "TDM8" : map->slots == 4 ? "TDM4" : "I2S");
+        for (int c = 0; c < map->channels; c++) {
+            int pair = map->position_of_channel[c] / 2;
+            printf(" %d.%d", pair % lines, (pair / lines) * 2 + map->position_of_channel[c] % 2);
+        }
+        printf(" (line.slot of each channel)\r\n");
+    }
+    return 0;
+}
+
+//======================================================================================================================
+unsigned char tdm_setup_options (const struct tdm_map* map, int slot_bits) {
+    unsigned char options = map->slots == 8 ? SETUP_OPTION_TDM8 : map->slots == 4 ? SETUP_OPTION_TDM4 : 0;
+    options |= map->lines == 4 ? SETUP_OPTION_LINES_4 : map->lines == 2 ? SETUP_OPTION_LINES_2 : 0;
+    if (map->slots != 0) {
+        switch (slot_bits) {
+            case 16: options |= SETUP_OPTION_SLOT_16; break;
+            case 24: options |= SETUP_OPTION_SLOT_24; break;
+            case 32: options |= SETUP_OPTION_SLOT_32; break;
+            default: break;
+        }
+    }
+
+    return options;
+}
+
+unsigned int tdm_frame_bytes (const struct tdm_map* map) {
+    return (unsigned int)((map->positions == 0 ? map->channels : map->positions) * map->sample_bytes);
+}
+
+//======================================================================================================================
+// The sample size is a constant in each caller so the copies compile to plain loads and stores.
+static inline void interleave_frames (const struct tdm_map* map, const unsigned char* in, size_t frames,
+                        unsigned char* out, const int bytes) {
+    const size_t in_frame = (size_t)map->channels * bytes;
+    const size_t out_frame = (size_t)map->positions * bytes;
+    for (size_t f = 0; f < frames; f++) {
+        memset(out, 0, out_frame);
+        for (int c = 0; c < map->channels; c++) {
+            memcpy(out + map->position_of_channel[c] * bytes, in + c * bytes, bytes);
+        }
+        in += in_frame;
+        out += out_frame;
+    }
+}
+
+size_t tdm_interleave (const struct tdm_map* map, const unsigned char* in, size_t frames, unsigned char* out) {
+    switch (map->sample_bytes) {
+        case 2: interleave_frames (map, in, frames, out, 2); break;
+        case 3: interleave_frames (map, in, frames, out, 3); break;
+        case 4: interleave_frames (map, in, frames, out, 4); break;
+        default: interleave_frames (map, in, frames, out, map->sample_bytes); break;
+    }
+
+    return frames * tdm_frame_bytes (map);
+}
+
+//======================================================================================================================
+unsigned int read_tdm_data (FILE* fp, const struct tdm_map* map, unsigned char* buffer, unsigned int length) {
+    const unsigned int in_frame = (unsigned int)(map->channels * map->sample_bytes);
+    const unsigned int out_frame = tdm_frame_bytes (map);
+    if (map->in_order) {
+        return (unsigned int)fread(buffer, in_frame, length / in_frame, fp) * in_frame;
+    }
+
+    unsigned char in[8192];
+    unsigned int bytes = 0;
+    while (length - bytes >= out_frame) {
+        size_t frames = (length - bytes) / out_frame;
+        frames = frames < sizeof(in) / in_frame ? frames : sizeof(in) / in_frame;
+        frames = fread(in, in_frame, frames, fp);
+        if (frames == 0) {
+            break;
+        }
+
+        bytes += (unsigned int)tdm_interleave (map, in, frames, buffer + bytes);
+    }
+
+    return bytes;
+}
@@ -0,0 +1,76 @@
+/***********************************************************************************************************************
+ * Copyright (c) 2024 Virgil Dobjanschi dobjanschivirgil@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS
+ * OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **********************************************************************************************************************/
+#ifndef TDM_MAP_H
+#define TDM_MAP_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "wav_reader.h"
+
+/***********************************************************************************************************************
+ * The channel map of multichannel WAV files on the TDM output of the I2S port (see SETUP_OPTION_TDM_SHIFT in
+ * hdl_audio/definitions.svh). Up to 4 channels play on TDM4 and up to 8 on TDM8. On TDM8 the channels go to the slots
+ * of their speaker positions (WAVE_FORMAT_EXTENSIBLE channel mask, in the usual order: FL FR FC LFE BL BR SL SR), the
+ * other positions to the free slots. Otherwise the channels go to the slots in file order. Unused slots are silent.
+ *
+ * With several sdata lines (SETUP_OPTION_LINES_SHIFT) the channels go to the lines in file order, 2 per line or as
+ * many as the TDM slots of each line (the fewest slots that fit the channels): line 0 gets the first channels. The
+ * FPGA gives each line a stereo frame in turn, so a frame sent to the FPGA holds the first slot pair of every line,
+ * then the second one and so on.
+ *
+ * The file frames are interleaved into the slot frames by a copy loop specialized for the sample size. When the slot
+ * order is the file order and no slot is unused, the file data is sent as read.
+ **********************************************************************************************************************/
+
+#define TDM_MAX_SLOTS           8
+#define TDM_MAX_LINES           4
+#define TDM_MAX_POSITIONS       (TDM_MAX_SLOTS * TDM_MAX_LINES)
+
+// CMD_HOST_SETUP_OUTPUT optional payload byte[1] options: TDM mode (bits[2:1]) and slot width (bits[4:3]).
+#define SETUP_OPTION_TDM4       0x02
+#define SETUP_OPTION_TDM8       0x04
+#define SETUP_OPTION_SLOT_16    0x08
+#define SETUP_OPTION_SLOT_24    0x10
+#define SETUP_OPTION_SLOT_32    0x18
+// Byte[1] bits[6:5]: the number of sdata lines.
+#define SETUP_OPTION_LINES_2    0x20
+#define SETUP_OPTION_LINES_4    0x40
+
+struct tdm_map {
+    int lines;                                      // The sdata lines: 1, 2 or 4
+    int slots;                                      // The slots of each line: 4 or 8, 0 for I2S
+    int positions;                                  // The samples of a frame sent to the FPGA, 0 for stereo on I2S
+    int channels;                                   // The channels of the file
+    int sample_bytes;                               // The bytes per sample of the file
+    int position_of_channel[TDM_MAX_POSITIONS];     // The position of each channel of the file in the sent frame
+    int in_order;                                   // The file frames are the sent frames
+};
+
+// Maps the channels of the file on 1, 2 or 4 lines. Returns a negative value for an unsupported number of channels or
+// lines.
+int tdm_map_init (struct tdm_map* map, const struct wav_header* wh, int lines);
+// The setup options of the map with slots of slot_bits (0: the bit depth of the file).
+unsigned char tdm_setup_options (const struct tdm_map* map, int slot_bits);
+// The bytes of a frame sent to the FPGA.
+unsigned int tdm_frame_bytes (const struct tdm_map* map);
+// Interleaves frames file frames into the sent frames. Returns the bytes written to out.
+size_t tdm_interleave (const struct tdm_map* map, const unsigned char* in, size_t frames, unsigned char* out);
+// Reads up to length bytes (whole frames) of sent frames. Returns the bytes written to buffer.
+unsigned int read_tdm_data (FILE* fp, const struct tdm_map* map, unsigned char* buffer, unsigned int length);
+
+#endif // TDM_MAP_H
@@ -59,12 +59,26 @@ struct fmt_subchunk read_fmt_subchunk(FILE* fp) {
     fread(&fs.bits_per_sample, 2, 1, fp);
     fs.bits_per_sample &= 0x0000ffff;
 
-    // If the Audio Format is PCM (1) the extra parameters do not exist.
-    if (fs.audio_format != 1) {
-        int extra_param_size;
+    fs.channel_mask = 0;
+
+    // If the Audio Format is PCM (1) the extra parameters do not exist. IEEE float files may end the fmt subchunk
+    // without them.
+    if (fs.audio_format != 1 && fs.subchunk1_size >= 18) {
+        int extra_param_size = 0;
         fread(&extra_param_size, 2, 1, fp);
         extra_param_size &= 0x0000ffff;
 
+        // WAVE_FORMAT_EXTENSIBLE: valid bits per sample (2 bytes), channel mask (4 bytes) and the sub format GUID whose
+        // first 2 bytes are the audio format.
+        if (fs.audio_format == WAVE_FORMAT_EXTENSIBLE && extra_param_size >= 22) {
+            int valid_bits = 0, sub_format = 0;
+            fread(&valid_bits, 2, 1, fp);
+            fread(&fs.channel_mask, 4, 1, fp);
+            fread(&sub_format, 2, 1, fp);
+            fs.audio_format = sub_format & 0x0000ffff;
+            extra_param_size -= 8;
+        }
+
         // Read out the extra param.
         int extra_param;
         for (int i=0; i<extra_param_size; i++) {
@@ -108,7 +122,8 @@ void print_wav_header(struct wav_header wh) {
     printf("SampleRate\t\t%d\n", wh.fmt_subchunk.sample_rate);
     printf("ByteRate\t\t%d\n", wh.fmt_subchunk.byte_rate);
     printf("BlockAlign\t\t%d\n", wh.fmt_subchunk.block_align);
-    printf("BitsPerSample\t\t%d\n\n", wh.fmt_subchunk.bits_per_sample);
+    printf("BitsPerSample\t\t%d\n", wh.fmt_subchunk.bits_per_sample);
+    printf("ChannelMask\t\t0x%x\n\n", wh.fmt_subchunk.channel_mask);
 
     printf("Subchunk2ID\t\t%s\n", wh.data_subchunk.subchunk2_id);
     printf("Subchunk2Size\t\t%d\n", wh.data_subchunk.subchunk2_size);
@@ -125,7 +140,16 @@ int read_wav_file(FILE* fp, struct wav_header* wh) {
         fseek(fp, 0, SEEK_SET);
         wh->riff_header = read_riff_header(fp);
         wh->fmt_subchunk = read_fmt_subchunk(fp);
+        // The next chunk follows the fmt subchunk, whatever the size of its extra parameters.
+        fseek(fp, 20 + ((wh->fmt_subchunk.subchunk1_size + 1) & ~1), SEEK_SET);
         wh->data_subchunk = read_data_subchunk(fp);
+        // Skip the chunks before the data chunk (the fact chunk of IEEE float files, LIST chunks). Chunks are padded
+        // to an even size.
+        while (strcmp(wh->data_subchunk.subchunk2_id, "data") != 0 && !feof(fp)) {
+            fseek(fp, ((long)(unsigned int)wh->data_subchunk.subchunk2_size + 1) & ~1L, SEEK_CUR);
+            wh->data_subchunk = read_data_subchunk(fp);
+        }
+        wh->data_offset = ftell(fp);
 
         print_wav_header(*wh);
         return 0;
@@ -23,8 +23,12 @@ struct fmt_subchunk {
     int byte_rate;          // == SampleRate * NumChannels * BitsPerSample/8
     int block_align;        // == NumChannels * BitsPerSample/8. The number of bytes for one sample including all channels
     int bits_per_sample;    // 8 bits = 8, 16 bits = 16, etc.
+    unsigned int channel_mask;  // WAVE_FORMAT_EXTENSIBLE: the speaker positions of the channels, 0 if not given.
 };
 
+// WAVE_FORMAT_EXTENSIBLE files report the audio format of their sub format GUID (PCM = 1, IEEE float = 3).
+#define WAVE_FORMAT_EXTENSIBLE  0xfffe
+
 struct data_subchunk {
     char subchunk2_id[5];   // Contains the letters "data"
     int subchunk2_size;     // == NumSamples * NumChannels * BitsPerSample/8. This is the number of bytes in the data.
@@ -34,6 +38,7 @@ struct wav_header {
     struct riff_header riff_header;
     struct fmt_subchunk fmt_subchunk;
     struct data_subchunk data_subchunk;
+    long data_offset;       // Offset in the file of the first byte of audio data.
 };
 /*
 int check_file_format(FILE* fp);